@@ -21,40 +21,89 @@
 #include "signal.h"
 
 struct signal_callback {
-	signal_callback_t callback;
-	void              *data;
-	bool              remove;
+	signal_callback_t              callback;
+	void                           *data;
+
+	/* set by disconnect.  emissions that still hold an array with this
+	 * callback check it before every call, and disconnect waits for
+	 * calls that are already running to return */
+	volatile long                  removed;
+	volatile long                  running;
+};
+
+/* callback arrays are never modified once published.  connect/disconnect
+ * build a new array and swap it in, so emitting never takes a lock */
+struct signal_callbacks {
+	size_t                         num;
+	struct signal_callback         **array;
 };
 
 struct signal_info {
 	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
+	struct signal_callbacks        *volatile callbacks;
+
+	/* serializes connect/disconnect and protects the retired lists.
+	 * disconnect waits on cond for removed callbacks to return */
 	pthread_mutex_t                mutex;
-	bool                           signalling;
+	pthread_cond_t                 cond;
+
+	/* number of emissions currently in progress.  arrays swapped out,
+	 * and the callbacks removed with them, are kept until no emission
+	 * is in progress (since an emission may still be using them) and no
+	 * disconnect is waiting on a removed callback */
+	volatile long                  emitting;
+	long                           waiting;
+	volatile long                  has_retired;
+	DARRAY(struct signal_callbacks*) retired;
+	DARRAY(struct signal_callback*)  retired_callbacks;
 
 	struct signal_info             *next;
 };
 
+/* emissions in progress on the current thread, so that disconnecting a
+ * callback from within that callback doesn't wait on itself */
+struct signal_emit {
+	struct signal_info             *sig;
+	struct signal_callback         *cur;
+	struct signal_emit             *prev;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct signal_emit *thread_emit = NULL;
+#else
+static __thread struct signal_emit *thread_emit = NULL;
+#endif
+
+static inline struct signal_callbacks *signal_callbacks_create(size_t num)
+{
+	struct signal_callbacks *cbs = bmalloc(sizeof(struct signal_callbacks) +
+			num * sizeof(struct signal_callback*));
+
+	cbs->num   = num;
+	cbs->array = (struct signal_callback**)(cbs + 1);
+	return cbs;
+}
+
 static inline struct signal_info *signal_info_create(struct decl_info *info)
 {
-	pthread_mutexattr_t attr;
 	struct signal_info *si;
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
+	si = bzalloc(sizeof(struct signal_info));
 
-	si = bmalloc(sizeof(struct signal_info));
+	si->func = *info;
 
-	si->func       = *info;
-	si->next       = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	if (pthread_mutex_init(&si->mutex, NULL) != 0) {
+		blog(LOG_ERROR, "Could not create signal");
+
+		decl_info_free(&si->func);
+		bfree(si);
+		return NULL;
+	}
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
+	if (pthread_cond_init(&si->cond, NULL) != 0) {
 		blog(LOG_ERROR, "Could not create signal");
 
+		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
 		bfree(si);
 		return NULL;
@@ -63,21 +112,44 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 	return si;
 }
 
+static void signal_info_free_retired(struct signal_info *si)
+{
+	for (size_t i = 0; i < si->retired.num; i++)
+		bfree(si->retired.array[i]);
+	for (size_t i = 0; i < si->retired_callbacks.num; i++)
+		bfree(si->retired_callbacks.array[i]);
+
+	da_resize(si->retired, 0);
+	da_resize(si->retired_callbacks, 0);
+	os_atomic_set_long(&si->has_retired, 0);
+}
+
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
+		struct signal_callbacks *cbs =
+			(struct signal_callbacks*)si->callbacks;
+
+		signal_info_free_retired(si);
+
+		for (size_t i = 0; cbs && i < cbs->num; i++)
+			bfree(cbs->array[i]);
+
+		pthread_cond_destroy(&si->cond);
 		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
+		da_free(si->retired);
+		da_free(si->retired_callbacks);
+		bfree(cbs);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
+static inline size_t signal_get_callback_idx(struct signal_callbacks *cbs,
 		signal_callback_t callback, void *data)
 {
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
+	for (size_t i = 0; cbs && i < cbs->num; i++) {
+		struct signal_callback *sc = cbs->array[i];
 
 		if (sc->callback == callback && sc->data == data)
 			return i;
@@ -86,6 +158,95 @@ static inline size_t signal_get_callback_idx(struct signal_info *si,
 	return DARRAY_INVALID;
 }
 
+/* number of calls of the callback in progress on the current thread */
+static inline long get_thread_running_count(struct signal_callback *cb)
+{
+	struct signal_emit *emit = thread_emit;
+	long count = 0;
+
+	while (emit) {
+		if (emit->cur == cb)
+			count++;
+		emit = emit->prev;
+	}
+
+	return count;
+}
+
+/* called with si->mutex locked */
+static inline void signal_info_try_free_retired(struct signal_info *si)
+{
+	if (os_atomic_load_long(&si->has_retired) && !si->waiting &&
+	    os_atomic_load_long(&si->emitting) == 0)
+		signal_info_free_retired(si);
+}
+
+/* publishes the new callback array, retiring the old one and the removed
+ * callback (if any) until nothing can still be using them.  called with
+ * si->mutex locked */
+static void signal_info_replace_callbacks(struct signal_info *si,
+		struct signal_callbacks *cbs, struct signal_callback *removed)
+{
+	struct signal_callbacks *old;
+
+	old = os_atomic_set_ptr((void *volatile *)&si->callbacks, cbs);
+
+	if (old)
+		da_push_back(si->retired, &old);
+	if (removed)
+		da_push_back(si->retired_callbacks, &removed);
+
+	os_atomic_set_long(&si->has_retired, 1);
+}
+
+static inline void signal_info_emit_end(struct signal_info *si)
+{
+	if (os_atomic_dec_long(&si->emitting) == 0 &&
+	    os_atomic_load_long(&si->has_retired)) {
+		pthread_mutex_lock(&si->mutex);
+		signal_info_try_free_retired(si);
+		pthread_mutex_unlock(&si->mutex);
+	}
+}
+
+static void signal_info_emit(struct signal_info *si, calldata_t *params)
+{
+	struct signal_callbacks *cbs;
+	struct signal_emit emit = {si, NULL, thread_emit};
+
+	thread_emit = &emit;
+	os_atomic_inc_long(&si->emitting);
+
+	cbs = os_atomic_load_ptr((void *const volatile *)&si->callbacks);
+	for (size_t i = 0; cbs && i < cbs->num; i++) {
+		struct signal_callback *cb = cbs->array[i];
+
+		/* mark the call as running before checking whether the
+		 * callback was removed, so that disconnect either sees the
+		 * call and waits for it, or the call sees the removal */
+		os_atomic_inc_long(&cb->running);
+
+		if (!os_atomic_load_long(&cb->removed)) {
+			emit.cur = cb;
+			cb->callback(cb->data, params);
+			emit.cur = NULL;
+		}
+
+		/* disconnect may be waiting for any number of calls to
+		 * remain (its own calls on its thread aren't waited for), so
+		 * every call that returns after the removal wakes it */
+		os_atomic_dec_long(&cb->running);
+		if (os_atomic_load_long(&cb->removed)) {
+			pthread_mutex_lock(&si->mutex);
+			pthread_cond_broadcast(&si->cond);
+			pthread_mutex_unlock(&si->mutex);
+		}
+	}
+
+	signal_info_emit_end(si);
+	thread_emit = emit.prev;
+}
+
 struct signal_handler {
 	struct signal_info *first;
 	pthread_mutex_t    mutex;
@@ -172,20 +333,37 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 	return success;
 }
 
-void signal_handler_connect(signal_handler_t *handler, const char *signal,
-		signal_callback_t callback, void *data)
+static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
+		const char *name)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false};
-	size_t idx;
+	struct signal_info *sig;
 
 	if (!handler)
-		return;
+		return NULL;
 
 	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
+	sig = getsignal(handler, name, NULL);
 	pthread_mutex_unlock(&handler->mutex);
 
+	return sig;
+}
+
+signal_id_t signal_handler_get_id(signal_handler_t *handler,
+		const char *signal)
+{
+	return getsignal_locked(handler, signal);
+}
+
+void signal_handler_connect(signal_handler_t *handler, const char *signal,
+		signal_callback_t callback, void *data)
+{
+	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_callbacks *old, *cbs;
+	size_t num;
+
+	if (!handler)
+		return;
+
 	if (!sig) {
 		blog(LOG_WARNING, "signal_handler_connect: "
 		                  "signal '%s' not found", signal);
@@ -196,32 +374,32 @@ void signal_handler_connect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-	
-	pthread_mutex_unlock(&sig->mutex);
-}
-
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-		const char *name)
-{
-	struct signal_info *sig;
-
-	if (!handler)
-		return NULL;
+	old = (struct signal_callbacks*)sig->callbacks;
+	if (signal_get_callback_idx(old, callback, data) != DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
+	}
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+	num = old ? old->num : 0;
+	cbs = signal_callbacks_create(num + 1);
+	if (num)
+		memcpy(cbs->array, old->array, num * sizeof(*cbs->array));
+	cbs->array[num] = bzalloc(sizeof(struct signal_callback));
+	cbs->array[num]->callback = callback;
+	cbs->array[num]->data     = data;
 
-	return sig;
+	signal_info_replace_callbacks(sig, cbs, NULL);
+	signal_info_try_free_retired(sig);
+	pthread_mutex_unlock(&sig->mutex);
 }
 
 void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
 	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_callbacks *old, *cbs = NULL;
+	struct signal_callback *removed;
+	long self_running;
 	size_t idx;
 
 	if (!sig)
@@ -229,14 +407,36 @@ void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID) {
-		if (sig->signalling)
-			sig->callbacks.array[idx].remove = true;
-		else
-			da_erase(sig->callbacks, idx);
+	old = (struct signal_callbacks*)sig->callbacks;
+	idx = signal_get_callback_idx(old, callback, data);
+	if (idx == DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
 	}
-	
+
+	removed = old->array[idx];
+	os_atomic_set_long(&removed->removed, 1);
+
+	if (old->num > 1) {
+		cbs = signal_callbacks_create(old->num - 1);
+		memcpy(cbs->array, old->array, idx * sizeof(*cbs->array));
+		memcpy(cbs->array + idx, old->array + idx + 1,
+				(old->num - idx - 1) * sizeof(*cbs->array));
+	}
+
+	self_running = get_thread_running_count(removed);
+	signal_info_replace_callbacks(sig, cbs, removed);
+
+	/* once disconnect returns the callback is no longer running on any
+	 * other thread.  calls on this thread (i.e. a callback disconnecting
+	 * itself) are still on the stack and can't be waited for.  waiting
+	 * keeps the removed callback from being freed in the meantime */
+	sig->waiting++;
+	while (os_atomic_load_long(&removed->running) > self_running)
+		pthread_cond_wait(&sig->cond, &sig->mutex);
+	sig->waiting--;
+
+	signal_info_try_free_retired(sig);
 	pthread_mutex_unlock(&sig->mutex);
 }
 
@@ -245,24 +445,13 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal,
 {
 	struct signal_info *sig = getsignal_locked(handler, signal);
 
-	if (!sig)
-		return;
-
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
-
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		if (!cb->remove)
-			cb->callback(cb->data, params);
-	}
-
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array+i-1;
-		if (cb->remove)
-			da_erase(sig->callbacks, i-1);
-	}
+	if (sig)
+		signal_info_emit(sig, params);
+}
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+void signal_handler_signal_id(signal_handler_t *handler, signal_id_t id,
+		calldata_t *params)
+{
+	if (handler && id)
+		signal_info_emit(id, params);
 }
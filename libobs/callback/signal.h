@@ -32,7 +32,9 @@ extern "C" {
  */
 
 struct signal_handler;
+struct signal_info;
 typedef struct signal_handler signal_handler_t;
+typedef struct signal_info *signal_id_t;
 typedef void (*signal_callback_t)(void*, calldata_t*);
 
 EXPORT signal_handler_t *signal_handler_create(void);
@@ -63,6 +65,16 @@ EXPORT void signal_handler_disconnect(signal_handler_t *handler,
 EXPORT void signal_handler_signal(signal_handler_t *handler, const char *signal,
 		calldata_t *params);
 
+/**
+ * Gets the id of a declared signal, or NULL if it doesn't exist.  The id is
+ * valid for the lifetime of the handler, so frequently emitted signals can
+ * look it up once and use signal_handler_signal_id to skip the name lookup.
+ */
+EXPORT signal_id_t signal_handler_get_id(signal_handler_t *handler,
+		const char *signal);
+EXPORT void signal_handler_signal_id(signal_handler_t *handler,
+		signal_id_t id, calldata_t *params);
+
 #ifdef __cplusplus
 }
 #endif
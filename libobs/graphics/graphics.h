@@ -507,6 +507,14 @@ EXPORT gs_shader_t *gs_pixelshader_create_from_file(const char *file,
 
 EXPORT gs_texture_t *gs_texture_create_from_file(const char *file);
 
+/**
+ * Decodes an image file to memory, doesn't require the graphics context.
+ * Returns the pixel data (cx * 4 bytes per line), free with bfree, or NULL
+ * if the file couldn't be loaded.
+ */
+EXPORT uint8_t *gs_create_texture_file_data(const char *file,
+		enum gs_color_format *format, uint32_t *cx, uint32_t *cy);
+
 EXPORT bool gs_stagesurface_save_to_file(gs_stagesurf_t *surf, const char *file);
 
 #define GS_FLIP_U (1<<0)
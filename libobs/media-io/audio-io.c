@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-mix.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -52,7 +53,6 @@ struct audio_line {
 	struct audio_output        *audio;
 	struct circlebuf           buffers[MAX_AV_PLANES];
 	pthread_mutex_t            mutex;
-	DARRAY(uint8_t)            volume_buffers[MAX_AV_PLANES];
 	uint64_t                   base_timestamp;
 	uint64_t                   last_timestamp;
 	uint64_t                   required_buffering;
@@ -81,10 +81,8 @@ struct audio_line {
 
 static inline void audio_line_destroy_data(struct audio_line *line)
 {
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
 		circlebuf_free(&line->buffers[i]);
-		da_free(line->volume_buffers[i]);
-	}
 
 	pthread_mutex_destroy(&line->mutex);
 	bfree(line->name);
@@ -113,12 +111,18 @@ struct audio_output {
 	bool                       pause_cutoff_time_valid;
 	uint64_t                   pause_cutoff_time;
 
+	struct audio_output_stats  stats;
+
 	pthread_mutex_t            line_mutex;
 	struct audio_line          *first_line;
 
 	pthread_mutex_t            input_mutex;
 
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	mix_floats_t               mix_floats;
+	clamp_floats_t             clamp_floats;
+	scale_floats_t             scale_floats;
 };
 
 static inline void audio_output_removeline(struct audio_output *audio,
@@ -220,38 +224,57 @@ static inline size_t min_size(size_t a, size_t b)
 	((val > maxval) ? maxval : ((val < minval) ? minval : val))
 #endif
 
-#define MIX_BUFFER_SIZE 256
+static void init_mix_funcs(struct audio_output *audio)
+{
+	if (os_cpu_has_feature(CPU_FEATURE_AVX)) {
+		audio->mix_floats   = mix_floats_avx;
+		audio->clamp_floats = clamp_floats_avx;
+		audio->scale_floats = scale_floats_avx;
+	} else {
+		audio->mix_floats   = mix_floats_sse2;
+		audio->clamp_floats = clamp_floats_sse2;
+		audio->scale_floats = scale_floats_sse2;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
 
-/* TODO: optimize mixing */
 static void mix_float(struct audio_output *audio, struct audio_line *line,
 		size_t size, size_t time_offset, size_t plane)
 {
+	struct circlebuf *buf = &line->buffers[plane];
 	float *mixes[MAX_AUDIO_MIXES];
-	float vals[MIX_BUFFER_SIZE];
+	size_t num_mixes = 0;
+	size_t offset = 0;
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		uint8_t *bytes = audio->mixes[mix_idx].mix_buffers[plane].array;
-		mixes[mix_idx] = (float*)&bytes[time_offset];
-	}
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+		/* only include this audio line in this mix if it's set
+		 * via the line's 'mixes' variable */
+		if ((line->mixers & (1 << mix_idx)) == 0)
+			continue;
 
-		circlebuf_pop_front(&line->buffers[plane], vals, pop_count);
-		pop_count /= sizeof(float);
+		mixes[num_mixes++] = (float*)&bytes[time_offset];
+	}
 
-		for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-			/* only include this audio line in this mix if it's set
-			 * via the line's 'mixes' variable */
-			if ((line->mixers & (1 << mix_idx)) == 0)
-				continue;
+	/* mix straight out of the (at most two) contiguous spans of the
+	 * circular buffer rather than copying the data out first */
+	while (num_mixes && offset < size) {
+		size_t pos = (buf->start_pos + offset) % buf->capacity;
+		size_t span = min_size(size - offset, buf->capacity - pos);
+		float *spans[MAX_AUDIO_MIXES];
 
-			for (size_t i = 0; i < pop_count; i++) {
-				*(mixes[mix_idx]++) += vals[i];
-			}
-		}
+		for (size_t i = 0; i < num_mixes; i++)
+			spans[i] = mixes[i] + offset / sizeof(float);
+
+		audio->mix_floats(spans, num_mixes,
+				(const float*)((uint8_t*)buf->data + pos),
+				span / sizeof(float));
+		offset += span;
 	}
+
+	circlebuf_pop_front(buf, NULL, size);
 }
 
 static inline bool mix_audio_line(struct audio_output *audio,
@@ -341,14 +364,7 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 
 		for (size_t plane = 0; plane < audio->planes; plane++) {
 			float *mix_data = (float*)mix->mix_buffers[plane].array;
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val >  1.0f) ?  1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
+			audio->clamp_floats(mix_data, float_size);
 		}
 	}
 }
@@ -392,6 +408,16 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 
 	frames = bytes / audio->block_size;
 
+	/* in tick mode only whole ticks are mixed so that outputs receive
+	 * blocks of a constant size, the rest is mixed on the next tick */
+	if (audio->info.frames_per_tick && !audio->catching_up) {
+		frames -= frames % audio->info.frames_per_tick;
+		if (!frames)
+			return prev_time;
+
+		bytes = (size_t)frames * audio->block_size;
+	}
+
 #ifdef DEBUG_AUDIO
 	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu",
 			audio_time, prev_time, bytes);
@@ -480,12 +506,31 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	return audio_time;
 }
 
+static inline void update_mix_stats(struct audio_output *audio,
+		uint64_t mix_ns, bool late)
+{
+	struct audio_output_stats *stats = &audio->stats;
+
+	stats->ticks++;
+	stats->last_mix_ns   = mix_ns;
+	stats->total_mix_ns += mix_ns;
+	if (mix_ns > stats->max_mix_ns)
+		stats->max_mix_ns = mix_ns;
+	if (late)
+		stats->late_ticks++;
+}
+
+static const char *mix_and_output_name = "mix_and_output";
+
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = 0;
 	uint64_t prev_time = os_gettime_ns() - buffer_time;
 	uint64_t audio_time;
+	uint64_t tick_ns = conv_frames_to_time(audio,
+			audio->info.frames_per_tick);
+	uint64_t tick_time = os_gettime_ns();
 
 	os_set_thread_name("audio-io: audio thread");
 
@@ -494,15 +539,39 @@ static void *audio_thread(void *param)
 				"audio_thread(%s)", audio->info.name);
 	
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		if (!audio->catching_up)
+		bool late = false;
+
+		if (tick_ns) {
+			tick_time += tick_ns;
+
+			/* if the tick was missed, resync to the clock instead
+			 * of mixing a burst of ticks back to back */
+			if (!audio->catching_up && !os_sleepto_ns(tick_time)) {
+				tick_time = os_gettime_ns();
+				late = true;
+			}
+
+		} else if (!audio->catching_up) {
 			os_sleep_ms(AUDIO_WAIT_TIME);
+		}
 
 		profile_start(audio_thread_name);
 		pthread_mutex_lock(&audio->line_mutex);
 
 		audio_time = os_gettime_ns() - buffer_time;
 		if (audio_time > prev_time) { // in case of buffer_time adjustments the new audio time can be below the previous time
+			uint64_t mix_start = os_gettime_ns();
+
+			profile_start(mix_and_output_name);
 			audio_time = mix_and_output(audio, audio_time, prev_time, &buffer_time);
+			profile_end(mix_and_output_name);
+
+			/* ticks that didn't reach a whole tick of frames
+			 * mixed nothing and don't count towards the stats */
+			if (audio_time != prev_time)
+				update_mix_stats(audio,
+						os_gettime_ns() - mix_start,
+						late);
 			prev_time = audio_time;
 		}
 
@@ -649,6 +718,8 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
 
+	init_mix_funcs(out);
+
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
@@ -682,6 +753,16 @@ void audio_output_close(audio_t *audio)
 	if (audio->initialized) {
 		os_event_signal(audio->stop_event);
 		pthread_join(audio->thread, &thread_ret);
+
+		if (audio->stats.ticks)
+			blog(LOG_INFO, "audio thread: %"PRIu64" mixes, "
+					"average mix time: %g ms, max: %g ms, "
+					"%"PRIu64" late ticks",
+					audio->stats.ticks,
+					(double)audio->stats.total_mix_ns /
+					(double)audio->stats.ticks / 1000000.0,
+					(double)audio->stats.max_mix_ns / 1000000.0,
+					audio->stats.late_ticks);
 	}
 
 	line = audio->first_line;
@@ -741,6 +822,16 @@ audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 	return line;
 }
 
+void audio_output_get_stats(audio_t *audio, struct audio_output_stats *stats)
+{
+	if (!audio || !stats)
+		return;
+
+	pthread_mutex_lock(&audio->line_mutex);
+	*stats = audio->stats;
+	pthread_mutex_unlock(&audio->line_mutex);
+}
+
 const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 {
 	return audio ? &audio->info : NULL;
@@ -790,39 +881,28 @@ uint32_t audio_output_get_sample_rate(const audio_t *audio)
 	return audio ? audio->info.samples_per_sec : 0;
 }
 
-/* TODO: optimize these two functions */
-static inline void mul_vol_float(float *array, float volume, size_t count)
-{
-	for (size_t i = 0; i < count; i++)
-		array[i] *= volume;
-}
-
 static void audio_line_place_data_pos(struct audio_line *line,
 		const struct audio_data *data, size_t position)
 {
-	bool   planar     = line->audio->planes > 1;
-	size_t total_num  = data->frames * (planar ? 1 : line->audio->channels);
-	size_t total_size = data->frames * line->audio->block_size;
-
-	for (size_t i = 0; i < line->audio->planes; i++) {
-		da_copy_array(line->volume_buffers[i], data->data[i],
-				total_size);
+	struct audio_output *audio = line->audio;
+	size_t total_size = data->frames * audio->block_size;
 
-		uint8_t *array = line->volume_buffers[i].array;
-
-		switch (line->audio->info.format) {
+	for (size_t i = 0; i < audio->planes; i++) {
+		switch (audio->info.format) {
 		case AUDIO_FORMAT_FLOAT:
 		case AUDIO_FORMAT_FLOAT_PLANAR:
-			mul_vol_float((float*)array, data->volume, total_num);
+			place_scaled_floats(audio->scale_floats,
+					&line->buffers[i], position,
+					data->data[i], total_size,
+					data->volume);
 			break;
 		default:
 			blog(LOG_ERROR, "audio_line_place_data_pos: "
 			                "Unsupported or unknown format");
+			circlebuf_place(&line->buffers[i], position,
+					data->data[i], total_size);
 			break;
 		}
-
-		circlebuf_place(&line->buffers[i], position,
-				line->volume_buffers[i].array, total_size);
 	}
 }
 
@@ -78,6 +78,18 @@ struct audio_output_info {
 	enum audio_format   format;
 	enum speaker_layout speakers;
 	uint64_t            max_buffer_ms;
+
+	/* if non-zero, audio is mixed on a fixed cadence of this many frames
+	 * driven by the sample clock, rather than every 25 ms */
+	uint32_t            frames_per_tick;
+};
+
+struct audio_output_stats {
+	uint64_t            ticks;
+	uint64_t            late_ticks;
+	uint64_t            last_mix_ns;
+	uint64_t            max_mix_ns;
+	uint64_t            total_mix_ns;
 };
 
 struct audio_convert_info {
@@ -192,6 +204,10 @@ EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *audio_output_get_info(
 		const audio_t *audio);
 
+/** Gets the mix timing statistics of the audio thread */
+EXPORT void audio_output_get_stats(audio_t *audio,
+		struct audio_output_stats *stats);
+
 EXPORT audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 		uint32_t mixers);
 EXPORT void audio_line_set_mixers(audio_line_t *line, uint32_t mixers);
@@ -0,0 +1,197 @@
+/******************************************************************************
+    Copyright (C) 2026 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "../util/cpu-features.h"
+#include "../util/circlebuf.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+
+/*
+ * Float kernels used by the audio thread to mix, clamp and scale planar
+ * audio.  The SSE2 versions are the baseline, the AVX versions must only be
+ * used when os_cpu_has_feature(CPU_FEATURE_AVX) is true.
+ */
+
+typedef void (*mix_floats_t)(float *const *mixes, size_t num_mixes,
+		const float *src, size_t count);
+typedef void (*clamp_floats_t)(float *data, size_t count);
+typedef void (*scale_floats_t)(float *dst, const float *src, size_t count,
+		float volume);
+
+/* mixing kernels: the line is added to each of its mixes in turn.  Looping
+ * over the mixes inside the vector loop instead (loading the source once)
+ * measured slower, see test/bench/bench-audio-mix.c */
+
+static inline void mix_floats_sse2(float *const *mixes, size_t num_mixes,
+		const float *src, size_t count)
+{
+	for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++) {
+		float *mix = mixes[mix_idx];
+		size_t i = 0;
+
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i),
+					_mm_loadu_ps(src + i)));
+
+		for (; i < count; i++)
+			mix[i] += src[i];
+	}
+}
+
+CPU_TARGET_AVX
+static inline void mix_floats_avx(float *const *mixes, size_t num_mixes,
+		const float *src, size_t count)
+{
+	for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++) {
+		float *mix = mixes[mix_idx];
+		size_t i = 0;
+
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(mix + i, _mm256_add_ps(
+					_mm256_loadu_ps(mix + i),
+					_mm256_loadu_ps(src + i)));
+
+		for (; i < count; i++)
+			mix[i] += src[i];
+	}
+
+	_mm256_zeroupper();
+}
+
+/* clamping kernels: clamp to -1.0..1.0, NaN samples (i.e. from a broken
+ * filter) become silence rather than a full scale sample */
+
+static inline void clamp_floats_tail(float *data, size_t start, size_t count)
+{
+	for (size_t i = start; i < count; i++) {
+		float val = data[i];
+		val = (val != val)  ?  0.0f : val;
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static inline void clamp_floats_sse2(float *data, size_t count)
+{
+	const __m128 max_val = _mm_set1_ps(1.0f);
+	const __m128 min_val = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_and_ps(val, _mm_cmpord_ps(val, val));
+		val = _mm_max_ps(_mm_min_ps(val, max_val), min_val);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	clamp_floats_tail(data, i, count);
+}
+
+CPU_TARGET_AVX
+static inline void clamp_floats_avx(float *data, size_t count)
+{
+	const __m256 max_val = _mm256_set1_ps(1.0f);
+	const __m256 min_val = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_loadu_ps(data + i);
+		val = _mm256_and_ps(val, _mm256_cmp_ps(val, val, _CMP_ORD_Q));
+		val = _mm256_max_ps(_mm256_min_ps(val, max_val), min_val);
+		_mm256_storeu_ps(data + i, val);
+	}
+
+	_mm256_zeroupper();
+	clamp_floats_tail(data, i, count);
+}
+
+/* copy-scale kernels: apply the line volume while copying the source data
+ * into the line's circular buffer */
+
+static inline void scale_floats_tail(float *dst, const float *src,
+		size_t start, size_t count, float volume)
+{
+	for (size_t i = start; i < count; i++)
+		dst[i] = src[i] * volume;
+}
+
+static inline void scale_floats_sse2(float *dst, const float *src, size_t count,
+		float volume)
+{
+	const __m128 vol = _mm_set1_ps(volume);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), vol));
+
+	scale_floats_tail(dst, src, i, count, volume);
+}
+
+CPU_TARGET_AVX
+static inline void scale_floats_avx(float *dst, const float *src, size_t count,
+		float volume)
+{
+	const __m256 vol = _mm256_set1_ps(volume);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i,
+				_mm256_mul_ps(_mm256_loadu_ps(src + i), vol));
+
+	_mm256_zeroupper();
+	scale_floats_tail(dst, src, i, count, volume);
+}
+
+/* places the data at the given position of the circular buffer, applying
+ * the volume while writing directly into the buffer's (at most two)
+ * contiguous spans rather than going through an intermediate copy.  see
+ * test/bench/bench-audio-place.c */
+static inline void place_scaled_floats(scale_floats_t scale_floats,
+		struct circlebuf *cb, size_t position, const uint8_t *data,
+		size_t size, float volume)
+{
+	size_t offset = 0;
+
+	if (position + size > cb->size)
+		circlebuf_upsize(cb, position + size);
+
+	position += cb->start_pos;
+	if (position >= cb->capacity)
+		position -= cb->capacity;
+
+	while (offset < size) {
+		size_t span = cb->capacity - position;
+		uint8_t *dst = (uint8_t*)cb->data + position;
+
+		if (span > size - offset)
+			span = size - offset;
+
+		if (volume == 1.0f)
+			memcpy(dst, data + offset, span);
+		else
+			scale_floats((float*)dst,
+					(const float*)(data + offset),
+					span / sizeof(float), volume);
+
+		offset  += span;
+		position = 0;
+	}
+}
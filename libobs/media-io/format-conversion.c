@@ -16,8 +16,11 @@
 ******************************************************************************/
 
 #include "format-conversion.h"
+#include "../util/cpu-features.h"
 #include <xmmintrin.h>
 #include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -89,7 +92,7 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(
+static void compress_uyvx_to_i420_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -127,7 +130,7 @@ void compress_uyvx_to_i420(
 	}
 }
 
-void compress_uyvx_to_nv12(
+static void compress_uyvx_to_nv12_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -163,7 +166,7 @@ void compress_uyvx_to_nv12(
 	}
 }
 
-void convert_uyvx_to_i444(
+static void convert_uyvx_to_i444_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -202,6 +205,403 @@ void convert_uyvx_to_i444(
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* SSSE3/AVX2 versions: these pick the components out of the packed pixels
+ * with byte shuffles, and sum the chroma of pixel pairs with a horizontal
+ * add.  widths that aren't a multiple of the vector size are finished with
+ * the SSE2 code above. */
+
+#define SHUF_LUM     1, 5, 9, 13, -1, -1, -1, -1, \
+                     -1, -1, -1, -1, -1, -1, -1, -1
+/* 16-bit U0 U1 U2 U3 V0 V1 V2 V3 */
+#define SHUF_UV_2PL  0, -1, 4, -1, 8, -1, 12, -1, \
+                     2, -1, 6, -1, 10, -1, 14, -1
+/* 16-bit U0 U1 V0 V1 U2 U3 V2 V3 */
+#define SHUF_UV_1PL  0, -1, 4, -1, 2, -1, 6, -1, \
+                     8, -1, 12, -1, 10, -1, 14, -1
+/* Y0-Y3 U0-U3 V0-V3 */
+#define SHUF_YUV     1, 5, 9, 13, 0, 4, 8, 12, \
+                     2, 6, 10, 14, -1, -1, -1, -1
+
+/* sums the chroma of 2x2 pixel blocks, returns the averages packed to bytes
+ * in the order of the shuffle */
+#define avg_ch_ssse3(line1, line2, shuf)                                      \
+	_mm_packus_epi16(_mm_srli_epi16(_mm_hadd_epi16(                       \
+		_mm_add_epi16(_mm_shuffle_epi8(line1, shuf),                  \
+		              _mm_shuffle_epi8(line2, shuf)),                 \
+		_mm_setzero_si128()), 2), _mm_setzero_si128())
+
+#define avg_ch_avx2(line1, line2, shuf)                                       \
+	_mm256_packus_epi16(_mm256_srli_epi16(_mm256_hadd_epi16(              \
+		_mm256_add_epi16(_mm256_shuffle_epi8(line1, shuf),            \
+		                 _mm256_shuffle_epi8(line2, shuf)),           \
+		_mm256_setzero_si256()), 2), _mm256_setzero_si256())
+
+/* gathers the low dword of both 128-bit lanes into the low qword */
+#define lanes_to_qword(val) \
+	_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(val, \
+			_mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)))
+
+#define store_32(ptr, val) (*(uint32_t*)(ptr) = (uint32_t)_mm_cvtsi128_si32(val))
+#define store_64(ptr, val) _mm_storel_epi64((__m128i*)(ptr), val)
+
+CPU_TARGET_SSSE3
+static void compress_uyvx_to_i420_ssse3(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m128i lum_shuf = _mm_setr_epi8(SHUF_LUM);
+	__m128i uv_shuf  = _mm_setr_epi8(SHUF_UV_2PL);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			uint32_t uv;
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
+
+			store_32(lum_plane + lum_pos0,
+					_mm_shuffle_epi8(line1, lum_shuf));
+			store_32(lum_plane + lum_pos1,
+					_mm_shuffle_epi8(line2, lum_shuf));
+
+			/* U01 U23 V01 V23 */
+			uv = (uint32_t)_mm_cvtsi128_si32(
+					avg_ch_ssse3(line1, line2, uv_shuf));
+			*(uint16_t*)(u_plane + chroma_y_pos + (x>>1)) =
+				(uint16_t)uv;
+			*(uint16_t*)(v_plane + chroma_y_pos + (x>>1)) =
+				(uint16_t)(uv >> 16);
+		}
+	}
+}
+
+CPU_TARGET_SSSE3
+static void compress_uyvx_to_nv12_ssse3(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m128i lum_shuf = _mm_setr_epi8(SHUF_LUM);
+	__m128i uv_shuf  = _mm_setr_epi8(SHUF_UV_1PL);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
+
+			store_32(lum_plane + lum_pos0,
+					_mm_shuffle_epi8(line1, lum_shuf));
+			store_32(lum_plane + lum_pos1,
+					_mm_shuffle_epi8(line2, lum_shuf));
+			store_32(chroma_plane + chroma_y_pos + x,
+					avg_ch_ssse3(line1, line2, uv_shuf));
+		}
+	}
+}
+
+CPU_TARGET_SSSE3
+static void convert_uyvx_to_i444_ssse3(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m128i yuv_shuf = _mm_setr_epi8(SHUF_YUV);
+
+	for (y = start_y; y < end_y; y++) {
+		const uint8_t *line   = input + y * in_linesize;
+		uint32_t      lum_pos = y * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < width; x += 4) {
+			__m128i yuv = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i*)(line + x*4)),
+					yuv_shuf);
+
+			store_32(lum_plane + lum_pos + x, yuv);
+			store_32(u_plane + lum_pos + x,
+					_mm_srli_si128(yuv, 4));
+			store_32(v_plane + lum_pos + x,
+					_mm_srli_si128(yuv, 8));
+		}
+	}
+}
+
+CPU_TARGET_AVX2
+static void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m256i lum_shuf = _mm256_setr_epi8(SHUF_LUM, SHUF_LUM);
+	__m256i uv_shuf  = _mm256_setr_epi8(SHUF_UV_2PL, SHUF_UV_2PL);
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			uint32_t uv0, uv1;
+			__m256i  uv;
+
+			__m256i line1 = _mm256_loadu_si256((const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			store_64(lum_plane + lum_pos0, lanes_to_qword(
+					_mm256_shuffle_epi8(line1, lum_shuf)));
+			store_64(lum_plane + lum_pos1, lanes_to_qword(
+					_mm256_shuffle_epi8(line2, lum_shuf)));
+
+			/* U01 U23 V01 V23 | U45 U67 V45 V67 */
+			uv  = avg_ch_avx2(line1, line2, uv_shuf);
+			uv0 = (uint32_t)_mm_cvtsi128_si32(
+					_mm256_castsi256_si128(uv));
+			uv1 = (uint32_t)_mm_cvtsi128_si32(
+					_mm256_extracti128_si256(uv, 1));
+
+			*(uint32_t*)(u_plane + chroma_y_pos + (x>>1)) =
+				(uv0 & 0xFFFF) | (uv1 << 16);
+			*(uint32_t*)(v_plane + chroma_y_pos + (x>>1)) =
+				(uv0 >> 16) | (uv1 & 0xFFFF0000);
+		}
+
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_shift(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask, 1);
+			pack_ch_2plane(u_plane, v_plane,
+					chroma_y_pos + (x>>1),
+					line1, line2, uv_mask);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+CPU_TARGET_AVX2
+static void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m256i lum_shuf = _mm256_setr_epi8(SHUF_LUM, SHUF_LUM);
+	__m256i uv_shuf  = _mm256_setr_epi8(SHUF_UV_1PL, SHUF_UV_1PL);
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m256i line1 = _mm256_loadu_si256((const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			store_64(lum_plane + lum_pos0, lanes_to_qword(
+					_mm256_shuffle_epi8(line1, lum_shuf)));
+			store_64(lum_plane + lum_pos1, lanes_to_qword(
+					_mm256_shuffle_epi8(line2, lum_shuf)));
+			store_64(chroma_plane + chroma_y_pos + x,
+					lanes_to_qword(avg_ch_avx2(line1, line2,
+							uv_shuf)));
+		}
+
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_shift(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask, 1);
+			pack_ch_1plane(chroma_plane, chroma_y_pos + x,
+					line1, line2, uv_mask);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+CPU_TARGET_AVX2
+static void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m256i yuv_shuf = _mm256_setr_epi8(SHUF_YUV, SHUF_YUV);
+	__m256i gather   = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	for (y = start_y; y < end_y; y++) {
+		const uint8_t *line   = input + y * in_linesize;
+		uint32_t      lum_pos = y * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			/* Y0-Y7 U0-U7 | V0-V7 */
+			__m256i yuv = _mm256_permutevar8x32_epi32(
+					_mm256_shuffle_epi8(_mm256_loadu_si256(
+						(const __m256i*)(line + x*4)),
+						yuv_shuf), gather);
+			__m128i yu = _mm256_castsi256_si128(yuv);
+
+			store_64(lum_plane + lum_pos + x, yu);
+			store_64(u_plane + lum_pos + x,
+					_mm_srli_si128(yu, 8));
+			store_64(v_plane + lum_pos + x,
+					_mm256_extracti128_si256(yuv, 1));
+		}
+
+		for (; x < width; x += 4) {
+			__m128i yuv = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i*)(line + x*4)),
+					_mm256_castsi256_si128(yuv_shuf));
+
+			store_32(lum_plane + lum_pos + x, yuv);
+			store_32(u_plane + lum_pos + x,
+					_mm_srli_si128(yuv, 4));
+			store_32(v_plane + lum_pos + x,
+					_mm_srli_si128(yuv, 8));
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t features = os_get_cpu_features();
+
+	if (features & CPU_FEATURE_AVX2)
+		compress_uyvx_to_i420_avx2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else if (features & CPU_FEATURE_SSSE3)
+		compress_uyvx_to_i420_ssse3(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else
+		compress_uyvx_to_i420_sse2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t features = os_get_cpu_features();
+
+	if (features & CPU_FEATURE_AVX2)
+		compress_uyvx_to_nv12_avx2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else if (features & CPU_FEATURE_SSSE3)
+		compress_uyvx_to_nv12_ssse3(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else
+		compress_uyvx_to_nv12_sse2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+}
+
+void convert_uyvx_to_i444(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t features = os_get_cpu_features();
+
+	if (features & CPU_FEATURE_AVX2)
+		convert_uyvx_to_i444_avx2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else if (features & CPU_FEATURE_SSSE3)
+		convert_uyvx_to_i444_ssse3(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+	else
+		convert_uyvx_to_i444_sse2(input, in_linesize,
+				start_y, end_y, output, out_linesize);
+}
+
 void decompress_420(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
@@ -30,10 +30,18 @@
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CACHE_SIZE 16
+#define MAX_FREE_CONTAINERS 16
 
 struct video_data_container {
 	volatile long refs;
 
+	/* set when this container only aliases the planes of another
+	 * container, see make_container_writable */
+	struct video_data_container *parent;
+
+	/* containers go back to this output's free list once released */
+	struct video_output *video;
+
 	struct video_data data;
 };
 
@@ -56,15 +64,46 @@ struct cached_frame_info {
 	DARRAY(struct track_duplicated_frame) tracked_ids;
 };
 
+/* each input gets its own worker thread so that a slow callback (i.e. an
+ * encoder using a slow preset) only drops its own frames instead of stalling
+ * every other input of the video output */
+struct video_input_queue {
+	pthread_t                  thread;
+	pthread_mutex_t            mutex;
+	os_sem_t                   *update_semaphore;
+	bool                       stop;
+
+	/* set when the input is disconnected from its own callback, the
+	 * thread then frees the queue itself once the callback returns */
+	bool                       detached;
+
+	void (*callback)(void *param, struct video_data_container *container);
+	void *param;
+
+	DARRAY(struct video_data_container*) frames;
+	size_t                     max_frames;
+
+	size_t                     max_queued_frames;
+	uint32_t                   dropped_frames;
+	uint32_t                   total_frames;
+
+	const char                 *profile_name;
+};
+
 struct video_input {
 	DARRAY(struct video_scale_info) info;
 
 	void (*callback)(void *param, struct video_data_container *container);
 	void *param;
+
+	struct video_input_queue *queue;
 };
 
+static void video_input_queue_destroy(struct video_input_queue *queue);
+
 static inline void video_input_free(struct video_input *input)
 {
+	video_input_queue_destroy(input->queue);
 	da_free(input->info);
 }
 
@@ -93,6 +132,9 @@ struct video_output {
 
 	DARRAY(struct video_conversion_info) infos;
 
+	pthread_mutex_t            free_containers_mutex;
+	DARRAY(struct video_data_container*) free_containers;
+
 	size_t                     available_frames;
 	size_t                     first_added;
 	size_t                     last_added;
@@ -101,18 +143,97 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
+/* compared field by field, memcmp would also compare the struct padding */
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
+{
+	return a->format         == b->format &&
+	       a->width          == b->width &&
+	       a->height         == b->height &&
+	       a->range          == b->range &&
+	       a->colorspace     == b->colorspace &&
+	       a->scale_type     == b->scale_type &&
+	       a->gpu_conversion == b->gpu_conversion;
+}
+
 static struct cached_video_data *find_frame(struct cached_frame_info *cfi, struct video_scale_info *info)
 {
 	for (size_t i = 0; i < cfi->frames.num; i++) {
 		if (!info->gpu_conversion && !cfi->frames.array[i].container->data.info.gpu_conversion)
 			return cfi->frames.array + i;
-		if (memcmp(&cfi->frames.array[i].container->data.info, info, sizeof(*info)) == 0)
+		if (scale_info_equal(&cfi->frames.array[i].container->data.info, info))
 			return cfi->frames.array + i;
 	}
 
 	return NULL;
 }
 
+/* the duplicated frame path changes the timestamp/tracked id of a cached
+ * frame after it has been handed to the inputs, so if any input queue still
+ * references the container, swap it for an alias that shares the planes */
+static void make_container_writable(struct cached_video_data *frame)
+{
+	struct video_data_container *old = frame->container;
+	struct video_data_container *alias;
+
+	if (old->refs <= 0)
+		return;
+
+	alias = bzalloc(sizeof(*alias));
+	alias->data = old->data;
+	alias->parent = old->parent ? old->parent : old;
+	video_data_container_addref(alias->parent);
+
+	frame->container = alias;
+	video_data_container_release(old);
+}
+
+static void video_input_queue_push(struct video_input_queue *queue,
+		struct video_data_container *container)
+{
+	struct video_data_container *dropped = NULL;
+
+	video_data_container_addref(container);
+
+	pthread_mutex_lock(&queue->mutex);
+
+	queue->total_frames++;
+
+	if (queue->frames.num >= queue->max_frames) {
+		/* drop the oldest frame, but try to keep tracked frames since
+		 * outputs may be waiting on their packets */
+		size_t idx = 0;
+		for (size_t i = 0; i < queue->frames.num; i++) {
+			if (!queue->frames.array[i]->data.tracked_id) {
+				idx = i;
+				break;
+			}
+		}
+
+		dropped = queue->frames.array[idx];
+		da_erase(queue->frames, idx);
+		queue->dropped_frames++;
+	}
+
+	da_push_back(queue->frames, &container);
+
+	if (queue->frames.num > queue->max_queued_frames)
+		queue->max_queued_frames = queue->frames.num;
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	if (dropped) {
+		if (dropped->data.tracked_id)
+			blog(LOG_WARNING, "video-io: Dropped tracked frame "
+					"%llu due to input lag",
+					(unsigned long long)
+					dropped->data.tracked_id);
+		video_data_container_release(dropped);
+	} else {
+		os_sem_post(queue->update_semaphore);
+	}
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
@@ -136,6 +257,15 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	/* -------------------------------- */
 
+	if (tracked_frame) {
+		for (size_t i = 0; i < frame_info->frames.num; i++) {
+			struct cached_video_data *frame = frame_info->frames.array + i;
+			make_container_writable(frame);
+			frame->container->data.tracked_id = tracked_id;
+		}
+		blog(LOG_INFO, "video-io: Outputting (duplicated) tracked frame %lld", tracked_id);
+	}
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
@@ -156,12 +286,7 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (!frame)
 			continue;
 
-		if (tracked_frame) {
-			frame->container->data.tracked_id = tracked_id;
-			blog(LOG_INFO, "video-io: Outputting (duplicated) tracked frame %lld", tracked_id);
-		}
-
-		input->callback(input->param, frame->container);
+		video_input_queue_push(input->queue, frame->container);
 	}
 
 	for (size_t i = 0; i < video->maybe_expired_scale_info.num;) {
@@ -216,6 +341,7 @@ static inline bool video_output_cur_frame(struct video_output *video)
 	} else {
 		for (size_t i = 0; i < frame_info->frames.num; i++) {
 			struct cached_video_data *frame = frame_info->frames.array + i;
+			make_container_writable(frame);
 			frame->container->data.timestamp += video->frame_time;
 			frame->container->data.tracked_id = 0;
 		}
@@ -257,6 +383,107 @@ static void *video_thread(void *param)
 	return NULL;
 }
 
+static void video_input_queue_free(struct video_input_queue *queue)
+{
+	for (size_t i = 0; i < queue->frames.num; i++)
+		video_data_container_release(queue->frames.array[i]);
+	da_free(queue->frames);
+
+	os_sem_destroy(queue->update_semaphore);
+	pthread_mutex_destroy(&queue->mutex);
+	bfree(queue);
+}
+
+static void *video_input_thread(void *param)
+{
+	struct video_input_queue *queue = param;
+
+	os_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(queue->update_semaphore) == 0) {
+		struct video_data_container *container = NULL;
+
+		if (queue->stop)
+			break;
+
+		pthread_mutex_lock(&queue->mutex);
+		if (queue->frames.num) {
+			container = queue->frames.array[0];
+			da_erase(queue->frames, 0);
+		}
+		pthread_mutex_unlock(&queue->mutex);
+
+		if (!container)
+			continue;
+
+		profile_start(queue->profile_name);
+		queue->callback(queue->param, container);
+		profile_end(queue->profile_name);
+
+		video_data_container_release(container);
+
+		profile_reenable_thread();
+	}
+
+	if (queue->detached)
+		video_input_queue_free(queue);
+
+	return NULL;
+}
+
+static struct video_input_queue *video_input_queue_create(
+		struct video_output *video, struct video_input *input)
+{
+	struct video_input_queue *queue = bzalloc(sizeof(*queue));
+
+	queue->callback   = input->callback;
+	queue->param      = input->param;
+	queue->max_frames = video->info.cache_size;
+	queue->profile_name = profile_store_name(
+			obs_get_profiler_name_store(),
+			"video_input_thread(%s: %p)", video->info.name,
+			input->param);
+
+	if (pthread_mutex_init(&queue->mutex, NULL) != 0)
+		goto fail_mutex;
+	if (os_sem_init(&queue->update_semaphore, 0) != 0)
+		goto fail_sem;
+	if (pthread_create(&queue->thread, NULL, video_input_thread,
+				queue) != 0)
+		goto fail_thread;
+
+	return queue;
+
+fail_thread:
+	os_sem_destroy(queue->update_semaphore);
+fail_sem:
+	pthread_mutex_destroy(&queue->mutex);
+fail_mutex:
+	bfree(queue);
+	return NULL;
+}
+
+static void video_input_queue_destroy(struct video_input_queue *queue)
+{
+	if (!queue)
+		return;
+
+	queue->stop = true;
+	os_sem_post(queue->update_semaphore);
+
+	/* disconnecting from within the callback (i.e. an encoder stopping
+	 * itself after an error) can't join its own thread, so leave the
+	 * queue to be freed by the thread once the callback returns */
+	if (pthread_equal(pthread_self(), queue->thread)) {
+		queue->detached = true;
+		pthread_detach(queue->thread);
+		return;
+	}
+
+	pthread_join(queue->thread, NULL);
+	video_input_queue_free(queue);
+}
+
 /* ------------------------------------------------------------------------- */
 
 static inline bool valid_video_params(const struct video_output_info *info)
@@ -304,6 +531,8 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->scale_info_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->free_containers_mutex, NULL) != 0)
+		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
@@ -339,10 +568,19 @@ void video_output_close(video_t *video)
 		da_free(video->cache[i].tracked_ids);
 	}
 
+	for (size_t i = 0; i < video->free_containers.num; i++) {
+		struct video_data_container *container =
+			video->free_containers.array[i];
+		video_frame_free((struct video_frame*)&container->data);
+		bfree(container);
+	}
+	da_free(video->free_containers);
+
 	os_sem_destroy(video->update_semaphore);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 	pthread_mutex_destroy(&video->scale_info_mutex);
+	pthread_mutex_destroy(&video->free_containers_mutex);
 	bfree(video);
 }
 
@@ -396,7 +634,8 @@ static inline bool video_input_init(struct video_input *input,
 	}
 #endif
 
-	return true;
+	input->queue = video_input_queue_create(video, input);
+	return input->queue != NULL;
 }
 
 bool video_output_connect(video_t *video,
@@ -448,6 +687,8 @@ bool video_output_connect(video_t *video,
 			pthread_mutex_unlock(&video->scale_info_mutex);
 
 			da_push_back(video->inputs, &input);
+		} else {
+			da_free(input.info);
 		}
 	}
 
@@ -460,6 +701,8 @@ void video_output_disconnect(video_t *video,
 		video_data_callback callback,
 		void *param)
 {
+	struct video_input input = {0};
+
 	if (!video || !callback)
 		return;
 
@@ -467,7 +710,7 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		struct video_input input = video->inputs.array[idx];
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
 
 		video_scale_info_ts removed = { 0 };
@@ -492,11 +735,13 @@ void video_output_disconnect(video_t *video,
 		}
 
 		da_free(removed);
-
-		video_input_free(&input);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* joins the input thread, so do this without holding input_mutex to
+	 * avoid stalling the video thread on the callback finishing */
+	video_input_free(&input);
 }
 
 bool video_output_update(video_t *video,
@@ -535,9 +780,9 @@ bool video_output_update(video_t *video,
 					continue;
 
 				struct video_input *other = video->inputs.array + i;
-				if (!found_new && memcmp(other->info.array, info, sizeof(*info)) == 0)
+				if (!found_new && scale_info_equal(other->info.array, info))
 					found_new = true;
-				if (!found_old && memcmp(other->info.array, old, sizeof(*info)) == 0)
+				if (!found_old && scale_info_equal(other->info.array, old))
 					found_old = true;
 				if (found_new && found_old)
 					break;
@@ -626,14 +871,55 @@ video_locked_frame video_output_lock_frame(video_t *video,
 
 static struct video_data_container *get_container(video_t *video, struct video_scale_info *info)
 {
-	struct video_data_container *container = bzalloc(sizeof(*container));
+	struct video_data_container *container = NULL;
+
+	/* input threads can still hold on to the previous frame, so reuse
+	 * released frames instead of reallocating the planes every frame */
+	pthread_mutex_lock(&video->free_containers_mutex);
+	for (size_t i = video->free_containers.num; i > 0; i--) {
+		struct video_data_container *free_container =
+			video->free_containers.array[i - 1];
+		if (scale_info_equal(&free_container->data.info, info)) {
+			container = free_container;
+			da_erase(video->free_containers, i - 1);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&video->free_containers_mutex);
+
+	if (container) {
+		container->refs = 0;
+		container->data.tracked_id = 0;
+		return container;
+	}
 
+	container = bzalloc(sizeof(*container));
+	container->video = video;
 	container->data.info = *info;
 	alloc_frame(&container->data);
 
 	return container;
 }
 
+static void free_container(struct video_data_container *container)
+{
+	struct video_output *video = container->video;
+	struct video_data_container *evicted = NULL;
+
+	pthread_mutex_lock(&video->free_containers_mutex);
+	if (video->free_containers.num == MAX_FREE_CONTAINERS) {
+		evicted = video->free_containers.array[0];
+		da_erase(video->free_containers, 0);
+	}
+	da_push_back(video->free_containers, &container);
+	pthread_mutex_unlock(&video->free_containers_mutex);
+
+	if (evicted) {
+		video_frame_free((struct video_frame*)&evicted->data);
+		bfree(evicted);
+	}
+}
+
 bool video_output_get_frame_buffer(video_t *video,
 	struct video_frame *frame, struct video_scale_info *info, video_locked_frame locked, bool expiring)
 {
@@ -643,12 +929,12 @@ bool video_output_get_frame_buffer(video_t *video,
 
 	struct cached_video_data *data = NULL;
 	for (size_t i = 0; i < cfi->frames.num; i++) {
-		if (memcmp(info, &cfi->frames.array[i].container->data.info, sizeof(*info)) != 0)
+		if (!scale_info_equal(info, &cfi->frames.array[i].container->data.info))
 			continue;
 
 		cfi->frames_written |= 1 << i;
 		data = cfi->frames.array + i;
-		if (data->container->refs > 0) {
+		if (data->container->refs > 0 || data->container->parent) {
 			video_data_container_release(data->container);
 			data->container = NULL;
 		}
@@ -740,6 +1026,36 @@ uint32_t video_output_get_total_frames(const video_t *video)
 	return video->total_frames;
 }
 
+bool video_output_get_input_stats(video_t *video,
+		video_data_callback callback, void *param,
+		struct video_input_stats *stats)
+{
+	bool success = false;
+
+	if (!video || !callback || !stats)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input_queue *queue = video->inputs.array[idx].queue;
+
+		pthread_mutex_lock(&queue->mutex);
+		stats->queued_frames     = queue->frames.num;
+		stats->max_queued_frames = queue->max_queued_frames;
+		stats->dropped_frames    = queue->dropped_frames;
+		stats->total_frames      = queue->total_frames;
+		pthread_mutex_unlock(&queue->mutex);
+
+		success = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return success;
+}
+
 bool video_output_get_changes(video_t *video, video_scale_info_ts *added,
 		video_scale_info_ts *expiring, video_scale_info_ts *removed)
 {
@@ -787,6 +1103,10 @@ void video_data_container_release(struct video_data_container *container)
 	if (os_atomic_dec_long(&container->refs) != -1)
 		return;
 
-	video_frame_free((struct video_frame*)&container->data);
-	bfree(container);
+	if (container->parent) {
+		video_data_container_release(container->parent);
+		bfree(container);
+	} else {
+		free_container(container);
+	}
 }
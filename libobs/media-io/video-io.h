@@ -148,6 +148,13 @@ struct video_data {
 
 struct video_data_container;
 
+struct video_input_stats {
+	size_t            queued_frames;
+	size_t            max_queued_frames;
+	uint32_t          dropped_frames;
+	uint32_t          total_frames;
+};
+
 typedef void (*video_data_callback)(void *param, struct video_data_container *container);
 
 EXPORT enum video_format video_format_from_fourcc(uint32_t fourcc);
@@ -197,6 +204,11 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/** Gets the queue statistics of the worker thread of a connected input */
+EXPORT bool video_output_get_input_stats(video_t *video,
+		video_data_callback callback, void *param,
+		struct video_input_stats *stats);
+
 EXPORT bool video_output_get_changes(video_t *video, video_scale_info_ts *added,
 		video_scale_info_ts *expiring, video_scale_info_ts *removed);
 
@@ -33,6 +33,7 @@ struct obs_data_item {
 	struct obs_data      *parent;
 	struct obs_data_item *next;
 	enum obs_data_type   type;
+	uint32_t             name_hash;
 	size_t               name_len;
 	size_t               data_len;
 	size_t               data_size;
@@ -46,6 +47,14 @@ struct obs_data {
 	volatile long        ref;
 	char                 *json;
 	struct obs_data_item *first_item;
+	struct obs_data_item *last_item;
+	size_t               num_items;
+
+	/* open-addressing (linear probing) name index, only built once the
+	 * object has more than OBS_DATA_INDEX_MIN_ITEMS items.  the linked
+	 * list stays authoritative for item order */
+	struct obs_data_item **index;
+	size_t               index_size;
 };
 
 struct obs_data_array {
@@ -64,6 +73,19 @@ struct obs_data_number {
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
+/* FNV-1a */
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
 static inline size_t get_align_size(size_t size)
 {
 	const size_t alignment = base_get_alignment();
@@ -276,10 +298,11 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 
 	item = bzalloc(total_size);
 
-	item->capacity = total_size;
-	item->type     = type;
-	item->name_len = name_size;
-	item->ref      = 1;
+	item->capacity  = total_size;
+	item->type      = type;
+	item->name_hash = hash_name(name);
+	item->name_len  = name_size;
+	item->ref       = 1;
 
 	if (default_data) {
 		item->default_len = size;
@@ -300,6 +323,117 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	return item;
 }
 
+/* ------------------------------------------------------------------------- */
+/* Name index */
+
+#define OBS_DATA_INDEX_MIN_ITEMS 8
+
+static void index_insert_slot(struct obs_data *data,
+		struct obs_data_item *item)
+{
+	size_t mask = data->index_size - 1;
+	size_t pos  = item->name_hash & mask;
+
+	while (data->index[pos])
+		pos = (pos + 1) & mask;
+
+	data->index[pos] = item;
+}
+
+static void index_rebuild(struct obs_data *data, size_t size)
+{
+	struct obs_data_item *item = data->first_item;
+
+	bfree(data->index);
+	data->index      = bzalloc(size * sizeof(struct obs_data_item*));
+	data->index_size = size;
+
+	while (item) {
+		index_insert_slot(data, item);
+		item = item->next;
+	}
+}
+
+/* called after the item has been linked in to the list */
+static void index_add(struct obs_data *data, struct obs_data_item *item)
+{
+	if (data->index) {
+		/* keep the load factor at or below 1/2 */
+		if (data->num_items * 2 > data->index_size)
+			index_rebuild(data, data->index_size * 2);
+		else
+			index_insert_slot(data, item);
+
+	} else if (data->num_items > OBS_DATA_INDEX_MIN_ITEMS) {
+		size_t size = OBS_DATA_INDEX_MIN_ITEMS * 4;
+		while (size < data->num_items * 2)
+			size *= 2;
+
+		index_rebuild(data, size);
+	}
+}
+
+static bool index_find_slot(struct obs_data *data,
+		struct obs_data_item *item, size_t *slot)
+{
+	size_t mask = data->index_size - 1;
+	size_t pos  = item->name_hash & mask;
+
+	while (data->index[pos]) {
+		if (data->index[pos] == item) {
+			*slot = pos;
+			return true;
+		}
+
+		pos = (pos + 1) & mask;
+	}
+
+	return false;
+}
+
+static void index_remove(struct obs_data *data, struct obs_data_item *item)
+{
+	size_t mask = data->index_size - 1;
+	size_t i, j;
+
+	if (!data->index || !index_find_slot(data, item, &i))
+		return;
+
+	/* backward shift deletion: pull any following items of the same
+	 * probe run back so that lookups never hit a premature empty slot */
+	data->index[i] = NULL;
+	j = i;
+
+	for (;;) {
+		struct obs_data_item *cur;
+		size_t home;
+
+		j = (j + 1) & mask;
+		cur = data->index[j];
+		if (!cur)
+			break;
+
+		home = cur->name_hash & mask;
+		if (i <= j ? (home <= i || home > j) :
+		             (home <= i && home > j)) {
+			data->index[i] = cur;
+			data->index[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+static void index_replace(struct obs_data *data, struct obs_data_item *old_ptr,
+		struct obs_data_item *new_ptr)
+{
+	size_t slot;
+
+	if (data->index && index_find_slot(data, old_ptr, &slot))
+		data->index[slot] = new_ptr;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static struct obs_data_item **get_item_prev_next(struct obs_data *data,
 		struct obs_data_item *current)
 {
@@ -322,23 +456,39 @@ static struct obs_data_item **get_item_prev_next(struct obs_data *data,
 
 static inline void obs_data_item_detach(struct obs_data_item *item)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(item->parent,
-			item);
+	struct obs_data *data = item->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, item);
 
 	if (prev_next) {
+		if (data->last_item == item)
+			data->last_item = (prev_next == &data->first_item) ?
+				NULL :
+				(struct obs_data_item*)((uint8_t*)prev_next -
+					offsetof(struct obs_data_item, next));
+
+		index_remove(data, item);
+		data->num_items--;
+
 		*prev_next = item->next;
 		item->next = NULL;
 	}
+
+	item->parent = NULL;
 }
 
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 		struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(new_ptr->parent,
-			old_ptr);
+	struct obs_data *data = new_ptr->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, old_ptr);
 
-	if (prev_next)
+	if (prev_next) {
 		*prev_next = new_ptr;
+
+		if (data->last_item == old_ptr)
+			data->last_item = new_ptr;
+		index_replace(data, old_ptr, new_ptr);
+	}
 }
 
 static struct obs_data_item *obs_data_item_ensure_capacity(
@@ -472,14 +622,44 @@ static inline void obs_data_item_set_autoselect_data(
 static void obs_data_add_json_item(obs_data_t *data, const char *key,
 		json_t *json);
 
+struct json_key_item {
+	const char *key;
+	json_t     *json;
+};
+
+static int cmp_json_key_item(const void *a, const void *b)
+{
+	const struct json_key_item *item_a = a;
+	const struct json_key_item *item_b = b;
+	return strcmp(item_a->key, item_b->key);
+}
+
 static inline void obs_data_add_json_object_data(obs_data_t *data, json_t *jobj)
 {
+	DARRAY(struct json_key_item) items;
 	const char *item_key;
 	json_t *jitem;
 
+	da_init(items);
+	da_reserve(items, json_object_size(jobj));
+
 	json_object_foreach (jobj, item_key, jitem) {
-		obs_data_add_json_item(data, item_key, jitem);
+		struct json_key_item *item = da_push_back_new(items);
+		item->key  = item_key;
+		item->json = jitem;
 	}
+
+	/* jansson doesn't iterate in key order, but obs_data keeps its items
+	 * sorted by name, so adding them sorted makes every insert an append
+	 * instead of a walk through the item list */
+	qsort(items.array, items.num, sizeof(struct json_key_item),
+			cmp_json_key_item);
+
+	for (size_t i = 0; i < items.num; i++)
+		obs_data_add_json_item(data, items.array[i].key,
+				items.array[i].json);
+
+	da_free(items);
 }
 
 static inline void obs_data_add_json_object(obs_data_t *data, const char *key,
@@ -706,12 +886,15 @@ static inline void obs_data_destroy(struct obs_data *data)
 
 	while (item) {
 		struct obs_data_item *next = item->next;
+		item->parent = NULL;
+		item->next   = NULL;
 		obs_data_item_release(&item);
 		item = next;
 	}
 
 	/* NOTE: don't use bfree for json text, allocated by json */
 	free(data->json);
+	bfree(data->index);
 	bfree(data);
 }
 
@@ -767,6 +950,23 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 {
 	if (!data) return NULL;
 
+	if (data->index) {
+		uint32_t hash = hash_name(name);
+		size_t   mask = data->index_size - 1;
+		size_t   pos  = hash & mask;
+		struct obs_data_item *item;
+
+		while ((item = data->index[pos]) != NULL) {
+			if (item->name_hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			pos = (pos + 1) & mask;
+		}
+
+		return NULL;
+	}
+
 	struct obs_data_item *item = data->first_item;
 
 	while (item) {
@@ -779,6 +979,33 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 	return NULL;
 }
 
+/* items are kept sorted by name.  appending is checked first, since that's
+ * the common case when loading previously saved json */
+static void insert_item(struct obs_data *data, struct obs_data_item *new_item)
+{
+	const char *name = get_item_name(new_item);
+	struct obs_data_item **prev_next = &data->first_item;
+	struct obs_data_item *last = data->last_item;
+
+	if (last && strcmp(get_item_name(last), name) < 0) {
+		prev_next = &last->next;
+	} else {
+		while (*prev_next &&
+		       strcmp(get_item_name(*prev_next), name) < 0)
+			prev_next = &(*prev_next)->next;
+	}
+
+	new_item->parent = data;
+	new_item->next   = *prev_next;
+	*prev_next       = new_item;
+
+	if (!new_item->next)
+		data->last_item = new_item;
+
+	data->num_items++;
+	index_add(data, new_item);
+}
+
 static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 		const char *name, const void *ptr, size_t size,
 		enum obs_data_type type,
@@ -789,31 +1016,8 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 	if ((!item || (item && !*item)) && data) {
 		new_item = obs_data_item_create(name, ptr, size, type,
 				default_data, autoselect_data);
-
-		obs_data_item_t *prev = obs_data_first(data);
-		obs_data_item_t *next = obs_data_first(data);
-		obs_data_item_next(&next);
-		for (; prev && next; obs_data_item_next(&prev),
-				obs_data_item_next(&next)) {
-			if (strcmp(get_item_name(next), name) > 0)
-				break;
-		}
-
-		new_item->parent = data;
-		if (prev && strcmp(get_item_name(prev), name) < 0) {
-			prev->next     = new_item;
-			new_item->next = next;
-
-		} else {
-			data->first_item = new_item;
-			new_item->next   = prev;
-		}
-
-		if (!prev)
-			data->first_item = new_item;
-
-		obs_data_item_release(&prev);
-		obs_data_item_release(&next);
+		if (new_item)
+			insert_item(data, new_item);
 
 	} else if (default_data) {
 		obs_data_item_set_default_data(item, ptr, size, type);
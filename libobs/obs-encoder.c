@@ -98,7 +98,8 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	obs_context_data_insert(&encoder->context,
 			&obs->data.encoders_mutex,
-			&obs->data.first_encoder);
+			&obs->data.first_encoder,
+			&obs->data.encoder_names);
 
 	blog(LOG_INFO, "encoder '%s' (%s) created", name, id);
 	return encoder;
@@ -596,6 +597,20 @@ void obs_encoder_set_audio(obs_encoder_t *encoder, audio_t *audio)
 	encoder->timebase_den = audio_output_get_sample_rate(audio);
 }
 
+uint32_t obs_encoder_get_frames_dropped(const obs_encoder_t *encoder)
+{
+	struct video_input_stats stats = {0};
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_frames_dropped"))
+		return 0;
+	if (encoder->info.type != OBS_ENCODER_VIDEO || !encoder->media)
+		return 0;
+
+	video_output_get_input_stats(encoder->media, receive_video,
+			(void*)encoder, &stats);
+	return stats.dropped_frames;
+}
+
 video_t *obs_encoder_video(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_video"))
@@ -745,6 +760,11 @@ static inline void do_encode(struct obs_encoder *encoder,
 			}
 		}
 
+		/* copy the encoder's data once, outputs then share it by
+		 * reference instead of each making their own copy */
+		struct encoder_packet shared;
+		obs_encoder_packet_ref(&shared, &pkt);
+
 		profile_start(encoder->profile_encoder_callback_mutex_name);
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
@@ -752,12 +772,14 @@ static inline void do_encode(struct obs_encoder *encoder,
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &shared);
 		}
 		profile_end(encoder->profile_encoder_send_name);
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
 		profile_end(encoder->profile_encoder_callback_mutex_name);
+
+		obs_free_encoder_packet(&shared);
 	}
 
 end_profile:
@@ -783,6 +805,18 @@ static void receive_video(void *param, struct video_data_container *container)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
+	/* video-io drops frames of inputs that can't keep up, so derive the
+	 * pts from the frame timestamp to leave a gap instead of shifting
+	 * every following frame out of sync with audio */
+	uint64_t frame_time = video_output_get_frame_time(encoder->media);
+	if (frame_time && frame->timestamp > encoder->start_ts) {
+		uint64_t frames = (frame->timestamp - encoder->start_ts +
+				frame_time / 2) / frame_time;
+		int64_t pts = (int64_t)frames * encoder->timebase_num;
+		if (pts > encoder->cur_pts)
+			encoder->cur_pts = pts;
+	}
+
 	enc_frame.frames = 1;
 	enc_frame.pts    = encoder->cur_pts;
 
@@ -914,6 +948,67 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+/* struct encoder_packet is part of the plugin ABI and packets are freely
+ * copied by plugins, so shared packet data can't be marked through a field
+ * of the packet.  instead it is preceded by a header with its reference
+ * count, and placed at an offset within a 64 byte block that bmalloc'd data
+ * never has (bmalloc aligns to 32 bytes).  data at any other offset was
+ * allocated by someone else and is freed directly without touching the
+ * memory around it.  data that happens to be at the same offset is told
+ * apart by the magic value; the header is in the same 64 byte block as the
+ * data, so reading it can't fault. */
+#define PACKET_BUFFER_ALIGN  64
+#define PACKET_BUFFER_OFFSET 48
+#define PACKET_BUFFER_MAGIC  ((uintptr_t)0x6f62735f706b7472ULL)
+
+struct packet_buffer {
+	uintptr_t            magic;
+	volatile long        refs;
+	void                 *allocation;
+};
+
+static inline uint8_t *packet_buffer_data(struct packet_buffer *buffer)
+{
+	return (uint8_t*)buffer + PACKET_BUFFER_OFFSET;
+}
+
+static inline struct packet_buffer *get_packet_buffer(uint8_t *data)
+{
+	struct packet_buffer *buffer;
+
+	if ((uintptr_t)data % PACKET_BUFFER_ALIGN != PACKET_BUFFER_OFFSET)
+		return NULL;
+
+	buffer = (struct packet_buffer*)(data - PACKET_BUFFER_OFFSET);
+	if (buffer->magic != (PACKET_BUFFER_MAGIC ^ (uintptr_t)buffer))
+		return NULL;
+
+	return buffer;
+}
+
+static uint8_t *packet_buffer_create(const uint8_t *data, size_t size)
+{
+	struct packet_buffer *buffer;
+	uint8_t *allocation;
+	uintptr_t pos;
+
+	allocation = bmalloc(size + PACKET_BUFFER_ALIGN - 1 +
+			PACKET_BUFFER_OFFSET);
+
+	pos = ((uintptr_t)allocation + PACKET_BUFFER_ALIGN - 1) &
+		~(uintptr_t)(PACKET_BUFFER_ALIGN - 1);
+
+	buffer = (struct packet_buffer*)pos;
+	buffer->magic      = PACKET_BUFFER_MAGIC ^ pos;
+	buffer->refs       = 1;
+	buffer->allocation = allocation;
+
+	if (size)
+		memcpy(packet_buffer_data(buffer), data, size);
+
+	return packet_buffer_data(buffer);
+}
+
 void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
@@ -921,9 +1016,40 @@ void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 	dst->data = bmemdup(src->data, src->size);
 }
 
+void obs_encoder_packet_ref(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	struct packet_buffer *buffer;
+
+	if (!dst || !src)
+		return;
+
+	buffer = get_packet_buffer(src->data);
+	if (buffer)
+		os_atomic_inc_long(&buffer->refs);
+
+	*dst = *src;
+	if (!buffer)
+		dst->data = packet_buffer_create(src->data, src->size);
+}
+
 void obs_free_encoder_packet(struct encoder_packet *packet)
 {
-	bfree(packet->data);
+	struct packet_buffer *buffer;
+
+	if (!packet)
+		return;
+
+	buffer = get_packet_buffer(packet->data);
+	if (!buffer) {
+		bfree(packet->data);
+
+	} else if (os_atomic_dec_long(&buffer->refs) == 0) {
+		/* so the stale header can't be taken for a live one */
+		buffer->magic = 0;
+		bfree(buffer->allocation);
+	}
+
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
 
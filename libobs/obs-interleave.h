@@ -0,0 +1,140 @@
+#pragma once
+
+#include "util/circlebuf.h"
+#include "obs.h"
+
+/*
+ * Output packet interleaving queue
+ *
+ *   Packets are kept in one dts ordered queue per track (video first, then
+ * one per audio mix).  Packets of a track almost always arrive in dts order,
+ * so inserting is normally just an append, and the next packet to send is
+ * found with a k-way merge of the track heads instead of keeping a single
+ * sorted array.
+ */
+
+#define NUM_INTERLEAVED_TRACKS (MAX_AUDIO_MIXES + 1)
+
+struct interleaved_packet {
+	struct encoder_packet           packet;
+
+	/* arrival order, used to keep packets with equal dts in order */
+	uint64_t                        seq;
+};
+
+struct interleave_queue {
+	struct circlebuf                tracks[NUM_INTERLEAVED_TRACKS];
+	uint64_t                        seq;
+};
+
+static inline size_t interleaved_track_idx(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : packet->track_idx + 1;
+}
+
+static inline size_t track_num_packets(const struct circlebuf *track)
+{
+	return track->size / sizeof(struct interleaved_packet);
+}
+
+static inline struct interleaved_packet *track_packet(struct circlebuf *track,
+		size_t idx)
+{
+	return circlebuf_data(track, idx * sizeof(struct interleaved_packet));
+}
+
+static inline bool interleaved_before(const struct interleaved_packet *a,
+		const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	return a->seq < b->seq;
+}
+
+/* k-way merge of the track queues: returns the next packet in dts order
+ * after skipping the first skip[i] packets of each track (if skip is set) */
+static inline struct interleaved_packet *interleave_queue_peek(
+		struct interleave_queue *queue, const size_t *skip,
+		size_t *track_idx)
+{
+	struct interleaved_packet *first = NULL;
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_TRACKS; i++) {
+		struct circlebuf *track = &queue->tracks[i];
+		size_t offset = skip ? skip[i] : 0;
+		struct interleaved_packet *packet;
+
+		if (track_num_packets(track) <= offset)
+			continue;
+
+		packet = track_packet(track, offset);
+		if (!first || interleaved_before(packet, first)) {
+			first = packet;
+			if (track_idx)
+				*track_idx = i;
+		}
+	}
+
+	return first;
+}
+
+static inline struct interleaved_packet *interleave_queue_last(
+		struct interleave_queue *queue)
+{
+	struct interleaved_packet *last = NULL;
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_TRACKS; i++) {
+		struct circlebuf *track = &queue->tracks[i];
+		size_t num = track_num_packets(track);
+		struct interleaved_packet *packet;
+
+		if (!num)
+			continue;
+
+		packet = track_packet(track, num - 1);
+		if (!last || interleaved_before(last, packet))
+			last = packet;
+	}
+
+	return last;
+}
+
+static inline void interleave_queue_pop(struct interleave_queue *queue,
+		size_t track_idx, struct encoder_packet *packet)
+{
+	struct interleaved_packet ip;
+
+	circlebuf_pop_front(&queue->tracks[track_idx], &ip, sizeof(ip));
+
+	if (packet)
+		*packet = ip.packet;
+}
+
+static inline void interleave_queue_insert(struct interleave_queue *queue,
+		const struct encoder_packet *out)
+{
+	struct circlebuf *track = &queue->tracks[interleaved_track_idx(out)];
+	struct interleaved_packet ip = {*out, queue->seq++};
+	size_t num = track_num_packets(track);
+	size_t idx = num;
+
+	/* packets of a track arrive in dts order, so this normally just
+	 * appends to the track */
+	while (idx > 0 && out->dts_usec < track_packet(track, idx - 1)->packet.dts_usec)
+		idx--;
+
+	circlebuf_push_back(track, &ip, sizeof(ip));
+
+	if (idx != num) {
+		for (size_t i = num; i > idx; i--)
+			*track_packet(track, i) = *track_packet(track, i - 1);
+		*track_packet(track, idx) = ip;
+	}
+}
+
+/* frees the queue itself, the packets have to be freed by the caller */
+static inline void interleave_queue_free(struct interleave_queue *queue)
+{
+	for (size_t i = 0; i < NUM_INTERLEAVED_TRACKS; i++)
+		circlebuf_free(&queue->tracks[i]);
+}
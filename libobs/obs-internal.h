@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/worker-pool.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -35,6 +36,7 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #define NUM_TEXTURES 2
 #define MICROSECOND_DEN 1000000
@@ -303,6 +305,15 @@ struct obs_video_output {
 	struct video_scale_info info;
 };
 
+/* part of a frame converted on the CPU by one worker */
+struct obs_convert_slice {
+	struct video_frame              output_frame;
+	const struct obs_video_output   *output;
+	const struct video_frame        *frame;
+	uint32_t                        start_y;
+	uint32_t                        end_y;
+};
+
 struct obs_core_video {
 	graphics_t                      *graphics;
 	obs_texture_pipeline_t          render_textures;
@@ -354,6 +365,15 @@ struct obs_core_video {
 
 	pthread_mutex_t                 video_thread_time_mutex;
 	uint64_t                        video_thread_time;
+
+	/* owned by the graphics thread */
+	worker_pool_t                   *tick_pool;
+	DARRAY(struct obs_source*)      tick_sources;
+	DARRAY(struct obs_source*)      parallel_tick_sources;
+	float                           tick_seconds;
+
+	worker_pool_t                   *convert_pool;
+	DARRAY(struct obs_convert_slice) convert_slices;
 };
 
 extern void obs_free_deferred_gs_data(void);
@@ -367,6 +387,18 @@ struct obs_core_audio {
 	float                           present_volume;
 };
 
+/* hash map of contexts by name, chained through the contexts themselves.
+ * lookups take the read lock, insert/remove/rename take the write lock */
+struct obs_context_name_map {
+	pthread_rwlock_t                rwlock;
+	struct obs_context_data         **buckets;
+	size_t                          num_buckets;
+	size_t                          num;
+};
+
+extern bool obs_context_name_map_init(struct obs_context_name_map *map);
+extern void obs_context_name_map_free(struct obs_context_name_map *map);
+
 /* user sources, output channels, and displays */
 struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
@@ -384,6 +416,11 @@ struct obs_core_data {
 	pthread_mutex_t                 encoders_mutex;
 	pthread_mutex_t                 services_mutex;
 
+	struct obs_context_name_map     source_names;
+	struct obs_context_name_map     output_names;
+	struct obs_context_name_map     encoder_names;
+	struct obs_context_name_map     service_names;
+
 	struct obs_view                 main_view;
 
 	volatile long                   active_transitions;
@@ -455,6 +492,9 @@ struct obs_core {
 	struct obs_core_audio           audio;
 	struct obs_core_data            data;
 	struct obs_core_hotkeys         hotkeys;
+
+	/* kept here, obs_core_audio is cleared when audio is reset */
+	uint32_t                        audio_frames_per_tick;
 };
 
 extern struct obs_core *obs;
@@ -482,6 +522,11 @@ struct obs_context_data {
 	pthread_mutex_t                 *mutex;
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
+
+	struct obs_context_name_map     *name_map;
+	struct obs_context_data         *name_next;
+	struct obs_context_data         **name_prev_next;
+	uint32_t                        name_hash;
 };
 
 extern bool obs_context_data_init(
@@ -492,7 +537,8 @@ extern bool obs_context_data_init(
 extern void obs_context_data_free(struct obs_context_data *context);
 
 extern void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *first);
+		pthread_mutex_t *mutex, void *first,
+		struct obs_context_name_map *name_map);
 extern void obs_context_data_remove(struct obs_context_data *context);
 
 extern void obs_context_data_setname(struct obs_context_data *context,
@@ -544,10 +590,20 @@ static inline bool obs_weak_ref_get_ref(struct obs_weak_ref *ref)
 /* ------------------------------------------------------------------------- */
 /* sources  */
 
+#define MAX_ASYNC_FRAMES 30
+
+/* the queued frames, plus the frame being displayed and the one being
+ * written by obs_source_output_video */
+#define ASYNC_POOL_SIZE (MAX_ASYNC_FRAMES + 2)
+
+/* must be a power of two and at least ASYNC_POOL_SIZE, so the queue can
+ * never be full */
+#define ASYNC_QUEUE_SIZE 32
+
 struct async_frame {
 	struct obs_source_frame *frame;
 	long unused_count;
-	bool used;
+	volatile long used;
 };
 
 struct obs_weak_source {
@@ -590,6 +646,10 @@ struct obs_source {
 	 * to handle things but it's the best option) */
 	bool                            removed;
 
+	/* set while the source is in the user source list (obs_add_source),
+	 * which is what obs_get_source_by_name searches */
+	bool                            added;
+
 	bool                            active;
 	bool                            showing;
 
@@ -613,6 +673,7 @@ struct obs_source {
 	int64_t                         sync_offset;
 	DARRAY(obs_source_audio_stream_t*) audio_streams;
 	calldata_t                      audio_signal_calldata;
+	signal_id_t                     audio_data_signal;
 
 	/* async video data */
 	gs_texture_t                    *async_texture;
@@ -629,9 +690,22 @@ struct obs_source {
 	int                             async_plane_offset[2];
 	bool                            async_flip;
 	bool                            async_active;
-	DARRAY(struct async_frame)      async_cache;
+	struct async_frame              async_cache[ASYNC_POOL_SIZE];
+	size_t                          async_cache_size;
 	DARRAY(struct obs_source_frame*)async_frames;
 	pthread_mutex_t                 async_mutex;
+
+	/* frames from obs_source_output_video are passed to the graphics
+	 * thread through this lock-free queue, and moved to async_frames
+	 * when the source ticks.  the queue has a single producer, so
+	 * obs_source_output_video calls are serialized by
+	 * async_output_mutex, which the graphics thread never takes */
+	pthread_mutex_t                 async_output_mutex;
+	struct obs_source_frame         *async_queue[ASYNC_QUEUE_SIZE];
+	volatile long                   async_queue_head;
+	volatile long                   async_queue_tail;
+	volatile long                   async_dropped_frames;
+	volatile long                   async_total_frames;
 	uint32_t                        async_width;
 	uint32_t                        async_height;
 	uint32_t                        async_cache_width;
@@ -683,6 +757,16 @@ enum view_type {
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+
+/* obs_source_video_tick split into its stages, for tick_sources:
+ * - obs_source_tick_async_frame only touches the source's own async frame
+ *   state and may be called for several sources at once
+ * - obs_source_tick_state must be called on the graphics thread
+ * - obs_source_tick_callback calls video_tick, which may be done off the
+ *   graphics thread if the source has OBS_SOURCE_PARALLEL_TICK */
+extern void obs_source_tick_async_frame(obs_source_t *source);
+extern void obs_source_tick_state(obs_source_t *source);
+extern void obs_source_tick_callback(obs_source_t *source, float seconds);
 extern float obs_source_get_target_volume(obs_source_t *source,
 		obs_source_t *target);
 
@@ -724,7 +808,8 @@ struct obs_output {
 	int64_t                         highest_audio_ts;
 	int64_t                         highest_video_ts;
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+
+	struct interleave_queue         interleaved;
 
 	int                             reconnect_retry_sec;
 	int                             reconnect_retry_max;
@@ -114,7 +114,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	obs_context_data_insert(&output->context,
 			&obs->data.outputs_mutex,
-			&obs->data.first_output);
+			&obs->data.first_output,
+			&obs->data.output_names);
 
 	blog(LOG_INFO, "output '%s' (%s) created", name, id);
 	return output;
@@ -126,9 +127,15 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < NUM_INTERLEAVED_TRACKS; i++) {
+		struct circlebuf *track = &output->interleaved.tracks[i];
+		size_t num = track_num_packets(track);
+
+		for (size_t j = 0; j < num; j++)
+			obs_free_encoder_packet(&track_packet(track, j)->packet);
+	}
+
+	interleave_queue_free(&output->interleaved);
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -284,6 +291,17 @@ static void log_frame_info(struct obs_output *output)
 				"to encoding lag: %"PRIu32" (%0.1f%%)",
 				output->context.name,
 				skipped, percentage_skipped);
+	if (output->video_encoder) {
+		uint32_t encoder_dropped =
+			obs_encoder_get_frames_dropped(output->video_encoder);
+		if (encoder_dropped)
+			blog(LOG_INFO, "Output '%s': Number of frames dropped "
+					"by encoder '%s' due to encoding lag: "
+					"%"PRIu32,
+					output->context.name,
+					output->video_encoder->context.name,
+					encoder_dropped);
+	}
 	if (drawn && lagged)
 		blog(LOG_INFO, "Output '%s': Number of lagged frames due "
 				"to rendering lag/stalls: %"PRIu32" (%0.1f%%)",
@@ -948,14 +966,25 @@ static bool handle_stop_timeout(obs_output_t *output, struct encoder_packet *out
 	if (output->hard_stop_system_time > os_gettime_ns())
 		return false;
 
-	size_t i = 0;
-	for (; i < output->interleaved_packets.num - 1; i++)
-		if (output->interleaved_packets.array[i].tracked_id == output->stop_frame_id) {
+	struct interleaved_packet *last =
+		interleave_queue_last(&output->interleaved);
+	struct encoder_packet *tracked_or_end = &last->packet;
+	struct circlebuf *video = &output->interleaved.tracks[0];
+	size_t num_video = track_num_packets(video);
+
+	/* only video packets are tracked */
+	for (size_t i = 0; i < num_video; i++) {
+		struct interleaved_packet *packet = track_packet(video, i);
+		if (packet == last)
+			break;
+
+		if (packet->packet.tracked_id == output->stop_frame_id) {
 			output->stop_frame_queued = true;
+			tracked_or_end = &packet->packet;
 			break;
 		}
+	}
 
-	struct encoder_packet *tracked_or_end = &output->interleaved_packets.array[i];
 	output->queue_length_usec_on_timeout = tracked_or_end->dts_usec - out->dts_usec;
 
 	output->hard_stop_system_time = 0;
@@ -985,7 +1014,9 @@ static void handle_queued_stop(obs_output_t *output, struct encoder_packet *out)
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	size_t track_idx = 0;
+	struct encoder_packet out = interleave_queue_peek(&output->interleaved,
+			NULL, &track_idx)->packet;
 
 	if (handle_stop_timeout(output, &out))
 		return;
@@ -999,7 +1030,7 @@ static inline void send_interleaved(struct obs_output *output)
 	if (out.type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_queue_pop(&output->interleaved, track_idx, NULL);
 	if (output->started) {
 		output->info.encoded_packet(output->context.data, &out);
 
@@ -1037,25 +1068,29 @@ static inline void set_higher_ts(struct obs_output *output,
 	}
 }
 
-static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
+static bool can_prune_interleaved_packet(struct obs_output *output,
+		size_t *track_idx)
 {
-	struct encoder_packet *packet;
-	struct encoder_packet *next;
+	size_t skip[NUM_INTERLEAVED_TRACKS] = {0};
+	struct interleaved_packet *packet;
+	struct interleaved_packet *next;
 
-	if (idx >= (output->interleaved_packets.num - 1))
+	packet = interleave_queue_peek(&output->interleaved, NULL, track_idx);
+	if (!packet)
 		return false;
 
-	packet = &output->interleaved_packets.array[idx];
-
 	/* audio packets will almost always come before video packets,
 	 * so it should only ever be necessary to prune audio packets */
-	if (packet->type != OBS_ENCODER_AUDIO)
+	if (packet->packet.type != OBS_ENCODER_AUDIO)
 		return false;
 
-	next = &output->interleaved_packets.array[idx + 1];
+	skip[*track_idx] = 1;
+	next = interleave_queue_peek(&output->interleaved, skip, NULL);
+	if (!next)
+		return false;
 
-	if (next->type == OBS_ENCODER_VIDEO &&
-	    next->dts_usec == packet->dts_usec)
+	if (next->packet.type == OBS_ENCODER_VIDEO &&
+	    next->packet.dts_usec == packet->packet.dts_usec)
 		return false;
 
 	return true;
@@ -1063,40 +1098,23 @@ static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
 
 static void prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-
-	while (can_prune_interleaved_packet(output, start_idx))
-		start_idx++;
+	size_t track_idx;
 
-	if (start_idx) {
-		for (size_t i = 0; i < start_idx; i++) {
-			struct encoder_packet *packet =
-				&output->interleaved_packets.array[i];
-			obs_free_encoder_packet(packet);
-		}
-
-		da_erase_range(output->interleaved_packets, 0, start_idx);
+	while (can_prune_interleaved_packet(output, &track_idx)) {
+		struct encoder_packet packet;
+		interleave_queue_pop(&output->interleaved, track_idx, &packet);
+		obs_free_encoder_packet(&packet);
 	}
 }
 
 static struct encoder_packet *find_first_packet_type(struct obs_output *output,
 		enum obs_encoder_type type, size_t audio_idx)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return packet;
-		}
-	}
+	size_t track_idx = type == OBS_ENCODER_VIDEO ? 0 : audio_idx + 1;
+	struct circlebuf *track = &output->interleaved.tracks[track_idx];
 
-	return NULL;
+	return track_num_packets(track) ?
+		&track_packet(track, 0)->packet : NULL;
 }
 
 static bool initialize_interleaved_packets(struct obs_output *output)
@@ -1130,43 +1148,19 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
-	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
-	}
-
-	return true;
-}
+	/* apply new offsets to all existing packet DTS/PTS values.  every
+	 * packet of a track gets the same offset, so the tracks stay sorted
+	 * and don't need to be resorted */
+	for (size_t i = 0; i < NUM_INTERLEAVED_TRACKS; i++) {
+		struct circlebuf *track = &output->interleaved.tracks[i];
+		size_t num = track_num_packets(track);
 
-static inline void insert_interleaved_packet(struct obs_output *output,
-		struct encoder_packet *out)
-{
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec < cur_packet->dts_usec)
-			break;
+		for (size_t j = 0; j < num; j++)
+			apply_interleaved_packet_offset(output,
+					&track_packet(track, j)->packet);
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
-}
-
-static void resort_interleaved_packets(struct obs_output *output)
-{
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-			sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	return true;
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1185,14 +1179,14 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_duplicate_encoder_packet(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
 	else
 		check_received(output, packet);
 
-	insert_interleaved_packet(output, &out);
+	interleave_queue_insert(&output->interleaved, &out);
 	set_higher_ts(output, &out);
 
 	/* when both video and audio have been received, we're ready
@@ -1200,10 +1194,8 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->received_audio && output->received_video) {
 		if (!was_started) {
 			prune_interleaved_packets(output);
-			if (initialize_interleaved_packets(output)) {
-				resort_interleaved_packets(output);
+			if (initialize_interleaved_packets(output))
 				send_interleaved(output);
-			}
 		} else {
 			send_interleaved(output);
 		}
@@ -72,7 +72,8 @@ obs_service_t *obs_service_create(const char *id, const char *name,
 
 	obs_context_data_insert(&service->context,
 			&obs->data.services_mutex,
-			&obs->data.first_service);
+			&obs->data.first_service,
+			&obs->data.service_names);
 
 	blog(LOG_INFO, "service '%s' (%s) created", name, id);
 	return service;
@@ -105,8 +105,13 @@ bool obs_source_init_context(struct obs_source *source,
 				hotkey_data))
 		return false;
 
-	return signal_handler_add_array(source->context.signals,
-			source_signals);
+	if (!signal_handler_add_array(source->context.signals, source_signals))
+		return false;
+
+	/* emitted for every audio buffer */
+	source->audio_data_signal = signal_handler_get_id(
+			source->context.signals, "audio_data");
+	return true;
 }
 
 const char *obs_source_get_display_name(enum obs_source_type type,
@@ -128,6 +133,7 @@ bool obs_source_init(struct obs_source *source,
 	source->sync_offset = 0;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
+	pthread_mutex_init_value(&source->async_output_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
@@ -140,6 +146,8 @@ bool obs_source_init(struct obs_source *source,
 		return false;
 	if (pthread_mutex_init(&source->async_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_output_mutex, NULL) != 0)
+		return false;
 
 	calldata_init(&source->audio_signal_calldata);
 
@@ -160,7 +168,8 @@ bool obs_source_init(struct obs_source *source,
 
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
-			&obs->data.first_source);
+			&obs->data.first_source,
+			&obs->data.source_names);
 	return true;
 }
 
@@ -391,8 +400,10 @@ void obs_source_destroy(struct obs_source *source)
 
 	calldata_free(&source->push_to_talk_active_data);
 
-	for (i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	for (i = 0; i < source->async_cache_size; i++) {
+		if (source->async_cache[i].frame)
+			obs_source_frame_decref(source->async_cache[i].frame);
+	}
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_convert_texrender)
@@ -407,13 +418,13 @@ void obs_source_destroy(struct obs_source *source)
 		free_source_audio_stream(source->audio_streams.array[i]);
 
 	da_free(source->audio_streams);
-	da_free(source->async_cache);
 	da_free(source->async_frames);
 	da_free(source->filters);
 	calldata_free(&source->audio_signal_calldata);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	pthread_mutex_destroy(&source->async_output_mutex);
 	obs_context_data_free(&source->context);
 
 	if (source->owns_info_id)
@@ -524,6 +535,7 @@ void obs_source_remove(obs_source_t *source)
 	exists = (id != DARRAY_INVALID);
 	if (exists) {
 		da_erase(data->user_sources, id);
+		source->added = false;
 		obs_source_release(source);
 	}
 
@@ -815,18 +827,15 @@ static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 		uint64_t sys_time);
 static void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
+static void drain_async_queue(obs_source_t *source);
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+void obs_source_tick_async_frame(obs_source_t *source)
 {
-	bool now_showing, now_active;
-
-	if (!obs_source_valid(source, "obs_source_video_tick"))
-		return;
-
 	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0) {
 		uint64_t sys_time = obs->video.video_time;
 
 		pthread_mutex_lock(&source->async_mutex);
+		drain_async_queue(source);
 		struct obs_source_frame *closest_frame =
 			get_closest_frame(source, sys_time);
 
@@ -839,6 +848,11 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		}
 		pthread_mutex_unlock(&source->async_mutex);
 	}
+}
+
+void obs_source_tick_state(obs_source_t *source)
+{
+	bool now_showing, now_active;
 
 	if (source->defer_update)
 		obs_source_deferred_update(source);
@@ -870,13 +884,26 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 		source->active = now_active;
 	}
+}
 
+void obs_source_tick_callback(obs_source_t *source, float seconds)
+{
 	if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
 	source->async_rendered = false;
 }
 
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (!obs_source_valid(source, "obs_source_video_tick"))
+		return;
+
+	obs_source_tick_async_frame(source);
+	obs_source_tick_state(source);
+	obs_source_tick_callback(source, seconds);
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(size_t frames)
 {
@@ -917,7 +944,8 @@ static void source_signal_audio_data(obs_source_t *source,
 	calldata_set_ptr(data, "data",   in);
 	calldata_set_bool(data, "muted", muted);
 
-	signal_handler_signal(source->context.signals, "audio_data", data);
+	signal_handler_signal_id(source->context.signals,
+			source->audio_data_signal, data);
 }
 
 static inline uint64_t uint64_diff(uint64_t ts1, uint64_t ts2)
@@ -1879,12 +1907,76 @@ static inline bool async_texture_changed(struct obs_source *source,
 		   source->async_shared_handle != frame->shared_handle;
 }
 
+#define MAX_UNUSED_FRAME_DURATION 5
+#define ASYNC_QUEUE_MASK          (ASYNC_QUEUE_SIZE - 1)
+
+/* takes the oldest frame from the async queue.  the graphics thread uses
+ * this to take new frames, and obs_source_output_video uses it to reclaim
+ * the oldest frame when the pool runs out */
+static struct obs_source_frame *async_queue_pop(obs_source_t *source)
+{
+	for (;;) {
+		long head = os_atomic_load_long(&source->async_queue_head);
+		long tail = os_atomic_load_long(&source->async_queue_tail);
+		struct obs_source_frame *frame;
+
+		if (head == tail)
+			return NULL;
+
+		frame = source->async_queue[head & ASYNC_QUEUE_MASK];
+		if (os_atomic_compare_swap_long(&source->async_queue_head,
+					head, head + 1))
+			return frame;
+	}
+}
+
+/* only called from obs_source_output_video, with async_output_mutex held */
+static void async_queue_push(obs_source_t *source,
+		struct obs_source_frame *frame)
+{
+	long tail = source->async_queue_tail;
+
+	source->async_queue[tail & ASYNC_QUEUE_MASK] = frame;
+	os_atomic_set_long(&source->async_queue_tail, tail + 1);
+}
+
+static inline size_t async_queue_size(obs_source_t *source)
+{
+	return (size_t)(os_atomic_load_long(&source->async_queue_tail) -
+			os_atomic_load_long(&source->async_queue_head));
+}
+
+static void drain_async_queue(obs_source_t *source)
+{
+	struct obs_source_frame *frame;
+	while ((frame = async_queue_pop(source)) != NULL)
+		da_push_back(source->async_frames, &frame);
+
+	/* drop the oldest frames rather than letting the queue build up */
+	while (source->async_frames.num > MAX_ASYNC_FRAMES) {
+		frame = source->async_frames.array[0];
+		da_erase(source->async_frames, 0);
+		remove_async_frame(source, frame);
+		os_atomic_inc_long(&source->async_dropped_frames);
+	}
+}
+
+/* must be called with async_mutex locked by the thread that outputs video,
+ * so that neither side of the queue can be using the pool */
 static inline void free_async_cache(struct obs_source *source)
 {
-	for (size_t i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	for (size_t i = 0; i < source->async_cache_size; i++) {
+		struct async_frame *af = &source->async_cache[i];
 
-	da_resize(source->async_cache, 0);
+		if (af->frame)
+			obs_source_frame_decref(af->frame);
+		af->frame = NULL;
+		af->unused_count = 0;
+		af->used = 0;
+	}
+
+	os_atomic_set_long(&source->async_queue_head,
+			source->async_queue_tail);
 	da_resize(source->async_frames, 0);
 	source->cur_async_frame = NULL;
 }
@@ -1916,82 +2008,90 @@ static bool update_shared_handles(obs_source_t *source,
 	return !!source->async_texture;
 }
 
-#define MAX_UNUSED_FRAME_DURATION 5
+/* takes an unused frame from the pool, frames are only allocated the first
+ * time their slot is used */
+static struct obs_source_frame *get_free_async_frame(struct obs_source *source,
+		const struct obs_source_frame *frame)
+{
+	for (size_t i = 0; i < source->async_cache_size; i++) {
+		struct async_frame *af = &source->async_cache[i];
+
+		if (!os_atomic_compare_swap_long(&af->used, 0, 1))
+			continue;
 
-/* frees frame allocations if they haven't been used for a specific period
- * of time */
-static void clean_cache(obs_source_t *source)
-{
-	for (size_t i = source->async_cache.num; i > 0; i--) {
-		struct async_frame *af = &source->async_cache.array[i - 1];
-		if (!af->used) {
-			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
-				da_erase(source->async_cache, i - 1);
-			}
+		if (!af->frame) {
+			af->frame = obs_source_frame_create(frame->format,
+					frame->width, frame->height);
+			af->frame->refs = 1;
 		}
+
+		af->unused_count = 0;
+		return af->frame;
 	}
+
+	return NULL;
 }
 
-#define MAX_ASYNC_FRAMES 30
+/* frees frames that haven't been used for a while, so a burst of queued
+ * frames doesn't keep the whole pool allocated.  only the output side claims
+ * slots, so a slot it claims here can't be taken by anything else */
+static void clean_async_cache(struct obs_source *source)
+{
+	for (size_t i = 0; i < source->async_cache_size; i++) {
+		struct async_frame *af = &source->async_cache[i];
+
+		if (!af->frame || os_atomic_load_long(&af->used))
+			continue;
+		if (++af->unused_count < MAX_UNUSED_FRAME_DURATION)
+			continue;
+		if (!os_atomic_compare_swap_long(&af->used, 0, 1))
+			continue;
+
+		obs_source_frame_decref(af->frame);
+		af->frame = NULL;
+		af->unused_count = 0;
+		os_atomic_set_long(&af->used, 0);
+	}
+}
 
 static inline struct obs_source_frame *cache_video(struct obs_source *source,
 		const struct obs_source_frame *frame)
 {
 	struct obs_source_frame *new_frame = NULL;
 
-	pthread_mutex_lock(&source->async_mutex);
+	os_atomic_inc_long(&source->async_total_frames);
 
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
-	}
+	if (!source->async_cache_size || async_texture_changed(source, frame)) {
+		pthread_mutex_lock(&source->async_mutex);
 
-	if (async_texture_changed(source, frame)) {
 		free_async_cache(source);
 		source->async_cache_width  = frame->width;
 		source->async_cache_height = frame->height;
 		source->async_cache_format = frame->format;
+		source->async_cache_size   = ASYNC_POOL_SIZE;
 
 		update_shared_handles(source, frame);
-	}
 
-	if (source->async_shared_handle) {
 		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
 	}
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *af = &source->async_cache.array[i];
-		if (!af->used) {
-			new_frame = af->frame;
-			af->used = true;
-			af->unused_count = 0;
-			break;
-		}
-	}
+	if (source->async_shared_handle)
+		return NULL;
 
-	clean_cache(source);
+	new_frame = get_free_async_frame(source, frame);
+	clean_async_cache(source);
 
+	/* every frame is in use, so reuse the oldest queued frame instead */
 	if (!new_frame) {
-		struct async_frame new_af;
-
-		new_frame = obs_source_frame_create(frame->format,
-				frame->width, frame->height);
-		new_af.frame = new_frame;
-		new_af.used = true;
-		new_af.unused_count = 0;
-		new_frame->refs = 1;
+		new_frame = async_queue_pop(source);
+		os_atomic_inc_long(&source->async_dropped_frames);
 
-		da_push_back(source->async_cache, &new_af);
+		if (!new_frame)
+			return NULL;
 	}
 
 	os_atomic_inc_long(&new_frame->refs);
 
-	pthread_mutex_unlock(&source->async_mutex);
-
 	copy_frame_data(new_frame, frame);
 
 	if (os_atomic_dec_long(&new_frame->refs) == 0) {
@@ -2013,17 +2113,19 @@ void obs_source_output_video(obs_source_t *source,
 		return;
 	}
 
+	pthread_mutex_lock(&source->async_output_mutex);
+
 	struct obs_source_frame *output = !!frame ?
 		cache_video(source, frame) : NULL;
 
 	/* ------------------------------------------- */
 
 	if (output) {
-		pthread_mutex_lock(&source->async_mutex);
-		da_push_back(source->async_frames, &output);
-		pthread_mutex_unlock(&source->async_mutex);
+		async_queue_push(source, output);
 		source->async_active = true;
 	}
+
+	pthread_mutex_unlock(&source->async_output_mutex);
 }
 
 obs_source_audio_stream_t *obs_source_add_audio_stream(obs_source_t *source)
@@ -2183,13 +2285,38 @@ static void downmix_to_mono_planar(obs_source_audio_stream_t *stream, uint32_t f
 	}
 }
 
-/* resamples/remixes new audio to the designated main audio output format */
-static void process_audio(obs_source_t *source,
+static struct obs_audio_data *reference_audio_data(
+		struct obs_audio_data *view, const uint8_t *const data[],
+		uint32_t frames, uint64_t ts)
+{
+	size_t planes = audio_output_get_planes(obs->audio.audio);
+
+	memset(view, 0, sizeof(*view));
+	view->frames    = frames;
+	view->timestamp = ts;
+
+	for (size_t i = 0; i < planes; i++)
+		view->data[i] = (uint8_t*)data[i];
+
+	return view;
+}
+
+/* resamples/remixes new audio to the designated main audio output format.
+ * the data is only copied to the stream's own storage when filters or the
+ * mono downmix need to modify it, otherwise the returned data references
+ * the resampler output (or the source's data) directly until the next call.
+ * must be called with filter_mutex locked */
+static struct obs_audio_data *process_audio(obs_source_t *source,
 		obs_source_audio_stream_t *stream,
-		const struct obs_source_audio *audio)
+		const struct obs_source_audio *audio,
+		struct obs_audio_data *view)
 {
+	const uint8_t *const *data = audio->data;
 	uint32_t frames = audio->frames;
+	uint64_t ts = audio->timestamp;
+	uint8_t  *output[MAX_AV_PLANES];
 	bool mono_output;
+	bool downmix;
 
 	if (stream->sample_info.samples_per_sec != audio->samples_per_sec ||
 	    stream->sample_info.format          != audio->format          ||
@@ -2197,10 +2324,9 @@ static void process_audio(obs_source_t *source,
 		reset_resampler(source, stream, audio);
 
 	if (source->audio_failed)
-		return;
+		return NULL;
 
 	if (stream->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
 		uint64_t offset;
 
 		memset(output, 0, sizeof(output));
@@ -2209,23 +2335,30 @@ static void process_audio(obs_source_t *source,
 				output, &frames, &offset,
 				audio->data, audio->frames);
 
-		copy_audio_data(source, stream, (const uint8_t *const *)output, frames,
-				audio->timestamp - offset);
-	} else {
-		copy_audio_data(source, stream, audio->data, audio->frames,
-				audio->timestamp);
+		data = (const uint8_t *const *)output;
+		ts  -= offset;
 	}
 
 	mono_output = audio_output_get_channels(obs->audio.audio) == 1;
+	downmix = !mono_output &&
+		(source->flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0;
+
+	if (!downmix && !source->filters.num)
+		return reference_audio_data(view, data, frames, ts);
 
-	if (!mono_output && (source->flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0)
+	copy_audio_data(source, stream, data, frames, ts);
+
+	if (downmix)
 		downmix_to_mono_planar(stream, frames);
+
+	return &stream->audio_data;
 }
 
 void obs_source_output_audio_stream(obs_source_t *source,
 		obs_source_audio_stream_t *stream,
 		const struct obs_source_audio *audio)
 {
+	struct obs_audio_data view;
 	struct obs_audio_data *output;
 
 	if (!obs_source_valid(source, "obs_source_output_audio_stream"))
@@ -2233,10 +2366,11 @@ void obs_source_output_audio_stream(obs_source_t *source,
 	if (!obs_ptr_valid(audio, "obs_source_output_audio_stream"))
 		return;
 
-	process_audio(source, stream, audio);
-
 	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_audio(source, &stream->audio_data);
+
+	output = process_audio(source, stream, audio, &view);
+	if (output)
+		output = filter_async_audio(source, output);
 
 	if (output) {
 		struct audio_data data;
@@ -2278,11 +2412,11 @@ static inline bool frame_out_of_bounds(const obs_source_t *source, uint64_t ts)
 static void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame)
 {
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *f = &source->async_cache.array[i];
+	for (size_t i = 0; i < source->async_cache_size; i++) {
+		struct async_frame *f = &source->async_cache[i];
 
 		if (f->frame == frame) {
-			f->used = false;
+			os_atomic_set_long(&f->used, 0);
 			break;
 		}
 	}
@@ -2444,6 +2578,25 @@ void obs_source_release_frame(obs_source_t *source,
 	}
 }
 
+bool obs_source_get_async_stats(obs_source_t *source,
+		struct obs_source_async_stats *stats)
+{
+	if (!obs_source_valid(source, "obs_source_get_async_stats") || !stats)
+		return false;
+
+	pthread_mutex_lock(&source->async_mutex);
+	stats->queued_frames  = (uint32_t)(async_queue_size(source) +
+			source->async_frames.num);
+	stats->pool_frames    = (uint32_t)source->async_cache_size;
+	pthread_mutex_unlock(&source->async_mutex);
+
+	stats->dropped_frames = (uint32_t)os_atomic_load_long(
+			&source->async_dropped_frames);
+	stats->total_frames   = (uint32_t)os_atomic_load_long(
+			&source->async_total_frames);
+	return true;
+}
+
 const char *obs_source_get_name(const obs_source_t *source)
 {
 	return obs_source_valid(source, "obs_source_get_name") ?
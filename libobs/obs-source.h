@@ -103,6 +103,17 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_INTERACTION (1<<5)
 
+/**
+ * Source video_tick can run in parallel.
+ *
+ * When this is used, the video_tick callback may be called on a worker
+ * thread, concurrently with the video_tick callbacks of other sources.  The
+ * callback must only use the source's own data, anything shared must be
+ * locked: graphics calls need obs_enter_graphics, and other sources need
+ * proper locking.
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1<<6)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
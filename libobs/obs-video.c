@@ -51,13 +51,50 @@ static inline void calculate_base_volume(struct obs_core_data *data,
 	}
 }
 
+/* below this many sources, ticking isn't worth waking the tick pool */
+#define MIN_PARALLEL_TICK_SOURCES 8
+#define MAX_TICK_THREADS          4
+
+static void tick_async_frame_job(void *param, size_t idx)
+{
+	struct obs_core_video *video = param;
+	obs_source_tick_async_frame(video->tick_sources.array[idx]);
+}
+
+static void tick_callback_job(void *param, size_t idx)
+{
+	struct obs_core_video *video = param;
+	obs_source_tick_callback(video->parallel_tick_sources.array[idx],
+			video->tick_seconds);
+}
+
+static inline worker_pool_t *get_tick_pool(struct obs_core_video *video,
+		size_t count)
+{
+	if (count < MIN_PARALLEL_TICK_SOURCES)
+		return NULL;
+
+	if (!video->tick_pool) {
+		int cores = os_get_logical_cores();
+		size_t threads = cores > 1 ? (size_t)(cores - 1) : 1;
+		if (threads > MAX_TICK_THREADS)
+			threads = MAX_TICK_THREADS;
+
+		video->tick_pool = worker_pool_create(
+				"libobs: source tick thread", threads);
+	}
+
+	return video->tick_pool;
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
-	struct obs_core_data *data = &obs->data;
-	struct obs_view      *view = &data->main_view;
-	struct obs_source    *source;
-	uint64_t             delta_time;
-	float                seconds;
+	struct obs_core_data  *data  = &obs->data;
+	struct obs_core_video *video = &obs->video;
+	struct obs_view       *view  = &data->main_view;
+	struct obs_source     *source;
+	uint64_t              delta_time;
+	float                 seconds;
 
 	if (!last_time)
 		last_time = cur_time -
@@ -68,13 +105,39 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 
 	pthread_mutex_lock(&data->sources_mutex);
 
-	/* call the tick function of each source */
+	da_resize(video->tick_sources, 0);
+	da_resize(video->parallel_tick_sources, 0);
+
 	source = data->first_source;
 	while (source) {
-		obs_source_video_tick(source, seconds);
+		da_push_back(video->tick_sources, &source);
 		source = (struct obs_source*)source->context.next;
 	}
 
+	/* async frame selection only uses per-source state */
+	worker_pool_run(get_tick_pool(video, video->tick_sources.num),
+			tick_async_frame_job, video, video->tick_sources.num);
+
+	/* state changes and non-thread-safe ticks stay on this thread, in
+	 * list order */
+	for (size_t i = 0; i < video->tick_sources.num; i++) {
+		source = video->tick_sources.array[i];
+
+		obs_source_tick_state(source);
+
+		if (source->info.output_flags & OBS_SOURCE_PARALLEL_TICK)
+			da_push_back(video->parallel_tick_sources, &source);
+		else
+			obs_source_tick_callback(source, seconds);
+	}
+
+	/* then the sources that opted in to parallel ticking */
+	video->tick_seconds = seconds;
+	worker_pool_run(get_tick_pool(video,
+				video->parallel_tick_sources.num),
+			tick_callback_job, video,
+			video->parallel_tick_sources.num);
+
 	/* calculate source volumes */
 	pthread_mutex_lock(&view->channels_mutex);
 
@@ -816,24 +879,25 @@ static void set_gpu_converted_data(struct video_frame *output_frame, const obs_v
 }
 
 static void convert_frame(
-		struct video_frame *output_frame, const obs_video_output_t *output, const struct video_frame *frame)
+		struct video_frame *output_frame, const obs_video_output_t *output, const struct video_frame *frame,
+		uint32_t start_y, uint32_t end_y)
 {
 	if (output->info.format == VIDEO_FORMAT_I420) {
 		compress_uyvx_to_i420(
 				frame->data[0], frame->linesize[0],
-				0, output->info.height,
+				start_y, end_y,
 				output_frame->data, output_frame->linesize);
 
 	} else if (output->info.format == VIDEO_FORMAT_NV12) {
 		compress_uyvx_to_nv12(
 				frame->data[0], frame->linesize[0],
-				0, output->info.height,
+				start_y, end_y,
 				output_frame->data, output_frame->linesize);
 
 	} else if (output->info.format == VIDEO_FORMAT_I444) {
 		convert_uyvx_to_i444(
 				frame->data[0], frame->linesize[0],
-				0, output->info.height,
+				start_y, end_y,
 				output_frame->data, output_frame->linesize);
 
 	} else {
@@ -841,6 +905,66 @@ static void convert_frame(
 	}
 }
 
+#define MAX_CONVERT_THREADS   8
+#define MIN_CONVERT_SLICE_CY  64
+
+static const char *convert_frame_slice_name = "convert_frame_slice";
+
+static void convert_slice_job(void *param, size_t idx)
+{
+	struct obs_core_video *video = param;
+	struct obs_convert_slice *slice = video->convert_slices.array + idx;
+
+	profile_start(convert_frame_slice_name);
+	convert_frame(&slice->output_frame, slice->output, slice->frame,
+			slice->start_y, slice->end_y);
+	profile_end(convert_frame_slice_name);
+}
+
+static inline worker_pool_t *get_convert_pool(struct obs_core_video *video)
+{
+	if (!video->convert_pool) {
+		int cores = os_get_logical_cores();
+		size_t threads = cores > 1 ? (size_t)(cores - 1) : 1;
+		if (threads > MAX_CONVERT_THREADS)
+			threads = MAX_CONVERT_THREADS;
+
+		video->convert_pool = worker_pool_create(
+				"libobs: frame conversion thread", threads);
+	}
+
+	return video->convert_pool;
+}
+
+/* splits the conversion of a frame into slices of an even number of lines
+ * (4:2:0 formats are converted two lines at a time) */
+static void add_convert_slices(struct obs_core_video *video,
+		const struct video_frame *output_frame,
+		const obs_video_output_t *output,
+		const struct video_frame *frame)
+{
+	uint32_t height = output->info.height;
+	size_t num_slices = worker_pool_num_threads(
+			get_convert_pool(video)) + 1;
+	uint32_t slice_cy = (uint32_t)((height + num_slices - 1) / num_slices);
+
+	if (slice_cy < MIN_CONVERT_SLICE_CY)
+		slice_cy = MIN_CONVERT_SLICE_CY;
+	slice_cy = (slice_cy + 1) & ~1;
+
+	for (uint32_t y = 0; y < height; y += slice_cy) {
+		struct obs_convert_slice *slice =
+			da_push_back_new(video->convert_slices);
+
+		slice->output_frame = *output_frame;
+		slice->output       = output;
+		slice->frame        = frame;
+		slice->start_y      = y;
+		slice->end_y        = (height - y > slice_cy) ?
+			y + slice_cy : height;
+	}
+}
+
 static inline void copy_rgbx_frame(struct video_frame *output_frame,
 	obs_video_output_t *output, const struct video_frame *input)
 {
@@ -867,7 +991,11 @@ static inline void output_video_data(video_t *video,
 	locked = video_output_lock_frame(video, info->data.num, info->count,
 			info->timestamp, info->tracked_id);
 	if (locked) {
+		struct obs_core_video *core_video = &obs->video;
 		struct video_frame output_frame;
+
+		da_resize(core_video->convert_slices, 0);
+
 		for (size_t i = 0; i < info->data.num; i++) {
 			obs_video_output_t *output = info->data.array[i].output;
 			if (!video_output_get_frame_buffer(video, &output_frame, &output->info, locked, output->expiring || output->expired)) {
@@ -879,14 +1007,21 @@ static inline void output_video_data(video_t *video,
 			if (output->info.gpu_conversion) {
 				set_gpu_converted_data(&output_frame, output, frame);
 			} else if (format_is_yuv(output->info.format)) {
-				convert_frame(&output_frame, output, frame);
+				add_convert_slices(core_video, &output_frame,
+						output, frame);
 			} else {
 				copy_rgbx_frame(&output_frame, output, frame);
 			}
+		}
 
+		/* CPU conversions of all outputs are split into slices and
+		 * converted in parallel */
+		worker_pool_run(core_video->convert_pool, convert_slice_job,
+				core_video, core_video->convert_slices.num);
+
+		for (size_t i = 0; i < info->data.num; i++)
 			if (info->data.array[i].tex)
 				obs_output_texture_release(info->data.array[i].tex);
-		}
 
 		video_output_unlock_frame(video, locked);
 
@@ -1357,6 +1492,15 @@ void *obs_video_thread(void *param)
 		video_sleep(&obs->video, &obs->video.video_time, interval, &vframe_info);
 	}
 
+	worker_pool_destroy(obs->video.tick_pool);
+	obs->video.tick_pool = NULL;
+	da_free(obs->video.tick_sources);
+	da_free(obs->video.parallel_tick_sources);
+
+	worker_pool_destroy(obs->video.convert_pool);
+	obs->video.convert_pool = NULL;
+	da_free(obs->video.convert_slices);
+
 	UNUSED_PARAMETER(param);
 	return NULL;
 }
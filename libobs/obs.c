@@ -359,6 +359,14 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&data->services_mutex, &attr) != 0)
 		goto fail;
+	if (!obs_context_name_map_init(&data->source_names))
+		goto fail;
+	if (!obs_context_name_map_init(&data->output_names))
+		goto fail;
+	if (!obs_context_name_map_init(&data->encoder_names))
+		goto fail;
+	if (!obs_context_name_map_init(&data->service_names))
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
@@ -422,6 +430,11 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
+
+	obs_context_name_map_free(&data->source_names);
+	obs_context_name_map_free(&data->output_names);
+	obs_context_name_map_free(&data->encoder_names);
+	obs_context_name_map_free(&data->service_names);
 }
 
 static const char *obs_signals[] = {
@@ -648,6 +661,7 @@ void obs_shutdown(void)
 	pthread_mutex_destroy(&obs->video.frame_tracker_mutex);
 
 	obs_free_data();
+	os_file_watch_shutdown();
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
@@ -794,15 +808,18 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.max_buffer_ms = oai->max_buffer_ms;
+	ai.frames_per_tick = obs->audio_frames_per_tick;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO, "audio settings reset:\n"
 	               "\tsamples per sec:     %d\n"
 	               "\tspeakers:            %d\n"
-	               "\tmax buffering (ms):  %d",
+	               "\tmax buffering (ms):  %d\n"
+	               "\tframes per tick:     %d",
 	               (int)ai.samples_per_sec,
 	               (int)ai.speakers,
-	               (int)ai.max_buffer_ms);
+	               (int)ai.max_buffer_ms,
+	               (int)ai.frames_per_tick);
 
 	return obs_init_audio(&ai);
 }
@@ -844,6 +861,17 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+void obs_set_audio_frames_per_tick(uint32_t frames)
+{
+	if (!obs) return;
+	obs->audio_frames_per_tick = frames;
+}
+
+uint32_t obs_get_audio_frames_per_tick(void)
+{
+	return obs ? obs->audio_frames_per_tick : 0;
+}
+
 bool obs_enum_input_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
@@ -996,6 +1024,7 @@ bool obs_add_source(obs_source_t *source)
 	pthread_mutex_lock(&obs->data.sources_mutex);
 	da_push_back(obs->data.user_sources, &source);
 	obs_source_addref(source);
+	source->added = true;
 	pthread_mutex_unlock(&obs->data.sources_mutex);
 
 	calldata_set_ptr(&params, "source", source);
@@ -1116,48 +1145,63 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t*), void *param)
 			enum_proc, param);
 }
 
-obs_source_t *obs_get_source_by_name(const char *name)
+/* FNV-1a */
+static inline uint32_t hash_context_name(const char *name)
 {
-	struct obs_core_data *data = &obs->data;
-	struct obs_source *source = NULL;
-	size_t i;
-
-	if (!obs) return NULL;
-
-	pthread_mutex_lock(&data->user_sources_mutex);
+	uint32_t hash = 2166136261U;
 
-	for (i = 0; i < data->user_sources.num; i++) {
-		struct obs_source *cur_source = data->user_sources.array[i];
-		if (strcmp(cur_source->context.name, name) == 0) {
-			source = cur_source;
-			obs_source_addref(source);
-			break;
-		}
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
 	}
 
-	pthread_mutex_unlock(&data->user_sources_mutex);
-	return source;
+	return hash;
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-		pthread_mutex_t *mutex, void *(*addref)(void*))
+/* returns the first context with the given name that addref accepts */
+static inline void *get_context_by_name(struct obs_context_name_map *map,
+		const char *name, void *(*addref)(void*))
 {
-	struct obs_context_data **first = vfirst;
 	struct obs_context_data *context;
+	void *ret = NULL;
+	uint32_t hash;
 
-	pthread_mutex_lock(mutex);
+	if (!name)
+		return NULL;
 
-	context = *first;
-	while (context) {
-		if (strcmp(context->name, name) == 0) {
-			context = addref(context);
-			break;
+	hash = hash_context_name(name);
+
+	pthread_rwlock_rdlock(&map->rwlock);
+
+	if (map->num_buckets) {
+		context = map->buckets[hash & (map->num_buckets - 1)];
+
+		while (context) {
+			if (context->name_hash == hash &&
+			    strcmp(context->name, name) == 0) {
+				ret = addref(context);
+				if (ret)
+					break;
+			}
+			context = context->name_next;
 		}
-		context = context->next;
 	}
 
-	pthread_mutex_unlock(mutex);
-	return context;
+	pthread_rwlock_unlock(&map->rwlock);
+	return ret;
+}
+
+static inline void *obs_source_addref_user_(void *ref)
+{
+	struct obs_source *source = ref;
+	return source->added ? obs_source_get_ref(source) : NULL;
+}
+
+obs_source_t *obs_get_source_by_name(const char *name)
+{
+	if (!obs) return NULL;
+	return get_context_by_name(&obs->data.source_names, name,
+			obs_source_addref_user_);
 }
 
 static inline void *obs_output_addref_safe_(void *ref)
@@ -1183,22 +1227,22 @@ static inline void *obs_id_(void *data)
 obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
-			&obs->data.outputs_mutex, obs_output_addref_safe_);
+	return get_context_by_name(&obs->data.output_names, name,
+			obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
-			&obs->data.encoders_mutex, obs_encoder_addref_safe_);
+	return get_context_by_name(&obs->data.encoder_names, name,
+			obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
-			&obs->data.services_mutex, obs_service_addref_safe_);
+	return get_context_by_name(&obs->data.service_names, name,
+			obs_service_addref_safe_);
 }
 
 gs_effect_t *obs_get_base_effect(enum obs_base_effect effect)
@@ -1548,8 +1592,105 @@ void obs_context_data_free(struct obs_context_data *context)
 	memset(context, 0, sizeof(*context));
 }
 
+/* ------------------------------------------------------------------------- */
+/* context name map */
+
+#define NAME_MAP_MIN_BUCKETS 64
+
+bool obs_context_name_map_init(struct obs_context_name_map *map)
+{
+	memset(map, 0, sizeof(*map));
+	return pthread_rwlock_init(&map->rwlock, NULL) == 0;
+}
+
+void obs_context_name_map_free(struct obs_context_name_map *map)
+{
+	pthread_rwlock_destroy(&map->rwlock);
+	bfree(map->buckets);
+	memset(map, 0, sizeof(*map));
+}
+
+static void name_map_link(struct obs_context_name_map *map,
+		struct obs_context_data *context)
+{
+	struct obs_context_data **bucket =
+		&map->buckets[context->name_hash & (map->num_buckets - 1)];
+
+	context->name_prev_next = bucket;
+	context->name_next      = *bucket;
+	*bucket                 = context;
+	if (context->name_next)
+		context->name_next->name_prev_next = &context->name_next;
+}
+
+static void name_map_unlink(struct obs_context_data *context)
+{
+	if (context->name_prev_next)
+		*context->name_prev_next = context->name_next;
+	if (context->name_next)
+		context->name_next->name_prev_next = context->name_prev_next;
+
+	context->name_prev_next = NULL;
+	context->name_next      = NULL;
+}
+
+static void name_map_rehash(struct obs_context_name_map *map,
+		size_t num_buckets)
+{
+	struct obs_context_data **old_buckets = map->buckets;
+	size_t old_num_buckets = map->num_buckets;
+
+	map->buckets     = bzalloc(num_buckets * sizeof(*map->buckets));
+	map->num_buckets = num_buckets;
+
+	/* walk each old chain from its tail so that relinking at the head
+	 * keeps the relative order of contexts with the same name */
+	for (size_t i = 0; i < old_num_buckets; i++) {
+		struct obs_context_data *context = old_buckets[i];
+
+		while (context && context->name_next)
+			context = context->name_next;
+
+		while (context) {
+			struct obs_context_data *prev =
+				(context->name_prev_next == &old_buckets[i]) ?
+				NULL :
+				(struct obs_context_data*)(
+					(uint8_t*)context->name_prev_next -
+					offsetof(struct obs_context_data,
+						name_next));
+
+			name_map_link(map, context);
+			context = prev;
+		}
+	}
+
+	bfree(old_buckets);
+}
+
+static void name_map_insert(struct obs_context_name_map *map,
+		struct obs_context_data *context)
+{
+	context->name_hash = hash_context_name(context->name);
+
+	if (map->num + 1 > map->num_buckets)
+		name_map_rehash(map, map->num_buckets ?
+				map->num_buckets * 2 : NAME_MAP_MIN_BUCKETS);
+
+	name_map_link(map, context);
+	map->num++;
+}
+
+static void name_map_remove(struct obs_context_name_map *map,
+		struct obs_context_data *context)
+{
+	name_map_unlink(context);
+	map->num--;
+}
+
 void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *pfirst)
+		pthread_mutex_t *mutex, void *pfirst,
+		struct obs_context_name_map *name_map)
 {
 	struct obs_context_data **first = pfirst;
 
@@ -1557,7 +1698,8 @@ void obs_context_data_insert(struct obs_context_data *context,
 	assert(mutex);
 	assert(first);
 
-	context->mutex = mutex;
+	context->mutex    = mutex;
+	context->name_map = name_map;
 
 	pthread_mutex_lock(mutex);
 	context->prev_next  = first;
@@ -1565,32 +1707,58 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first              = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+
+	if (name_map) {
+		pthread_rwlock_wrlock(&name_map->rwlock);
+		name_map_insert(name_map, context);
+		pthread_rwlock_unlock(&name_map->rwlock);
+	}
 	pthread_mutex_unlock(mutex);
 }
 
 void obs_context_data_remove(struct obs_context_data *context)
 {
 	if (context && context->mutex) {
+		struct obs_context_name_map *name_map = context->name_map;
+
 		pthread_mutex_lock(context->mutex);
 		if (context->prev_next)
 			*context->prev_next = context->next;
 		if (context->next)
 			context->next->prev_next = context->prev_next;
+
+		if (name_map) {
+			pthread_rwlock_wrlock(&name_map->rwlock);
+			name_map_remove(name_map, context);
+			pthread_rwlock_unlock(&name_map->rwlock);
+		}
 		pthread_mutex_unlock(context->mutex);
 
-		context->mutex = NULL;
+		context->mutex    = NULL;
+		context->name_map = NULL;
 	}
 }
 
 void obs_context_data_setname(struct obs_context_data *context,
 		const char *name)
 {
+	struct obs_context_name_map *name_map = context->name_map;
+
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
+	if (name_map)
+		pthread_rwlock_wrlock(&name_map->rwlock);
+
 	if (context->name)
 		da_push_back(context->rename_cache, &context->name);
 	context->name = dup_name(name);
 
+	if (name_map) {
+		name_map_remove(name_map, context);
+		name_map_insert(name_map, context);
+		pthread_rwlock_unlock(&name_map->rwlock);
+	}
+
 	pthread_mutex_unlock(&context->rename_cache_mutex);
 }
 
@@ -310,6 +310,16 @@ EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
 
+/**
+ * Sets the audio mix cadence in frames, or 0 for the default of 25 ms
+ *
+ * @note Takes effect on the next obs_reset_audio call.
+ */
+EXPORT void obs_set_audio_frames_per_tick(uint32_t frames);
+
+/** Gets the audio mix cadence set with obs_set_audio_frames_per_tick */
+EXPORT uint32_t obs_get_audio_frames_per_tick(void);
+
 EXPORT video_tracked_frame_id obs_track_next_frame(void);
 
 EXPORT bool obs_get_video_thread_time(uint64_t *val);
@@ -945,6 +955,17 @@ EXPORT struct obs_source_frame *obs_source_get_frame(obs_source_t *source);
 EXPORT void obs_source_release_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
 
+struct obs_source_async_stats {
+	uint32_t            queued_frames;
+	uint32_t            pool_frames;
+	uint32_t            dropped_frames;
+	uint32_t            total_frames;
+};
+
+/** Gets the async video frame queue statistics of a source */
+EXPORT bool obs_source_get_async_stats(obs_source_t *source,
+		struct obs_source_async_stats *stats);
+
 /**
  * Default RGB filter handler for generic effect filters.  Processes the
  * filter chain and renders them to texture if needed, then the filter is
@@ -1430,6 +1451,12 @@ EXPORT uint32_t obs_encoder_get_height(const obs_encoder_t *encoder);
 /** For audio encoders, returns the sample rate of the audio */
 EXPORT uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder);
 
+/**
+ * For video encoders, returns the number of frames dropped before reaching
+ * the encoder because it could not keep up with the video output
+ */
+EXPORT uint32_t obs_encoder_get_frames_dropped(const obs_encoder_t *encoder);
+
 
 /** Sets the video conversion info */
 EXPORT bool obs_encoder_set_video_conversion(obs_encoder_t *encoder,
@@ -1495,10 +1522,27 @@ EXPORT void *obs_encoder_get_type_data(obs_encoder_t *encoder);
 
 EXPORT const char *obs_encoder_get_id(const obs_encoder_t *encoder);
 
-/** Duplicates an encoder packet */
+/**
+ * Duplicates an encoder packet, always making a private copy of the data.
+ *
+ * Only use this if the data needs to be modified, otherwise use
+ * obs_encoder_packet_ref to share the data without copying it.
+ */
 EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src);
 
+/**
+ * Creates a new reference to an encoder packet.  The data is shared
+ * read-only if the packet is reference counted, otherwise it is copied into
+ * a new reference counted buffer.
+ */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/**
+ * Releases an encoder packet created with obs_encoder_packet_ref or
+ * obs_duplicate_encoder_packet (the data is freed with the last reference)
+ */
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
 
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "cpu-features.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#define CPUID1_ECX_SSSE3     (1<<9)
+#define CPUID1_ECX_SSE41     (1<<19)
+#define CPUID1_ECX_OSXSAVE   (1<<27)
+#define CPUID1_ECX_AVX       (1<<28)
+#define CPUID1_EDX_SSE2      (1<<26)
+#define CPUID7_EBX_AVX2      (1<<5)
+
+/* XMM and YMM state enabled by the OS */
+#define XCR0_AVX_STATE       0x6
+
+static void get_cpuid(uint32_t leaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, 0);
+#else
+	if (__get_cpuid_max(0, NULL) < leaf) {
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+		return;
+	}
+
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t get_xcr0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static uint32_t detect_cpu_features(void)
+{
+	uint32_t features = 0;
+	uint32_t regs[4];
+	bool os_avx = false;
+
+	get_cpuid(0, regs);
+	uint32_t max_leaf = regs[0];
+
+	get_cpuid(1, regs);
+	if (regs[3] & CPUID1_EDX_SSE2)
+		features |= CPU_FEATURE_SSE2;
+	if (regs[2] & CPUID1_ECX_SSSE3)
+		features |= CPU_FEATURE_SSSE3;
+	if (regs[2] & CPUID1_ECX_SSE41)
+		features |= CPU_FEATURE_SSE41;
+
+	if ((regs[2] & CPUID1_ECX_OSXSAVE) != 0)
+		os_avx = (get_xcr0() & XCR0_AVX_STATE) == XCR0_AVX_STATE;
+
+	if (os_avx && (regs[2] & CPUID1_ECX_AVX) != 0)
+		features |= CPU_FEATURE_AVX;
+
+	if (os_avx && max_leaf >= 7) {
+		get_cpuid(7, regs);
+		if (regs[1] & CPUID7_EBX_AVX2)
+			features |= CPU_FEATURE_AVX2;
+	}
+
+	return features;
+}
+
+static volatile uint32_t cpu_features = 0;
+static volatile uint32_t cpu_features_mask = 0xFFFFFFFF;
+static volatile bool cpu_features_detected = false;
+
+uint32_t os_get_cpu_features(void)
+{
+	/* detection is idempotent, so racing first calls are harmless */
+	if (!cpu_features_detected) {
+		cpu_features = detect_cpu_features();
+		cpu_features_detected = true;
+	}
+
+	return cpu_features & cpu_features_mask;
+}
+
+void os_limit_cpu_features(uint32_t mask)
+{
+	cpu_features_mask = mask;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime CPU feature detection, for selecting SIMD code paths that go
+ * beyond the SSE2 baseline libobs is compiled with.
+ *
+ * Functions that use these instruction sets should be marked with the
+ * matching CPU_TARGET_* macro so they can be compiled without changing the
+ * flags of the whole library, and must only be called when the feature is
+ * reported as available.
+ */
+
+#define CPU_FEATURE_SSE2     (1<<0)
+#define CPU_FEATURE_SSSE3    (1<<1)
+#define CPU_FEATURE_SSE41    (1<<2)
+#define CPU_FEATURE_AVX      (1<<3)
+#define CPU_FEATURE_AVX2     (1<<4)
+
+#ifdef _MSC_VER
+#define CPU_TARGET_SSSE3
+#define CPU_TARGET_SSE41
+#define CPU_TARGET_AVX
+#define CPU_TARGET_AVX2
+#else
+#define CPU_TARGET_SSSE3     __attribute__((target("ssse3")))
+#define CPU_TARGET_SSE41     __attribute__((target("sse4.1")))
+#define CPU_TARGET_AVX       __attribute__((target("avx")))
+#define CPU_TARGET_AVX2      __attribute__((target("avx2")))
+#endif
+
+/** Returns the CPU_FEATURE_* flags supported by the CPU and OS */
+EXPORT uint32_t os_get_cpu_features(void);
+
+/**
+ * Limits the flags returned by os_get_cpu_features to the given mask, so
+ * that the code paths for older CPUs can be tested and compared.  Pass
+ * 0xFFFFFFFF to remove the limit.  Code that caches function pointers picks
+ * up the change the next time it selects them.
+ */
+EXPORT void os_limit_cpu_features(uint32_t mask);
+
+static inline bool os_cpu_has_feature(uint32_t feature)
+{
+	return (os_get_cpu_features() & feature) == feature;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,595 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include "platform.h"
+#include "threading.h"
+#include "darray.h"
+#include "dstr.h"
+#include "bmem.h"
+#include "base.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#define INOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | \
+		IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+#define POLL_INTERVAL_MS 1000
+
+struct os_file_watch {
+	uint64_t              id;
+	char                  *path;
+	os_file_watch_cb_t    callback;
+	void                  *param;
+
+	/* files that can't be watched through inotify are polled */
+	bool                  polled;
+	bool                  exists;
+	int64_t               mtime;
+	int64_t               size;
+
+#ifdef __linux__
+	int                   wd;
+	const char            *name;
+#endif
+};
+
+#ifdef __linux__
+struct watched_dir {
+	int                   wd;
+	size_t                refs;
+};
+#endif
+
+struct pending_callback {
+	struct os_file_watch  *watch;
+	uint64_t              id;
+};
+
+/* watch_mutex protects the watch list.  callback_mutex is held by the
+ * thread while making callbacks so os_file_watch_remove can wait for them to
+ * finish.  thread_mutex is held while starting or joining the thread, and
+ * is never taken by the thread itself */
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t callback_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static DARRAY(struct os_file_watch*) watches;
+static uint64_t next_watch_id = 1;
+static size_t num_polled;
+
+/* started with the first watch.  the thread exits once there are no watches
+ * left, or when watch_thread_stop is set, and is joined by the next
+ * os_file_watch_add, the removal of the last watch, or
+ * os_file_watch_shutdown */
+static pthread_t watch_thread;
+static bool watch_thread_active;
+static bool watch_thread_stop;
+
+#ifdef __linux__
+static DARRAY(struct watched_dir) watched_dirs;
+static int inotify_fd = -1;
+static int wake_fd = -1;
+#else
+static os_event_t *wake_event;
+#endif
+
+static void get_file_info(struct os_file_watch *watch)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	wchar_t *wpath = NULL;
+	bool exists;
+
+	os_utf8_to_wcs_ptr(watch->path, 0, &wpath);
+	exists = wpath && _wstat64(wpath, &st) == 0;
+	bfree(wpath);
+#else
+	struct stat st;
+	bool exists = stat(watch->path, &st) == 0;
+#endif
+
+	watch->exists = exists;
+	watch->mtime  = exists ? (int64_t)st.st_mtime : 0;
+	watch->size   = exists ? (int64_t)st.st_size : 0;
+}
+
+static void wake_thread(void)
+{
+#ifdef __linux__
+	uint64_t val = 1;
+	ssize_t ret = write(wake_fd, &val, sizeof(val));
+	UNUSED_PARAMETER(ret);
+#else
+	os_event_signal(wake_event);
+#endif
+}
+
+static inline void queue_callback(struct pending_callback **list,
+		size_t *num, struct os_file_watch *watch)
+{
+	for (size_t i = 0; i < *num; i++) {
+		if ((*list)[i].watch == watch)
+			return;
+	}
+
+	*list = brealloc(*list, (*num + 1) * sizeof(struct pending_callback));
+	(*list)[*num].watch = watch;
+	(*list)[*num].id    = watch->id;
+	(*num)++;
+}
+
+static bool watch_valid(struct os_file_watch *watch, uint64_t id)
+{
+	for (size_t i = 0; i < watches.num; i++) {
+		if (watches.array[i] == watch)
+			return watch->id == id;
+	}
+
+	return false;
+}
+
+/* called with callback_mutex held, a watch can be removed by an earlier
+ * callback in the same batch so each one is checked before its call */
+static void make_callbacks(struct pending_callback *list, size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		struct os_file_watch *watch = list[i].watch;
+		bool valid;
+
+		pthread_mutex_lock(&watch_mutex);
+		valid = watch_valid(watch, list[i].id);
+		pthread_mutex_unlock(&watch_mutex);
+
+		if (valid)
+			watch->callback(watch->param, watch->path);
+	}
+}
+
+static void poll_files(struct pending_callback **list, size_t *num)
+{
+	pthread_mutex_lock(&watch_mutex);
+
+	for (size_t i = 0; i < watches.num; i++) {
+		struct os_file_watch *watch = watches.array[i];
+		bool    exists = watch->exists;
+		int64_t mtime  = watch->mtime;
+		int64_t size   = watch->size;
+
+		if (!watch->polled)
+			continue;
+
+		get_file_info(watch);
+		if (watch->exists != exists || watch->mtime != mtime ||
+		    watch->size != size)
+			queue_callback(list, num, watch);
+	}
+
+	pthread_mutex_unlock(&watch_mutex);
+}
+
+#ifdef __linux__
+static void read_inotify_events(struct pending_callback **list, size_t *num)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for (;;) {
+		ssize_t len = read(inotify_fd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+
+		pthread_mutex_lock(&watch_mutex);
+
+		for (char *ptr = buf; ptr < buf + len;) {
+			const struct inotify_event *event = (void*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (!event->len)
+				continue;
+
+			for (size_t i = 0; i < watches.num; i++) {
+				struct os_file_watch *watch = watches.array[i];
+
+				if (watch->wd == event->wd &&
+				    strcmp(watch->name, event->name) == 0)
+					queue_callback(list, num, watch);
+			}
+		}
+
+		pthread_mutex_unlock(&watch_mutex);
+	}
+}
+
+static void wait_for_events(struct pending_callback **list, size_t *num)
+{
+	struct pollfd fds[2] = {
+		{wake_fd,    POLLIN, 0},
+		{inotify_fd, POLLIN, 0}
+	};
+	int timeout;
+
+	pthread_mutex_lock(&watch_mutex);
+	timeout = num_polled ? POLL_INTERVAL_MS : -1;
+	pthread_mutex_unlock(&watch_mutex);
+
+	if (poll(fds, inotify_fd != -1 ? 2 : 1, timeout) < 0) {
+		if (errno != EINTR)
+			os_sleep_ms(POLL_INTERVAL_MS);
+		return;
+	}
+
+	if (fds[0].revents & POLLIN) {
+		uint64_t val;
+		ssize_t ret = read(wake_fd, &val, sizeof(val));
+		UNUSED_PARAMETER(ret);
+	}
+
+	if (inotify_fd != -1 && (fds[1].revents & POLLIN))
+		read_inotify_events(list, num);
+}
+
+static inline const char *split_dir(const char *path, struct dstr *dir)
+{
+	const char *slash = strrchr(path, '/');
+
+	if (!slash) {
+		dstr_copy(dir, ".");
+		return path;
+	}
+
+	if (slash == path)
+		dstr_copy(dir, "/");
+	else
+		dstr_ncopy(dir, path, slash - path);
+
+	return slash + 1;
+}
+
+static void add_inotify_watch(struct os_file_watch *watch)
+{
+	struct dstr dir = {0};
+	struct watched_dir *wdir = NULL;
+	int wd;
+
+	watch->wd = -1;
+	watch->name = split_dir(watch->path, &dir);
+
+	if (inotify_fd == -1 || !*watch->name)
+		goto polled;
+
+	wd = inotify_add_watch(inotify_fd, dir.array, INOTIFY_MASK);
+	if (wd == -1) {
+		blog(LOG_DEBUG, "os_file_watch: Failed to watch directory "
+				"'%s', polling '%s' instead: %s",
+				dir.array, watch->path, strerror(errno));
+		goto polled;
+	}
+
+	for (size_t i = 0; i < watched_dirs.num; i++) {
+		if (watched_dirs.array[i].wd == wd) {
+			wdir = &watched_dirs.array[i];
+			break;
+		}
+	}
+
+	if (!wdir) {
+		wdir = da_push_back_new(watched_dirs);
+		wdir->wd = wd;
+	}
+
+	wdir->refs++;
+	watch->wd = wd;
+	dstr_free(&dir);
+	return;
+
+polled:
+	watch->polled = true;
+	dstr_free(&dir);
+}
+
+static void remove_inotify_watch(struct os_file_watch *watch)
+{
+	if (watch->wd == -1)
+		return;
+
+	for (size_t i = 0; i < watched_dirs.num; i++) {
+		struct watched_dir *wdir = &watched_dirs.array[i];
+
+		if (wdir->wd == watch->wd) {
+			if (--wdir->refs == 0) {
+				inotify_rm_watch(inotify_fd, wdir->wd);
+				da_erase(watched_dirs, i);
+			}
+			break;
+		}
+	}
+}
+
+static bool init_thread_data(void)
+{
+	wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_fd == -1)
+		return false;
+
+	inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (inotify_fd == -1)
+		blog(LOG_WARNING, "os_file_watch: inotify unavailable, "
+				"falling back to polling: %s",
+				strerror(errno));
+	return true;
+}
+
+static void free_thread_data(void)
+{
+	if (inotify_fd != -1)
+		close(inotify_fd);
+	if (wake_fd != -1)
+		close(wake_fd);
+	inotify_fd = -1;
+	wake_fd = -1;
+
+	da_free(watched_dirs);
+}
+
+#else
+
+static void wait_for_events(struct pending_callback **list, size_t *num)
+{
+	UNUSED_PARAMETER(list);
+	UNUSED_PARAMETER(num);
+
+	os_event_timedwait(wake_event, POLL_INTERVAL_MS);
+}
+
+static inline void add_inotify_watch(struct os_file_watch *watch)
+{
+	watch->polled = true;
+}
+
+static inline void remove_inotify_watch(struct os_file_watch *watch)
+{
+	UNUSED_PARAMETER(watch);
+}
+
+static bool init_thread_data(void)
+{
+	return os_event_init(&wake_event, OS_EVENT_TYPE_AUTO) == 0;
+}
+
+static void free_thread_data(void)
+{
+	os_event_destroy(wake_event);
+	wake_event = NULL;
+}
+
+#endif
+
+static void *file_watch_thread(void *unused)
+{
+	struct pending_callback *list = NULL;
+	uint64_t last_poll = os_gettime_ns();
+
+	os_set_thread_name("libobs: file watch thread");
+
+	for (;;) {
+		size_t num = 0;
+		uint64_t now;
+		bool stop;
+
+		wait_for_events(&list, &num);
+
+		now = os_gettime_ns();
+		if (now - last_poll >= POLL_INTERVAL_MS * 1000000ULL) {
+			poll_files(&list, &num);
+			last_poll = now;
+		}
+
+		if (num) {
+			pthread_mutex_lock(&callback_mutex);
+			make_callbacks(list, num);
+			pthread_mutex_unlock(&callback_mutex);
+		}
+
+		/* a callback can remove the last watch, the thread is then
+		 * joined by whoever uses the watches next */
+		pthread_mutex_lock(&watch_mutex);
+		stop = watch_thread_stop || !watches.num;
+		watch_thread_stop = stop;
+		pthread_mutex_unlock(&watch_mutex);
+
+		if (stop)
+			break;
+	}
+
+	bfree(list);
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+/* called with thread_mutex held, once watch_thread_stop has been set */
+static void join_thread(void)
+{
+	pthread_join(watch_thread, NULL);
+
+	pthread_mutex_lock(&watch_mutex);
+	free_thread_data();
+	watch_thread_active = false;
+	watch_thread_stop = false;
+	if (!watches.num)
+		da_free(watches);
+	pthread_mutex_unlock(&watch_mutex);
+}
+
+/* called with thread_mutex and watch_mutex held */
+static bool start_thread(void)
+{
+	if (watch_thread_active && watch_thread_stop) {
+		pthread_mutex_unlock(&watch_mutex);
+		join_thread();
+		pthread_mutex_lock(&watch_mutex);
+	}
+
+	if (watch_thread_active)
+		return true;
+
+	if (!init_thread_data())
+		goto fail;
+	if (pthread_create(&watch_thread, NULL, file_watch_thread, NULL) != 0)
+		goto fail;
+
+	watch_thread_active = true;
+	return true;
+
+fail:
+	blog(LOG_ERROR, "os_file_watch: Failed to start watch thread");
+	free_thread_data();
+	return false;
+}
+
+os_file_watch_t *os_file_watch_add(const char *path,
+		os_file_watch_cb_t callback, void *param)
+{
+	struct os_file_watch *watch;
+	bool polled;
+
+	if (!path || !*path || !callback)
+		return NULL;
+
+	pthread_mutex_lock(&thread_mutex);
+	pthread_mutex_lock(&watch_mutex);
+
+	if (!start_thread()) {
+		pthread_mutex_unlock(&watch_mutex);
+		pthread_mutex_unlock(&thread_mutex);
+		return NULL;
+	}
+
+	watch = bzalloc(sizeof(struct os_file_watch));
+	watch->id       = next_watch_id++;
+	watch->path     = bstrdup(path);
+	watch->callback = callback;
+	watch->param    = param;
+
+	get_file_info(watch);
+	add_inotify_watch(watch);
+	polled = watch->polled;
+	if (polled)
+		num_polled++;
+
+	da_push_back(watches, &watch);
+
+	pthread_mutex_unlock(&watch_mutex);
+
+	/* lets the thread pick up the poll timeout for polled files (the
+	 * watch itself may already have been removed by its callback) */
+	if (polled)
+		wake_thread();
+
+	pthread_mutex_unlock(&thread_mutex);
+	return watch;
+}
+
+static inline bool on_watch_thread(void)
+{
+	bool on_thread;
+
+	pthread_mutex_lock(&watch_mutex);
+	on_thread = watch_thread_active &&
+		pthread_equal(pthread_self(), watch_thread);
+	pthread_mutex_unlock(&watch_mutex);
+
+	return on_thread;
+}
+
+void os_file_watch_remove(os_file_watch_t *watch)
+{
+	bool from_callback;
+	bool last = false;
+
+	if (!watch)
+		return;
+
+	/* the thread stops itself after the callback if this was the last
+	 * watch, it can't be joined from here */
+	from_callback = on_watch_thread();
+	if (!from_callback)
+		pthread_mutex_lock(&thread_mutex);
+
+	pthread_mutex_lock(&watch_mutex);
+
+	da_erase_item(watches, &watch);
+	remove_inotify_watch(watch);
+	if (watch->polled)
+		num_polled--;
+
+	if (!from_callback && watch_thread_active && !watches.num) {
+		watch_thread_stop = true;
+		last = true;
+	}
+
+	pthread_mutex_unlock(&watch_mutex);
+
+	/* stopping the thread also waits for any callback in progress */
+	if (last) {
+		wake_thread();
+		join_thread();
+	}
+
+	if (!from_callback)
+		pthread_mutex_unlock(&thread_mutex);
+
+	if (!from_callback && !last) {
+		pthread_mutex_lock(&callback_mutex);
+		pthread_mutex_unlock(&callback_mutex);
+	}
+
+	bfree(watch->path);
+	bfree(watch);
+}
+
+void os_file_watch_shutdown(void)
+{
+	bool active;
+
+	pthread_mutex_lock(&thread_mutex);
+	pthread_mutex_lock(&watch_mutex);
+
+	if (watches.num)
+		blog(LOG_WARNING, "os_file_watch: %u watches still active on "
+				"shutdown", (unsigned)watches.num);
+
+	active = watch_thread_active;
+	if (active)
+		watch_thread_stop = true;
+
+	pthread_mutex_unlock(&watch_mutex);
+
+	if (active) {
+		wake_thread();
+		join_thread();
+	}
+
+	pthread_mutex_unlock(&thread_mutex);
+}
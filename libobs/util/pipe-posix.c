@@ -14,15 +14,32 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include "bmem.h"
 #include "pipe.h"
 
+/* buffers passed to each writev call */
+#define MAX_IOV 64
+
+extern char **environ;
+
 struct os_process_pipe {
 	bool read_pipe;
 	FILE *file;
+
+	/* set if the process wasn't started with popen */
+	pid_t pid;
 };
 
 os_process_pipe_t *os_process_pipe_create(const char *cmd_line,
@@ -47,12 +64,128 @@ os_process_pipe_t *os_process_pipe_create(const char *cmd_line,
 	return out;
 }
 
+static int create_cloexec_pipe(int fds[2])
+{
+#ifdef __linux__
+	return pipe2(fds, O_CLOEXEC);
+#else
+	if (pipe(fds) != 0)
+		return -1;
+
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
+os_process_pipe_t *os_process_pipe_create_inherit(const char *cmd_line,
+		const char *type, const int *inherit_fds, size_t num_fds)
+{
+	struct os_process_pipe pipe = {0};
+	struct os_process_pipe *out;
+	posix_spawn_file_actions_t actions;
+	char *argv[] = {"sh", "-c", (char*)cmd_line, NULL};
+	int fds[2];
+	int child_fd, parent_fd;
+	int temp_fd;
+	int ret;
+
+	if (!cmd_line || !type) {
+		return NULL;
+	}
+
+	/* temp_fd ends up above every descriptor involved */
+	temp_fd = OS_PROCESS_PIPE_FIRST_FD + (int)num_fds;
+	for (size_t i = 0; i < num_fds; i++) {
+		if (fcntl(inherit_fds[i], F_GETFD) == -1)
+			return NULL;
+		if (inherit_fds[i] >= temp_fd)
+			temp_fd = inherit_fds[i] + 1;
+	}
+
+	pipe.read_pipe = *type == 'r';
+
+	if (create_cloexec_pipe(fds) != 0) {
+		return NULL;
+	}
+
+	child_fd  = pipe.read_pipe ? fds[1] : fds[0];
+	parent_fd = pipe.read_pipe ? fds[0] : fds[1];
+
+	if (fds[0] >= temp_fd)
+		temp_fd = fds[0] + 1;
+	if (fds[1] >= temp_fd)
+		temp_fd = fds[1] + 1;
+
+	/* the descriptors are dup'd in the child only, so they stay
+	 * close-on-exec for any other process started in the meantime.  dup2
+	 * to the same number doesn't clear close-on-exec everywhere, so they
+	 * are moved out of the way to unused numbers first, then to their
+	 * final numbers (which may be taken by one of the originals) */
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, child_fd,
+			pipe.read_pipe ? STDOUT_FILENO : STDIN_FILENO);
+	for (size_t i = 0; i < num_fds; i++)
+		posix_spawn_file_actions_adddup2(&actions, inherit_fds[i],
+				temp_fd + (int)i);
+	for (size_t i = 0; i < num_fds; i++) {
+		posix_spawn_file_actions_adddup2(&actions, temp_fd + (int)i,
+				OS_PROCESS_PIPE_FIRST_FD + (int)i);
+		posix_spawn_file_actions_addclose(&actions, temp_fd + (int)i);
+	}
+
+	ret = posix_spawn(&pipe.pid, "/bin/sh", &actions, NULL, argv,
+			environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(child_fd);
+
+	if (ret != 0) {
+		close(parent_fd);
+		return NULL;
+	}
+
+	pipe.file = fdopen(parent_fd, type);
+	if (!pipe.file) {
+		close(parent_fd);
+		waitpid(pipe.pid, NULL, 0);
+		return NULL;
+	}
+
+	/* writes go straight to the pipe, the process may be waiting on
+	 * them while it reads the inherited descriptors */
+	setvbuf(pipe.file, NULL, _IONBF, 0);
+
+	out = bmalloc(sizeof(pipe));
+	*out = pipe;
+	return out;
+}
+
+static int wait_process(pid_t pid)
+{
+	int status;
+
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR)
+			return -1;
+	}
+
+	return status;
+}
+
 int os_process_pipe_destroy(os_process_pipe_t *pp)
 {
 	int ret = 0;
 
 	if (pp) {
-		int status = pclose(pp->file);
+		int status;
+
+		if (pp->pid) {
+			fclose(pp->file);
+			status = wait_process(pp->pid);
+		} else {
+			status = pclose(pp->file);
+		}
+
 		if (WIFEXITED(status))
 			ret = (int)(char)WEXITSTATUS(status);
 		bfree(pp);
@@ -85,3 +218,62 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return fwrite(data, 1, len, pp->file);
 }
+
+size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_process_pipe_buf *bufs, size_t num_bufs)
+{
+	struct iovec iov[MAX_IOV];
+	size_t total = 0;
+	size_t offset = 0;
+	size_t idx = 0;
+	int fd;
+
+	if (!pp) {
+		return 0;
+	}
+	if (pp->read_pipe) {
+		return 0;
+	}
+
+	/* data from os_process_pipe_write may still be buffered */
+	if (fflush(pp->file) != 0) {
+		return 0;
+	}
+
+	fd = fileno(pp->file);
+
+	while (idx < num_bufs) {
+		size_t written;
+		ssize_t ret;
+		int count = 0;
+
+		for (size_t i = idx; i < num_bufs && count < MAX_IOV; i++) {
+			size_t skip = i == idx ? offset : 0;
+			iov[count].iov_base = (void*)(bufs[i].data + skip);
+			iov[count].iov_len  = bufs[i].size - skip;
+			count++;
+		}
+
+		ret = writev(fd, iov, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		written = (size_t)ret;
+		total += written;
+
+		/* skip past what was written, a pipe may take less than all
+		 * of it */
+		while (idx < num_bufs && written >= bufs[idx].size - offset) {
+			written -= bufs[idx].size - offset;
+			offset = 0;
+			idx++;
+		}
+
+		offset += written;
+	}
+
+	return total;
+}
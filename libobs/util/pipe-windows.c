@@ -179,3 +179,25 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return 0;
 }
+
+size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_process_pipe_buf *bufs, size_t num_bufs)
+{
+	size_t total = 0;
+
+	/* WriteFileGather only works on page aligned file data, not pipes */
+	for (size_t i = 0; i < num_bufs; i++) {
+		size_t written;
+
+		if (!bufs[i].size)
+			continue;
+
+		written = os_process_pipe_write(pp, bufs[i].data, bufs[i].size);
+		total += written;
+
+		if (written != bufs[i].size)
+			break;
+	}
+
+	return total;
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pipe.h"
+#include "threading.h"
+#include "platform.h"
+#include "darray.h"
+#include "bmem.h"
+#include "base.h"
+
+#define RATE_INTERVAL_NS 1000000000ULL
+
+struct pipe_release {
+	os_process_pipe_release_t release;
+	void                      *param;
+};
+
+struct pipe_queue {
+	DARRAY(struct os_process_pipe_buf) bufs;
+	DARRAY(struct pipe_release)        releases;
+};
+
+struct os_process_pipe_writer {
+	os_process_pipe_t     *pipe;
+	pthread_t             thread;
+	bool                  thread_active;
+
+	/* serializes os_process_pipe_writer_write calls */
+	pthread_mutex_t       write_mutex;
+
+	pthread_mutex_t       mutex;
+	os_event_t            *data_event;
+	os_event_t            *space_event;
+	bool                  stop;
+	bool                  failed;
+
+	/* producers append to pending, the thread swaps it with writing */
+	struct pipe_queue     pending;
+	struct pipe_queue     writing;
+	size_t                queued;
+	size_t                max_queued;
+
+	uint64_t              max_stall_ns;
+	uint64_t              total_writes;
+	uint64_t              total_bytes;
+
+	uint64_t              rate_ts;
+	uint64_t              rate_writes;
+	double                writes_per_sec;
+};
+
+static inline void swap_queues(struct os_process_pipe_writer *writer)
+{
+	struct pipe_queue tmp = writer->pending;
+	writer->pending = writer->writing;
+	writer->writing = tmp;
+}
+
+static inline bool queue_empty(const struct pipe_queue *queue)
+{
+	return !queue->bufs.num && !queue->releases.num;
+}
+
+static void release_queue(struct pipe_queue *queue)
+{
+	for (size_t i = 0; i < queue->releases.num; i++) {
+		struct pipe_release *rel = queue->releases.array + i;
+		rel->release(rel->param);
+	}
+
+	da_resize(queue->bufs, 0);
+	da_resize(queue->releases, 0);
+}
+
+static inline void free_queue(struct pipe_queue *queue)
+{
+	release_queue(queue);
+	da_free(queue->bufs);
+	da_free(queue->releases);
+}
+
+static void *writer_thread(void *data)
+{
+	struct os_process_pipe_writer *writer = data;
+
+	os_set_thread_name("os_process_pipe_writer");
+
+	for (;;) {
+		size_t size;
+		bool success;
+
+		pthread_mutex_lock(&writer->mutex);
+		while (queue_empty(&writer->pending) && !writer->stop) {
+			pthread_mutex_unlock(&writer->mutex);
+			os_event_wait(writer->data_event);
+			pthread_mutex_lock(&writer->mutex);
+		}
+
+		if (queue_empty(&writer->pending)) {
+			pthread_mutex_unlock(&writer->mutex);
+			break;
+		}
+
+		swap_queues(writer);
+		size = writer->queued;
+		pthread_mutex_unlock(&writer->mutex);
+
+		/* queued only counts what's pending, and was all swapped */
+		success = os_process_pipe_write_bufs(writer->pipe,
+				writer->writing.bufs.array,
+				writer->writing.bufs.num) == size;
+		release_queue(&writer->writing);
+
+		pthread_mutex_lock(&writer->mutex);
+		writer->queued -= size;
+		writer->total_writes++;
+		writer->total_bytes += size;
+
+		if (!success) {
+			writer->failed = true;
+			writer->queued = 0;
+			swap_queues(writer);
+		}
+		pthread_mutex_unlock(&writer->mutex);
+
+		os_event_signal(writer->space_event);
+
+		if (!success) {
+			release_queue(&writer->writing);
+			blog(LOG_WARNING, "os_process_pipe_writer: Failed to "
+					"write %u bytes to pipe", (unsigned)size);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+os_process_pipe_writer_t *os_process_pipe_writer_create(
+		os_process_pipe_t *pp, size_t max_queued)
+{
+	struct os_process_pipe_writer *writer;
+
+	if (!pp)
+		return NULL;
+
+	writer = bzalloc(sizeof(struct os_process_pipe_writer));
+	writer->pipe = pp;
+	writer->max_queued = max_queued;
+	writer->rate_ts = os_gettime_ns();
+	pthread_mutex_init_value(&writer->write_mutex);
+	pthread_mutex_init_value(&writer->mutex);
+
+	if (pthread_mutex_init(&writer->write_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&writer->data_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&writer->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+		goto fail;
+
+	writer->thread_active = true;
+	return writer;
+
+fail:
+	blog(LOG_WARNING, "os_process_pipe_writer_create: Failed to create "
+			"writer");
+	os_process_pipe_writer_destroy(writer);
+	return NULL;
+}
+
+void os_process_pipe_writer_destroy(os_process_pipe_writer_t *writer)
+{
+	if (!writer)
+		return;
+
+	if (writer->thread_active) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->stop = true;
+		pthread_mutex_unlock(&writer->mutex);
+
+		os_event_signal(writer->data_event);
+		pthread_join(writer->thread, NULL);
+	}
+
+	free_queue(&writer->pending);
+	free_queue(&writer->writing);
+	os_event_destroy(writer->data_event);
+	os_event_destroy(writer->space_event);
+	pthread_mutex_destroy(&writer->mutex);
+	pthread_mutex_destroy(&writer->write_mutex);
+	bfree(writer);
+}
+
+bool os_process_pipe_writer_write(os_process_pipe_writer_t *writer,
+		const struct os_process_pipe_buf *bufs, size_t num_bufs,
+		os_process_pipe_release_t release, void *param)
+{
+	uint64_t stall_start = 0;
+	size_t size = 0;
+	bool success;
+
+	if (!writer) {
+		if (release)
+			release(param);
+		return false;
+	}
+
+	for (size_t i = 0; i < num_bufs; i++)
+		size += bufs[i].size;
+
+	pthread_mutex_lock(&writer->write_mutex);
+	pthread_mutex_lock(&writer->mutex);
+
+	/* a write larger than max_queued still goes through once the queue
+	 * is empty */
+	while (!writer->failed && writer->queued &&
+	       writer->queued + size > writer->max_queued) {
+		if (!stall_start)
+			stall_start = os_gettime_ns();
+
+		pthread_mutex_unlock(&writer->mutex);
+		os_event_wait(writer->space_event);
+		pthread_mutex_lock(&writer->mutex);
+	}
+
+	if (stall_start) {
+		uint64_t stall = os_gettime_ns() - stall_start;
+		if (stall > writer->max_stall_ns)
+			writer->max_stall_ns = stall;
+	}
+
+	success = !writer->failed;
+	if (success) {
+		for (size_t i = 0; i < num_bufs; i++) {
+			if (bufs[i].size)
+				da_push_back(writer->pending.bufs, &bufs[i]);
+		}
+
+		if (release) {
+			struct pipe_release rel = {release, param};
+			da_push_back(writer->pending.releases, &rel);
+		}
+
+		writer->queued += size;
+	}
+
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_mutex_unlock(&writer->write_mutex);
+
+	if (success)
+		os_event_signal(writer->data_event);
+	else if (release)
+		release(param);
+	return success;
+}
+
+void os_process_pipe_writer_get_stats(os_process_pipe_writer_t *writer,
+		struct os_process_pipe_writer_stats *stats)
+{
+	uint64_t ts = os_gettime_ns();
+
+	if (!writer || !stats)
+		return;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	if (ts - writer->rate_ts >= RATE_INTERVAL_NS) {
+		uint64_t writes = writer->total_writes - writer->rate_writes;
+
+		writer->writes_per_sec = (double)writes * 1000000000.0 /
+			(double)(ts - writer->rate_ts);
+		writer->rate_ts = ts;
+		writer->rate_writes = writer->total_writes;
+	}
+
+	stats->queued_bytes   = writer->queued;
+	stats->max_stall_ns   = writer->max_stall_ns;
+	stats->total_writes   = writer->total_writes;
+	stats->total_bytes    = writer->total_bytes;
+	stats->writes_per_sec = writer->writes_per_sec;
+
+	pthread_mutex_unlock(&writer->mutex);
+}
@@ -25,15 +25,84 @@ extern "C" {
 struct os_process_pipe;
 typedef struct os_process_pipe os_process_pipe_t;
 
+struct os_process_pipe_buf {
+	const uint8_t *data;
+	size_t        size;
+};
+
 EXPORT os_process_pipe_t *os_process_pipe_create(const char *cmd_line,
 		const char *type);
 EXPORT int os_process_pipe_destroy(os_process_pipe_t *pp);
 
+#ifndef _WIN32
+/** Descriptor number of the first inherited descriptor in the process */
+#define OS_PROCESS_PIPE_FIRST_FD 3
+
+/**
+ * Like os_process_pipe_create, but the process also inherits inherit_fds,
+ * even if they are close-on-exec.  The process receives inherit_fds[i] as
+ * descriptor OS_PROCESS_PIPE_FIRST_FD + i.  The descriptors stay
+ * close-on-exec in this process, and writes to the pipe are not buffered.
+ *
+ * Returns NULL if any of inherit_fds isn't a valid descriptor.
+ */
+EXPORT os_process_pipe_t *os_process_pipe_create_inherit(const char *cmd_line,
+		const char *type, const int *inherit_fds, size_t num_fds);
+#endif
+
 EXPORT size_t os_process_pipe_read(os_process_pipe_t *pp, uint8_t *data,
 		size_t len);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 		size_t len);
 
+/** Writes the buffers in order, with a single system call where possible */
+EXPORT size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_process_pipe_buf *bufs, size_t num_bufs);
+
+/*
+ * Asynchronous process pipe writer
+ *
+ *   Queues buffers and writes them to the pipe from a separate thread, so a
+ * slow reader doesn't block the thread producing the data.  The data isn't
+ * copied, and everything queued while the previous write was in progress is
+ * written with a single os_process_pipe_write_bufs call.  Once max_queued
+ * bytes are waiting, os_process_pipe_writer_write blocks until the writer
+ * thread catches up, which also limits how much data
+ * os_process_pipe_writer_destroy has to wait for.
+ */
+
+struct os_process_pipe_writer;
+typedef struct os_process_pipe_writer os_process_pipe_writer_t;
+
+typedef void (*os_process_pipe_release_t)(void *param);
+
+struct os_process_pipe_writer_stats {
+	uint64_t queued_bytes;
+	uint64_t max_stall_ns;   /* longest time a write was blocked for */
+	uint64_t total_writes;   /* calls to os_process_pipe_write_bufs */
+	uint64_t total_bytes;
+	double   writes_per_sec;
+};
+
+EXPORT os_process_pipe_writer_t *os_process_pipe_writer_create(
+		os_process_pipe_t *pp, size_t max_queued);
+
+/** Writes out any queued data, then stops the writer (not the pipe) */
+EXPORT void os_process_pipe_writer_destroy(os_process_pipe_writer_t *writer);
+
+/**
+ * Queues the buffers without copying them.  The data has to stay valid until
+ * release is called with param, which happens once it has been written or
+ * dropped (possibly before this returns).  Returns false if a previous write
+ * to the pipe failed, in which case nothing more will be written.
+ */
+EXPORT bool os_process_pipe_writer_write(os_process_pipe_writer_t *writer,
+		const struct os_process_pipe_buf *bufs, size_t num_bufs,
+		os_process_pipe_release_t release, void *param);
+
+EXPORT void os_process_pipe_writer_get_stats(os_process_pipe_writer_t *writer,
+		struct os_process_pipe_writer_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -115,6 +115,14 @@ struct os_cpu_usage_info {
 	DWORD core_count;
 };
 
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+}
+
 os_cpu_usage_info_t *os_cpu_usage_info_start(void)
 {
 	struct os_cpu_usage_info *info = bzalloc(sizeof(*info));
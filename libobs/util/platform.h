@@ -85,6 +85,8 @@ EXPORT os_cpu_usage_info_t *os_cpu_usage_info_start(void);
 EXPORT double              os_cpu_usage_info_query(os_cpu_usage_info_t *info);
 EXPORT void                os_cpu_usage_info_destroy(os_cpu_usage_info_t *info);
 
+EXPORT int os_get_logical_cores(void);
+
 typedef const void os_performance_token_t;
 EXPORT os_performance_token_t *os_request_high_performance(const char *reason);
 EXPORT void                   os_end_high_performance(os_performance_token_t *);
@@ -160,6 +162,34 @@ EXPORT void os_inhibit_sleep_destroy(os_inhibit_t *info);
 
 EXPORT void os_breakpoint(void);
 
+/*
+ * File watching
+ *
+ *   Calls a callback when a file is written, created, removed or replaced.
+ * All watches share one thread, which makes the callbacks.  On Linux it
+ * waits on inotify for the file's directory, so files replaced by a rename
+ * are picked up as well.  Elsewhere, or if a directory can't be watched,
+ * the file's size and modification time are checked once a second.
+ */
+
+struct os_file_watch;
+typedef struct os_file_watch os_file_watch_t;
+
+/* called on the watch thread, callbacks can remove watches but not add
+ * them */
+typedef void (*os_file_watch_cb_t)(void *param, const char *path);
+
+EXPORT os_file_watch_t *os_file_watch_add(const char *path,
+		os_file_watch_cb_t callback, void *param);
+
+/* no callbacks are made for the watch once this returns, unless called from
+ * the watch's own callback.  the thread is stopped once the last watch has
+ * been removed */
+EXPORT void os_file_watch_remove(os_file_watch_t *watch);
+
+/* stops the watch thread, called by obs_shutdown */
+EXPORT void os_file_watch_shutdown(void);
+
 #ifdef _MSC_VER
 #define strtoll _strtoi64
 #if _MSC_VER < 1900
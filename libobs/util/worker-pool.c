@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "worker-pool.h"
+#include "threading.h"
+#include "platform.h"
+#include "darray.h"
+#include "bmem.h"
+#include "base.h"
+
+struct worker_pool {
+	char                  *name;
+	DARRAY(pthread_t)     threads;
+
+	/* serializes worker_pool_run calls */
+	pthread_mutex_t       run_mutex;
+	os_sem_t              *start_sem;
+	os_event_t            *done_event;
+	volatile bool         stop;
+
+	/* current job */
+	worker_pool_job_t     job;
+	void                  *param;
+	long                  count;
+	volatile long         next_idx;
+	volatile long         pending_workers;
+};
+
+static inline void do_jobs(struct worker_pool *pool)
+{
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&pool->next_idx) - 1) < pool->count)
+		pool->job(pool->param, (size_t)idx);
+}
+
+static void *worker_thread(void *data)
+{
+	struct worker_pool *pool = data;
+
+	os_set_thread_name(pool->name);
+
+	while (os_sem_wait(pool->start_sem) == 0) {
+		if (pool->stop)
+			break;
+
+		do_jobs(pool);
+
+		if (os_atomic_dec_long(&pool->pending_workers) == 0)
+			os_event_signal(pool->done_event);
+	}
+
+	return NULL;
+}
+
+worker_pool_t *worker_pool_create(const char *name, size_t num_threads)
+{
+	struct worker_pool *pool = bzalloc(sizeof(struct worker_pool));
+
+	if (!num_threads) {
+		int cores = os_get_logical_cores();
+		num_threads = cores > 1 ? (size_t)(cores - 1) : 1;
+	}
+
+	pool->name = bstrdup(name ? name : "worker pool");
+	pthread_mutex_init_value(&pool->run_mutex);
+
+	if (pthread_mutex_init(&pool->run_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&pool->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	for (size_t i = 0; i < num_threads; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, worker_thread, pool) != 0) {
+			blog(LOG_WARNING, "worker_pool_create: Failed to "
+					"create thread %u for '%s'",
+					(unsigned)i, pool->name);
+			break;
+		}
+
+		da_push_back(pool->threads, &thread);
+	}
+
+	return pool;
+
+fail:
+	worker_pool_destroy(pool);
+	return NULL;
+}
+
+void worker_pool_destroy(worker_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pool->stop = true;
+	for (size_t i = 0; i < pool->threads.num; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		pthread_join(pool->threads.array[i], NULL);
+
+	da_free(pool->threads);
+	os_event_destroy(pool->done_event);
+	os_sem_destroy(pool->start_sem);
+	pthread_mutex_destroy(&pool->run_mutex);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t worker_pool_num_threads(const worker_pool_t *pool)
+{
+	return pool ? pool->threads.num : 0;
+}
+
+void worker_pool_run(worker_pool_t *pool, worker_pool_job_t job,
+		void *param, size_t count)
+{
+	size_t workers;
+
+	if (!count)
+		return;
+
+	if (!pool || !pool->threads.num || count == 1) {
+		for (size_t i = 0; i < count; i++)
+			job(param, i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->run_mutex);
+
+	/* the calling thread takes one share of the work itself */
+	workers = count - 1;
+	if (workers > pool->threads.num)
+		workers = pool->threads.num;
+
+	pool->job             = job;
+	pool->param           = param;
+	pool->count           = (long)count;
+	pool->next_idx        = 0;
+	pool->pending_workers = (long)workers;
+
+	for (size_t i = 0; i < workers; i++)
+		os_sem_post(pool->start_sem);
+
+	do_jobs(pool);
+
+	/* wait for every woken worker to leave the job, so none of them can
+	 * pick up the state of the next one */
+	os_event_wait(pool->done_event);
+
+	pthread_mutex_unlock(&pool->run_mutex);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fork/join worker pool
+ *
+ *   Runs a job over a range of indices on a set of persistent worker threads.
+ * The calling thread takes part in the work as well, and indices are handed
+ * out one at a time from a shared counter, so threads that finish early keep
+ * taking work from the ones that are still busy.
+ */
+
+struct worker_pool;
+typedef struct worker_pool worker_pool_t;
+
+typedef void (*worker_pool_job_t)(void *param, size_t idx);
+
+/**
+ * Creates a worker pool
+ *
+ * @param  name         Name used for the worker threads
+ * @param  num_threads  Number of worker threads, or 0 to use one less than
+ *                      the number of logical cores
+ */
+EXPORT worker_pool_t *worker_pool_create(const char *name, size_t num_threads);
+EXPORT void worker_pool_destroy(worker_pool_t *pool);
+
+/** Returns the number of worker threads, not counting the calling thread */
+EXPORT size_t worker_pool_num_threads(const worker_pool_t *pool);
+
+/**
+ * Calls job(param, idx) for every idx in [0, count) and returns when all
+ * calls have completed.  Calls to this function on the same pool are
+ * serialized.  If pool is NULL, the job is run on the calling thread.
+ */
+EXPORT void worker_pool_run(worker_pool_t *pool, worker_pool_job_t job,
+		void *param, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
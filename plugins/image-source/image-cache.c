@@ -0,0 +1,264 @@
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include "image-cache.h"
+
+#define DECODE_THREADS 2
+
+struct image_cache_entry {
+	char                 *file;
+	time_t               timestamp;
+	long                 refs;
+
+	/* set by the decode thread, data is freed once the texture has been
+	 * created from it */
+	bool                 decoded;
+	uint8_t              *data;
+	enum gs_color_format format;
+	uint32_t             cx;
+	uint32_t             cy;
+
+	gs_texture_t         *tex;
+};
+
+struct image_cache {
+	pthread_mutex_t                   mutex;
+	DARRAY(struct image_cache_entry*) entries;
+
+	/* each queued entry holds a reference until it has been decoded */
+	DARRAY(struct image_cache_entry*) queue;
+	os_sem_t                          *queue_sem;
+	bool                              stop;
+
+	pthread_t                         threads[DECODE_THREADS];
+	size_t                            num_threads;
+};
+
+static struct image_cache cache;
+
+static void entry_destroy(struct image_cache_entry *entry)
+{
+	if (entry->tex) {
+		obs_enter_graphics();
+		gs_texture_destroy(entry->tex);
+		obs_leave_graphics();
+	}
+
+	bfree(entry->data);
+	bfree(entry->file);
+	bfree(entry);
+}
+
+void image_cache_release(struct image_cache_entry *entry)
+{
+	bool destroy;
+
+	if (!entry)
+		return;
+
+	pthread_mutex_lock(&cache.mutex);
+	destroy = --entry->refs == 0;
+	if (destroy)
+		da_erase_item(cache.entries, &entry);
+	pthread_mutex_unlock(&cache.mutex);
+
+	if (destroy)
+		entry_destroy(entry);
+}
+
+static void *decode_thread(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	os_set_thread_name("image-source: decode thread");
+
+	for (;;) {
+		struct image_cache_entry *entry;
+		enum gs_color_format format = GS_UNKNOWN;
+		uint32_t cx = 0, cy = 0;
+		uint8_t *data = NULL;
+		bool unused_entry;
+
+		os_sem_wait(cache.queue_sem);
+
+		pthread_mutex_lock(&cache.mutex);
+		if (cache.stop) {
+			pthread_mutex_unlock(&cache.mutex);
+			break;
+		}
+
+		entry = cache.queue.array[0];
+		da_erase(cache.queue, 0);
+
+		/* skip decoding if the queue holds the only reference */
+		unused_entry = entry->refs == 1;
+		pthread_mutex_unlock(&cache.mutex);
+
+		if (!unused_entry) {
+			uint64_t start = os_gettime_ns();
+
+			data = gs_create_texture_file_data(entry->file,
+					&format, &cx, &cy);
+			if (data)
+				blog(LOG_DEBUG, "image-source: decoded '%s' "
+						"(%ux%u) in %.2f ms",
+						entry->file, cx, cy,
+						(double)(os_gettime_ns() - start)
+						/ 1000000.0);
+		}
+
+		pthread_mutex_lock(&cache.mutex);
+		entry->data    = data;
+		entry->format  = format;
+		entry->cx      = cx;
+		entry->cy      = cy;
+		entry->decoded = true;
+		pthread_mutex_unlock(&cache.mutex);
+
+		image_cache_release(entry);
+	}
+
+	return NULL;
+}
+
+bool image_cache_init(void)
+{
+	pthread_mutex_init_value(&cache.mutex);
+
+	if (pthread_mutex_init(&cache.mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&cache.queue_sem, 0) != 0)
+		goto fail;
+
+	for (size_t i = 0; i < DECODE_THREADS; i++) {
+		if (pthread_create(&cache.threads[i], NULL, decode_thread,
+					NULL) != 0)
+			goto fail;
+		cache.num_threads++;
+	}
+
+	return true;
+
+fail:
+	blog(LOG_ERROR, "image-source: Failed to start decode threads");
+	image_cache_free();
+	return false;
+}
+
+void image_cache_free(void)
+{
+	pthread_mutex_lock(&cache.mutex);
+	cache.stop = true;
+	pthread_mutex_unlock(&cache.mutex);
+
+	for (size_t i = 0; i < cache.num_threads; i++)
+		os_sem_post(cache.queue_sem);
+	for (size_t i = 0; i < cache.num_threads; i++)
+		pthread_join(cache.threads[i], NULL);
+	cache.num_threads = 0;
+
+	while (cache.queue.num) {
+		struct image_cache_entry *entry = cache.queue.array[0];
+		da_erase(cache.queue, 0);
+		image_cache_release(entry);
+	}
+
+	if (cache.entries.num)
+		blog(LOG_WARNING, "image-source: %u cached images still in "
+				"use on shutdown",
+				(unsigned)cache.entries.num);
+
+	da_free(cache.queue);
+	da_free(cache.entries);
+	os_sem_destroy(cache.queue_sem);
+	cache.queue_sem = NULL;
+	pthread_mutex_destroy(&cache.mutex);
+}
+
+static struct image_cache_entry *find_entry(const char *file,
+		time_t timestamp)
+{
+	for (size_t i = 0; i < cache.entries.num; i++) {
+		struct image_cache_entry *entry = cache.entries.array[i];
+
+		if (entry->timestamp == timestamp &&
+		    strcmp(entry->file, file) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+struct image_cache_entry *image_cache_acquire(const char *file,
+		time_t timestamp)
+{
+	struct image_cache_entry *entry;
+
+	if (!file || !*file)
+		return NULL;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	entry = find_entry(file, timestamp);
+	if (entry) {
+		entry->refs++;
+		pthread_mutex_unlock(&cache.mutex);
+		return entry;
+	}
+
+	entry = bzalloc(sizeof(struct image_cache_entry));
+	entry->file      = bstrdup(file);
+	entry->timestamp = timestamp;
+
+	/* one for the caller, one for the queue */
+	entry->refs      = 2;
+
+	da_push_back(cache.entries, &entry);
+	da_push_back(cache.queue, &entry);
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	os_sem_post(cache.queue_sem);
+	return entry;
+}
+
+bool image_cache_ready(struct image_cache_entry *entry)
+{
+	bool ready;
+
+	pthread_mutex_lock(&cache.mutex);
+	ready = entry->decoded;
+	pthread_mutex_unlock(&cache.mutex);
+
+	return ready;
+}
+
+gs_texture_t *image_cache_get_texture(struct image_cache_entry *entry,
+		uint32_t *cx, uint32_t *cy)
+{
+	gs_texture_t *tex;
+	uint8_t *data;
+
+	pthread_mutex_lock(&cache.mutex);
+	tex = entry->tex;
+	data = entry->data;
+	entry->data = NULL;
+	pthread_mutex_unlock(&cache.mutex);
+
+	/* upload without holding the cache lock.  callers hold the graphics
+	 * context, so the data can't be taken by anyone else meanwhile */
+	if (!tex && data) {
+		tex = gs_texture_create(entry->cx, entry->cy, entry->format, 1,
+				(const uint8_t**)&data, 0);
+		bfree(data);
+
+		pthread_mutex_lock(&cache.mutex);
+		entry->tex = tex;
+		pthread_mutex_unlock(&cache.mutex);
+	}
+
+	*cx = tex ? entry->cx : 0;
+	*cy = tex ? entry->cy : 0;
+
+	return tex;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <obs-module.h>
+#include <time.h>
+
+/*
+ * Decoded image cache
+ *
+ *   Images are decoded to memory on a small pool of background threads, so
+ * loading a large file doesn't stall the graphics thread.  Entries are keyed
+ * by path and modification time and shared between all sources using the
+ * same file.  The texture is created from the decoded data by the first
+ * image_cache_get_texture call, and destroyed with the last reference.
+ */
+
+struct image_cache_entry;
+
+extern bool image_cache_init(void);
+extern void image_cache_free(void);
+
+/* returns a new reference, queueing the file for decoding if it isn't
+ * cached yet */
+extern struct image_cache_entry *image_cache_acquire(const char *file,
+		time_t timestamp);
+
+/* can be called from any thread */
+extern void image_cache_release(struct image_cache_entry *entry);
+
+/* true once decoding has finished, whether or not it succeeded */
+extern bool image_cache_ready(struct image_cache_entry *entry);
+
+/* requires the graphics context.  returns NULL while the image is still
+ * being decoded, or if it failed to load */
+extern gs_texture_t *image_cache_get_texture(struct image_cache_entry *entry,
+		uint32_t *cx, uint32_t *cy);
@@ -1,6 +1,8 @@
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <sys/stat.h>
+#include "image-cache.h"
 
 #define blog(log_level, format, ...) \
 	blog(log_level, "[image_source: '%s'] " format, \
@@ -19,7 +21,17 @@ struct image_source {
 	char         *file;
 	bool         persistent;
 	time_t       file_timestamp;
-	float        update_time_elapsed;
+
+	/* without a watch, the tick checks the file once a second */
+	os_file_watch_t *file_watch;
+	float           update_time_elapsed;
+
+	/* pending is still being decoded, and replaces image once it's done.
+	 * both are guarded by mutex, which is taken before the graphics
+	 * context */
+	pthread_mutex_t          mutex;
+	struct image_cache_entry *image;
+	struct image_cache_entry *pending;
 
 	gs_texture_t *tex;
 	uint32_t     cx;
@@ -40,44 +52,102 @@ static const char *image_source_get_name(void *unused)
 	return obs_module_text("ImageInput");
 }
 
-static void image_source_load(struct image_source *context)
+/* requires the mutex.  called on tick rather than render, so the size is
+ * known once decoding finishes even if the source isn't rendered.  only
+ * enters the graphics context if there's a texture to create */
+static void image_source_check_pending(struct image_source *context)
 {
-	char *file = context->file;
+	struct image_cache_entry *old_image;
+
+	if (!context->pending || !image_cache_ready(context->pending))
+		return;
+
+	old_image = context->image;
+	context->image = context->pending;
+	context->pending = NULL;
 
 	obs_enter_graphics();
+	context->tex = image_cache_get_texture(context->image,
+			&context->cx, &context->cy);
+	obs_leave_graphics();
 
-	if (context->tex)
-		gs_texture_destroy(context->tex);
-	context->tex = NULL;
+	if (!context->tex)
+		warn("failed to load texture '%s'", context->file);
+
+	image_cache_release(old_image);
+}
+
+static void image_source_load(struct image_source *context)
+{
+	char *file = context->file;
+	struct image_cache_entry *pending = NULL;
+	struct image_cache_entry *old_image = NULL;
+	struct image_cache_entry *old_pending;
 
 	if (file && *file) {
 		debug("loading texture '%s'", file);
 		context->file_timestamp = get_modified_timestamp(file);
-		context->tex = gs_texture_create_from_file(file);
 		context->update_time_elapsed = 0;
+		pending = image_cache_acquire(file, context->file_timestamp);
+	}
 
-		if (context->tex) {
-			context->cx = gs_texture_get_width(context->tex);
-			context->cy = gs_texture_get_height(context->tex);
-		} else {
-			warn("failed to load texture '%s'", file);
-			context->cx = 0;
-			context->cy = 0;
-		}
+	/* decoding happens off the graphics thread, the current image keeps
+	 * being shown until the new one is ready.  cached images are
+	 * swapped in right away */
+	pthread_mutex_lock(&context->mutex);
+
+	old_pending = context->pending;
+	context->pending = pending;
+
+	if (!pending) {
+		old_image = context->image;
+		context->image = NULL;
+
+		obs_enter_graphics();
+		context->tex = NULL;
+		obs_leave_graphics();
 	}
 
-	obs_leave_graphics();
+	image_source_check_pending(context);
+
+	pthread_mutex_unlock(&context->mutex);
+
+	image_cache_release(old_pending);
+	image_cache_release(old_image);
 }
 
 static void image_source_unload(struct image_source *context)
 {
-	obs_enter_graphics();
+	struct image_cache_entry *image;
+	struct image_cache_entry *pending;
 
-	if (context->tex)
-		gs_texture_destroy(context->tex);
-	context->tex = NULL;
+	pthread_mutex_lock(&context->mutex);
+
+	image = context->image;
+	pending = context->pending;
+	context->image = NULL;
+	context->pending = NULL;
 
+	obs_enter_graphics();
+	context->tex = NULL;
 	obs_leave_graphics();
+
+	pthread_mutex_unlock(&context->mutex);
+
+	image_cache_release(image);
+	image_cache_release(pending);
+}
+
+/* called on the file watch thread, the image is decoded in the background
+ * and swapped in by the tick once it's ready */
+static void image_source_file_changed(void *data, const char *path)
+{
+	struct image_source *context = data;
+
+	if (context->persistent || obs_source_showing(context->source)) {
+		if (context->file_timestamp < get_modified_timestamp(path))
+			image_source_load(context);
+	}
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -86,11 +156,18 @@ static void image_source_update(void *data, obs_data_t *settings)
 	const char *file = obs_data_get_string(settings, "file");
 	const bool unload = obs_data_get_bool(settings, "unload");
 
+	os_file_watch_remove(context->file_watch);
+	context->file_watch = NULL;
+
 	if (context->file)
 		bfree(context->file);
 	context->file = bstrdup(file);
 	context->persistent = !unload;
 
+	if (file && *file)
+		context->file_watch = os_file_watch_add(file,
+				image_source_file_changed, context);
+
 	/* Load the image if the source is persistent or showing */
 	if (context->persistent || obs_source_showing(context->source))
 		image_source_load(data);
@@ -124,6 +201,12 @@ static void *image_source_create(obs_data_t *settings, obs_source_t *source)
 	struct image_source *context = bzalloc(sizeof(struct image_source));
 	context->source = source;
 
+	pthread_mutex_init_value(&context->mutex);
+	if (pthread_mutex_init(&context->mutex, NULL) != 0) {
+		bfree(context);
+		return NULL;
+	}
+
 	image_source_update(context, settings);
 	return context;
 }
@@ -132,10 +215,12 @@ static void image_source_destroy(void *data)
 {
 	struct image_source *context = data;
 
+	os_file_watch_remove(context->file_watch);
 	image_source_unload(context);
 
 	if (context->file)
 		bfree(context->file);
+	pthread_mutex_destroy(&context->mutex);
 	bfree(context);
 }
 
@@ -164,11 +249,18 @@ static void image_source_render(void *data, gs_effect_t *effect)
 	gs_draw_sprite(context->tex, 0, context->cx, context->cy);
 }
 
+/* runs in parallel with other sources' ticks: image and pending are locked,
+ * the cache has its own lock, and graphics is only entered to swap */
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
 
+	pthread_mutex_lock(&context->mutex);
+	image_source_check_pending(context);
+	pthread_mutex_unlock(&context->mutex);
+
 	if (!obs_source_showing(context->source)) return;
+	if (context->file_watch) return;
 
 	context->update_time_elapsed += seconds;
 
@@ -209,7 +301,7 @@ static obs_properties_t *image_source_properties(void *unused)
 static struct obs_source_info image_source_info = {
 	.id             = "image_source",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_VIDEO,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_PARALLEL_TICK,
 	.get_name       = image_source_get_name,
 	.create         = image_source_create,
 	.destroy        = image_source_destroy,
@@ -229,6 +321,14 @@ OBS_MODULE_USE_DEFAULT_LOCALE("image-source", "en-US")
 
 bool obs_module_load(void)
 {
+	if (!image_cache_init())
+		return false;
+
 	obs_register_source(&image_source_info);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	image_cache_free();
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2026 by OBS Studio contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+#include "xshm-damage.h"
+
+bool xshm_damage_init(xshm_damage_t *damage, xcb_connection_t *xcb,
+		xcb_window_t root, int_fast32_t x, int_fast32_t y,
+		int_fast32_t w, int_fast32_t h)
+{
+	const xcb_query_extension_reply_t *ext;
+	xcb_damage_query_version_reply_t  *ver;
+
+	memset(damage, 0, sizeof(xshm_damage_t));
+	damage->xcb    = xcb;
+	damage->root   = root;
+	damage->x_org  = x;
+	damage->y_org  = y;
+	damage->width  = w;
+	damage->height = h;
+
+	for (size_t i = 0; i < XSHM_BUFFERS; i++)
+		damage->bottom[i] = h;
+	damage->changed = true;
+
+	ext = xcb_get_extension_data(xcb, &xcb_damage_id);
+	if (!ext || !ext->present)
+		return false;
+
+	ver = xcb_damage_query_version_reply(xcb,
+			xcb_damage_query_version(xcb,
+				XCB_DAMAGE_MAJOR_VERSION,
+				XCB_DAMAGE_MINOR_VERSION), NULL);
+	if (!ver)
+		return false;
+	free(ver);
+
+	damage->damage       = xcb_generate_id(xcb);
+	damage->notify_event = ext->first_event + XCB_DAMAGE_NOTIFY;
+	damage->active       = true;
+
+	xcb_damage_create(xcb, damage->damage, root,
+			XCB_DAMAGE_REPORT_LEVEL_BOUNDING_BOX);
+	return true;
+}
+
+void xshm_damage_free(xshm_damage_t *damage)
+{
+	if (damage->active) {
+		xcb_damage_destroy(damage->xcb, damage->damage);
+		damage->active = false;
+	}
+}
+
+void xshm_damage_add_rows(xshm_damage_t *damage, int_fast32_t top,
+		int_fast32_t bottom)
+{
+	if (top < 0)
+		top = 0;
+	if (bottom > damage->height)
+		bottom = damage->height;
+	if (top >= bottom)
+		return;
+
+	for (size_t i = 0; i < XSHM_BUFFERS; i++) {
+		if (damage->top[i] >= damage->bottom[i]) {
+			damage->top[i]    = top;
+			damage->bottom[i] = bottom;
+		} else {
+			if (top < damage->top[i])
+				damage->top[i] = top;
+			if (bottom > damage->bottom[i])
+				damage->bottom[i] = bottom;
+		}
+	}
+
+	damage->changed = true;
+}
+
+/*
+ * The damage is cleared before the image is fetched, so anything drawn
+ * afterwards is reported again for the next frame.  With bounding box
+ * reporting no further events are sent until the damage is cleared.
+ */
+void xshm_damage_process(xshm_damage_t *damage)
+{
+	xcb_generic_event_t *event;
+	bool damaged = false;
+
+	if (!damage->active) {
+		xshm_damage_add_rows(damage, 0, damage->height);
+		return;
+	}
+
+	while ((event = xcb_poll_for_event(damage->xcb))) {
+		if ((event->response_type & 0x7f) == damage->notify_event) {
+			xcb_damage_notify_event_t *notify = (void*)event;
+			xcb_rectangle_t *area = &notify->area;
+
+			if (area->x < damage->x_org + damage->width &&
+			    area->x + area->width > damage->x_org)
+				xshm_damage_add_rows(damage,
+						area->y - damage->y_org,
+						area->y + area->height -
+						damage->y_org);
+			damaged = true;
+		}
+
+		free(event);
+	}
+
+	if (damaged)
+		xcb_damage_subtract(damage->xcb, damage->damage, XCB_NONE,
+				XCB_NONE);
+}
+
+bool xshm_damage_fetch(xshm_damage_t *damage, xcb_shm_t *shm, int buffer)
+{
+	xcb_shm_get_image_cookie_t img_c;
+	xcb_shm_get_image_reply_t  *img_r;
+	int_fast32_t top    = damage->top[buffer];
+	int_fast32_t bottom = damage->bottom[buffer];
+
+	if (top < bottom) {
+		img_c = xcb_shm_get_image_unchecked(damage->xcb, damage->root,
+				damage->x_org, damage->y_org + top,
+				damage->width, bottom - top,
+				~0, XCB_IMAGE_FORMAT_Z_PIXMAP, shm->seg,
+				(uint32_t)(top * damage->width * 4));
+		img_r = xcb_shm_get_image_reply(damage->xcb, img_c, NULL);
+		if (!img_r)
+			return false;
+		free(img_r);
+	}
+
+	damage->top[buffer]    = 0;
+	damage->bottom[buffer] = 0;
+	damage->changed        = false;
+	return true;
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (C) 2026 by OBS Studio contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xcb/damage.h>
+#include "xhelpers.h"
+
+#define XSHM_BUFFERS 2
+
+/**
+ * Tracks which rows of each capture buffer are out of date
+ *
+ * Damage is tracked on the root window, for the captured area only.  A
+ * buffer is brought up to date by fetching its out of date rows at full
+ * width, so they land at the right offset in the buffer.
+ */
+typedef struct {
+	xcb_connection_t    *xcb;
+	xcb_window_t        root;
+	int_fast32_t        x_org;
+	int_fast32_t        y_org;
+	int_fast32_t        width;
+	int_fast32_t        height;
+
+	/* without the damage extension every frame is fetched in full */
+	bool                active;
+	xcb_damage_damage_t damage;
+	uint8_t             notify_event;
+
+	/* rows of each buffer that are out of date, and whether anything
+	 * changed since a buffer was last fetched */
+	int_fast32_t        top[XSHM_BUFFERS];
+	int_fast32_t        bottom[XSHM_BUFFERS];
+	bool                changed;
+} xshm_damage_t;
+
+/**
+ * Start tracking changes to an area of the root window
+ *
+ * All rows of all buffers start out of date.
+ *
+ * @return false if the damage extension isn't available
+ */
+bool xshm_damage_init(xshm_damage_t *damage, xcb_connection_t *xcb,
+		xcb_window_t root, int_fast32_t x, int_fast32_t y,
+		int_fast32_t w, int_fast32_t h);
+
+/**
+ * Stop tracking changes
+ */
+void xshm_damage_free(xshm_damage_t *damage);
+
+/**
+ * Collect the damage reported since the last call
+ *
+ * @note This reads all pending events of the connection
+ */
+void xshm_damage_process(xshm_damage_t *damage);
+
+/**
+ * Mark a range of rows as out of date in all buffers
+ */
+void xshm_damage_add_rows(xshm_damage_t *damage, int_fast32_t top,
+		int_fast32_t bottom);
+
+/**
+ * Fetch the out of date rows of a buffer into its shm segment
+ *
+ * @return true if the buffer is up to date
+ */
+bool xshm_damage_fetch(xshm_damage_t *damage, xcb_shm_t *shm, int buffer);
+
+#ifdef __cplusplus
+}
+#endif
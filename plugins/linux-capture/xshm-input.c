@@ -24,8 +24,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/dstr.h>
+#include <util/threading.h>
+#include <util/platform.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
+#include "xshm-damage.h"
 
 #define XSHM_DATA(voidptr) struct xshm_data *data = voidptr;
 
@@ -36,7 +39,7 @@ struct xshm_data {
 
 	xcb_connection_t *xcb;
 	xcb_screen_t     *xcb_screen;
-	xcb_shm_t        *xshm;
+	xcb_shm_t        *xshm[XSHM_BUFFERS];
 	xcb_xcursor_t    *cursor;
 
 	char             *server;
@@ -51,6 +54,24 @@ struct xshm_data {
 	bool             show_cursor;
 	bool             use_xinerama;
 	bool             advanced;
+
+	/* the capture thread grabs one frame each time the event is
+	 * signalled by the video tick */
+	pthread_t        capture_thread;
+	bool             capture_thread_active;
+	os_event_t       *capture_event;
+	volatile bool    stop_capture;
+
+	/* only used by the capture thread */
+	xshm_damage_t    damage;
+	int              write_buffer;
+
+	/* ready_buffer is the latest finished capture, read_buffer is being
+	 * uploaded by the video tick.  -1 if none */
+	pthread_mutex_t  buffer_mutex;
+	int              ready_buffer;
+	int              read_buffer;
+	xcb_xfixes_get_cursor_image_reply_t *cursor_reply;
 };
 
 /**
@@ -129,6 +150,58 @@ static int_fast32_t xshm_update_geometry(struct xshm_data *data)
 	return 1;
 }
 
+/**
+ * Fetch the changed rows of the next buffer and hand it to the video tick
+ */
+static void xshm_capture_frame(struct xshm_data *data)
+{
+	xcb_xfixes_get_cursor_image_cookie_t cur_c;
+	xcb_xfixes_get_cursor_image_reply_t  *cur_r;
+	int idx = data->write_buffer;
+	bool fetch;
+
+	cur_c = xcb_xfixes_get_cursor_image_unchecked(data->xcb);
+
+	xshm_damage_process(&data->damage);
+
+	pthread_mutex_lock(&data->buffer_mutex);
+	fetch = data->damage.changed && idx != data->read_buffer;
+	pthread_mutex_unlock(&data->buffer_mutex);
+
+	if (fetch)
+		fetch = xshm_damage_fetch(&data->damage, data->xshm[idx], idx);
+	if (fetch)
+		data->write_buffer = (idx + 1) % XSHM_BUFFERS;
+
+	cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb, cur_c, NULL);
+
+	pthread_mutex_lock(&data->buffer_mutex);
+	if (fetch)
+		data->ready_buffer = idx;
+	if (cur_r) {
+		free(data->cursor_reply);
+		data->cursor_reply = cur_r;
+	}
+	pthread_mutex_unlock(&data->buffer_mutex);
+}
+
+static void *xshm_capture_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+
+	os_set_thread_name("xshm-input: capture thread");
+
+	for (;;) {
+		os_event_wait(data->capture_event);
+		if (os_atomic_load_bool(&data->stop_capture))
+			break;
+
+		xshm_capture_frame(data);
+	}
+
+	return NULL;
+}
+
 /**
  * Returns the name of the plugin
  */
@@ -143,6 +216,18 @@ static const char* xshm_getname(void *unused)
  */
 static void xshm_capture_stop(struct xshm_data *data)
 {
+	if (data->capture_thread_active) {
+		os_atomic_set_bool(&data->stop_capture, true);
+		os_event_signal(data->capture_event);
+		pthread_join(data->capture_thread, NULL);
+		data->capture_thread_active = false;
+	}
+
+	free(data->cursor_reply);
+	data->cursor_reply = NULL;
+	data->ready_buffer = -1;
+	data->read_buffer  = -1;
+
 	obs_enter_graphics();
 
 	if (data->texture) {
@@ -156,9 +241,13 @@ static void xshm_capture_stop(struct xshm_data *data)
 
 	obs_leave_graphics();
 
-	if (data->xshm) {
-		xshm_xcb_detach(data->xshm);
-		data->xshm = NULL;
+	xshm_damage_free(&data->damage);
+
+	for (size_t i = 0; i < XSHM_BUFFERS; i++) {
+		if (data->xshm[i]) {
+			xshm_xcb_detach(data->xshm[i]);
+			data->xshm[i] = NULL;
+		}
 	}
 
 	if (data->xcb) {
@@ -196,12 +285,22 @@ static void xshm_capture_start(struct xshm_data *data)
 		goto fail;
 	}
 
-	data->xshm = xshm_xcb_attach(data->xcb, data->width, data->height);
-	if (!data->xshm) {
-		blog(LOG_ERROR, "failed to attach shm !");
-		goto fail;
+	for (size_t i = 0; i < XSHM_BUFFERS; i++) {
+		data->xshm[i] = xshm_xcb_attach(data->xcb, data->width,
+				data->height);
+		if (!data->xshm[i]) {
+			blog(LOG_ERROR, "failed to attach shm !");
+			goto fail;
+		}
 	}
 
+	if (!xshm_damage_init(&data->damage, data->xcb,
+				data->xcb_screen->root, data->x_org,
+				data->y_org, data->width, data->height))
+		blog(LOG_INFO, "Missing DAMAGE extension, capturing every "
+				"frame");
+	data->write_buffer = 0;
+
 	data->cursor = xcb_xcursor_init(data->xcb);
 	xcb_xcursor_offset(data->cursor, data->x_org, data->y_org);
 
@@ -211,6 +310,14 @@ static void xshm_capture_start(struct xshm_data *data)
 
 	obs_leave_graphics();
 
+	data->stop_capture = false;
+	if (pthread_create(&data->capture_thread, NULL, xshm_capture_thread,
+				data) != 0) {
+		blog(LOG_ERROR, "failed to create capture thread !");
+		goto fail;
+	}
+	data->capture_thread_active = true;
+
 	return;
 fail:
 	xshm_capture_stop(data);
@@ -367,6 +474,8 @@ static void xshm_destroy(void *vptr)
 
 	xshm_capture_stop(data);
 
+	os_event_destroy(data->capture_event);
+	pthread_mutex_destroy(&data->buffer_mutex);
 	bfree(data);
 }
 
@@ -376,11 +485,24 @@ static void xshm_destroy(void *vptr)
 static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct xshm_data *data = bzalloc(sizeof(struct xshm_data));
-	data->source = source;
+	data->source       = source;
+	data->ready_buffer = -1;
+	data->read_buffer  = -1;
+
+	pthread_mutex_init_value(&data->buffer_mutex);
+	if (pthread_mutex_init(&data->buffer_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&data->capture_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
 
 	xshm_update(data, settings);
 
 	return data;
+
+fail:
+	blog(LOG_ERROR, "failed to create capture !");
+	xshm_destroy(data);
+	return NULL;
 }
 
 /**
@@ -391,37 +513,42 @@ static void xshm_video_tick(void *vptr, float seconds)
 	UNUSED_PARAMETER(seconds);
 	XSHM_DATA(vptr);
 
-	if (!data->texture)
+	if (!data->texture || !data->capture_thread_active)
 		return;
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t           img_c;
-	xcb_shm_get_image_reply_t            *img_r;
-	xcb_xfixes_get_cursor_image_cookie_t cur_c;
-	xcb_xfixes_get_cursor_image_reply_t  *cur_r;
+	xcb_xfixes_get_cursor_image_reply_t *cur_r;
+	int idx;
 
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root,
-			data->x_org, data->y_org, data->width, data->height,
-			~0, XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg, 0);
-	cur_c = xcb_xfixes_get_cursor_image_unchecked(data->xcb);
+	/* request the next frame, this one uploads the last finished one */
+	os_event_signal(data->capture_event);
 
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
-	cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb, cur_c, NULL);
+	pthread_mutex_lock(&data->buffer_mutex);
+	idx = data->ready_buffer;
+	data->ready_buffer = -1;
+	data->read_buffer = idx;
+	cur_r = data->cursor_reply;
+	data->cursor_reply = NULL;
+	pthread_mutex_unlock(&data->buffer_mutex);
 
-	if (!img_r)
-		goto exit;
+	if (idx == -1 && !cur_r)
+		return;
 
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *) data->xshm->data,
-		data->width * 4, false);
+	if (idx != -1)
+		gs_texture_set_image(data->texture,
+				(void *) data->xshm[idx]->data,
+				data->width * 4, false);
 	xcb_xcursor_update(data->cursor, cur_r);
 
 	obs_leave_graphics();
 
-exit:
-	free(img_r);
+	pthread_mutex_lock(&data->buffer_mutex);
+	data->read_buffer = -1;
+	pthread_mutex_unlock(&data->buffer_mutex);
+
 	free(cur_r);
 }
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "ffmpeg-mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libavformat side of ffmpeg-mux, shared by the ffmpeg-mux process and the
+ * recording buffer's in-process muxing.  Fill in params/audio, hand the
+ * encoder headers to ffmpeg_mux_header, then call ffmpeg_mux_init_context.
+ * ffmpeg_mux_free writes the trailer and frees audio/audio_header with
+ * free().
+ */
+
+struct AVFormatContext;
+struct AVStream;
+
+struct main_params {
+	char *file;
+	int has_video;
+	int tracks;
+	char *vcodec;
+	int vbitrate;
+	int gop;
+	int width;
+	int height;
+	int fps_num;
+	int fps_den;
+	char *acodec;
+	char *muxer_settings;
+};
+
+struct audio_params {
+	char *name;
+	int abitrate;
+	int sample_rate;
+	int channels;
+};
+
+struct header {
+	uint8_t *data;
+	int size;
+};
+
+struct ffmpeg_mux {
+	struct AVFormatContext *output;
+	struct AVStream        *video_stream;
+	struct AVStream        **audio_streams;
+	struct main_params     params;
+	struct audio_params    *audio;
+	struct header          video_header;
+	struct header          *audio_header;
+	int                    num_audio_streams;
+	bool                   initialized;
+	char error[4096];
+
+	/* where messages go, printed to stdout if not set */
+	void                   (*log)(void *param, const char *msg);
+	void                   *log_param;
+};
+
+extern void ffmpeg_mux_free(struct ffmpeg_mux *ffm);
+extern void ffmpeg_mux_header(struct ffmpeg_mux *ffm, uint8_t *data,
+		struct ffm_packet_info *info);
+extern int ffmpeg_mux_init_context(struct ffmpeg_mux *ffm);
+extern bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
+		struct ffm_packet_info *info);
+
+#ifdef __cplusplus
+}
+#endif
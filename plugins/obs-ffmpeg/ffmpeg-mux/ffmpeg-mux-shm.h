@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Shared memory packet transport (Linux only)
+ *
+ *   Instead of writing packets to ffmpeg-mux's stdin, the parent process can
+ * create a memfd holding a single producer/single consumer ring of
+ * ffm_packet_info headers, each directly followed by its packet data, and
+ * pass it on the command line as the first argument:
+ *
+ *   ffmpeg-mux --shm=<memfd>,<data eventfd>,<space eventfd> <file> ...
+ *
+ *   Records never wrap around the end of the ring so the muxer can use packet
+ * data in place.  The writer skips the rest of the ring when a record
+ * doesn't fit, marking the skipped area with a header of size
+ * FFM_SHM_PAD_SIZE if there is room for one.  Packets larger than half the
+ * ring are written to stdin as usual, after a header of size
+ * FFM_SHM_PIPE_SIZE in the ring that keeps them in order with the rest.
+ *
+ *   Each side only sleeps on its eventfd after setting its waiting flag, and
+ * the other side only signals the eventfd if that flag is set.
+ */
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <unistd.h>
+#include "ffmpeg-mux.h"
+
+#define FFM_SHM_ARG         "--shm="
+#define FFM_SHM_MAGIC       0x4d484646 /* "FFHM" */
+#define FFM_SHM_DATA_OFFSET 4096
+#define FFM_SHM_PAD_SIZE    0xFFFFFFFF
+#define FFM_SHM_PIPE_SIZE   0xFFFFFFFE
+#define FFM_SHM_ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+struct ffm_shm_header {
+	uint32_t          magic;
+	uint32_t          reserved;
+	uint64_t          capacity; /* power of two */
+
+	volatile uint64_t write_pos;
+	volatile uint64_t read_pos;
+
+	volatile uint32_t writer_waiting;
+	volatile uint32_t reader_waiting;
+
+	/* set by the writer when it won't write any more data, and by the
+	 * reader when it exits */
+	volatile uint32_t writer_closed;
+	volatile uint32_t reader_closed;
+};
+
+static inline uint64_t ffm_shm_load(const volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void ffm_shm_store(volatile uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t ffm_shm_load_flag(const volatile uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void ffm_shm_store_flag(volatile uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void ffm_shm_signal(int event_fd)
+{
+	uint64_t val = 1;
+	ssize_t ret = write(event_fd, &val, sizeof(val));
+	(void)ret;
+}
+
+static inline void ffm_shm_wait(int event_fd)
+{
+	uint64_t val;
+	ssize_t ret = read(event_fd, &val, sizeof(val));
+	(void)ret;
+}
+
+#endif
@@ -25,7 +25,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-core.h"
+#include "ffmpeg-mux-shm.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include <libavformat/avformat.h>
 
@@ -62,95 +70,154 @@ static inline void resize_buf_free(struct resize_buf *rb)
 
 /* ------------------------------------------------------------------------- */
 
-struct main_params {
-	char *file;
-	int has_video;
-	int tracks;
-	char *vcodec;
-	int vbitrate;
-	int gop;
-	int width;
-	int height;
-	int fps_num;
-	int fps_den;
-	char *acodec;
-	char *muxer_settings;
+#ifdef __linux__
+struct shm_reader {
+	struct ffm_shm_header *header;
+	uint8_t               *data;
+	size_t                map_size;
+	uint64_t              mask;
+	uint64_t              read_pos;
+	uint64_t              record_size;
+	int                   data_event;
+	int                   space_event;
 };
 
-struct audio_params {
-	char *name;
-	int abitrate;
-	int sample_rate;
-	int channels;
-};
+static bool shm_reader_init(struct shm_reader *shm, const char *arg)
+{
+	int mem_fd, data_event, space_event;
+	struct stat st;
+	void *map;
 
-struct header {
-	uint8_t *data;
-	int size;
-};
+	if (sscanf(arg + strlen(FFM_SHM_ARG), "%d,%d,%d", &mem_fd,
+				&data_event, &space_event) != 3) {
+		printf("Invalid shared memory argument '%s'\n", arg);
+		return false;
+	}
 
-struct ffmpeg_mux {
-	AVFormatContext        *output;
-	AVStream               *video_stream;
-	AVStream               **audio_streams;
-	struct main_params     params;
-	struct audio_params    *audio;
-	struct header          video_header;
-	struct header          *audio_header;
-	int                    num_audio_streams;
-	bool                   initialized;
-	char error[4096];
-};
+	if (fstat(mem_fd, &st) != 0 || st.st_size <= FFM_SHM_DATA_OFFSET) {
+		printf("Invalid shared memory descriptor\n");
+		return false;
+	}
 
-static void header_free(struct header *header)
-{
-	free(header->data);
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, mem_fd, 0);
+	close(mem_fd);
+
+	if (map == MAP_FAILED) {
+		printf("Failed to map shared memory\n");
+		return false;
+	}
+
+	shm->header      = map;
+	shm->data        = (uint8_t*)map + FFM_SHM_DATA_OFFSET;
+	shm->map_size    = (size_t)st.st_size;
+	shm->mask        = shm->header->capacity - 1;
+	shm->read_pos    = ffm_shm_load(&shm->header->read_pos);
+	shm->data_event  = data_event;
+	shm->space_event = space_event;
+
+	if (shm->header->magic != FFM_SHM_MAGIC ||
+	    shm->header->capacity + FFM_SHM_DATA_OFFSET > shm->map_size) {
+		printf("Invalid shared memory header\n");
+		munmap(map, shm->map_size);
+		shm->header = NULL;
+		return false;
+	}
+
+	return true;
 }
 
-static void free_avformat(struct ffmpeg_mux *ffm)
+static void shm_reader_free(struct shm_reader *shm)
 {
-	if (ffm->output) {
-		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0)
-			avio_close(ffm->output->pb);
+	if (shm->header) {
+		ffm_shm_store_flag(&shm->header->reader_closed, 1);
+		ffm_shm_signal(shm->space_event);
 
-		avformat_free_context(ffm->output);
-		ffm->output = NULL;
+		munmap(shm->header, shm->map_size);
+		close(shm->data_event);
+		close(shm->space_event);
+		shm->header = NULL;
 	}
+}
 
-	if (ffm->audio_streams) {
-		free(ffm->audio_streams);
-	}
+static inline void shm_reader_advance(struct shm_reader *shm, uint64_t size)
+{
+	shm->read_pos += size;
+	ffm_shm_store(&shm->header->read_pos, shm->read_pos);
 
-	ffm->video_stream = NULL;
-	ffm->audio_streams = NULL;
-	ffm->num_audio_streams = 0;
+	if (ffm_shm_load_flag(&shm->header->writer_waiting))
+		ffm_shm_signal(shm->space_event);
 }
 
-static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
+/* returns the next packet, with its data still in the ring.  the previous
+ * packet's data is released once this is called again.  if info->size is
+ * FFM_SHM_PIPE_SIZE, the packet is on stdin instead */
+static bool shm_reader_read(struct shm_reader *shm,
+		struct ffm_packet_info *info, uint8_t **data)
 {
-	if (ffm->initialized) {
-		av_write_trailer(ffm->output);
+	struct ffm_shm_header *header = shm->header;
+
+	if (shm->record_size) {
+		shm_reader_advance(shm, shm->record_size);
+		shm->record_size = 0;
 	}
 
-	free_avformat(ffm);
+	for (;;) {
+		uint64_t write_pos = ffm_shm_load(&header->write_pos);
+
+		if (write_pos != shm->read_pos) {
+			uint64_t offset = shm->read_pos & shm->mask;
+			uint64_t tail = header->capacity - offset;
+
+			if (tail < sizeof(*info)) {
+				shm_reader_advance(shm, tail);
+				continue;
+			}
+
+			memcpy(info, shm->data + offset, sizeof(*info));
+
+			if (info->size == FFM_SHM_PAD_SIZE) {
+				shm_reader_advance(shm, tail);
+				continue;
+			}
 
-	header_free(&ffm->video_header);
+			if (info->size == FFM_SHM_PIPE_SIZE) {
+				shm_reader_advance(shm,
+						FFM_SHM_ALIGN(sizeof(*info)));
+				return true;
+			}
 
-	if (ffm->audio_header) {
-		for (int i = 0; i < ffm->params.tracks; i++) {
-			header_free(&ffm->audio_header[i]);
+			*data = shm->data + offset + sizeof(*info);
+			shm->record_size =
+				FFM_SHM_ALIGN(sizeof(*info) + info->size);
+			return true;
 		}
 
-		free(ffm->audio_header);
-	}
+		if (ffm_shm_load_flag(&header->writer_closed))
+			return false;
+
+		ffm_shm_store_flag(&header->reader_waiting, 1);
+
+		if (ffm_shm_load(&header->write_pos) == shm->read_pos &&
+		    !ffm_shm_load_flag(&header->writer_closed))
+			ffm_shm_wait(shm->data_event);
 
-	if (ffm->audio) {
-		free(ffm->audio);
+		ffm_shm_store_flag(&header->reader_waiting, 0);
 	}
+}
+
+static struct shm_reader shm;
+#endif
 
-	memset(ffm, 0, sizeof(*ffm));
+static inline void free_transport(void)
+{
+#ifdef __linux__
+	shm_reader_free(&shm);
+#endif
 }
 
+/* ------------------------------------------------------------------------- */
+
 static bool get_opt_str(int *p_argc, char ***p_argv, char **str,
 		const char *opt)
 {
@@ -255,174 +322,65 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 	return true;
 }
 
-static bool new_stream(struct ffmpeg_mux *ffm, AVStream **stream,
-		const char *name, enum AVCodecID *id)
-{
-	const AVCodecDescriptor *desc = avcodec_descriptor_get_by_name(name);
-	AVCodec *codec;
-
-	if (!desc) {
-		printf("Couldn't find encoder '%s'\n", name);
-		return false;
-	}
-
-	*id = desc->id;
-
-	codec = avcodec_find_encoder(desc->id);
-	if (!codec) {
-		printf("Couldn't create encoder");
-		return false;
-	}
-
-	*stream = avformat_new_stream(ffm->output, codec);
-	if (!*stream) {
-		printf("Couldn't create stream for encoder '%s'\n", name);
-		return false;
-	}
-
-	(*stream)->id = ffm->output->nb_streams-1;
-	return true;
-}
-
-static void create_video_stream(struct ffmpeg_mux *ffm)
-{
-	AVCodecContext *context;
-	void *extradata = NULL;
-
-	if (!new_stream(ffm, &ffm->video_stream, ffm->params.vcodec,
-				&ffm->output->oformat->video_codec))
-		return;
-
-	if (ffm->video_header.size) {
-		extradata = av_memdup(ffm->video_header.data,
-				ffm->video_header.size);
-	}
-
-	context                 = ffm->video_stream->codec;
-	context->bit_rate       = ffm->params.vbitrate * 1000;
-	context->width          = ffm->params.width;
-	context->height         = ffm->params.height;
-	context->coded_width    = ffm->params.width;
-	context->coded_height   = ffm->params.height;
-	context->extradata      = extradata;
-	context->extradata_size = ffm->video_header.size;
-	context->time_base =
-		(AVRational){ffm->params.fps_den, ffm->params.fps_num};
-
-	ffm->video_stream->time_base = context->time_base;
-
-	if (ffm->output->oformat->flags & AVFMT_GLOBALHEADER)
-		context->flags |= CODEC_FLAG_GLOBAL_HEADER;
-}
-
-static void create_audio_stream(struct ffmpeg_mux *ffm, int idx)
+static size_t safe_read(void *vdata, size_t size)
 {
-	AVCodecContext *context;
-	AVStream *stream;
-	void *extradata = NULL;
-
-	if (!new_stream(ffm, &stream, ffm->params.acodec,
-				&ffm->output->oformat->audio_codec))
-		return;
-
-	ffm->audio_streams[idx] = stream;
-
-	av_dict_set(&stream->metadata, "title", ffm->audio[idx].name, 0);
+	uint8_t *data = vdata;
+	size_t  total = size;
 
-	stream->time_base = (AVRational){1, ffm->audio[idx].sample_rate};
+	while (size > 0) {
+		size_t in_size = fread(data, 1, size, stdin);
+		if (in_size == 0)
+			return 0;
 
-	if (ffm->audio_header[idx].size) {
-		extradata = av_memdup(ffm->audio_header[idx].data,
-				ffm->audio_header[idx].size);
+		size -= in_size;
+		data += in_size;
 	}
 
-	context                 = stream->codec;
-	context->bit_rate       = ffm->audio[idx].abitrate * 1000;
-	context->channels       = ffm->audio[idx].channels;
-	context->sample_rate    = ffm->audio[idx].sample_rate;
-	context->sample_fmt     = AV_SAMPLE_FMT_S16;
-	context->time_base      = stream->time_base;
-	context->extradata      = extradata;
-	context->extradata_size = ffm->audio_header[idx].size;
-	context->channel_layout =
-			av_get_default_channel_layout(context->channels);
-
-	if (ffm->output->oformat->flags & AVFMT_GLOBALHEADER)
-		context->flags |= CODEC_FLAG_GLOBAL_HEADER;
-
-	ffm->num_audio_streams++;
+	return total;
 }
 
-static bool init_streams(struct ffmpeg_mux *ffm)
+static bool read_pipe_packet(struct ffm_packet_info *info,
+		struct resize_buf *rb, uint8_t **data)
 {
-	create_video_stream(ffm);
-
-	if (ffm->params.tracks) {
-		ffm->audio_streams =
-			calloc(1, ffm->params.tracks * sizeof(void*));
+	if (safe_read(info, sizeof(*info)) != sizeof(*info))
+		return false;
 
-		for (int i = 0; i < ffm->params.tracks; i++)
-			create_audio_stream(ffm, i);
-	}
+	resize_buf_resize(rb, info->size);
 
-	if (!ffm->video_stream && !ffm->num_audio_streams)
+	if (safe_read(rb->buf, info->size) != info->size)
 		return false;
 
+	*data = rb->buf;
 	return true;
 }
 
-static void set_header(struct header *header, uint8_t *data, size_t size)
+/* reads the next packet either from the shared memory ring or from stdin */
+static bool read_packet(struct ffm_packet_info *info, struct resize_buf *rb,
+		uint8_t **data)
 {
-	header->size = (int)size;
-	header->data = malloc(size);
-	memcpy(header->data, data, size);
-}
-
-static void ffmpeg_mux_header(struct ffmpeg_mux *ffm, uint8_t *data,
-		struct ffm_packet_info *info)
-{
-	if (info->type == FFM_PACKET_VIDEO) {
-		set_header(&ffm->video_header, data, (size_t)info->size);
-	} else {
-		set_header(&ffm->audio_header[info->index], data,
-				(size_t)info->size);
-	}
-}
-
-static size_t safe_read(void *vdata, size_t size)
-{
-	uint8_t *data = vdata;
-	size_t  total = size;
-
-	while (size > 0) {
-		size_t in_size = fread(data, 1, size, stdin);
-		if (in_size == 0)
-			return 0;
-
-		size -= in_size;
-		data += in_size;
+#ifdef __linux__
+	if (shm.header) {
+		if (!shm_reader_read(&shm, info, data))
+			return false;
+		if (info->size != FFM_SHM_PIPE_SIZE)
+			return true;
 	}
+#endif
 
-	return total;
+	return read_pipe_packet(info, rb, data);
 }
 
 static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
 {
 	struct ffm_packet_info info = {0};
+	struct resize_buf rb = {0};
+	uint8_t *data;
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
-	if (success) {
-		uint8_t *data = malloc(info.size);
-
-		if (safe_read(data, info.size) == info.size) {
-			ffmpeg_mux_header(ffm, data, &info);
-		} else {
-			success = false;
-		}
-
-		free(data);
-	}
+	bool success = read_packet(&info, &rb, &data);
+	if (success)
+		ffmpeg_mux_header(ffm, data, &info);
 
+	resize_buf_free(&rb);
 	return success;
 }
 
@@ -443,106 +401,22 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 	return true;
 }
 
-#ifdef _MSC_VER
-#pragma warning(disable : 4996)
-#endif
-
-static inline int open_output_file(struct ffmpeg_mux *ffm)
+static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
+		char *argv[])
 {
-	AVOutputFormat *format = ffm->output->oformat;
-	int ret;
+	argc--;
+	argv++;
 
-	if ((format->flags & AVFMT_NOFILE) == 0) {
-		ret = avio_open(&ffm->output->pb, ffm->params.file,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
-			printf("Couldn't open '%s', %s",
-					ffm->params.file, av_err2str(ret));
+#ifdef __linux__
+	if (argc && strncmp(argv[0], FFM_SHM_ARG, strlen(FFM_SHM_ARG)) == 0) {
+		if (!shm_reader_init(&shm, argv[0]))
 			return FFM_ERROR;
-		}
-	}
-
-	strncpy(ffm->output->filename, ffm->params.file,
-			sizeof(ffm->output->filename));
-	ffm->output->filename[sizeof(ffm->output->filename) - 1] = 0;
-
-	AVDictionary *dict = NULL;
-	if ((ret = av_dict_parse_string(&dict, ffm->params.muxer_settings,
-				"=", " ", 0))) {
-		printf("Failed to parse muxer settings: %s\n%s",
-				av_err2str(ret), ffm->params.muxer_settings);
-
-		av_dict_free(&dict);
-	}
-
-	if (av_dict_count(dict) > 0) {
-		printf("Using muxer settings:");
-
-		AVDictionaryEntry *entry = NULL;
-		while ((entry = av_dict_get(dict, "", entry,
-						AV_DICT_IGNORE_SUFFIX)))
-			printf("\n\t%s=%s", entry->key, entry->value);
-
-		printf("\n");
-	}
-
-	ret = avformat_write_header(ffm->output, &dict);
-	if (ret < 0) {
-		printf("Error opening '%s': %s",
-				ffm->params.file, av_err2str(ret));
-
-		av_dict_free(&dict);
 
-		return ret == -22 ? FFM_UNSUPPORTED : FFM_ERROR;
+		argc--;
+		argv++;
 	}
+#endif
 
-	av_dict_free(&dict);
-
-	return FFM_SUCCESS;
-}
-
-static int ffmpeg_mux_init_context(struct ffmpeg_mux *ffm)
-{
-	AVOutputFormat *output_format;
-	int ret;
-
-	output_format = av_guess_format(NULL, ffm->params.file, NULL);
-	if (output_format == NULL) {
-		printf("Couldn't find an appropriate muxer for '%s'\n",
-				ffm->params.file);
-		return FFM_ERROR;
-	}
-
-	ret = avformat_alloc_output_context2(&ffm->output, output_format,
-			NULL, NULL);
-	if (ret < 0) {
-		printf("Couldn't initialize output context: %s\n",
-				av_err2str(ret));
-		return FFM_ERROR;
-	}
-
-	ffm->output->oformat->video_codec = AV_CODEC_ID_NONE;
-	ffm->output->oformat->audio_codec = AV_CODEC_ID_NONE;
-
-	if (!init_streams(ffm)) {
-		free_avformat(ffm);
-		return FFM_ERROR;
-	}
-
-	ret = open_output_file(ffm);
-	if (ret != FFM_SUCCESS) {
-		free_avformat(ffm);
-		return ret;
-	}
-
-	return FFM_SUCCESS;
-}
-
-static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
-		char *argv[])
-{
-	argc--;
-	argv++;
 	if (!init_params(&argc, &argv, &ffm->params, &ffm->audio))
 		return FFM_ERROR;
 
@@ -566,68 +440,12 @@ static int ffmpeg_mux_init(struct ffmpeg_mux *ffm, int argc, char *argv[])
 	int ret = ffmpeg_mux_init_internal(ffm, argc, argv);
 	if (ret != FFM_SUCCESS) {
 		ffmpeg_mux_free(ffm);
-		return ret;
+		free_transport();
 	}
 
-	ffm->initialized = true;
 	return ret;
 }
 
-static inline int get_index(struct ffmpeg_mux *ffm,
-		struct ffm_packet_info *info)
-{
-	if (info->type == FFM_PACKET_VIDEO) {
-		if (ffm->video_stream) {
-			return ffm->video_stream->id;
-		}
-	} else {
-		if ((int)info->index < ffm->num_audio_streams) {
-			return ffm->audio_streams[info->index]->id;
-		}
-	}
-
-	return -1;
-}
-
-static inline AVStream *get_stream(struct ffmpeg_mux *ffm, int idx)
-{
-	return ffm->output->streams[idx];
-}
-
-static inline int64_t rescale_ts(struct ffmpeg_mux *ffm, int64_t val, int idx)
-{
-	AVStream *stream = get_stream(ffm, idx);
-
-	return av_rescale_q_rnd(val / stream->codec->time_base.num,
-			stream->codec->time_base, stream->time_base,
-			AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-}
-
-static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
-		struct ffm_packet_info *info)
-{
-	int idx = get_index(ffm, info);
-	AVPacket packet = {0};
-
-	/* The muxer might not support video/audio, or multiple audio tracks */
-	if (idx == -1) {
-		return true;
-	}
-
-        av_init_packet(&packet);
-
-	packet.data = buf;
-	packet.size = (int)info->size;
-	packet.stream_index = idx;
-	packet.pts = rescale_ts(ffm, info->pts, idx);
-	packet.dts = rescale_ts(ffm, info->dts, idx);
-
-	if (info->keyframe)
-		packet.flags = AV_PKT_FLAG_KEY;
-
-	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
-}
-
 /* ------------------------------------------------------------------------- */
 
 #ifdef _WIN32
@@ -639,7 +457,7 @@ int main(int argc, char *argv[])
 	struct ffm_packet_info info = {0};
 	struct ffmpeg_mux ffm = {0};
 	struct resize_buf rb = {0};
-	bool fail = false;
+	uint8_t *data;
 	int ret;
 
 #ifdef _WIN32
@@ -668,17 +486,11 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
-		resize_buf_resize(&rb, info.size);
-
-		if (safe_read(rb.buf, info.size) == info.size) {
-			ffmpeg_mux_packet(&ffm, rb.buf, &info);
-		} else {
-			fail = true;
-		}
-	}
+	while (read_packet(&info, &rb, &data))
+		ffmpeg_mux_packet(&ffm, data, &info);
 
 	ffmpeg_mux_free(&ffm);
+	free_transport();
 	resize_buf_free(&rb);
 
 #ifdef _WIN32
@@ -0,0 +1,317 @@
+/******************************************************************************
+    Copyright (C) 2026 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/base.h>
+#include "obs-ffmpeg-mux-shm.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+/* packets larger than half of this go through the pipe */
+#define SHM_RING_SIZE (32 * 1024 * 1024)
+
+struct ffmpeg_mux_shm {
+	struct ffm_shm_header *header;
+	uint8_t               *data;
+	size_t                map_size;
+	uint64_t              mask;
+
+	int                   mem_fd;
+	int                   data_event;
+	int                   space_event;
+
+	/* the process inherits the write end, so the read end hangs up if
+	 * it exits without getting to set reader_closed */
+	int                   alive_fds[2];
+
+	os_process_pipe_t     *pipe;
+};
+
+static int create_memfd(const char *name)
+{
+#ifdef SYS_memfd_create
+	return (int)syscall(SYS_memfd_create, name, MFD_CLOEXEC);
+#else
+	UNUSED_PARAMETER(name);
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static inline void close_fd(int *fd)
+{
+	if (*fd != -1) {
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+void ffmpeg_mux_shm_destroy(struct ffmpeg_mux_shm *shm)
+{
+	if (!shm)
+		return;
+
+	if (shm->header) {
+		ffm_shm_store_flag(&shm->header->writer_closed, 1);
+		ffm_shm_signal(shm->data_event);
+
+		munmap(shm->header, shm->map_size);
+	}
+
+	close_fd(&shm->mem_fd);
+	close_fd(&shm->data_event);
+	close_fd(&shm->space_event);
+	close_fd(&shm->alive_fds[0]);
+	close_fd(&shm->alive_fds[1]);
+	bfree(shm);
+}
+
+struct ffmpeg_mux_shm *ffmpeg_mux_shm_create(void)
+{
+	struct ffmpeg_mux_shm *shm = bzalloc(sizeof(*shm));
+	void *map;
+
+	shm->mem_fd       = create_memfd("ffmpeg-mux");
+	shm->data_event   = eventfd(0, EFD_CLOEXEC);
+	shm->space_event  = eventfd(0, EFD_CLOEXEC);
+	shm->alive_fds[0] = -1;
+	shm->alive_fds[1] = -1;
+
+	if (shm->mem_fd == -1 || shm->data_event == -1 ||
+	    shm->space_event == -1)
+		goto fail;
+	if (pipe(shm->alive_fds) != 0)
+		goto fail;
+
+	fcntl(shm->alive_fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(shm->alive_fds[1], F_SETFD, FD_CLOEXEC);
+
+	shm->map_size = FFM_SHM_DATA_OFFSET + SHM_RING_SIZE;
+	if (ftruncate(shm->mem_fd, (off_t)shm->map_size) != 0)
+		goto fail;
+
+	map = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			shm->mem_fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	shm->header = map;
+	shm->data   = (uint8_t*)map + FFM_SHM_DATA_OFFSET;
+	shm->mask   = SHM_RING_SIZE - 1;
+
+	shm->header->capacity = SHM_RING_SIZE;
+	shm->header->magic    = FFM_SHM_MAGIC;
+	return shm;
+
+fail:
+	blog(LOG_INFO, "ffmpeg-mux shared memory transport unavailable "
+	               "(%s), using pipe", strerror(errno));
+	ffmpeg_mux_shm_destroy(shm);
+	return NULL;
+}
+
+void ffmpeg_mux_shm_add_arg(struct ffmpeg_mux_shm *shm, struct dstr *cmd)
+{
+	/* the descriptor numbers in ffmpeg-mux, in the order passed to
+	 * os_process_pipe_create_inherit */
+	dstr_catf(cmd, FFM_SHM_ARG "%d,%d,%d ", OS_PROCESS_PIPE_FIRST_FD,
+			OS_PROCESS_PIPE_FIRST_FD + 1,
+			OS_PROCESS_PIPE_FIRST_FD + 2);
+
+	UNUSED_PARAMETER(shm);
+}
+
+os_process_pipe_t *ffmpeg_mux_shm_start_process(struct ffmpeg_mux_shm *shm,
+		const char *cmd_line)
+{
+	const int fds[] = {
+		shm->mem_fd,
+		shm->data_event,
+		shm->space_event,
+		shm->alive_fds[1]
+	};
+
+	shm->pipe = os_process_pipe_create_inherit(cmd_line, "w", fds,
+			sizeof(fds) / sizeof(fds[0]));
+
+	close_fd(&shm->alive_fds[1]);
+	return shm->pipe;
+}
+
+static inline bool process_alive(struct ffmpeg_mux_shm *shm)
+{
+	struct pollfd pfd = {shm->alive_fds[0], POLLIN, 0};
+	return poll(&pfd, 1, 0) == 0;
+}
+
+static bool wait_for_space(struct ffmpeg_mux_shm *shm, uint64_t write_pos,
+		uint64_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	for (;;) {
+		uint64_t read_pos = ffm_shm_load(&header->read_pos);
+		struct pollfd pfds[2] = {
+			{shm->space_event,  POLLIN, 0},
+			{shm->alive_fds[0], POLLIN, 0}
+		};
+
+		if (header->capacity - (write_pos - read_pos) >= size)
+			return true;
+		if (ffm_shm_load_flag(&header->reader_closed))
+			return false;
+
+		ffm_shm_store_flag(&header->writer_waiting, 1);
+
+		if (ffm_shm_load(&header->read_pos) != read_pos ||
+		    ffm_shm_load_flag(&header->reader_closed)) {
+			ffm_shm_store_flag(&header->writer_waiting, 0);
+			continue;
+		}
+
+		if (poll(pfds, 2, -1) < 0 && errno != EINTR)
+			return false;
+		if (pfds[0].revents & POLLIN)
+			ffm_shm_wait(shm->space_event);
+
+		ffm_shm_store_flag(&header->writer_waiting, 0);
+
+		if (pfds[1].revents && !process_alive(shm))
+			return false;
+	}
+}
+
+static bool write_record(struct ffmpeg_mux_shm *shm,
+		const struct ffm_packet_info *info, const uint8_t *data,
+		uint32_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+	uint64_t record_size = FFM_SHM_ALIGN(sizeof(*info) + size);
+	uint64_t write_pos = header->write_pos;
+	uint64_t offset = write_pos & shm->mask;
+	uint64_t tail = header->capacity - offset;
+	uint64_t needed = record_size;
+	uint8_t *record;
+
+	/* records don't wrap, skip the rest of the ring instead */
+	if (tail < record_size)
+		needed += tail;
+
+	if (!wait_for_space(shm, write_pos, needed))
+		return false;
+
+	if (tail < record_size) {
+		if (tail >= sizeof(*info)) {
+			struct ffm_packet_info pad = {0};
+			pad.size = FFM_SHM_PAD_SIZE;
+			memcpy(shm->data + offset, &pad, sizeof(pad));
+		}
+
+		write_pos += tail;
+		offset = 0;
+	}
+
+	record = shm->data + offset;
+	memcpy(record, info, sizeof(*info));
+	if (size)
+		memcpy(record + sizeof(*info), data, size);
+
+	ffm_shm_store(&header->write_pos, write_pos + record_size);
+
+	if (ffm_shm_load_flag(&header->reader_waiting))
+		ffm_shm_signal(shm->data_event);
+	return true;
+}
+
+/* the ring only holds a marker, ffmpeg-mux reads the packet from stdin once
+ * it gets to it */
+static bool write_to_pipe(struct ffmpeg_mux_shm *shm,
+		const struct ffm_packet_info *info, const uint8_t *data)
+{
+	struct ffm_packet_info marker = {0};
+	marker.size = FFM_SHM_PIPE_SIZE;
+
+	if (!write_record(shm, &marker, NULL, 0))
+		return false;
+
+	if (os_process_pipe_write(shm->pipe, (const uint8_t*)info,
+				sizeof(*info)) != sizeof(*info))
+		return false;
+
+	return os_process_pipe_write(shm->pipe, data, info->size) ==
+		info->size;
+}
+
+bool ffmpeg_mux_shm_write(struct ffmpeg_mux_shm *shm,
+		const struct ffm_packet_info *info, const uint8_t *data)
+{
+	uint64_t record_size = FFM_SHM_ALIGN(sizeof(*info) + info->size);
+
+	if (record_size > shm->header->capacity / 2)
+		return write_to_pipe(shm, info, data);
+
+	return write_record(shm, info, data, info->size);
+}
+
+#else
+
+struct ffmpeg_mux_shm *ffmpeg_mux_shm_create(void)
+{
+	return NULL;
+}
+
+void ffmpeg_mux_shm_destroy(struct ffmpeg_mux_shm *shm)
+{
+	UNUSED_PARAMETER(shm);
+}
+
+void ffmpeg_mux_shm_add_arg(struct ffmpeg_mux_shm *shm, struct dstr *cmd)
+{
+	UNUSED_PARAMETER(shm);
+	UNUSED_PARAMETER(cmd);
+}
+
+os_process_pipe_t *ffmpeg_mux_shm_start_process(struct ffmpeg_mux_shm *shm,
+		const char *cmd_line)
+{
+	UNUSED_PARAMETER(shm);
+	return os_process_pipe_create(cmd_line, "w");
+}
+
+bool ffmpeg_mux_shm_write(struct ffmpeg_mux_shm *shm,
+		const struct ffm_packet_info *info, const uint8_t *data)
+{
+	UNUSED_PARAMETER(shm);
+	UNUSED_PARAMETER(info);
+	UNUSED_PARAMETER(data);
+	return false;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/******************************************************************************
+    Copyright (C) 2026 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/dstr.h>
+#include <util/pipe.h>
+#include "ffmpeg-mux/ffmpeg-mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parent side of the ffmpeg-mux shared memory transport (see
+ * ffmpeg-mux/ffmpeg-mux-shm.h).  ffmpeg_mux_shm_create returns NULL where
+ * the transport isn't available, in which case packets are written to the
+ * process pipe as before.
+ */
+
+struct ffmpeg_mux_shm;
+
+extern struct ffmpeg_mux_shm *ffmpeg_mux_shm_create(void);
+
+/* sets the writer closed flag (letting ffmpeg-mux drain the ring and exit),
+ * then releases the parent's side of the transport.  call before destroying
+ * the process pipe */
+extern void ffmpeg_mux_shm_destroy(struct ffmpeg_mux_shm *shm);
+
+/* appends the transport argument, must directly follow the executable */
+extern void ffmpeg_mux_shm_add_arg(struct ffmpeg_mux_shm *shm,
+		struct dstr *cmd);
+
+/* starts the process, letting it inherit the transport's descriptors */
+extern os_process_pipe_t *ffmpeg_mux_shm_start_process(
+		struct ffmpeg_mux_shm *shm, const char *cmd_line);
+
+/* blocks while the ring is full, fails if ffmpeg-mux exited.  packets too
+ * large for the ring are written to the process pipe */
+extern bool ffmpeg_mux_shm_write(struct ffmpeg_mux_shm *shm,
+		const struct ffm_packet_info *info, const uint8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
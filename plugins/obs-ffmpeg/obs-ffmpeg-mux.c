@@ -19,7 +19,9 @@
 #include <obs-avc.h>
 #include <util/dstr.h>
 #include <util/pipe.h>
+#include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "obs-ffmpeg-mux-shm.h"
 
 #include <libavformat/avformat.h>
 
@@ -30,9 +32,27 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+/* packets are written to the pipe from a separate thread so a slow disk
+ * doesn't stall the encoder, this is how far behind that thread can get.
+ * stopping waits for the queued packets to be written, so keep it to a
+ * second or two of a high bitrate recording */
+#define MAX_QUEUED_BYTES (8 * 1024 * 1024)
+
+/* a packet waiting for the writer thread */
+struct queued_packet {
+	struct ffm_packet_info info;
+	struct encoder_packet  packet;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
+	struct ffmpeg_mux_shm *shm;
+
+	/* writer_mutex protects writer against get_pipe_stats */
+	pthread_mutex_t   writer_mutex;
+	os_process_pipe_writer_t *writer;
+
 	struct dstr       path;
 	bool              sent_headers;
 	bool              active;
@@ -48,15 +68,46 @@ static const char *ffmpeg_mux_getname(void *unused)
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
+	os_process_pipe_writer_destroy(stream->writer);
+	ffmpeg_mux_shm_destroy(stream->shm);
 	os_process_pipe_destroy(stream->pipe);
+	pthread_mutex_destroy(&stream->writer_mutex);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
 
+static void get_pipe_stats(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct os_process_pipe_writer_stats stats = {0};
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	os_process_pipe_writer_get_stats(stream->writer, &stats);
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	calldata_set_int(cd, "queued_bytes", (long long)stats.queued_bytes);
+	calldata_set_int(cd, "max_stall_ns", (long long)stats.max_stall_ns);
+	calldata_set_int(cd, "total_writes", (long long)stats.total_writes);
+	calldata_set_int(cd, "total_bytes", (long long)stats.total_bytes);
+	calldata_set_float(cd, "writes_per_sec", stats.writes_per_sec);
+}
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
 	stream->output = output;
+	pthread_mutex_init_value(&stream->writer_mutex);
+	if (pthread_mutex_init(&stream->writer_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	proc_handler_add(ph, "void get_pipe_stats(out int queued_bytes, "
+			"out int max_stall_ns, out int total_writes, "
+			"out int total_bytes, out float writes_per_sec)",
+			get_pipe_stats, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -177,7 +228,10 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 
 	dstr_init_move_array(cmd, obs_module_file(FFMPEG_MUX));
 	dstr_insert_ch(cmd, 0, '\"');
-	dstr_cat(cmd, "\" \"");
+	dstr_cat(cmd, "\" ");
+	if (stream->shm)
+		ffmpeg_mux_shm_add_arg(stream->shm, cmd);
+	dstr_cat(cmd, "\"");
 	dstr_cat_dstr(cmd, &stream->path);
 	dstr_catf(cmd, "\" %d %d ", vencoder ? 1 : 0, num_tracks);
 
@@ -213,15 +267,30 @@ static bool ffmpeg_mux_start(void *data)
 	dstr_replace(&stream->path, "\"", "\"\"");
 	obs_data_release(settings);
 
+	stream->shm = ffmpeg_mux_shm_create();
+
 	build_command_line(stream, &cmd);
-	stream->pipe = os_process_pipe_create(cmd.array, "w");
+	stream->pipe = stream->shm ?
+		ffmpeg_mux_shm_start_process(stream->shm, cmd.array) :
+		os_process_pipe_create(cmd.array, "w");
 	dstr_free(&cmd);
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
+		ffmpeg_mux_shm_destroy(stream->shm);
+		stream->shm = NULL;
 		return false;
 	}
 
+	/* the shared memory transport is already non-blocking unless the
+	 * ring is full, so only pipe writes go through the writer thread */
+	if (!stream->shm) {
+		pthread_mutex_lock(&stream->writer_mutex);
+		stream->writer = os_process_pipe_writer_create(stream->pipe,
+				MAX_QUEUED_BYTES);
+		pthread_mutex_unlock(&stream->writer_mutex);
+	}
+
 	/* write headers and start capture */
 	stream->active = true;
 	stream->capturing = true;
@@ -236,6 +305,14 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (stream->active) {
+		pthread_mutex_lock(&stream->writer_mutex);
+		os_process_pipe_writer_destroy(stream->writer);
+		stream->writer = NULL;
+		pthread_mutex_unlock(&stream->writer_mutex);
+
+		ffmpeg_mux_shm_destroy(stream->shm);
+		stream->shm = NULL;
+
 		ret = os_process_pipe_destroy(stream->pipe);
 		stream->pipe = NULL;
 
@@ -274,6 +351,33 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	stream->capturing = false;
 }
 
+static void free_queued_packet(void *param)
+{
+	struct queued_packet *queued = param;
+	obs_free_encoder_packet(&queued->packet);
+	bfree(queued);
+}
+
+static bool queue_packet(struct ffmpeg_muxer *stream,
+		const struct ffm_packet_info *info,
+		struct encoder_packet *packet)
+{
+	struct queued_packet *queued = bzalloc(sizeof(*queued));
+	struct os_process_pipe_buf bufs[2];
+
+	/* shares the encoder's packet data instead of copying it */
+	queued->info = *info;
+	obs_encoder_packet_ref(&queued->packet, packet);
+
+	bufs[0].data = (const uint8_t*)&queued->info;
+	bufs[0].size = sizeof(queued->info);
+	bufs[1].data = queued->packet.data;
+	bufs[1].size = queued->packet.size;
+
+	return os_process_pipe_writer_write(stream->writer, bufs, 2,
+			free_queued_packet, queued);
+}
+
 static bool write_packet(struct ffmpeg_muxer *stream,
 		struct encoder_packet *packet)
 {
@@ -289,6 +393,26 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 		.keyframe = packet->keyframe
 	};
 
+	if (stream->shm) {
+		if (!ffmpeg_mux_shm_write(stream->shm, &info, packet->data)) {
+			warn("ffmpeg_mux_shm_write failed");
+			signal_failure(stream);
+			return false;
+		}
+
+		return true;
+	}
+
+	if (stream->writer) {
+		if (!queue_packet(stream, &info, packet)) {
+			warn("os_process_pipe_writer_write failed");
+			signal_failure(stream);
+			return false;
+		}
+
+		return true;
+	}
+
 	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
 			sizeof(info));
 	if (ret != sizeof(info)) {
@@ -21,7 +21,11 @@
 #include <util/dstr.hpp>
 #include <util/pipe.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
+#include "obs-ffmpeg-mux-shm.h"
+#include "obs-ffmpeg-spill-file.h"
 
 #include <algorithm>
 #include <atomic>
@@ -46,6 +50,13 @@ extern "C" {
 }
 
 const auto settings_buffer_length_name = "buffer_length";
+const auto settings_buffer_max_size_name = "buffer_max_size";
+const auto settings_spill_size_name = "spill_size";
+const auto settings_spill_path_name = "spill_path";
+const auto settings_mux_in_process_name = "mux_in_process";
+
+/* threads shared by all saves of one recording buffer */
+#define MUX_WORKER_THREADS 2
 
 using namespace std;
 
@@ -58,6 +69,34 @@ struct default_delete<os_process_pipe_t> {
 	}
 };
 
+/* sets the writer closed flag, so it has to be destroyed before the
+ * process pipe */
+template <>
+struct default_delete<ffmpeg_mux_shm> {
+	void operator()(ffmpeg_mux_shm *shm)
+	{
+		ffmpeg_mux_shm_destroy(shm);
+	}
+};
+
+/* writes the trailer if the muxer was initialized */
+template <>
+struct default_delete<ffmpeg_mux> {
+	void operator()(ffmpeg_mux *mux)
+	{
+		ffmpeg_mux_free(mux);
+		delete mux;
+	}
+};
+
+template <>
+struct default_delete<spill_file> {
+	void operator()(spill_file *file)
+	{
+		spill_file_destroy(file);
+	}
+};
+
 template <>
 struct default_delete<calldata_t> {
 	void operator()(calldata_t *data)
@@ -84,33 +123,288 @@ struct ffmpeg_muxer;
 }
 
 static bool build_command_line(struct ffmpeg_muxer *stream, const dstr *path,
-		struct dstr *cmd);
+		ffmpeg_mux_shm *shm, struct dstr *cmd);
+static bool init_mux_params(struct ffmpeg_muxer *stream, ffmpeg_mux *mux,
+		const char *path, vector<DStr> &strings);
+static void mux_log(void *param, const char *msg);
 static bool write_packet(struct ffmpeg_muxer *stream, os_process_pipe_t *pipe,
+		ffmpeg_mux_shm *shm, ffmpeg_mux *mux,
 		struct encoder_packet *packet);
 
+/* ffmpeg_mux_init_context modifies the output format, which is shared by
+ * all saves using the same container */
+static mutex init_context_mutex;
+
+static inline ffm_packet_info get_packet_info(const encoder_packet &packet)
+{
+	ffm_packet_info info;
+	info.pts = packet.pts;
+	info.dts = packet.dts;
+	info.size = (uint32_t)packet.size;
+	info.index = (int)packet.track_idx;
+	info.type = packet.type == OBS_ENCODER_VIDEO ?
+		FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
+	info.keyframe = packet.keyframe;
+	return info;
+}
+
 namespace {
 
+/* compact copy of the parts of an encoder_packet needed for muxing, the
+ * data is a reference to the encoder's shared packet data, or points into
+ * the spill file if shared is false */
+struct packet_entry {
+	uint8_t                *data;
+	int64_t                pts;
+	int64_t                dts;
+	video_tracked_frame_id tracked_id;
+	int32_t                timebase_num;
+	int32_t                timebase_den;
+	uint32_t               size;
+	uint8_t                type;
+	uint8_t                track_idx;
+	bool                   keyframe;
+	bool                   shared;
+
+	void Ref(const encoder_packet &pkt)
+	{
+		encoder_packet ref;
+		obs_encoder_packet_ref(&ref, &pkt);
+
+		data         = ref.data;
+		shared       = true;
+		pts          = ref.pts;
+		dts          = ref.dts;
+		tracked_id   = ref.tracked_id;
+		timebase_num = ref.timebase_num;
+		timebase_den = ref.timebase_den;
+		size         = static_cast<uint32_t>(ref.size);
+		type         = static_cast<uint8_t>(ref.type);
+		track_idx    = static_cast<uint8_t>(ref.track_idx);
+		keyframe     = ref.keyframe;
+	}
+
+	void Release()
+	{
+		if (!shared)
+			return;
+
+		encoder_packet pkt = ToPacket();
+		obs_free_encoder_packet(&pkt);
+	}
+
+	encoder_packet ToPacket() const
+	{
+		encoder_packet pkt{};
+		pkt.data         = data;
+		pkt.size         = size;
+		pkt.pts          = pts;
+		pkt.dts          = dts;
+		pkt.tracked_id   = tracked_id;
+		pkt.timebase_num = timebase_num;
+		pkt.timebase_den = timebase_den;
+		pkt.type         = static_cast<obs_encoder_type>(type);
+		pkt.track_idx    = track_idx;
+		pkt.keyframe     = keyframe;
+		return pkt;
+	}
+};
+
+/* packets are stored in fixed size blocks that are never reallocated, so
+ * the output threads can read the start of a segment while the encoder
+ * thread keeps appending to it */
+struct packet_block {
+	static const size_t capacity = 256;
+
+	packet_entry           entries[capacity];
+	packet_block           *next = nullptr;
+};
+
+struct packet_block_pool {
+	mutex                  blocks_mutex;
+	vector<packet_block*>  blocks;
+
+	~packet_block_pool()
+	{
+		for (auto block : blocks)
+			delete block;
+	}
+
+	packet_block *Pop()
+	{
+		{
+			LOCK(blocks_mutex);
+			if (!blocks.empty()) {
+				auto block = blocks.back();
+				blocks.pop_back();
+				block->next = nullptr;
+				return block;
+			}
+		}
+
+		return new packet_block;
+	}
+
+	void Push(packet_block *block)
+	{
+		LOCK(blocks_mutex);
+		blocks.push_back(block);
+	}
+};
+
+/* allocates space in the spill file in FIFO order.  regions are freed
+ * when their segment is destroyed, which can happen out of order while
+ * outputs still hold older segments, so the space is only reused once
+ * everything before it has been freed as well */
+struct spill_ring {
+	struct region {
+		size_t             offset;
+		size_t             size;
+		bool               freed;
+	};
+
+	unique_ptr<spill_file> file;
+	mutex                  ring_mutex;
+	deque<region>          regions;
+	size_t                 tail = 0;
+
+	bool Alloc(size_t size, size_t &offset)
+	{
+		LOCK(ring_mutex);
+
+		auto capacity = spill_file_size(file.get());
+		size = max<size_t>(size, 1);
+
+		if (regions.empty()) {
+			offset = 0;
+		} else {
+			auto head = regions.front().offset;
+
+			if (tail > head) {
+				if (tail + size <= capacity)
+					offset = tail;
+				else if (size <= head)
+					offset = 0;
+				else
+					return false;
+			} else if (tail + size <= head) {
+				offset = tail;
+			} else {
+				return false;
+			}
+		}
+
+		if (offset + size > capacity)
+			return false;
+
+		regions.push_back({offset, size, false});
+		tail = offset + size;
+		return true;
+	}
+
+	void Free(size_t offset)
+	{
+		LOCK(ring_mutex);
+
+		for (auto &region : regions) {
+			if (region.offset == offset && !region.freed) {
+				region.freed = true;
+				break;
+			}
+		}
+
+		while (!regions.empty() && regions.front().freed)
+			regions.pop_front();
+	}
+};
+
+struct spill_allocation {
+	spill_ring             *ring;
+	size_t                 offset;
+
+	spill_allocation(spill_ring *ring, size_t offset)
+		: ring(ring),
+		  offset(offset)
+	{}
+
+	~spill_allocation()
+	{
+		ring->Free(offset);
+	}
+
+	uint8_t *Data() const
+	{
+		return spill_file_data(ring->file.get()) + offset;
+	}
+};
+
 struct packets_segment {
-	using data_t = std::vector<uint8_t>;
-	using offset_t = data_t::size_type;
-	vector<encoder_packet> pkts;
-	vector<offset_t>       offsets;
-	data_t                 data;
+	packet_block_pool      *pool;
+
+	/* set if the packet data was moved to the spill file */
+	unique_ptr<spill_allocation> spill;
+
+	packet_block           *first_block = nullptr;
+	packet_block           *last_block = nullptr;
+	size_t                 num_pkts = 0;
+	size_t                 num_bytes = 0;
 	bool                   finalized = false;
 
-	int64_t                keyframe_pts;
-	double                 first_pts;
-	double                 last_pts;
+	int64_t                keyframe_pts = 0;
+	double                 first_pts = 0.;
+	double                 last_pts = 0.;
 	bool                   have_pts = false;
 
+	explicit packets_segment(packet_block_pool *pool=nullptr)
+		: pool(pool)
+	{}
+
+	packets_segment(const packets_segment &) = delete;
+	packets_segment &operator=(const packets_segment &) = delete;
+
+	~packets_segment()
+	{
+		ForEach(num_pkts, [](packet_entry &entry)
+		{
+			entry.Release();
+			return true;
+		});
+
+		while (first_block) {
+			auto next = first_block->next;
+			if (pool)
+				pool->Push(first_block);
+			else
+				delete first_block;
+			first_block = next;
+		}
+	}
+
+	/* returns the slot for the next packet, which is only counted in
+	 * num_pkts once the caller has filled it in */
+	packet_entry &NextEntry()
+	{
+		auto idx = num_pkts % packet_block::capacity;
+		if (!idx) {
+			auto block = pool ? pool->Pop() : new packet_block;
+			if (last_block)
+				last_block->next = block;
+			else
+				first_block = block;
+			last_block = block;
+		}
+
+		return last_block->entries[idx];
+	}
+
 	void AddPacket(const encoder_packet &pkt)
 	{
 		if (finalized)
 			return;
 
-		pkts.push_back(pkt);
-		offsets.push_back(data.size());
-		data.insert(end(data), pkt.data, pkt.data + pkt.size);
+		NextEntry().Ref(pkt);
+		num_pkts += 1;
+		num_bytes += pkt.size;
 
 		auto pkt_pts = static_cast<double>(pkt.pts) * pkt.timebase_num / pkt.timebase_den;
 
@@ -126,14 +420,28 @@ struct packets_segment {
 		last_pts = max(last_pts, pkt_pts);
 	}
 
-	void Finalize()
+	/* calls fun for the first count packets, stopping early if it returns
+	 * false.  doesn't look past those packets, so it's safe to use while
+	 * packets are being added if count was read under the same lock */
+	template <typename Fun>
+	bool ForEach(size_t count, Fun &&fun) const
 	{
-		if (finalized)
-			return;
+		auto block = first_block;
 
-		for (size_t i = 0, size = pkts.size(); i < size; i++)
-			pkts[i].data = data.data() + offsets[i];
+		for (size_t i = 0; i < count; i++) {
+			auto idx = i % packet_block::capacity;
+			if (idx == 0 && i)
+				block = block->next;
 
+			if (!fun(block->entries[idx]))
+				return false;
+		}
+
+		return true;
+	}
+
+	void Finalize()
+	{
 		finalized = true;
 	}
 
@@ -143,36 +451,152 @@ struct packets_segment {
 	}
 };
 
+/* the packets of a segment at some point in time, which lets outputs share
+ * the segment that's still being written instead of copying it */
+struct segment_snapshot {
+	shared_ptr<packets_segment> seg;
+	size_t                 num_pkts = 0;
+
+	int64_t                keyframe_pts = 0;
+	double                 first_pts = 0.;
+	double                 last_pts = 0.;
+
+	segment_snapshot() = default;
+
+	explicit segment_snapshot(const shared_ptr<packets_segment> &seg)
+		: seg(seg),
+		  num_pkts(seg->num_pkts),
+		  keyframe_pts(seg->keyframe_pts),
+		  first_pts(seg->first_pts),
+		  last_pts(seg->last_pts)
+	{}
+};
+
 struct buffer_output;
 
+/* runs the saves of a recording buffer on a few shared threads, every step
+ * writes at most one segment so concurrent saves take turns */
+struct mux_worker_pool {
+	mutex             queue_mutex;
+	condition_variable queue_update;
+	condition_variable step_done;
+	deque<buffer_output*> queue;
+	vector<buffer_output*> running;
+	vector<unique_ptr<buffer_output>> released;
+	vector<thread>    threads;
+	bool              stop = false;
+
+	/* waits for the released outputs to finish */
+	~mux_worker_pool();
+
+	/* starts the threads on first use */
+	void Enqueue(buffer_output *out);
+
+	/* takes over an output that's no longer needed: outputs that have
+	 * all their packets still finish, outputs waiting for packets fail.
+	 * the output is freed once no worker is running it, so this can be
+	 * called from the output's own step (e.g. by a signal handler that
+	 * stops the output) */
+	void Release(unique_ptr<buffer_output> out);
+
+private:
+	void WorkerThread(size_t idx);
+	unique_ptr<buffer_output> TakeReleased(buffer_output *out);
+};
+
+/* pending outputs are only handed the packets they're waiting for: their
+ * tracked frame or stop frame, the first video packet at or past a pts or
+ * dts, or (once the stop frame was found) the next video packet */
+struct output_wakeups {
+	multimap<video_tracked_frame_id, buffer_output*> frames;
+	multimap<int64_t, buffer_output*> pts;
+	multimap<int64_t, buffer_output*> dts;
+	vector<buffer_output*> next_video;
+
+	void Remove(buffer_output *out);
+
+	/* removes and returns the outputs woken by packet */
+	vector<buffer_output*> Take(const encoder_packet &packet);
+
+	void Clear();
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	bool              have_headers = false;
 	bool              active = false;
 	bool              capturing = false;
 	double            buffer_length = 60.;
+	size_t            buffer_max_bytes = 0;
+	bool              mux_in_process = false;
 
 	signal_handler_t  *signal;
 
-	mutex             buffers_mutex;
-	vector<packets_segment::data_t> buffers;
+	/* recycles the packet index blocks of pruned segments */
+	packet_block_pool buffers;
+
+	/* finalized segments are copied to the spill file by spill_thread
+	 * and replaced in payload_data, only the current segment and the
+	 * ones waiting to be spilled stay in memory */
+	spill_ring        spill;
 
 	mutex             buffer_mutex;
 
 	packets_segment   encoder_headers;
 	deque<shared_ptr<packets_segment>> payload_data;
+	size_t            payload_bytes = 0;
+	size_t            payload_spilled_bytes = 0;
 	shared_ptr<packets_segment> current_segment;
 
+	uint64_t          spill_latency_ns = 0;
+	uint64_t          max_spill_latency_ns = 0;
+	uint64_t          spill_failures = 0;
+
+	/* outputs are handed to the workers when they're removed, destroying
+	 * the pool waits for them */
+	mux_worker_pool   workers;
+
 	vector<unique_ptr<buffer_output>> outputs;
 	vector<unique_ptr<buffer_output>> complete_outputs;
+	output_wakeups    wakeups;
 
 	uint32_t next_interruptiple_buffer_id = 0;
 	map<uint32_t, buffer_output*> interruptible_buffers;
+
+	using spill_item_t = pair<shared_ptr<packets_segment>, uint64_t>;
+
+	thread            spill_thread;
+	mutex             spill_mutex;
+	condition_variable spill_update;
+	deque<spill_item_t> spill_queue;
+	bool              spill_exit = false;
+};
+
+/* segments are in order, returns the first one that ends less than
+ * duration before end_pts */
+static vector<shared_ptr<packets_segment>>::const_iterator find_recent_segment(
+		const vector<shared_ptr<packets_segment>> &segments,
+		double end_pts, double duration)
+{
+	return partition_point(begin(segments), end(segments),
+			[&](const shared_ptr<packets_segment> &seg)
+	{
+		return end_pts - seg->last_pts >= duration;
+	});
+}
+
+enum class output_stage {
+	open,
+	initial,
+	final,
 };
 
 struct buffer_output {
 	ffmpeg_muxer      *stream;
 	unique_ptr<os_process_pipe_t> pipe;
+	unique_ptr<ffmpeg_mux_shm> shm;
+	unique_ptr<ffmpeg_mux> mux;
+	vector<DStr>      mux_strings;
 	DStr              path;
 	video_tracked_frame_id tracked_id;
 	bool              tracked_frame_pts_valid = false;
@@ -195,25 +619,33 @@ struct buffer_output {
 	packets_segment   &headers;
 	vector<shared_ptr<packets_segment>> initial_segments;
 	vector<shared_ptr<packets_segment>> new_segments;
-	packets_segment   final_segment;
+	segment_snapshot  final_segment;
+
+	/* stage and pending are only used by the worker running Step */
+	output_stage      stage = output_stage::open;
+	deque<segment_snapshot> pending;
+	bool              write_all_segments = false;
 
-	thread            output_thread;
 	mutex             output_mutex;
-	condition_variable output_update;
 	bool              finish_output = false;
-	bool              exit_thread = false;
+	bool              waiting = false;
+	bool              abandoned = false;
 
-	atomic<bool>      thread_finished{};
+	atomic<bool>      finished{};
 	int               total_frames = 0;
 
+	uint64_t          create_ts;
+	uint64_t          open_ts = 0;
+
 	unique_ptr<calldata_t> signal_data;
 
 	buffer_output(ffmpeg_muxer *stream, const char *path_,
 			video_tracked_frame_id tracked_id=0, double save_duration=0.)
 		: stream(stream),
 		  tracked_id(tracked_id),
+		  save_duration(save_duration),
 		  headers(stream->encoder_headers),
-		  save_duration(save_duration)
+		  create_ts(os_gettime_ns())
 	{
 		dstr_copy(path, path_);
 
@@ -222,66 +654,44 @@ struct buffer_output {
 		calldata_set_ptr(signal_data.get(), "output", stream->output);
 		calldata_set_string(signal_data.get(), "filename", path);
 
-		DStr escaped_path;
-		dstr_copy_dstr(escaped_path, path);
-		dstr_replace(escaped_path, "\"", "\"\""); //?
-
-		DStr cmd;
-		if (!build_command_line(stream, escaped_path, cmd)) {
-			warn("Failed to build command line");
-			thread_finished = true;
-
-			SignalFailure();
-			return;
-		}
-
-		pipe.reset(os_process_pipe_create(cmd->array, "w"));
-		if (!pipe) {
-			warn("Failed to create process pipe");
-			thread_finished = true;
-
-			SignalFailure();
-			return;
-		}
-
 		finish_output = !tracked_id;
 
 		initial_segments.assign(begin(stream->payload_data),
 			end(stream->payload_data));
-
-		output_thread = thread([=]()
-		{
-			OutputThread();
-		});
 	}
 
-	~buffer_output()
+	/* hands the output to the workers, call once the proc handler has
+	 * finished setting it up */
+	void Start()
 	{
-		if (!output_thread.joinable())
-			return;
-
-		NotifyThread([&]
-		{
-			exit_thread = true;
-		});
-
-		if (output_thread.get_id() != this_thread::get_id())
-			output_thread.join();
-		else
-			output_thread.detach(); // FIXME: investigate when this is necessary
+		stream->workers.Enqueue(this);
 	}
 
-	template <typename Fun>
-	void NotifyThread(Fun &&fun)
+	/* called by mux_worker_pool::Release, an output that's waiting for
+	 * packets is queued again so its next step fails it */
+	void Abandon()
 	{
+		bool requeue;
 		{
 			LOCK(output_mutex);
-			fun();
+			abandoned = true;
+			requeue = waiting;
+			waiting = false;
 		}
-		output_update.notify_one();
+
+		if (requeue)
+			stream->workers.Enqueue(this);
 	}
 
-	bool NewPacket(const encoder_packet &pkt, const packets_segment &seg)
+	/* true if the output was released before it got all its packets */
+	bool Abandoned()
+	{
+		LOCK(output_mutex);
+		return abandoned && !finish_output;
+	}
+
+	bool NewPacket(const encoder_packet &pkt,
+			const shared_ptr<packets_segment> &seg)
 	{
 		if (finish_output)
 			return false;
@@ -317,15 +727,40 @@ struct buffer_output {
 			}
 		}
 
-		final_segment = seg;
-
-		NotifyThread([&]
+		bool requeue;
 		{
+			LOCK(output_mutex);
+			final_segment = segment_snapshot{seg};
 			finish_output = true;
-		});
+			requeue = waiting;
+			waiting = false;
+		}
+
+		if (requeue)
+			stream->workers.Enqueue(this);
 		return false;
 	}
 
+	/* registers the packets NewPacket has to see next, has to be called
+	 * again after NewPacket returned true */
+	void AddWakeups(output_wakeups &wakeups)
+	{
+		if (finish_output)
+			return;
+
+		if (tracked_id && !tracked_frame_pts_valid)
+			wakeups.frames.emplace(tracked_id, this);
+		if (stop_frame_id_valid && !stop_frame_id_found)
+			wakeups.frames.emplace(stop_frame_id, this);
+
+		if (wait_for_dts)
+			wakeups.dts.emplace(end_dts, this);
+		else if (stop_frame_id_found)
+			wakeups.next_video.push_back(this);
+		else if (wait_for_end_time)
+			wakeups.pts.emplace(end_pts, this);
+	}
+
 	void AppendSegment(const shared_ptr<packets_segment> &seg)
 	{
 		if (finish_output)
@@ -334,228 +769,504 @@ struct buffer_output {
 		new_segments.push_back(seg);
 	}
 
+	/* called on a worker thread, writes at most one segment and returns
+	 * true if the output should be queued again */
+	bool Step()
+	{
+		if (Abandoned())
+			return Finish(false);
+
+		switch (stage) {
+		case output_stage::open:
+			if (!Open())
+				return Finish(false);
+
+			open_ts = os_gettime_ns();
+			write_all_segments = save_duration < .25;
+			if (write_all_segments)
+				QueueSegments(initial_segments);
+
+			stage = output_stage::initial;
+			return true;
+
+		case output_stage::initial:
+			if (!pending.empty())
+				return WritePending("initial segments");
+
+			{
+				LOCK(output_mutex);
+				if (!finish_output && !abandoned) {
+					waiting = true;
+					return false;
+				}
+			}
+
+			if (Abandoned())
+				return Finish(false);
+
+			QueueFinalSegments();
+			stage = output_stage::final;
+			return true;
+
+		case output_stage::final:
+			if (!pending.empty())
+				return WritePending(write_all_segments ?
+						"new segments" :
+						"limited segments");
+
+			return Finish(true);
+		}
+
+		return false;
+	}
+
 private:
 	using stream_id_t = std::pair<obs_encoder_type, decltype(encoder_packet::track_idx)>;
 	using first_stream_packet_t = std::map<stream_id_t, encoder_packet>;
 
-	packets_segment *first_output_segment = nullptr;
-	packets_segment *last_output_segment = nullptr;
+	first_stream_packet_t first_packets;
+
+	segment_snapshot  first_output_segment;
+	segment_snapshot  last_output_segment;
 
-	void RebaseTimestamp(encoder_packet &pkt,
-			first_stream_packet_t *first_packets=nullptr)
+	bool Open()
 	{
-		if (!first_packets)
-			return;
+		if (stream->mux_in_process)
+			return OpenMux();
+
+		DStr escaped_path;
+		dstr_copy_dstr(escaped_path, path);
+		dstr_replace(escaped_path, "\"", "\"\""); //?
+
+		shm.reset(ffmpeg_mux_shm_create());
+
+		DStr cmd;
+		if (!build_command_line(stream, escaped_path, shm.get(), cmd)) {
+			warn("Failed to build command line");
+			return false;
+		}
 
+		pipe.reset(shm ?
+			ffmpeg_mux_shm_start_process(shm.get(), cmd->array) :
+			os_process_pipe_create(cmd->array, "w"));
+		if (!pipe) {
+			warn("Failed to create process pipe");
+			return false;
+		}
+
+		return WriteHeaders();
+	}
+
+	bool OpenMux()
+	{
+		mux.reset(new ffmpeg_mux{});
+		mux->log = mux_log;
+		mux->log_param = stream;
+
+		if (!init_mux_params(stream, mux.get(), path, mux_strings)) {
+			warn("Failed to get muxer parameters");
+			return false;
+		}
+
+		headers.ForEach(headers.num_pkts, [&](const packet_entry &entry)
+		{
+			auto info = get_packet_info(entry.ToPacket());
+			ffmpeg_mux_header(mux.get(), entry.data, &info);
+			return true;
+		});
+
+		int ret;
+		{
+			LOCK(init_context_mutex);
+			ret = ffmpeg_mux_init_context(mux.get());
+		}
+
+		if (ret != FFM_SUCCESS) {
+			warn("Failed to initialize muxer: %d", ret);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool WriteHeaders()
+	{
+		bool headers_written = headers.ForEach(headers.num_pkts,
+				[&](const packet_entry &entry)
+		{
+			auto pkt = entry.ToPacket();
+			return write_packet(stream, pipe.get(), shm.get(), nullptr,
+					&pkt);
+		});
+		if (!headers_written)
+			warn("Failed to write headers");
+
+		return headers_written;
+	}
+
+	void QueueSegments(const vector<shared_ptr<packets_segment>> &segments)
+	{
+		for (auto &seg : segments)
+			pending.emplace_back(seg);
+	}
+
+	void QueueSegments(const vector<shared_ptr<packets_segment>> &segments,
+			vector<shared_ptr<packets_segment>>::const_iterator it)
+	{
+		for (; it != end(segments); it++)
+			pending.emplace_back(*it);
+	}
+
+	void QueueFinalSegments()
+	{
+		if (write_all_segments) {
+			QueueSegments(new_segments);
+		} else {
+			auto last_pts = tracked_frame_pts_valid ?
+				tracked_frame_pts : final_segment.last_pts;
+
+			auto it = find_recent_segment(initial_segments, last_pts,
+					save_duration);
+			if (it != end(initial_segments)) {
+				QueueSegments(initial_segments, it);
+				QueueSegments(new_segments);
+			} else {
+				QueueSegments(new_segments, find_recent_segment(
+							new_segments, last_pts,
+							save_duration));
+			}
+		}
+
+		if (final_segment.seg)
+			pending.push_back(final_segment);
+	}
+
+	bool WritePending(const char *what)
+	{
+		auto seg = move(pending.front());
+		pending.pop_front();
+
+		if (!OutputPackets(seg)) {
+			warn("Failed to write %s", what);
+			return Finish(false);
+		}
+
+		return true;
+	}
+
+	void RebaseTimestamp(encoder_packet &pkt)
+	{
 		// This can potentially introduce a minor desync
 		// but then libobs behaves similarly, so the
 		// desync shouldn't be noticable
 
 		auto id = make_pair(pkt.type, pkt.track_idx);
-		auto idx = first_packets->find(id);
+		auto idx = first_packets.find(id);
 
-		if (idx == end(*first_packets))
-			idx = first_packets->emplace(id, pkt).first;
+		if (idx == end(first_packets))
+			idx = first_packets.emplace(id, pkt).first;
 
-		if (idx == end(*first_packets))
+		if (idx == end(first_packets))
 			return;
 
 		pkt.dts -= idx->second.dts;
 		pkt.pts -= idx->second.dts;
 	}
 
-	bool OutputPackets(packets_segment &seg,
-			first_stream_packet_t *first_packets=nullptr)
+	bool OutputPackets(const segment_snapshot &seg)
 	{
-		seg.Finalize();
+		if (!first_output_segment.seg)
+			first_output_segment = seg;
 
-		if (!first_output_segment)
-			first_output_segment = &seg;
+		last_output_segment = seg;
 
-		last_output_segment = &seg;
+		return seg.seg->ForEach(seg.num_pkts,
+				[&](const packet_entry &entry)
+		{
+			auto pkt = entry.ToPacket();
+			RebaseTimestamp(pkt);
 
-		for (auto pkt : seg.pkts) {
-			RebaseTimestamp(pkt, first_packets);
-				
-			if (!write_packet(stream, pipe.get(), &pkt))
+			if (!write_packet(stream, pipe.get(), shm.get(), mux.get(),
+						&pkt))
 				return false;
 
 			if (pkt.type == OBS_ENCODER_VIDEO)
 				total_frames += 1;
-		}
 
-		return true;
+			return true;
+		});
 	}
 
-	bool OutputSegments(const vector<shared_ptr<packets_segment>> &segments,
-			first_stream_packet_t *first_packets=nullptr)
+	int64_t GetStartPTS()
 	{
-		for (auto &seg : segments)
-			if (!OutputPackets(*seg, first_packets))
-				return false;
+		if (first_output_segment.seg)
+			return first_output_segment.keyframe_pts;
 
-		return true;
+		if (initial_segments.size())
+			return initial_segments.front()->keyframe_pts;
+		if (new_segments.size())
+			return new_segments.front()->keyframe_pts;
+		return final_segment.keyframe_pts;
 	}
 
-	bool WriteLimitedOutput()
+	double CalculateDuration()
 	{
-		first_stream_packet_t first_packets;
+		if (first_output_segment.seg && last_output_segment.seg)
+			return last_output_segment.last_pts - first_output_segment.first_pts;
 
-		auto last_pts = tracked_frame_pts_valid ?
-			tracked_frame_pts : final_segment.last_pts;
+		auto start = DBL_MAX;
+		auto end_ = 0.;
 
-		auto find_and_output = [&](vector<shared_ptr<packets_segment>> &seg)
+		auto update = [&](double val)
 		{
-			auto it = begin(seg);
-			auto end_ = end(seg);
-			if (first_packets.empty()) {
-				for (; it != end_; it++) {
-					if ((last_pts - (*it)->last_pts) < save_duration)
-						break;
-				}
-			}
+			start = min(start, val);
+			end_ = max(end_, val);
+		};
 
-			for (; it != end_; it++) {
-				if (!OutputPackets(**it, &first_packets))
-					return false;
-			}
+		if (initial_segments.size())
+			update(initial_segments.front()->first_pts);
+		if (new_segments.size())
+			update(new_segments.back()->first_pts);
+		if (final_segment.num_pkts)
+			update(final_segment.last_pts);
 
-			return true;
-		};
+		return end_ - start;
+	}
 
-		if (!find_and_output(initial_segments)) {
-			warn("Failed to write limited initial segments");
-			return false;
-		}
+	/* closes the file (waiting for ffmpeg-mux to exit) before signalling,
+	 * always returns false so Step can return it */
+	bool Finish(bool success)
+	{
+		shm.reset();
+		pipe.reset();
+		mux.reset();
 
-		if (!find_and_output(new_segments)) {
-			warn("Failed to write limited new segments");
-			return false;
-		}
+		if (success) {
+			auto start_pts = GetStartPTS();
+			auto duration = CalculateDuration();
+			auto ts = os_gettime_ns();
 
-		if (!OutputPackets(final_segment, &first_packets)) {
-			warn("Failed to write limited final segments");
-			return false;
+			info("Saved '%s' (%s): started writing after %.1f ms, "
+					"finished after %.1f ms", path->array,
+					stream->mux_in_process ?
+						"in-process" : "ffmpeg-mux",
+					(open_ts - create_ts) / 1000000.,
+					(ts - create_ts) / 1000000.);
+
+			calldata_set_int(signal_data.get(), "frames", total_frames);
+			calldata_set_int(signal_data.get(), "start_pts", start_pts);
+			calldata_set_float(signal_data.get(), "duration", duration);
+
+			if (tracked_id)
+				calldata_set_int(signal_data.get(), "tracked_frame_id", tracked_id);
+
+			calldata_set_ptr(signal_data.get(), "buffer_id", buffer_id_valid ? &buffer_id : nullptr);
+
+			signal_handler_signal(stream->signal,
+					"buffer_output_finished", signal_data.get());
+		} else {
+			os_unlink(path);
+
+			SignalFailure();
 		}
 
-		return true;
+		finished = true;
+		return false;
 	}
 
-	bool WriteOutput()
+	void SignalFailure()
 	{
-		first_stream_packet_t first_packets;
+		calldata_set_ptr(signal_data.get(), "buffer_id", buffer_id_valid ? &buffer_id : nullptr);
+		signal_handler_signal(stream->signal,
+				"buffer_output_failed", signal_data.get());
+	}
+};
 
-		for (auto &pkt : headers.pkts) {
-			if (!write_packet(stream, pipe.get(), &pkt)) {
-				warn("Failed to write headers");
-				return false;
-			}
+void output_wakeups::Remove(buffer_output *out)
+{
+	auto remove_from = [&](multimap<int64_t, buffer_output*> &waiters)
+	{
+		for (auto it = begin(waiters); it != end(waiters);) {
+			if (it->second == out)
+				it = waiters.erase(it);
+			else
+				it++;
 		}
+	};
 
-		bool write_all_segments = save_duration < .25;
-		if (write_all_segments && !OutputSegments(initial_segments, &first_packets)) {
-			warn("Failed to write initial segments");
-			finish_output = false;
-			return false;
-		}
+	for (auto it = begin(frames); it != end(frames);) {
+		if (it->second == out)
+			it = frames.erase(it);
+		else
+			it++;
+	}
 
+	remove_from(pts);
+	remove_from(dts);
+	next_video.erase(remove(begin(next_video), end(next_video), out),
+			end(next_video));
+}
+
+vector<buffer_output*> output_wakeups::Take(const encoder_packet &packet)
+{
+	vector<buffer_output*> woken;
+
+	if (packet.tracked_id) {
+		auto range = frames.equal_range(packet.tracked_id);
+		for (auto it = range.first; it != range.second; it++)
+			woken.push_back(it->second);
+	}
+
+	if (packet.type == OBS_ENCODER_VIDEO) {
+		auto take = [&](multimap<int64_t, buffer_output*> &waiters,
+				int64_t ts)
 		{
-			unique_lock<decltype(output_mutex)> lock(output_mutex);
-			output_update.wait(lock, [&]
-			{
-				return exit_thread || finish_output;
-			});
+			auto last = waiters.upper_bound(ts);
+			for (auto it = begin(waiters); it != last; it++)
+				woken.push_back(it->second);
+		};
 
-			if (exit_thread)
-				return false;
-		}
+		take(pts, packet.pts);
+		take(dts, packet.dts);
+		woken.insert(end(woken), begin(next_video), end(next_video));
+	}
 
-		if (!write_all_segments)
-			return WriteLimitedOutput();
-		
-		if (!OutputSegments(new_segments, &first_packets)) {
-			warn("Failed to write new segments");
-			return false;
+	if (woken.empty())
+		return woken;
+
+	sort(begin(woken), end(woken));
+	woken.erase(unique(begin(woken), end(woken)), end(woken));
+
+	for (auto out : woken)
+		Remove(out);
+
+	return woken;
+}
+
+void output_wakeups::Clear()
+{
+	frames.clear();
+	pts.clear();
+	dts.clear();
+	next_video.clear();
+}
+
+void mux_worker_pool::Enqueue(buffer_output *out)
+{
+	{
+		LOCK(queue_mutex);
+		if (threads.empty()) {
+			running.assign(MUX_WORKER_THREADS, nullptr);
+			for (size_t i = 0; i < MUX_WORKER_THREADS; i++)
+				threads.emplace_back([=]()
+				{
+					WorkerThread(i);
+				});
 		}
 
+		queue.push_back(out);
+	}
+	queue_update.notify_one();
+}
 
-		if (!OutputPackets(final_segment, &first_packets)) {
-			warn("Failed to write final segment");
-			return false;
-		}
+void mux_worker_pool::Release(unique_ptr<buffer_output> out)
+{
+	if (!out)
+		return;
 
-		return true;
-	}
+	out->Abandon();
 
-	int64_t GetStartPTS()
 	{
-		if (first_output_segment)
-			return first_output_segment->keyframe_pts;
-
-		if (initial_segments.size())
-			return initial_segments.front()->keyframe_pts;
-		if (new_segments.size())
-			return new_segments.front()->keyframe_pts;
-		return final_segment.keyframe_pts;
+		LOCK(queue_mutex);
+		bool busy = find(begin(running), end(running), out.get()) !=
+				end(running) ||
+			find(begin(queue), end(queue), out.get()) != end(queue);
+
+		/* the worker that finishes it frees it */
+		if (busy || !out->finished) {
+			released.push_back(move(out));
+			return;
+		}
 	}
 
-	double CalculateDuration()
+	out.reset();
+}
+
+unique_ptr<buffer_output> mux_worker_pool::TakeReleased(buffer_output *out)
+{
+	auto it = find_if(begin(released), end(released),
+			[&](const unique_ptr<buffer_output> &released_out)
 	{
-		if (first_output_segment && last_output_segment)
-			return last_output_segment->last_pts - first_output_segment->first_pts;
+		return released_out.get() == out;
+	});
+	if (it == end(released))
+		return nullptr;
 
-		auto start = DBL_MAX;
-		auto end_ = 0.;
+	auto taken = move(*it);
+	released.erase(it);
+	return taken;
+}
 
-		auto update = [&](double val)
-		{
-			start = min(start, val);
-			end_ = max(end_, val);
-		};
+void mux_worker_pool::WorkerThread(size_t idx)
+{
+	os_set_thread_name("recordingbuffer: mux worker");
 
-		if (initial_segments.size())
-			update(initial_segments.front()->first_pts);
-		if (new_segments.size())
-			update(new_segments.back()->first_pts);
-		if (final_segment.pkts.size())
-			update(final_segment.last_pts);
+	unique_lock<decltype(queue_mutex)> lock(queue_mutex);
+	for (;;) {
+		queue_update.wait(lock, [&]
+		{
+			return stop || !queue.empty();
+		});
 
-		return end_ - start;
-	}
+		if (stop)
+			break;
 
-	void OutputThread()
-	{
-		if (WriteOutput()) {
-			auto start_pts = GetStartPTS();
-			auto duration = CalculateDuration();
+		auto out = queue.front();
+		queue.pop_front();
+		running[idx] = out;
 
-			calldata_set_int(signal_data.get(), "frames", total_frames);
-			calldata_set_int(signal_data.get(), "start_pts", start_pts);
-			calldata_set_float(signal_data.get(), "duration", duration);
+		lock.unlock();
+		bool more = out->Step();
+		lock.lock();
 
-			if (tracked_id)
-				calldata_set_int(signal_data.get(), "tracked_frame_id", tracked_id);
+		running[idx] = nullptr;
 
-			calldata_set_ptr(signal_data.get(), "buffer_id", buffer_id_valid ? &buffer_id : nullptr);
+		unique_ptr<buffer_output> done;
+		if (more)
+			queue.push_back(out);
+		else if (out->finished)
+			done = TakeReleased(out);
 
-			signal_handler_signal(stream->signal,
-					"buffer_output_finished", signal_data.get());
-		} else {
-			os_unlink(path);
+		step_done.notify_all();
 
-			SignalFailure();
+		if (done) {
+			lock.unlock();
+			done.reset();
+			lock.lock();
 		}
-
-		thread_finished = true;
 	}
+}
 
-	void SignalFailure()
+mux_worker_pool::~mux_worker_pool()
+{
 	{
-		calldata_set_ptr(signal_data.get(), "buffer_id", buffer_id_valid ? &buffer_id : nullptr);
-		signal_handler_signal(stream->signal,
-				"buffer_output_failed", signal_data.get());
+		unique_lock<decltype(queue_mutex)> lock(queue_mutex);
+		step_done.wait(lock, [&]
+		{
+			return queue.empty() && find_if(begin(running),
+					end(running), [](buffer_output *out)
+			{
+				return out != nullptr;
+			}) == end(running);
+		});
+
+		stop = true;
 	}
-};
+	queue_update.notify_all();
+
+	for (auto &thread_ : threads)
+		thread_.join();
+}
 
 }
 
@@ -565,9 +1276,38 @@ static const char *ffmpeg_mux_getname(void *unused)
 	return obs_module_text("FFmpegMuxer");
 }
 
+static void stop_spill_thread(ffmpeg_muxer *stream)
+{
+	if (!stream->spill_thread.joinable())
+		return;
+
+	{
+		LOCK(stream->spill_mutex);
+		stream->spill_exit = true;
+	}
+	stream->spill_update.notify_one();
+	stream->spill_thread.join();
+}
+
+static void release_outputs(struct ffmpeg_muxer *stream)
+{
+	stream->wakeups.Clear();
+	stream->interruptible_buffers.clear();
+
+	for (auto &out : stream->outputs)
+		stream->workers.Release(move(out));
+	for (auto &out : stream->complete_outputs)
+		stream->workers.Release(move(out));
+
+	stream->outputs.clear();
+	stream->complete_outputs.clear();
+}
+
 static void ffmpeg_mux_destroy(void *data)
 {
 	auto stream = static_cast<ffmpeg_muxer*>(data);
+	release_outputs(stream);
+	stop_spill_thread(stream);
 	delete stream;
 }
 
@@ -580,6 +1320,7 @@ static void output_buffer_handler(void *data, calldata_t *calldata)
 	LOCK(stream->buffer_mutex);
 	stream->complete_outputs.emplace_back(
 			new buffer_output{stream, filename});
+	stream->complete_outputs.back()->Start();
 }
 
 static void output_precise_buffer_handler(void *data, calldata_t *calldata)
@@ -593,6 +1334,8 @@ static void output_precise_buffer_handler(void *data, calldata_t *calldata)
 	auto frame_id = obs_track_next_frame();
 	stream->outputs.emplace_back(
 			new buffer_output{stream, filename, frame_id, duration});
+	stream->outputs.back()->AddWakeups(stream->wakeups);
+	stream->outputs.back()->Start();
 
 	calldata_set_int(calldata, "tracked_frame_id", frame_id);
 }
@@ -611,6 +1354,8 @@ static void output_precise_buffer_and_keep_recording_handler(
 	auto &out = stream->outputs.back();
 	out->keep_recording = true;
 	out->keep_recording_time = calldata_float(calldata, "extra_recording_duration");
+	out->AddWakeups(stream->wakeups);
+	out->Start();
 
 	calldata_set_int(calldata, "tracked_frame_id", frame_id);
 }
@@ -628,16 +1373,40 @@ static void output_interruptible_future_buffer(void *data, calldata_t *calldata)
 	auto &out = stream->outputs.back();
 	out->keep_recording = true;
 	out->keep_recording_time = calldata_float(calldata, "maximum_recording_duration");
+	out->AddWakeups(stream->wakeups);
 
 	auto buffer_id = stream->next_interruptiple_buffer_id++;
 	stream->interruptible_buffers.emplace(buffer_id, out.get());
 	out->buffer_id = buffer_id;
 	out->buffer_id_valid = true;
+	out->Start();
 
 	calldata_set_int(calldata, "tracked_frame_id", frame_id);
 	calldata_set_int(calldata, "buffer_id", buffer_id);
 }
 
+static size_t ram_bytes(const ffmpeg_muxer *stream)
+{
+	auto bytes = stream->payload_bytes - stream->payload_spilled_bytes;
+	if (stream->current_segment)
+		bytes += stream->current_segment->num_bytes;
+	return bytes;
+}
+
+static void get_buffer_stats(void *data, calldata_t *calldata)
+{
+	auto stream = static_cast<ffmpeg_muxer*>(data);
+
+	LOCK(stream->buffer_mutex);
+	calldata_set_int(calldata, "ram_bytes", ram_bytes(stream));
+	calldata_set_int(calldata, "disk_bytes", stream->payload_spilled_bytes);
+	calldata_set_float(calldata, "spill_latency_ms",
+			stream->spill_latency_ns / 1000000.);
+	calldata_set_float(calldata, "max_spill_latency_ms",
+			stream->max_spill_latency_ns / 1000000.);
+	calldata_set_int(calldata, "spill_failures", stream->spill_failures);
+}
+
 static void interrupt_buffer(void *data, calldata_t *calldata)
 {
 	auto stream = static_cast<ffmpeg_muxer*>(data);
@@ -655,9 +1424,125 @@ static void interrupt_buffer(void *data, calldata_t *calldata)
 	buffer->stop_frame_id = frame_id;
 	buffer->stop_frame_id_valid = true;
 
+	stream->wakeups.Remove(buffer);
+	buffer->AddWakeups(stream->wakeups);
+
 	calldata_set_int(calldata, "tracked_frame_id", frame_id);
 }
 
+static void spill_segment(ffmpeg_muxer *stream,
+		const shared_ptr<packets_segment> &seg, uint64_t queued_ts)
+{
+	size_t offset;
+	if (!stream->spill.Alloc(seg->num_bytes, offset)) {
+		LOCK(stream->buffer_mutex);
+		stream->spill_failures += 1;
+		return;
+	}
+
+	auto spilled = make_shared<packets_segment>(&stream->buffers);
+	spilled->spill.reset(new spill_allocation{&stream->spill, offset});
+
+	auto data = spilled->spill->Data();
+	seg->ForEach(seg->num_pkts, [&](const packet_entry &entry)
+	{
+		auto &copy = spilled->NextEntry();
+		copy = entry;
+		copy.data = data;
+		copy.shared = false;
+
+		if (entry.size)
+			memcpy(data, entry.data, entry.size);
+		data += entry.size;
+
+		spilled->num_pkts += 1;
+		return true;
+	});
+
+	spilled->num_bytes    = seg->num_bytes;
+	spilled->keyframe_pts = seg->keyframe_pts;
+	spilled->first_pts    = seg->first_pts;
+	spilled->last_pts     = seg->last_pts;
+	spilled->have_pts     = seg->have_pts;
+	spilled->Finalize();
+
+	LOCK(stream->buffer_mutex);
+
+	/* outputs that already have the in-memory segment keep using it */
+	auto it = find(begin(stream->payload_data), end(stream->payload_data),
+			seg);
+	if (it == end(stream->payload_data))
+		return;
+
+	*it = move(spilled);
+	stream->payload_spilled_bytes += seg->num_bytes;
+
+	stream->spill_latency_ns = os_gettime_ns() - queued_ts;
+	stream->max_spill_latency_ns = max(stream->max_spill_latency_ns,
+			stream->spill_latency_ns);
+}
+
+static void spill_thread(ffmpeg_muxer *stream)
+{
+	os_set_thread_name("recordingbuffer spill thread");
+
+	for (;;) {
+		ffmpeg_muxer::spill_item_t item;
+
+		{
+			unique_lock<decltype(stream->spill_mutex)> lock(
+					stream->spill_mutex);
+			stream->spill_update.wait(lock, [&]
+			{
+				return stream->spill_exit ||
+					!stream->spill_queue.empty();
+			});
+
+			if (stream->spill_exit)
+				return;
+
+			item = move(stream->spill_queue.front());
+			stream->spill_queue.pop_front();
+		}
+
+		spill_segment(stream, item.first, item.second);
+	}
+}
+
+static void start_spilling(ffmpeg_muxer *stream, obs_data_t *settings,
+		size_t size)
+{
+	DStr dir;
+	dstr_copy(dir, obs_data_get_string(settings, settings_spill_path_name));
+	if (dstr_is_empty(dir)) {
+		char *config_path = obs_module_config_path("spill");
+		dstr_copy(dir, config_path);
+		bfree(config_path);
+	}
+
+	if (os_mkdirs(dir) == MKDIR_ERROR) {
+		warn("Failed to create spill directory '%s'", dir->array);
+		return;
+	}
+
+	DStr path;
+	dstr_printf(path, "%s/recordingbuffer-%p-%llu.spill", dir->array,
+			static_cast<void*>(stream),
+			static_cast<unsigned long long>(os_gettime_ns()));
+
+	stream->spill.file.reset(spill_file_create(path, size));
+	if (!stream->spill.file)
+		return;
+
+	stream->spill_thread = thread([=]()
+	{
+		spill_thread(stream);
+	});
+
+	info("Spilling buffered packets to '%s' (%llu MB)", path->array,
+			static_cast<unsigned long long>(size / 1024 / 1024));
+}
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	auto stream = new ffmpeg_muxer;
@@ -669,6 +1554,20 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 		stream->buffer_length = 1.;
 	}
 
+	auto max_size_mb = obs_data_get_int(settings, settings_buffer_max_size_name);
+	if (max_size_mb > 0)
+		stream->buffer_max_bytes = static_cast<size_t>(max_size_mb) * 1024 * 1024;
+
+	stream->mux_in_process = obs_data_get_bool(settings,
+			settings_mux_in_process_name);
+	if (stream->mux_in_process)
+		av_register_all();
+
+	auto spill_size_mb = obs_data_get_int(settings, settings_spill_size_name);
+	if (spill_size_mb > 0)
+		start_spilling(stream, settings,
+				static_cast<size_t>(spill_size_mb) * 1024 * 1024);
+
 	auto proc = obs_output_get_proc_handler(output);
 	proc_handler_add(proc, "void output_buffer(string filename)",
 			output_buffer_handler, stream);
@@ -685,6 +1584,10 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 			output_interruptible_future_buffer, stream);
 	proc_handler_add(proc, "void interrupt_buffer(int buffer_id, out int tracked_frame_id)",
 			interrupt_buffer, stream);
+	proc_handler_add(proc, "void get_buffer_stats(out int ram_bytes, "
+			"out int disk_bytes, out float spill_latency_ms, "
+			"out float max_spill_latency_ms, out int spill_failures)",
+			get_buffer_stats, stream);
 
 	auto signal = obs_output_get_signal_handler(output);
 	signal_handler_add(signal,
@@ -710,8 +1613,8 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 
 /* TODO: allow codecs other than h264 whenever we start using them */
 
-static bool add_video_encoder_params(struct ffmpeg_muxer *stream,
-		struct dstr *cmd, obs_encoder_t *vencoder)
+static bool get_video_params(struct ffmpeg_muxer *stream,
+		obs_encoder_t *vencoder, struct main_params *params)
 {
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
@@ -723,37 +1626,68 @@ static bool add_video_encoder_params(struct ffmpeg_muxer *stream,
 	if (!info)
 		return false;
 
-	dstr_catf(cmd, "%s %d %d %d %d %d ",
-			"h264",
-			bitrate,
-			obs_output_get_width(stream->output),
-			obs_output_get_height(stream->output),
-			(int)info->fps_num,
-			(int)info->fps_den);
-
+	params->vcodec   = const_cast<char*>("h264");
+	params->vbitrate = bitrate;
+	params->width    = (int)obs_output_get_width(stream->output);
+	params->height   = (int)obs_output_get_height(stream->output);
+	params->fps_num  = (int)info->fps_num;
+	params->fps_den  = (int)info->fps_den;
 	return true;
 }
 
-static bool add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
+static bool get_audio_params(obs_encoder_t *aencoder,
+		struct audio_params *params)
 {
 	obs_data_t *settings = obs_encoder_get_settings(aencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
 	audio_t *audio = obs_get_audio();
-	struct dstr name = {0};
 
 	obs_data_release(settings);
 
 	if (!audio)
 		return false;
 
+	params->abitrate    = bitrate;
+	params->sample_rate = (int)obs_encoder_get_sample_rate(aencoder);
+	params->channels    = (int)audio_output_get_channels(audio);
+	return true;
+}
+
+static bool add_video_encoder_params(struct ffmpeg_muxer *stream,
+		struct dstr *cmd, obs_encoder_t *vencoder)
+{
+	struct main_params params = {};
+
+	if (!get_video_params(stream, vencoder, &params))
+		return false;
+
+	dstr_catf(cmd, "%s %d %d %d %d %d ",
+			params.vcodec,
+			params.vbitrate,
+			params.width,
+			params.height,
+			params.fps_num,
+			params.fps_den);
+
+	return true;
+}
+
+static bool add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
+{
+	struct audio_params params = {};
+	struct dstr name = {0};
+
+	if (!get_audio_params(aencoder, &params))
+		return false;
+
 	dstr_copy(&name, obs_encoder_get_name(aencoder));
 	dstr_replace(&name, "\"", "\"\"");
 
 	dstr_catf(cmd, "\"%s\" %d %d %d ",
 			name.array,
-			bitrate,
-			(int)obs_encoder_get_sample_rate(aencoder),
-			(int)audio_output_get_channels(audio));
+			params.abitrate,
+			params.sample_rate,
+			params.channels);
 
 	dstr_free(&name);
 
@@ -813,7 +1747,7 @@ static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
 }
 
 static bool build_command_line(struct ffmpeg_muxer *stream, const dstr *path,
-		struct dstr *cmd)
+		ffmpeg_mux_shm *shm, struct dstr *cmd)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
 	obs_encoder_t *aencoders[MAX_AUDIO_MIXES];
@@ -831,7 +1765,10 @@ static bool build_command_line(struct ffmpeg_muxer *stream, const dstr *path,
 
 	dstr_init_move_array(cmd, obs_module_file(FFMPEG_MUX));
 	dstr_insert_ch(cmd, 0, '\"');
-	dstr_cat(cmd, "\" \"");
+	dstr_cat(cmd, "\" ");
+	if (shm)
+		ffmpeg_mux_shm_add_arg(shm, cmd);
+	dstr_cat(cmd, "\"");
 	dstr_cat_dstr(cmd, path);
 	dstr_catf(cmd, "\" %d %d ", vencoder ? 1 : 0, num_tracks);
 
@@ -852,6 +1789,71 @@ static bool build_command_line(struct ffmpeg_muxer *stream, const dstr *path,
 	return true;
 }
 
+/* fills in the same parameters build_command_line passes to ffmpeg-mux,
+ * strings keeps the ones that aren't owned by the output alive */
+static bool init_mux_params(struct ffmpeg_muxer *stream, ffmpeg_mux *mux,
+		const char *path, vector<DStr> &strings)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_encoder_t *aencoders[MAX_AUDIO_MIXES];
+	int num_tracks = 0;
+
+	for (;;) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(
+				stream->output, num_tracks);
+		if (!aencoder)
+			break;
+
+		aencoders[num_tracks] = aencoder;
+		num_tracks++;
+	}
+
+	mux->params.file      = const_cast<char*>(path);
+	mux->params.has_video = vencoder ? 1 : 0;
+	mux->params.tracks    = num_tracks;
+
+	if (vencoder && !get_video_params(stream, vencoder, &mux->params))
+		return false;
+
+	if (num_tracks) {
+		mux->params.acodec = const_cast<char*>("aac");
+		mux->audio = static_cast<audio_params*>(
+				calloc(num_tracks, sizeof(audio_params)));
+		mux->audio_header = static_cast<header*>(
+				calloc(num_tracks, sizeof(header)));
+
+		for (int i = 0; i < num_tracks; i++) {
+			if (!get_audio_params(aencoders[i], &mux->audio[i]))
+				return false;
+
+			strings.emplace_back();
+			dstr_copy(strings.back(),
+					obs_encoder_get_name(aencoders[i]));
+			mux->audio[i].name = strings.back();
+		}
+	}
+
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	strings.emplace_back();
+	dstr_copy(strings.back(), obs_data_get_string(settings,
+				"muxer_settings"));
+	mux->params.muxer_settings = strings.back();
+	obs_data_release(settings);
+
+	return true;
+}
+
+static void mux_log(void *param, const char *msg)
+{
+	auto stream = static_cast<ffmpeg_muxer*>(param);
+	size_t len = strlen(msg);
+
+	while (len && msg[len - 1] == '\n')
+		len--;
+
+	info("%.*s", (int)len, msg);
+}
+
 static bool ffmpeg_mux_start(void *data)
 {
 	auto stream = static_cast<ffmpeg_muxer*>(data);
@@ -874,8 +1876,7 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (stream->active) {
-		stream->outputs.clear();
-		stream->complete_outputs.clear();
+		release_outputs(stream);
 		stream->active = false;
 		stream->have_headers = false;
 
@@ -897,50 +1898,45 @@ static void ffmpeg_mux_stop(void *data)
 	deactivate(stream);
 }
 
-static void signal_failure(struct ffmpeg_muxer *stream)
-{
-	int ret = deactivate(stream);
-	int code;
-
-	switch (ret) {
-	case FFM_UNSUPPORTED:          code = OBS_OUTPUT_UNSUPPORTED; break;
-	default:                       code = OBS_OUTPUT_ERROR;
-	}
-
-	obs_output_signal_stop(stream->output, code);
-	stream->capturing = false;
-}
-
 static bool write_packet(struct ffmpeg_muxer *stream, os_process_pipe_t *pipe,
+		ffmpeg_mux_shm *shm, ffmpeg_mux *mux,
 		struct encoder_packet *packet)
 {
-	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	struct ffm_packet_info info = get_packet_info(*packet);
 	size_t ret;
 
-	struct ffm_packet_info info;
-	info.pts = packet->pts;
-	info.dts = packet->dts;
-	info.size = (uint32_t)packet->size;
-	info.index = (int)packet->track_idx;
-	info.type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
-	info.keyframe = packet->keyframe;
-
 	if (packet->tracked_id)
 		blog(LOG_INFO, "writing tracked packet %lld (%lld)", packet->pts,
 				packet->tracked_id);
 
+	if (mux) {
+		if (!ffmpeg_mux_packet(mux, packet->data, &info)) {
+			warn("ffmpeg_mux_packet failed");
+			return false;
+		}
+
+		return true;
+	}
+
+	if (shm) {
+		if (!ffmpeg_mux_shm_write(shm, &info, packet->data)) {
+			warn("ffmpeg_mux_shm_write failed");
+			return false;
+		}
+
+		return true;
+	}
+
 	ret = os_process_pipe_write(pipe, (const uint8_t*)&info,
 			sizeof(info));
 	if (ret != sizeof(info)) {
 		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
 		return false;
 	}
 
 	ret = os_process_pipe_write(pipe, packet->data, packet->size);
 	if (ret != packet->size) {
 		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
 		return false;
 	}
 
@@ -1007,58 +2003,41 @@ static double interval(const packets_segment &oldest, const packets_segment &you
 	return youngest.last_pts - oldest.first_pts;
 }
 
-static void prune_old_segments(ffmpeg_muxer *stream)
+static void pop_old_segment(ffmpeg_muxer *stream)
 {
-	if (stream->payload_data.empty())
-		return;
+	auto &seg = stream->payload_data.front();
 
-	if (interval(*stream->payload_data.front(), *stream->current_segment)
-			- stream->current_segment->Length() < stream->buffer_length)
-		return;
+	stream->payload_bytes -= seg->num_bytes;
+	if (seg->spill)
+		stream->payload_spilled_bytes -= seg->num_bytes;
 
 	stream->payload_data.pop_front();
 }
 
-template <typename T, typename D, typename ... Ts>
-static shared_ptr<T> make_shared_deleter(D &&d, Ts &&... ts)
-{
-	return {new T{forward<Ts>(ts)...}, forward<D>(d)};
-}
-
-static void push_buffer(ffmpeg_muxer *stream, packets_segment::data_t &&data)
+static void prune_old_segments(ffmpeg_muxer *stream)
 {
-	if (!data.capacity())
+	if (stream->payload_data.empty())
 		return;
 
-	data.clear();
-
-	LOCK(stream->buffers_mutex);
-	stream->buffers.emplace_back(move(data));
-}
-
-static packets_segment::data_t pop_buffer(ffmpeg_muxer *stream)
-{
-	LOCK(stream->buffers_mutex);
-	if (stream->buffers.empty())
-		return {};
+	if (interval(*stream->payload_data.front(), *stream->current_segment)
+			- stream->current_segment->Length() >= stream->buffer_length)
+		pop_old_segment(stream);
 
-	auto buffer = move(stream->buffers.back());
-	stream->buffers.pop_back();
+	if (!stream->buffer_max_bytes)
+		return;
 
-	return buffer;
+	/* only memory counts, the spill file has its own size.  segments are
+	 * spilled oldest first, so once the oldest one is on disk the rest
+	 * are still waiting for the spill thread */
+	while (!stream->payload_data.empty() &&
+			!stream->payload_data.front()->spill &&
+			ram_bytes(stream) > stream->buffer_max_bytes)
+		pop_old_segment(stream);
 }
 
 static shared_ptr<packets_segment> create_segment(ffmpeg_muxer *stream)
 {
-	auto seg = make_shared_deleter<packets_segment>([&, stream](packets_segment *seg)
-	{
-		push_buffer(stream, move(seg->data));
-		delete seg;
-	});
-
-	seg->data = pop_buffer(stream);
-
-	return seg;
+	return make_shared<packets_segment>(&stream->buffers);
 }
 
 static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
@@ -1082,34 +2061,58 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 	if (packet->keyframe) {
 		prune_old_segments(stream);
 
+		stream->current_segment->Finalize();
+
 		for (auto &output : stream->outputs)
 			output->AppendSegment(stream->current_segment);
 
-		if (!stream->current_segment->pkts.empty())
+		if (stream->current_segment->num_pkts) {
+			stream->payload_bytes += stream->current_segment->num_bytes;
 			stream->payload_data.emplace_back(move(stream->current_segment));
 
+			if (stream->spill.file) {
+				{
+					LOCK(stream->spill_mutex);
+					stream->spill_queue.emplace_back(
+							stream->payload_data.back(),
+							os_gettime_ns());
+				}
+				stream->spill_update.notify_one();
+			}
+		}
+
 		stream->current_segment = create_segment(stream);
 	}
 
 	stream->current_segment->AddPacket(*packet);
 
-	for (size_t i = 0; i < stream->outputs.size();) {
-		auto &output = stream->outputs[i];
-		if (!output->NewPacket(*packet, *stream->current_segment)) {
-			stream->complete_outputs.emplace_back(move(output));
-			stream->outputs.erase(begin(stream->outputs) + i);
-		} else
-			i += 1;
+	for (auto output : stream->wakeups.Take(*packet)) {
+		if (output->NewPacket(*packet, stream->current_segment)) {
+			output->AddWakeups(stream->wakeups);
+			continue;
+		}
+
+		auto it = find_if(begin(stream->outputs), end(stream->outputs),
+				[&](const unique_ptr<buffer_output> &out)
+		{
+			return out.get() == output;
+		});
+		if (it == end(stream->outputs))
+			continue;
+
+		stream->complete_outputs.emplace_back(move(*it));
+		stream->outputs.erase(it);
 	}
 
 	for (size_t i = 0; i < stream->complete_outputs.size();) {
-		if (stream->complete_outputs[i]->thread_finished) {
+		if (stream->complete_outputs[i]->finished) {
 			auto &out = stream->complete_outputs[i];
 			if (out->buffer_id_valid) {
 				auto it = stream->interruptible_buffers.find(out->buffer_id);
 				if (it != end(stream->interruptible_buffers))
 					stream->interruptible_buffers.erase(it);
 			}
+			stream->workers.Release(move(out));
 			stream->complete_outputs.erase(
 					begin(stream->complete_outputs) + i);
 		} else
@@ -1132,6 +2135,11 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 static void ffmpeg_mux_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_double(settings, settings_buffer_length_name, 60.);
+	obs_data_set_default_int(settings, settings_buffer_max_size_name, 0);
+	obs_data_set_default_int(settings, settings_spill_size_name, 0);
+	/* in-process muxing is opt-in: it hasn't been benchmarked against
+	 * ffmpeg-mux, which also keeps a crashing muxer out of obs */
+	obs_data_set_default_bool(settings, settings_mux_in_process_name, false);
 }
 
 extern "C" void register_recordingbuffer(void)
@@ -0,0 +1,164 @@
+/******************************************************************************
+    Copyright (C) 2026 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/base.h>
+#include <util/platform.h>
+#include "obs-ffmpeg-spill-file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct spill_file {
+	uint8_t *data;
+	size_t  size;
+#ifdef _WIN32
+	HANDLE  file;
+	HANDLE  mapping;
+#endif
+};
+
+#ifdef _WIN32
+
+struct spill_file *spill_file_create(const char *path, size_t size)
+{
+	struct spill_file *sf = bzalloc(sizeof(*sf));
+	wchar_t *wpath = NULL;
+
+	sf->size = size;
+	sf->file = INVALID_HANDLE_VALUE;
+
+	os_utf8_to_wcs_ptr(path, 0, &wpath);
+	if (!wpath)
+		goto fail;
+
+	sf->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+			NULL);
+	bfree(wpath);
+	if (sf->file == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	sf->mapping = CreateFileMappingW(sf->file, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+	if (!sf->mapping)
+		goto fail;
+
+	sf->data = MapViewOfFile(sf->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!sf->data)
+		goto fail;
+
+	return sf;
+
+fail:
+	blog(LOG_WARNING, "Failed to create spill file '%s' (%lu)", path,
+			GetLastError());
+	spill_file_destroy(sf);
+	return NULL;
+}
+
+void spill_file_destroy(struct spill_file *sf)
+{
+	if (!sf)
+		return;
+
+	if (sf->data)
+		UnmapViewOfFile(sf->data);
+	if (sf->mapping)
+		CloseHandle(sf->mapping);
+	if (sf->file != INVALID_HANDLE_VALUE)
+		CloseHandle(sf->file);
+	bfree(sf);
+}
+
+#else
+
+struct spill_file *spill_file_create(const char *path, size_t size)
+{
+	struct spill_file *sf;
+	void *map;
+	int fd;
+	int ret;
+
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	/* only the mapping is needed from here on */
+	unlink(path);
+
+	/* reserve the space up front, running out of it while writing to
+	 * the mapping would raise SIGBUS */
+#ifdef __APPLE__
+	ret = ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+#else
+	ret = posix_fallocate(fd, 0, (off_t)size);
+#endif
+	if (ret != 0) {
+		close(fd);
+		goto fail;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ret = errno;
+	close(fd);
+
+	if (map == MAP_FAILED)
+		goto fail;
+
+	sf = bzalloc(sizeof(*sf));
+	sf->data = map;
+	sf->size = size;
+	return sf;
+
+fail:
+	blog(LOG_WARNING, "Failed to create spill file '%s' (%s)", path,
+			strerror(ret));
+	return NULL;
+}
+
+void spill_file_destroy(struct spill_file *sf)
+{
+	if (!sf)
+		return;
+
+	munmap(sf->data, sf->size);
+	bfree(sf);
+}
+
+#endif
+
+uint8_t *spill_file_data(struct spill_file *sf)
+{
+	return sf->data;
+}
+
+size_t spill_file_size(const struct spill_file *sf)
+{
+	return sf->size;
+}
@@ -0,0 +1,42 @@
+/******************************************************************************
+    Copyright (C) 2026 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory mapped scratch file used by the recording buffer to keep older
+ * packet data on disk.  The file is deleted when it's destroyed (or when the
+ * process exits, where the platform allows it).
+ */
+
+struct spill_file;
+
+extern struct spill_file *spill_file_create(const char *path, size_t size);
+extern void spill_file_destroy(struct spill_file *file);
+
+extern uint8_t *spill_file_data(struct spill_file *file);
+extern size_t spill_file_size(const struct spill_file *file);
+
+#ifdef __cplusplus
+}
+#endif
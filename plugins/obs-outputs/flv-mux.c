@@ -177,11 +177,30 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
+size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+		uint8_t *prefix)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		uint32_t offset = get_ms_time(packet, packet->pts - packet->dts);
+
+		prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		prefix[1] = is_header ? 0 : 1;
+		prefix[2] = (uint8_t)(offset >> 16);
+		prefix[3] = (uint8_t)(offset >> 8);
+		prefix[4] = (uint8_t)offset;
+		return VIDEO_HEADER_SIZE;
+	}
+
+	prefix[0] = 0xaf;
+	prefix[1] = is_header ? 0 : 1;
+	return 2;
+}
+
 static void flv_video(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
-	int64_t offset  = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
 
 	if (!packet->data || !packet->size)
 		return;
@@ -203,9 +222,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
+	s_write(s, prefix, flv_packet_prefix(packet, is_header, prefix));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
@@ -216,6 +233,7 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
 
 	if (!packet->data || !packet->size)
 		return;
@@ -237,8 +255,7 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	s_write(s, prefix, flv_packet_prefix(packet, is_header, prefix));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
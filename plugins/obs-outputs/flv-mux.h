@@ -19,7 +19,9 @@
 
 #include <obs.h>
 
-#define MILLISECOND_DEN   1000
+#define MILLISECOND_DEN     1000
+#define FLV_MAX_PREFIX_SIZE 5
+#define FLV_TAG_OVERHEAD    15 /* tag header and trailing tag size */
 
 static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 {
@@ -32,3 +34,8 @@ extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+/* writes the bytes of an FLV audio/video tag body that precede the packet
+ * data (at most FLV_MAX_PREFIX_SIZE), returns their size */
+extern size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+		uint8_t *prefix);
@@ -32,6 +32,10 @@
 #include "rtmp_sys.h"
 #include "log.h"
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #ifdef CRYPTO
 #ifdef USE_POLARSSL
 #include <polarssl/havege.h>
@@ -5239,3 +5243,280 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+#ifdef _WIN32
+typedef WSABUF RTMPIOVec;
+#define IOV_BASE(v) (v).buf
+#define IOV_LEN(v)  (v).len
+#else
+typedef struct iovec RTMPIOVec;
+#define IOV_BASE(v) (v).iov_base
+#define IOV_LEN(v)  (v).iov_len
+#endif
+
+/* enough for 21 chunks (header, prefix and data each) per call */
+#define RTMP_MAX_IOV 64
+
+static inline void
+SetIOV(RTMPIOVec *v, const char *buf, int len)
+{
+    IOV_BASE(*v) = (void *)buf;
+    IOV_LEN(*v) = len;
+}
+
+/* connections that encrypt or wrap the data (or send it through a custom
+ * function) have to go through WriteN */
+static int
+CanWriteV(RTMP *r)
+{
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend && r->m_customSendFunc)
+        return FALSE;
+#if defined(CRYPTO) && !defined(NO_SSL)
+    if (r->m_sb.sb_ssl)
+        return FALSE;
+#endif
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#endif
+    return TRUE;
+}
+
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        int nBytes;
+#ifdef _WIN32
+        DWORD sent = 0;
+        nBytes = WSASend(r->m_sb.sb_socket, iov, iovcnt, &sent, 0, NULL,
+                         NULL) == 0 ? (int)sent : -1;
+#else
+        nBytes = (int)writev(r->m_sb.sb_socket, iov, iovcnt);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip what was written, partially written vectors are advanced */
+        while (iovcnt && nBytes >= (int)IOV_LEN(*iov))
+        {
+            nBytes -= (int)IOV_LEN(*iov);
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt)
+        {
+            SetIOV(iov, (const char *)IOV_BASE(*iov) + nBytes,
+                   (int)IOV_LEN(*iov) - nBytes);
+        }
+    }
+
+    return TRUE;
+}
+
+/* encodes the first chunk header of packet into hbuf (RTMP_MAX_HEADER_SIZE
+ * bytes) the same way RTMP_SendPacket does, returns its size.  c and cSize
+ * receive what's needed for the continuation chunk headers */
+static int
+EncodeChunkHeader(RTMP *r, RTMPPacket *packet, char *hbuf, char *c,
+                  int *cSize)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0;
+    uint32_t t;
+    int nSize, hSize;
+    char *hptr, *hend = hbuf + RTMP_MAX_HEADER_SIZE;
+
+    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int n = packet->m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
+        if (!packets)
+        {
+            free(r->m_vecChannelsOut);
+            r->m_vecChannelsOut = NULL;
+            r->m_channelsAllocatedOut = 0;
+            return -1;
+        }
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = n;
+    }
+
+    prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
+    if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet->m_nBodySize
+                && prevPacket->m_packetType == packet->m_packetType
+                && packet->m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet->m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet->m_nTimeStamp
+                && packet->m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet->m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet->m_headerType];
+    hSize = nSize;
+    t = packet->m_nTimeStamp - last;
+
+    *cSize = 0;
+    if (packet->m_nChannel > 319)
+        *cSize = 2;
+    else if (packet->m_nChannel > 63)
+        *cSize = 1;
+
+    hptr = hbuf;
+    *c = packet->m_headerType << 6;
+    switch (*cSize)
+    {
+    case 0:
+        *c |= packet->m_nChannel;
+        break;
+    case 1:
+        break;
+    case 2:
+        *c |= 1;
+        break;
+    }
+    *hptr++ = *c;
+    if (*cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        *hptr++ = tmp & 0xff;
+        if (*cSize == 2)
+            *hptr++ = tmp >> 8;
+        hSize += *cSize;
+    }
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet->m_nBodySize);
+        *hptr++ = packet->m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet->m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+    {
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+        hSize += 4;
+    }
+
+    return hSize;
+}
+
+int
+RTMP_WriteMedia(RTMP *r, int packetType, uint32_t timestamp,
+                const char *prefix, int prefixSize,
+                const char *data, int dataSize, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    char hbuf[RTMP_MAX_HEADER_SIZE], cont[3], c;
+    int iovcnt = 0, hSize, cSize, contSize, nChunkSize, offset = 0;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = prefixSize + dataSize;
+    packet.m_headerType = timestamp ? RTMP_PACKET_SIZE_MEDIUM :
+                          RTMP_PACKET_SIZE_LARGE;
+
+    if (!CanWriteV(r))
+    {
+        int ret;
+
+        if (!RTMPPacket_Alloc(&packet, packet.m_nBodySize))
+            return FALSE;
+
+        memcpy(packet.m_body, prefix, prefixSize);
+        memcpy(packet.m_body + prefixSize, data, dataSize);
+        ret = RTMP_SendPacket(r, &packet, FALSE);
+        RTMPPacket_Free(&packet);
+        return ret;
+    }
+
+    hSize = EncodeChunkHeader(r, &packet, hbuf, &c, &cSize);
+    if (hSize < 0)
+        return FALSE;
+
+    cont[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet.m_nChannel - 64;
+        cont[1] = tmp & 0xff;
+        if (cSize == 2)
+            cont[2] = tmp >> 8;
+    }
+    contSize = 1 + cSize;
+
+    SetIOV(&iov[iovcnt++], hbuf, hSize);
+    nChunkSize = r->m_outChunkSize;
+
+    while (offset < (int)packet.m_nBodySize)
+    {
+        int end = offset + nChunkSize;
+        if (end > (int)packet.m_nBodySize)
+            end = packet.m_nBodySize;
+
+        if (offset)
+        {
+            if (iovcnt + 3 > RTMP_MAX_IOV)
+            {
+                if (!WriteV(r, iov, iovcnt))
+                    return FALSE;
+                iovcnt = 0;
+            }
+
+            SetIOV(&iov[iovcnt++], cont, contSize);
+        }
+
+        if (offset < prefixSize)
+        {
+            int prefixEnd = end < prefixSize ? end : prefixSize;
+            SetIOV(&iov[iovcnt++], prefix + offset, prefixEnd - offset);
+        }
+
+        if (end > prefixSize)
+        {
+            int start = offset > prefixSize ? offset : prefixSize;
+            SetIOV(&iov[iovcnt++], data + (start - prefixSize),
+                   end - start);
+        }
+
+        offset = end;
+    }
+
+    if (iovcnt && !WriteV(r, iov, iovcnt))
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return TRUE;
+}
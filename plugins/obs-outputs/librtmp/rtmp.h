@@ -414,6 +414,14 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* sends an audio/video message whose body is prefix followed by data.
+     * on plain connections the chunk headers are written along with the
+     * (uncopied) body using writev/WSASend, other connections copy the body
+     * once and use RTMP_SendPacket */
+    int RTMP_WriteMedia(RTMP *r, int packetType, uint32_t timestamp,
+                        const char *prefix, int prefixSize,
+                        const char *data, int dataSize, int streamIdx);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+
+/*
+ * Single producer/single consumer encoder packet queue
+ *
+ *   Packets are stored in linked fixed-size segments and published through
+ * atomic push/pop sequence counters, so one thread can push while another
+ * pops without any lock.  Sequence numbers wrap, so always compare them
+ * through packet_seq_diff.
+ */
+
+#define PACKET_SEGMENT_SIZE 256
+
+struct packet_segment {
+	struct packet_segment *next;
+	struct encoder_packet packets[PACKET_SEGMENT_SIZE];
+};
+
+struct packet_queue {
+	struct packet_segment *write_segment;
+	size_t                write_idx;
+	struct packet_segment *read_segment;
+	size_t                read_idx;
+	volatile long         pushed;
+	volatile long         popped;
+};
+
+static inline long packet_seq_diff(long a, long b)
+{
+	return (long)((unsigned long)a - (unsigned long)b);
+}
+
+static inline void packet_queue_init(struct packet_queue *pq)
+{
+	pq->write_segment = bzalloc(sizeof(struct packet_segment));
+	pq->read_segment  = pq->write_segment;
+}
+
+/* doesn't free the packets themselves, pop them first */
+static inline void packet_queue_free(struct packet_queue *pq)
+{
+	struct packet_segment *segment = pq->read_segment;
+
+	while (segment) {
+		struct packet_segment *next = segment->next;
+		bfree(segment);
+		segment = next;
+	}
+
+	pq->read_segment  = NULL;
+	pq->write_segment = NULL;
+}
+
+static inline size_t packet_queue_size(struct packet_queue *pq)
+{
+	long pushed = os_atomic_load_long(&pq->pushed);
+	long popped = os_atomic_load_long(&pq->popped);
+	return (size_t)packet_seq_diff(pushed, popped);
+}
+
+/* producer side */
+static inline void packet_queue_push(struct packet_queue *pq,
+		const struct encoder_packet *packet)
+{
+	if (pq->write_idx == PACKET_SEGMENT_SIZE) {
+		struct packet_segment *segment =
+			bzalloc(sizeof(struct packet_segment));
+		pq->write_segment->next = segment;
+		pq->write_segment = segment;
+		pq->write_idx = 0;
+	}
+
+	pq->write_segment->packets[pq->write_idx++] = *packet;
+
+	/* publishes both the packet and the segment link to the consumer */
+	os_atomic_inc_long(&pq->pushed);
+}
+
+/* consumer side */
+static inline bool packet_queue_pop(struct packet_queue *pq,
+		struct encoder_packet *packet, long *seq)
+{
+	long popped = pq->popped;
+	long pushed = os_atomic_load_long(&pq->pushed);
+
+	if (packet_seq_diff(pushed, popped) <= 0)
+		return false;
+
+	if (pq->read_idx == PACKET_SEGMENT_SIZE) {
+		struct packet_segment *next = pq->read_segment->next;
+		bfree(pq->read_segment);
+		pq->read_segment = next;
+		pq->read_idx = 0;
+	}
+
+	*packet = pq->read_segment->packets[pq->read_idx++];
+	*seq = popped;
+
+	os_atomic_inc_long(&pq->popped);
+	return true;
+}
@@ -0,0 +1,389 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* how often the send buffer is checked against the congestion window */
+#define SNDBUF_CHECK_INTERVAL_MS 1000
+
+static inline void close_fd(int *fd)
+{
+	if (*fd != -1) {
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+bool socket_thread_linux_init(struct rtmp_stream *stream)
+{
+	struct epoll_event ev = {0};
+
+	stream->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	stream->socket_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (stream->epoll_fd == -1 || stream->socket_wake_fd == -1)
+		goto fail;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_wake_fd;
+	if (epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, stream->socket_wake_fd,
+				&ev) != 0)
+		goto fail;
+
+	/* edge triggered, so EPOLLOUT is only reported again once send()
+	 * has returned EAGAIN, the same way FD_WRITE works on windows */
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+	if (epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD,
+				stream->rtmp.m_sb.sb_socket, &ev) != 0)
+		goto fail;
+
+	return true;
+
+fail:
+	blog(LOG_ERROR, "socket_thread_linux: Failed to initialize, %s",
+			strerror(errno));
+	socket_thread_linux_free(stream);
+	return false;
+}
+
+void socket_thread_linux_free(struct rtmp_stream *stream)
+{
+	close_fd(&stream->epoll_fd);
+	close_fd(&stream->socket_wake_fd);
+}
+
+void socket_thread_linux_wake(struct rtmp_stream *stream)
+{
+	uint64_t val = 1;
+	ssize_t ret;
+
+	if (stream->socket_wake_fd == -1)
+		return;
+
+	ret = write(stream->socket_wake_fd, &val, sizeof(val));
+	UNUSED_PARAMETER(ret);
+}
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	stream->write_buf_pos = 0;
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static void set_nonblocking(int fd, bool nonblocking)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1)
+		return;
+
+	if (nonblocking)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+
+	fcntl(fd, F_SETFL, flags);
+}
+
+static bool socket_event(struct rtmp_stream *stream, uint32_t events,
+		bool *can_write, uint64_t last_send_time)
+{
+	if (events & EPOLLOUT)
+		*can_write = true;
+
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+		char discard[16384];
+
+		for (;;) {
+			ssize_t ret = recv(stream->rtmp.m_sb.sb_socket,
+					discard, sizeof(discard), 0);
+			int err_code = errno;
+
+			if (ret > 0)
+				continue;
+			if (ret == -1 && err_code == EINTR)
+				continue;
+			if (ret == -1 && (err_code == EAGAIN ||
+			                  err_code == EWOULDBLOCK))
+				break;
+
+			if (ret == 0) {
+				uint32_t diff = last_send_time ?
+					(uint32_t)(os_gettime_ns() / 1000000 -
+						last_send_time) : 0;
+
+				if (os_event_try(stream->stop_event) != EAGAIN)
+					blog(LOG_ERROR, "socket_thread_linux: "
+							"Aborting due to EOF "
+							"during shutdown, "
+							"%d bytes lost",
+							(int)stream->write_buf_len);
+				else
+					blog(LOG_ERROR, "socket_thread_linux: "
+							"Aborting due to EOF, "
+							"%u ms since last send "
+							"(buffer: %d / %d)",
+							diff,
+							(int)stream->write_buf_len,
+							(int)stream->write_buf_size);
+			} else {
+				blog(LOG_ERROR, "socket_thread_linux: "
+						"Socket error, recv() returned "
+						"%d, errno %d",
+						(int)ret, err_code);
+			}
+
+			fatal_sock_shutdown(stream);
+			return false;
+		}
+	}
+
+	if (events & EPOLLERR) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR,
+				&err_code, &size);
+
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to socket "
+				"error %d", err_code);
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	return true;
+}
+
+/* linux has no equivalent of the ideal send backlog notification, so the
+ * send buffer is periodically grown to fit the congestion window instead */
+static void check_send_buffer(struct rtmp_stream *stream)
+{
+	struct tcp_info info;
+	socklen_t size = sizeof(info);
+	uint64_t ideal;
+
+	if (getsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_INFO,
+				&info, &size) != 0) {
+		blog(LOG_ERROR, "socket_thread_linux: getsockopt(TCP_INFO) "
+				"returned %d", errno);
+		return;
+	}
+
+	ideal = (uint64_t)info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+	if (!ideal || ideal > INT_MAX)
+		return;
+
+	if (adjust_sndbuf_size(stream, (int)ideal))
+		blog(LOG_INFO, "socket_thread_linux: Increasing send buffer to "
+				"%d (cwnd: %u, rtt: %u us, buffer: %d / %d)",
+				(int)ideal, info.tcpi_snd_cwnd, info.tcpi_rtt,
+				(int)stream->write_buf_len,
+				(int)stream->write_buf_size);
+}
+
+enum data_ret {
+	RET_BREAK,
+	RET_FATAL,
+	RET_CONTINUE
+};
+
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
+		uint64_t *last_send_time, size_t latency_packet_size,
+		int delay_time)
+{
+	bool exit_loop = false;
+	struct iovec iov[2];
+	struct msghdr msg = {0};
+	size_t send_len;
+	ssize_t ret;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		/* can happen when the buffer was emptied by a previous loop
+		 * cycle before the wakeup for its data was consumed */
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	send_len = stream->write_buf_len;
+	if (stream->low_latency_mode && send_len > latency_packet_size)
+		send_len = latency_packet_size;
+
+	iov[0].iov_base = stream->write_buf + stream->write_buf_pos;
+	iov[0].iov_len  = write_buf_contiguous(stream);
+	if (iov[0].iov_len > send_len)
+		iov[0].iov_len = send_len;
+	iov[1].iov_base = stream->write_buf;
+	iov[1].iov_len  = send_len - iov[0].iov_len;
+
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+
+	do {
+		ret = sendmsg(stream->rtmp.m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		write_buf_pop(stream, (size_t)ret);
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		update_packets_sent(stream, (int)ret);
+
+		os_event_signal(stream->buffer_space_available_event);
+	} else {
+		int err_code = ret == -1 ? errno : 0;
+
+		if (ret == -1 && (err_code == EAGAIN ||
+		                  err_code == EWOULDBLOCK)) {
+			*can_write = false;
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+			return RET_BREAK;
+		}
+
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR, "socket_thread_linux: Socket error, "
+				"sendmsg() returned %d, errno %d",
+				(int)ret, err_code);
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	/* finish writing for now */
+	if (stream->write_buf_len <= 1000)
+		exit_loop = true;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return exit_loop ? RET_BREAK : RET_CONTINUE;
+}
+
+#define LATENCY_FACTOR 20
+#define MAX_EVENTS 2
+
+static inline void socket_thread_linux_internal(struct rtmp_stream *stream)
+{
+	bool can_write = false;
+
+	int delay_time;
+	int timeout;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+	uint64_t last_check_time = 0;
+
+	set_nonblocking(stream->rtmp.m_sb.sb_socket, true);
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size = stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	if (!stream->disable_send_window_optimization) {
+		timeout = SNDBUF_CHECK_INTERVAL_MS;
+	} else {
+		blog(LOG_INFO, "socket_thread_linux: Send window "
+				"optimization disabled by user.");
+		timeout = -1;
+	}
+
+	for (;;) {
+		struct epoll_event events[MAX_EVENTS];
+		int num;
+
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+		}
+
+		num = epoll_wait(stream->epoll_fd, events, MAX_EVENTS, timeout);
+		if (num == -1 && errno != EINTR) {
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due "
+					"to epoll_wait failure, errno %d",
+					errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+
+		for (int i = 0; i < num; i++) {
+			if (events[i].data.fd == stream->socket_wake_fd) {
+				uint64_t val;
+				ssize_t ret = read(stream->socket_wake_fd,
+						&val, sizeof(val));
+				UNUSED_PARAMETER(ret);
+
+			} else if (!socket_event(stream, events[i].events,
+						&can_write, last_send_time)) {
+				return;
+			}
+		}
+
+		if (timeout != -1) {
+			uint64_t now = os_gettime_ns() / 1000000;
+			if (now - last_check_time >= SNDBUF_CHECK_INTERVAL_MS) {
+				check_send_buffer(stream);
+				last_check_time = now;
+			}
+		}
+
+		if (can_write) {
+			for (;;) {
+				enum data_ret ret = write_data(
+						stream,
+						&can_write,
+						&last_send_time,
+						latency_packet_size,
+						delay_time);
+
+				switch (ret) {
+				case RET_BREAK:
+					goto exit_write_loop;
+				case RET_FATAL:
+					return;
+				case RET_CONTINUE:;
+				}
+			}
+		}
+		exit_write_loop:;
+	}
+
+	set_nonblocking(stream->rtmp.m_sb.sb_socket, false);
+
+	blog(LOG_INFO, "socket_thread_linux: Normal exit");
+}
+
+void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+	os_set_thread_name("rtmp-stream: socket_thread_linux");
+	socket_thread_linux_internal(stream);
+	return NULL;
+}
+#endif
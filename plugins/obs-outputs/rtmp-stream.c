@@ -31,24 +31,56 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream);
+/* ------------------------------------------------------------------------- */
+/* packet queue */
+
+static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+{
+	return packet_queue_size(&stream->packets);
+}
+
+static inline bool packet_dropped(struct rtmp_stream *stream,
+		const struct encoder_packet *packet, long seq)
+{
+	if (packet->type != OBS_ENCODER_VIDEO)
+		return false;
+
+	for (int i = packet->drop_priority + 1;
+	     i <= OBS_NAL_PRIORITY_HIGHEST;
+	     i++) {
+		long end = os_atomic_load_long(&stream->drop_end_seq[i]);
+		if (packet_seq_diff(seq, end) < 0)
+			return true;
+	}
+
+	return false;
+}
 
 static inline void free_packets(struct rtmp_stream *stream)
 {
+	struct encoder_packet packet;
 	size_t num_packets;
-
-	pthread_mutex_lock(&stream->packets_mutex);
+	long seq;
 
 	num_packets = num_buffered_packets(stream);
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	while (packet_queue_pop(&stream->packets, &packet, &seq))
 		obs_free_encoder_packet(&packet);
-	}
-	pthread_mutex_unlock(&stream->packets_mutex);
+}
+
+/* only call while neither the send thread nor the encoders are active */
+static inline void reset_packet_queue(struct rtmp_stream *stream)
+{
+	long pushed;
+
+	free_packets(stream);
+	circlebuf_free(&stream->video_index);
+
+	pushed = os_atomic_load_long(&stream->packets.pushed);
+	for (size_t i = 0; i <= OBS_NAL_PRIORITY_HIGHEST; i++)
+		os_atomic_set_long(&stream->drop_end_seq[i], pushed);
 }
 
 static inline bool stopping(struct rtmp_stream *stream)
@@ -93,6 +125,8 @@ static void rtmp_stream_destroy(void *data)
 
 	if (stream) {
 		free_packets(stream);
+		packet_queue_free(&stream->packets);
+		circlebuf_free(&stream->video_index);
 		dstr_free(&stream->path);
 		dstr_free(&stream->key);
 		dstr_free(&stream->username);
@@ -102,8 +136,6 @@ static void rtmp_stream_destroy(void *data)
 		dstr_free(&stream->bind_ip);
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
-		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
 
 		os_event_destroy(stream->buffer_space_available_event);
 		os_event_destroy(stream->buffer_has_data_event);
@@ -128,14 +160,16 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
-	pthread_mutex_init_value(&stream->packets_mutex);
+	packet_queue_init(&stream->packets);
+#ifdef __linux__
+	stream->epoll_fd = -1;
+	stream->socket_wake_fd = -1;
+#endif
 
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
 
-	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
-		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
@@ -213,17 +247,17 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 static inline bool get_next_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	bool new_packet = false;
+	long seq;
 
-	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
-		new_packet = true;
+	while (packet_queue_pop(&stream->packets, packet, &seq)) {
+		if (!packet_dropped(stream, packet, seq))
+			return true;
+
+		os_atomic_inc_long(&stream->dropped_frames);
+		obs_free_encoder_packet(packet);
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
 
-	return new_packet;
+	return false;
 }
 
 static bool discard_recv_data(struct rtmp_stream *stream, size_t size)
@@ -420,14 +454,16 @@ retry_send:
 		goto retry_send;
 	}
 
-	memcpy(stream->write_buf + stream->write_buf_len, data, len);
-	stream->write_buf_len += len;
+	write_buf_push(stream, data, len);
 
 	update_packet_strain(stream);
 
 	pthread_mutex_unlock(&stream->write_buf_mutex);
 
 	os_event_signal (stream->buffer_has_data_event);
+#ifdef __linux__
+	socket_thread_linux_wake(stream);
+#endif
 
 	return len;
 }
@@ -435,7 +471,8 @@ retry_send:
 static int send_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
+	size_t  prefix_size;
 	size_t  size;
 	int     recv_size = 0;
 	int     ret = 0;
@@ -454,19 +491,36 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, &data, &size, is_header);
+	if (!packet->data || !packet->size) {
+		obs_free_encoder_packet(packet);
+		return 0;
+	}
+
+	/* the payload is sent from the packet itself, only the few bytes in
+	 * front of it are written to prefix */
+	prefix_size = flv_packet_prefix(packet, is_header, prefix);
+
+	/* count the size of the equivalent FLV tag, like before */
+	size = FLV_TAG_OVERHEAD + prefix_size + packet->size;
 
 #ifdef TEST_FRAMEDROPS
 	droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-	bfree(data);
+	ret = RTMP_WriteMedia(&stream->rtmp,
+			packet->type == OBS_ENCODER_VIDEO ?
+				RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO,
+			get_ms_time(packet, packet->dts) & 0x7FFFFFFF,
+			(const char*)prefix, (int)prefix_size,
+			(const char*)packet->data, (int)packet->size, (int)idx);
 
 	obs_free_encoder_packet(packet);
 
+	if (!ret)
+		return -1;
+
 	stream->total_bytes_sent += size;
-	return ret;
+	return (int)size;
 }
 
 static inline bool send_headers(struct rtmp_stream *stream);
@@ -538,7 +592,13 @@ static void *send_thread(void *data)
 	if (stream->new_socket_loop) {
 		os_event_signal(stream->send_thread_signaled_exit);
 		os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+		socket_thread_linux_wake(stream);
+#endif
 		pthread_join(stream->socket_thread, NULL);
+#ifdef __linux__
+		socket_thread_linux_free(stream);
+#endif
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
 	}
@@ -646,7 +706,7 @@ static inline bool reset_semaphore(struct rtmp_stream *stream)
 
 #define MIN_SENDBUF_SIZE 65535
 
-static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
+bool adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 {
 	int cur_sendbuf_size = new_size;
 	socklen_t int_size = sizeof(int);
@@ -658,7 +718,10 @@ static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 		cur_sendbuf_size = new_size;
 		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
 				(const char*)&cur_sendbuf_size, int_size);
+		return true;
 	}
+
+	return false;
 }
 
 static int init_send(struct rtmp_stream *stream)
@@ -667,7 +730,7 @@ static int init_send(struct rtmp_stream *stream)
 	size_t idx = 0;
 	bool next = true;
 
-#if defined(_WIN32)
+#if defined(_WIN32) || defined(__linux__)
 	adjust_sndbuf_size(stream, MIN_SENDBUF_SIZE);
 #endif
 
@@ -735,6 +798,8 @@ static int init_send(struct rtmp_stream *stream)
 
 		stream->write_buf_size = ideal_buffer_size;
 		stream->write_buf = bmalloc(ideal_buffer_size);
+		stream->write_buf_pos = 0;
+		stream->write_buf_len = 0;
 
 		stream->target_write_buf_size = ideal_buffer_size;
 
@@ -764,6 +829,17 @@ static int init_send(struct rtmp_stream *stream)
 #ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL,
 				socket_thread_windows, stream);
+#elif defined(__linux__)
+		if (!socket_thread_linux_init(stream)) {
+			RTMP_Close(&stream->rtmp);
+			warn("Failed to initialize socket loop");
+			return OBS_OUTPUT_ERROR;
+		}
+
+		ret = pthread_create(&stream->socket_thread, NULL,
+				socket_thread_linux, stream);
+		if (ret != 0)
+			socket_thread_linux_free(stream);
 #else
 		warn("New socket loop not supported on this platform");
 		return OBS_OUTPUT_ERROR;
@@ -946,7 +1022,7 @@ static bool init_connect(struct rtmp_stream *stream)
 		pthread_join(stream->send_thread, NULL);
 	}
 
-	free_packets(stream);
+	reset_packet_queue(stream);
 
 	service = obs_output_get_service(stream->output);
 	if (!service)
@@ -954,7 +1030,7 @@ static bool init_connect(struct rtmp_stream *stream)
 
 	os_atomic_set_bool(&stream->disconnected, false);
 	stream->total_bytes_sent = 0;
-	stream->dropped_frames   = 0;
+	os_atomic_set_long(&stream->dropped_frames, 0);
 	stream->min_priority     = 0;
 
 	settings = obs_output_get_settings(stream->output);
@@ -1034,74 +1110,92 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		struct video_packet_index entry = {
+			.seq           = stream->packets.pushed,
+			.dts_usec      = packet->dts_usec,
+			.drop_priority = packet->drop_priority,
+			.keyframe      = packet->keyframe
+		};
+		circlebuf_push_back(&stream->video_index, &entry,
+				sizeof(entry));
+	}
+
+	packet_queue_push(&stream->packets, packet);
 	return true;
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+/* removes index entries of packets the send thread already popped */
+static void prune_video_index(struct rtmp_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	long popped = os_atomic_load_long(&stream->packets.popped);
+
+	while (stream->video_index.size) {
+		struct video_packet_index *entry =
+			circlebuf_data(&stream->video_index, 0);
+		if (packet_seq_diff(entry->seq, popped) >= 0)
+			break;
+
+		circlebuf_pop_front(&stream->video_index, NULL,
+				sizeof(*entry));
+	}
 }
 
-static void drop_frames(struct rtmp_stream *stream, const char *name,
+static int drop_frames(struct rtmp_stream *stream, const char *name,
 		int highest_priority, bool pframes)
 {
-	struct circlebuf new_buf            = {0};
-	uint64_t         last_drop_dts_usec = 0;
-	int              num_frames_dropped = 0;
+	size_t count = stream->video_index.size /
+		sizeof(struct video_packet_index);
+	int    num_frames_dropped = 0;
 
 #ifdef _DEBUG
 	int start_packets = (int)num_buffered_packets(stream);
 #else
 	UNUSED_PARAMETER(name);
 #endif
+	UNUSED_PARAMETER(pframes);
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-
-		last_drop_dts_usec = packet.dts_usec;
-
-		/* do not drop audio data or video keyframes */
-		if (packet.type          == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority >= highest_priority) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+	/* audio data isn't indexed, so only video frames below the priority
+	 * get dropped; keyframes are always of the highest priority */
+	for (size_t i = 0; i < count; i++) {
+		struct video_packet_index entry;
+		circlebuf_pop_front(&stream->video_index, &entry,
+				sizeof(entry));
 
-		} else {
+		if (entry.drop_priority >= highest_priority)
+			circlebuf_push_back(&stream->video_index, &entry,
+					sizeof(entry));
+		else
 			num_frames_dropped++;
-			obs_free_encoder_packet(&packet);
-		}
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
+	/* the send thread skips (and counts) every queued packet below this
+	 * priority that was pushed before this point */
+	os_atomic_set_long(&stream->drop_end_seq[highest_priority],
+			stream->packets.pushed);
 
 	if (stream->min_priority < highest_priority)
 		stream->min_priority = highest_priority;
-	if (!num_frames_dropped)
-		return;
 
-	stream->dropped_frames += num_frames_dropped;
 #ifdef _DEBUG
-	debug("Dropped %s, prev packet count: %d, new packet count: %d",
-			name,
-			start_packets,
-			(int)num_buffered_packets(stream));
+	if (num_frames_dropped)
+		debug("Dropped %s, prev packet count: %d, dropped: %d",
+				name,
+				start_packets,
+				num_frames_dropped);
 #endif
+	return num_frames_dropped;
 }
 
 static bool find_first_video_packet(struct rtmp_stream *stream,
-		struct encoder_packet *first)
+		struct video_packet_index *first)
 {
-	size_t count = stream->packets.size / sizeof(*first);
+	size_t count = stream->video_index.size / sizeof(*first);
 
 	for (size_t i = 0; i < count; i++) {
-		struct encoder_packet *cur = circlebuf_data(&stream->packets,
-				i * sizeof(*first));
-		if (cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
+		struct video_packet_index *cur = circlebuf_data(
+				&stream->video_index, i * sizeof(*first));
+		if (!cur->keyframe) {
 			*first = *cur;
 			return true;
 		}
@@ -1110,9 +1204,9 @@ static bool find_first_video_packet(struct rtmp_stream *stream,
 	return false;
 }
 
-static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
+static int check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 {
-	struct encoder_packet first;
+	struct video_packet_index first;
 	int64_t buffer_duration_usec;
 	size_t num_packets = num_buffered_packets(stream);
 	const char *name = pframes ? "p-frames" : "b-frames";
@@ -1123,10 +1217,10 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 		stream->drop_threshold_usec;
 
 	if (num_packets < 5)
-		return;
+		return 0;
 
 	if (!find_first_video_packet(stream, &first))
-		return;
+		return 0;
 
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
@@ -1134,8 +1228,10 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 
 	if (buffer_duration_usec > drop_threshold) {
 		debug("buffer_duration_usec: %" PRId64, buffer_duration_usec);
-		drop_frames(stream, name, priority, pframes);
+		return drop_frames(stream, name, priority, pframes);
 	}
+
+	return 0;
 }
 
 static void update_bitrate(struct rtmp_stream *stream)
@@ -1191,17 +1287,19 @@ static void handle_packet_strain(struct rtmp_stream *stream, bool dropped_frames
 static bool add_video_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	int prev_dropped = stream->dropped_frames;
-	check_to_drop_frames(stream, false);
-	check_to_drop_frames(stream, true);
-	bool dropped_frames = stream->dropped_frames != prev_dropped;
+	prune_video_index(stream);
+
+	int num_dropped = check_to_drop_frames(stream, false);
+	num_dropped += check_to_drop_frames(stream, true);
+	bool dropped_frames = num_dropped != 0;
 
 	if (stream->adjustment_frame_id_valid) {
 		if (packet->tracked_id == stream->adjustment_frame_id) {
 			uint64_t buffer_length = 0;
-			if (stream->packets.size) {
-				struct encoder_packet first;
-				circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+			if (stream->video_index.size) {
+				struct video_packet_index first;
+				circlebuf_peek_front(&stream->video_index,
+						&first, sizeof(first));
 				buffer_length = packet->dts_usec - first.dts_usec;
 			}
 
@@ -1226,7 +1324,7 @@ static bool add_video_packet(struct rtmp_stream *stream,
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
 	if (packet->drop_priority < stream->min_priority) {
-		stream->dropped_frames++;
+		os_atomic_inc_long(&stream->dropped_frames);
 		return false;
 	} else {
 		stream->min_priority = 0;
@@ -1248,9 +1346,7 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 	if (packet->type == OBS_ENCODER_VIDEO)
 		obs_parse_avc_packet(&new_packet, packet);
 	else
-		obs_duplicate_encoder_packet(&new_packet, packet);
-
-	pthread_mutex_lock(&stream->packets_mutex);
+		obs_encoder_packet_ref(&new_packet, packet);
 
 	if (!disconnected(stream)) {
 		added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
@@ -1258,8 +1354,6 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 			add_packet(stream, &new_packet);
 	}
 
-	pthread_mutex_unlock(&stream->packets_mutex);
-
 	if (added_packet)
 		os_sem_post(stream->send_sem);
 	else
@@ -1319,7 +1413,7 @@ static uint64_t rtmp_stream_total_bytes_sent(void *data)
 static int rtmp_stream_dropped_frames(void *data)
 {
 	struct rtmp_stream *stream = data;
-	return stream->dropped_frames;
+	return (int)os_atomic_load_long(&stream->dropped_frames);
 }
 
 static float rtmp_stream_congestion(void *data)
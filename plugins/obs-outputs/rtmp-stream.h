@@ -8,6 +8,7 @@
 #include "librtmp/rtmp.h"
 #include "librtmp/log.h"
 #include "flv-mux.h"
+#include "packet-queue.h"
 #include "net-if.h"
 
 #ifdef _WIN32
@@ -47,11 +48,25 @@ struct droptest_info {
 };
 #endif
 
+/* position of a queued video packet, used by the frame drop logic so it
+ * doesn't have to scan the packet queue */
+struct video_packet_index {
+	long             seq;
+	int64_t          dts_usec;
+	int              drop_priority;
+	bool             keyframe;
+};
+
 struct rtmp_stream {
 	obs_output_t     *output;
 
-	pthread_mutex_t  packets_mutex;
-	struct circlebuf packets;
+	/* single producer/single consumer packet queue.  packets are only
+	 * pushed from rtmp_stream_data (serialized by the output) and only
+	 * popped by the send thread, so no lock is needed.  dropped video
+	 * packets are skipped by the consumer using drop_end_seq. */
+	struct packet_queue packets;
+	volatile long    drop_end_seq[OBS_NAL_PRIORITY_HIGHEST + 1];
+	struct circlebuf video_index;
 	bool             sent_headers;
 
 	volatile bool    connecting;
@@ -83,7 +98,7 @@ struct rtmp_stream {
 	int64_t          last_dts_usec;
 
 	uint64_t         total_bytes_sent;
-	int              dropped_frames;
+	volatile long    dropped_frames;
 
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
@@ -97,7 +112,9 @@ struct rtmp_stream {
 	bool             disable_send_window_optimization;
 	bool             socket_thread_active;
 	pthread_t        socket_thread;
+	/* byte ring, write_buf_pos is the offset of the oldest queued byte */
 	uint8_t          *write_buf;
+	size_t           write_buf_pos;
 	size_t           write_buf_len;
 	size_t           write_buf_size;
 	pthread_mutex_t  write_buf_mutex;
@@ -105,6 +122,10 @@ struct rtmp_stream {
 	os_event_t       *buffer_has_data_event;
 	os_event_t       *socket_available_event;
 	os_event_t       *send_thread_signaled_exit;
+#ifdef __linux__
+	int              epoll_fd;
+	int              socket_wake_fd;
+#endif
 
 	bool             autotune;
 	uint32_t         target_bitrate;
@@ -122,6 +143,50 @@ struct rtmp_stream {
 	size_t           target_write_buf_size;
 };
 
+extern bool adjust_sndbuf_size(struct rtmp_stream *stream, int new_size);
+extern void update_packets_sent(struct rtmp_stream *stream, int sent);
+
+/* size of the data at the front of the write buffer that doesn't wrap */
+static inline size_t write_buf_contiguous(struct rtmp_stream *stream)
+{
+	size_t tail = stream->write_buf_size - stream->write_buf_pos;
+	return stream->write_buf_len < tail ? stream->write_buf_len : tail;
+}
+
+static inline void write_buf_pop(struct rtmp_stream *stream, size_t size)
+{
+	stream->write_buf_pos += size;
+	if (stream->write_buf_pos >= stream->write_buf_size)
+		stream->write_buf_pos -= stream->write_buf_size;
+
+	stream->write_buf_len -= size;
+	if (!stream->write_buf_len)
+		stream->write_buf_pos = 0;
+}
+
+static inline void write_buf_push(struct rtmp_stream *stream,
+		const void *data, size_t size)
+{
+	size_t end = stream->write_buf_pos + stream->write_buf_len;
+	size_t first;
+
+	if (end >= stream->write_buf_size)
+		end -= stream->write_buf_size;
+
+	first = stream->write_buf_size - end;
+	if (first > size)
+		first = size;
+
+	memcpy(stream->write_buf + end, data, first);
+	memcpy(stream->write_buf, (const uint8_t*)data + first, size - first);
+	stream->write_buf_len += size;
+}
+
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+extern bool socket_thread_linux_init(struct rtmp_stream *stream);
+extern void socket_thread_linux_free(struct rtmp_stream *stream);
+extern void socket_thread_linux_wake(struct rtmp_stream *stream);
+void *socket_thread_linux(void *data);
 #endif
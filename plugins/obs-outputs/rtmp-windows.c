@@ -144,7 +144,6 @@ enum data_ret {
 	RET_CONTINUE
 };
 
-void update_packets_sent(struct rtmp_stream *stream, int sent);
 static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
 		uint64_t *last_send_time, size_t latency_packet_size,
 		int delay_time)
@@ -165,25 +164,17 @@ static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
 	}
 
 	int ret;
-	if (stream->low_latency_mode) {
-		size_t send_len =
-			min(latency_packet_size, stream->write_buf_len);
+	size_t send_len = write_buf_contiguous(stream);
 
-		ret = send(stream->rtmp.m_sb.sb_socket,
-				(const char *)stream->write_buf,
-				(int)send_len, 0);
-	} else {
-		ret = send(stream->rtmp.m_sb.sb_socket,
-				(const char *)stream->write_buf,
-				(int)stream->write_buf_len, 0);
-	}
+	if (stream->low_latency_mode)
+		send_len = min(latency_packet_size, send_len);
+
+	ret = send(stream->rtmp.m_sb.sb_socket,
+			(const char *)stream->write_buf + stream->write_buf_pos,
+			(int)send_len, 0);
 
 	if (ret > 0) {
-		if (stream->write_buf_len - ret)
-			memmove(stream->write_buf,
-					stream->write_buf + ret,
-					stream->write_buf_len - ret);
-		stream->write_buf_len -= ret;
+		write_buf_pop(stream, ret);
 
 		*last_send_time = os_gettime_ns() / 1000000;
 
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -149,6 +150,10 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
+	os_file_watch_remove(srcdata->file_watch);
+	bfree(srcdata->pending_text);
+	pthread_mutex_destroy(&srcdata->pending_mutex);
+
 	if (srcdata->font_face != NULL) {
 		FT_Done_Face(srcdata->font_face);
 		srcdata->font_face = NULL;
@@ -211,25 +216,56 @@ static void ft2_source_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+/* called on the file watch thread, or by the tick if the file couldn't be
+ * watched */
+static void ft2_file_changed(void *data, const char *path)
+{
+	struct ft2_source *srcdata = data;
+	wchar_t *text = NULL;
+
+	if (srcdata->m_timestamp == get_modified_timestamp(srcdata->text_file))
+		return;
+
+	if (srcdata->log_mode)
+		read_from_end(srcdata, srcdata->text_file, &text);
+	else
+		load_text_from_file(srcdata, srcdata->text_file, &text);
+
+	if (!text)
+		return;
+
+	pthread_mutex_lock(&srcdata->pending_mutex);
+	bfree(srcdata->pending_text);
+	srcdata->pending_text = text;
+	pthread_mutex_unlock(&srcdata->pending_mutex);
+
+	UNUSED_PARAMETER(path);
+}
+
 static void ft2_video_tick(void *data, float seconds)
 {
 	struct ft2_source *srcdata = data;
+	wchar_t *text;
+
 	if (srcdata == NULL) return;
 	if (!srcdata->from_file || !srcdata->text_file) return;
 
-	if (os_gettime_ns() - srcdata->last_checked >= 1000000000) {
-		time_t t = get_modified_timestamp(srcdata->text_file);
+	if (!srcdata->file_watch &&
+	    os_gettime_ns() - srcdata->last_checked >= 1000000000) {
 		srcdata->last_checked = os_gettime_ns();
+		ft2_file_changed(srcdata, srcdata->text_file);
+	}
 
-		if (srcdata->m_timestamp != t) {
-			if (srcdata->log_mode)
-				read_from_end(srcdata, srcdata->text_file);
-			else
-				load_text_from_file(srcdata,
-					srcdata->text_file);
-			cache_glyphs(srcdata, srcdata->text);
-			set_up_vertex_buffer(srcdata);
-		}
+	pthread_mutex_lock(&srcdata->pending_mutex);
+	text = srcdata->pending_text;
+	srcdata->pending_text = NULL;
+	pthread_mutex_unlock(&srcdata->pending_mutex);
+
+	if (text) {
+		bfree(srcdata->text);
+		srcdata->text = text;
+		cache_glyphs(srcdata, srcdata->text);
+		set_up_vertex_buffer(srcdata);
 	}
 
 	UNUSED_PARAMETER(seconds);
@@ -392,14 +428,24 @@ skip_font_load:
 				!vbuf_needs_update)
 				goto error;
 
+			os_file_watch_remove(srcdata->file_watch);
 			bfree(srcdata->text_file);
 
+			pthread_mutex_lock(&srcdata->pending_mutex);
+			bfree(srcdata->pending_text);
+			srcdata->pending_text = NULL;
+			pthread_mutex_unlock(&srcdata->pending_mutex);
+
 			srcdata->text_file = bstrdup(tmp);
+			srcdata->file_watch = os_file_watch_add(tmp,
+					ft2_file_changed, srcdata);
+			srcdata->last_checked = os_gettime_ns();
+
 			if (chat_log_mode)
-				read_from_end(srcdata, tmp);
+				read_from_end(srcdata, tmp, &srcdata->text);
 			else
-				load_text_from_file(srcdata, tmp);
-			srcdata->last_checked = os_gettime_ns();
+				load_text_from_file(srcdata, tmp,
+						&srcdata->text);
 		}
 	}
 	else {
@@ -437,6 +483,9 @@ static void *ft2_source_create(obs_data_t *settings, obs_source_t *source)
 	obs_data_t *font_obj = obs_data_create();
 	srcdata->src = source;
 
+	pthread_mutex_init_value(&srcdata->pending_mutex);
+	pthread_mutex_init(&srcdata->pending_mutex, NULL);
+
 	srcdata->font_size = 32;
 
 	obs_data_set_default_string(font_obj, "face", DEFAULT_FACE);
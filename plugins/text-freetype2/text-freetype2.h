@@ -16,6 +16,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
 #include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 
 #define num_cache_slots 65535
@@ -38,6 +40,12 @@ struct ft2_source {
 	char *text_file;
 	wchar_t *text;
 	time_t m_timestamp;
+
+	/* the file is read by the watch callback, the tick swaps in the new
+	 * text.  without a watch the tick checks the file once a second */
+	os_file_watch_t *file_watch;
+	pthread_mutex_t pending_mutex;
+	wchar_t *pending_text;
 	uint64_t last_checked;
 
 	uint32_t cx, cy, max_h, custom_width;
@@ -84,8 +92,11 @@ static const char *ft2_source_get_name(void *unused);
 uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata);
 
 time_t get_modified_timestamp(char *filename);
-void load_text_from_file(struct ft2_source *srcdata, const char *filename);
-void read_from_end(struct ft2_source *srcdata, const char *filename);
+/* replace *text with the file's text */
+void load_text_from_file(struct ft2_source *srcdata, const char *filename,
+		wchar_t **text);
+void read_from_end(struct ft2_source *srcdata, const char *filename,
+		wchar_t **text);
 
 void cache_standard_glyphs(struct ft2_source *srcdata);
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
@@ -320,8 +320,8 @@ time_t get_modified_timestamp(char *filename)
 {
 	struct stat stats;
 
-	// stat is apparently terrifying and horrible, but we only call it once
-	// every second at most.
+	// stat is apparently terrifying and horrible, but we only call it when
+	// the file changed, or once a second if the file can't be watched.
 	stat(filename, &stats);
 
 	return stats.st_mtime;
@@ -338,7 +338,8 @@ static void remove_cr(wchar_t* source)
 	source[j] = '\0';
 }
 
-void load_text_from_file(struct ft2_source *srcdata, const char *filename)
+void load_text_from_file(struct ft2_source *srcdata, const char *filename,
+		wchar_t **text)
 {
 	FILE *tmp_file = NULL;
 	uint32_t filesize = 0;
@@ -361,12 +362,12 @@ void load_text_from_file(struct ft2_source *srcdata, const char *filename)
 
 	if (bytes_read == 2 && header == 0xFEFF) {
 		// File is already in UTF-16 format
-		if (srcdata->text != NULL) {
-			bfree(srcdata->text);
-			srcdata->text = NULL;
+		if (*text != NULL) {
+			bfree(*text);
+			*text = NULL;
 		}
-		srcdata->text = bzalloc(filesize);
-		bytes_read = fread(srcdata->text, filesize - 2, 1, tmp_file);
+		*text = bzalloc(filesize);
+		bytes_read = fread(*text, filesize - 2, 1, tmp_file);
 
 		srcdata->m_timestamp =
 			get_modified_timestamp(srcdata->text_file);
@@ -383,19 +384,20 @@ void load_text_from_file(struct ft2_source *srcdata, const char *filename)
 	bytes_read = fread(tmp_read, filesize, 1, tmp_file);
 	fclose(tmp_file);
 
-	if (srcdata->text != NULL) {
-		bfree(srcdata->text);
-		srcdata->text = NULL;
+	if (*text != NULL) {
+		bfree(*text);
+		*text = NULL;
 	}
-	srcdata->text = bzalloc((strlen(tmp_read) + 1)*sizeof(wchar_t));
+	*text = bzalloc((strlen(tmp_read) + 1)*sizeof(wchar_t));
 	os_utf8_to_wcs(tmp_read, strlen(tmp_read),
-		srcdata->text, (strlen(tmp_read) + 1));
+		*text, (strlen(tmp_read) + 1));
 
-	remove_cr(srcdata->text);
+	remove_cr(*text);
 	bfree(tmp_read);
 }
 
-void read_from_end(struct ft2_source *srcdata, const char *filename)
+void read_from_end(struct ft2_source *srcdata, const char *filename,
+		wchar_t **text)
 {
 	FILE *tmp_file = NULL;
 	uint32_t filesize = 0, cur_pos = 0;
@@ -446,15 +448,15 @@ void read_from_end(struct ft2_source *srcdata, const char *filename)
 	fseek(tmp_file, cur_pos, SEEK_SET);
 
 	if (utf16) {
-		if (srcdata->text != NULL) {
-			bfree(srcdata->text);
-			srcdata->text = NULL;
+		if (*text != NULL) {
+			bfree(*text);
+			*text = NULL;
 		}
-		srcdata->text = bzalloc(filesize - cur_pos);
-		bytes_read = fread(srcdata->text, (filesize - cur_pos), 1,
+		*text = bzalloc(filesize - cur_pos);
+		bytes_read = fread(*text, (filesize - cur_pos), 1,
 				tmp_file);
 
-		remove_cr(srcdata->text);
+		remove_cr(*text);
 		srcdata->m_timestamp =
 			get_modified_timestamp(srcdata->text_file);
 		bfree(tmp_read);
@@ -467,15 +469,15 @@ void read_from_end(struct ft2_source *srcdata, const char *filename)
 	bytes_read = fread(tmp_read, filesize - cur_pos, 1, tmp_file);
 	fclose(tmp_file);
 
-	if (srcdata->text != NULL) {
-		bfree(srcdata->text);
-		srcdata->text = NULL;
+	if (*text != NULL) {
+		bfree(*text);
+		*text = NULL;
 	}
-	srcdata->text = bzalloc((strlen(tmp_read) + 1)*sizeof(wchar_t));
+	*text = bzalloc((strlen(tmp_read) + 1)*sizeof(wchar_t));
 	os_utf8_to_wcs(tmp_read, strlen(tmp_read),
-		srcdata->text, (strlen(tmp_read) + 1));
+		*text, (strlen(tmp_read) + 1));
 
-	remove_cr(srcdata->text);
+	remove_cr(*text);
 	srcdata->m_timestamp = get_modified_timestamp(srcdata->text_file);
 	bfree(tmp_read);
 }
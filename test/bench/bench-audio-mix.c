@@ -0,0 +1,198 @@
+/*
+ * Mixes 1 to 64 stereo audio lines into two of the audio mixes and clamps
+ * the result once per tick, the same work the audio thread does, with the
+ * copy-out scalar loop the audio thread used before and with the SSE2 and
+ * AVX kernels it uses now.
+ */
+
+#include <stdio.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-mix.h>
+
+#define PLANES          2
+#define FRAMES          1024
+#define LINE_MIXES      ((1 << 0) | (1 << 1))
+#define MAX_LINES       64
+#define TICKS           2000
+
+struct mixer {
+	const char     *name;
+	void           (*mix)(const struct mixer *mixer, struct circlebuf *buf,
+			float *const *mixes, size_t num_mixes);
+	mix_floats_t   mix_floats;
+	clamp_floats_t clamp_floats;
+};
+
+static struct circlebuf lines[MAX_LINES][PLANES];
+static float mix_buffers[MAX_AUDIO_MIXES][PLANES][FRAMES];
+static float source[FRAMES];
+
+/* ------------------------------------------------------------------------- */
+
+#define SCALAR_BUFFER_SIZE 256
+
+static void mix_scalar(const struct mixer *mixer, struct circlebuf *buf,
+		float *const *mixes, size_t num_mixes)
+{
+	float vals[SCALAR_BUFFER_SIZE];
+	size_t size = FRAMES * sizeof(float);
+	size_t offset = 0;
+
+	while (size) {
+		size_t pop_count = size < sizeof(vals) ? size : sizeof(vals);
+		size -= pop_count;
+
+		circlebuf_pop_front(buf, vals, pop_count);
+		pop_count /= sizeof(float);
+
+		for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++) {
+			float *mix = mixes[mix_idx] + offset;
+			for (size_t i = 0; i < pop_count; i++)
+				mix[i] += vals[i];
+		}
+
+		offset += pop_count;
+	}
+
+	UNUSED_PARAMETER(mixer);
+}
+
+static void clamp_scalar(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void mix_spans(const struct mixer *mixer, struct circlebuf *buf,
+		float *const *mixes, size_t num_mixes)
+{
+	size_t size = FRAMES * sizeof(float);
+	size_t offset = 0;
+
+	while (offset < size) {
+		size_t pos = (buf->start_pos + offset) % buf->capacity;
+		size_t span = size - offset;
+		float *spans[MAX_AUDIO_MIXES];
+
+		if (span > buf->capacity - pos)
+			span = buf->capacity - pos;
+
+		for (size_t i = 0; i < num_mixes; i++)
+			spans[i] = mixes[i] + offset / sizeof(float);
+
+		mixer->mix_floats(spans, num_mixes,
+				(const float*)((uint8_t*)buf->data + pos),
+				span / sizeof(float));
+		offset += span;
+	}
+
+	circlebuf_pop_front(buf, NULL, size);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double run(const struct mixer *mixer, size_t num_lines)
+{
+	uint64_t total = 0;
+
+	for (size_t tick = 0; tick < TICKS; tick++) {
+		uint64_t start;
+
+		/* the sources place their data outside of the mix */
+		for (size_t line = 0; line < num_lines; line++) {
+			for (size_t plane = 0; plane < PLANES; plane++)
+				circlebuf_push_back(&lines[line][plane],
+						source, sizeof(source));
+		}
+
+		start = os_gettime_ns();
+
+		memset(mix_buffers, 0, sizeof(mix_buffers));
+
+		for (size_t line = 0; line < num_lines; line++) {
+			for (size_t plane = 0; plane < PLANES; plane++) {
+				float *mixes[MAX_AUDIO_MIXES];
+				size_t num_mixes = 0;
+
+				for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+					if (LINE_MIXES & (1 << i))
+						mixes[num_mixes++] =
+							mix_buffers[i][plane];
+				}
+
+				mixer->mix(mixer, &lines[line][plane], mixes,
+						num_mixes);
+			}
+		}
+
+		for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+			if ((LINE_MIXES & (1 << i)) == 0)
+				continue;
+			for (size_t plane = 0; plane < PLANES; plane++)
+				mixer->clamp_floats(mix_buffers[i][plane],
+						FRAMES);
+		}
+
+		total += os_gettime_ns() - start;
+	}
+
+	return (double)total / TICKS;
+}
+
+int main(void)
+{
+	const struct mixer mixers[] = {
+		{"scalar", mix_scalar, NULL, clamp_scalar},
+		{"sse2", mix_spans, mix_floats_sse2, clamp_floats_sse2},
+		{"avx", mix_spans, mix_floats_avx, clamp_floats_avx},
+	};
+	size_t num_mixers = os_cpu_has_feature(CPU_FEATURE_AVX) ? 3 : 2;
+
+	for (size_t i = 0; i < FRAMES; i++)
+		source[i] = (float)((int)(i % 64) - 32) / 128.0f;
+
+	/* offset the read position so the mix crosses the end of the
+	 * circular buffer like it does on a running audio thread */
+	for (size_t line = 0; line < MAX_LINES; line++) {
+		for (size_t plane = 0; plane < PLANES; plane++) {
+			struct circlebuf *buf = &lines[line][plane];
+			size_t skip = sizeof(float) * 100;
+
+			circlebuf_push_back(buf, source, sizeof(source));
+			circlebuf_pop_front(buf, NULL, skip);
+			circlebuf_push_back(buf, source, sizeof(source));
+			circlebuf_pop_front(buf, NULL,
+					sizeof(source) * 2 - skip);
+		}
+	}
+
+	printf("%d frames per tick, %d planes, 2 of %d mixes per line\n",
+			FRAMES, PLANES, MAX_AUDIO_MIXES);
+	printf("%6s", "lines");
+	for (size_t i = 0; i < num_mixers; i++)
+		printf(" %13s", mixers[i].name);
+	printf("   (ns per tick)\n");
+
+	for (size_t num_lines = 1; num_lines <= MAX_LINES; num_lines *= 2) {
+		printf("%6d", (int)num_lines);
+		for (size_t i = 0; i < num_mixers; i++)
+			printf(" %13.0f", run(&mixers[i], num_lines));
+		printf("\n");
+	}
+
+	for (size_t line = 0; line < MAX_LINES; line++) {
+		for (size_t plane = 0; plane < PLANES; plane++)
+			circlebuf_free(&lines[line][plane]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Places planar float audio buffers into a line's circular buffers, the way
+ * audio_line_place_data_pos does, at a few buffer sizes and channel counts:
+ *
+ * - the way it did before: copy each plane into the line's volume buffer,
+ *   scale it there with a scalar loop, then copy it into the circular buffer
+ * - the way it does now: place_scaled_floats scales while writing directly
+ *   into the circular buffer (a plain memcpy at unity volume)
+ *
+ * Each buffer is popped again after it's placed, as the mixer would, so the
+ * circular buffers stay the same size and the placement wraps around.
+ * Reports the time per buffer (all channels).
+ */
+
+#include <stdio.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-mix.h>
+
+#define TOTAL_FRAMES (48000 * 600)
+#define BUFFERED     4096
+
+static const size_t frame_counts[] = {256, 480, 1024, 4096};
+static const size_t channel_counts[] = {1, 2, 6};
+static const float volumes[] = {0.5f, 1.0f};
+
+static struct circlebuf buffers[MAX_AV_PLANES];
+static DARRAY(uint8_t) volume_buffers[MAX_AV_PLANES];
+static float *source[MAX_AV_PLANES];
+
+static scale_floats_t scale_floats;
+
+/* ------------------------------------------------------------------------- */
+
+static inline void mul_vol_float(float *array, float volume, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		array[i] *= volume;
+}
+
+static void place_copy_scale(size_t planes, size_t size, size_t position,
+		float volume)
+{
+	for (size_t i = 0; i < planes; i++) {
+		da_copy_array(volume_buffers[i], source[i], size);
+
+		mul_vol_float((float*)volume_buffers[i].array, volume,
+				size / sizeof(float));
+
+		circlebuf_place(&buffers[i], position,
+				volume_buffers[i].array, size);
+	}
+}
+
+static void place_fused(size_t planes, size_t size, size_t position,
+		float volume)
+{
+	for (size_t i = 0; i < planes; i++)
+		place_scaled_floats(scale_floats, &buffers[i], position,
+				(const uint8_t*)source[i], size, volume);
+}
+
+typedef void (*place_func_t)(size_t planes, size_t size, size_t position,
+		float volume);
+
+/* ------------------------------------------------------------------------- */
+
+static double run(place_func_t place, size_t planes, size_t frames,
+		float volume)
+{
+	size_t size = frames * sizeof(float);
+	size_t buffered = BUFFERED * sizeof(float);
+	size_t count = TOTAL_FRAMES / frames;
+	uint64_t start;
+
+	for (size_t i = 0; i < planes; i++) {
+		circlebuf_init(&buffers[i]);
+		circlebuf_upsize(&buffers[i], buffered);
+	}
+
+	start = os_gettime_ns();
+
+	for (size_t n = 0; n < count; n++) {
+		/* the new data lands after what's already buffered, then the
+		 * mixer takes the same amount from the front */
+		place(planes, size, buffered, volume);
+
+		for (size_t i = 0; i < planes; i++)
+			circlebuf_pop_front(&buffers[i], NULL, size);
+	}
+
+	start = os_gettime_ns() - start;
+
+	for (size_t i = 0; i < planes; i++)
+		circlebuf_free(&buffers[i]);
+
+	return (double)start / (double)count;
+}
+
+int main(void)
+{
+	size_t max_frames = frame_counts[sizeof(frame_counts) /
+		sizeof(frame_counts[0]) - 1];
+
+	scale_floats = os_cpu_has_feature(CPU_FEATURE_AVX) ?
+		scale_floats_avx : scale_floats_sse2;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		source[i] = bmalloc(max_frames * sizeof(float));
+		for (size_t j = 0; j < max_frames; j++)
+			source[i][j] = (float)((j * 31 + i) % 200) / 100.0f -
+				1.0f;
+	}
+
+	printf("%s kernel, ns per buffer\n",
+			os_cpu_has_feature(CPU_FEATURE_AVX) ? "AVX" : "SSE2");
+	printf("%-6s %-8s %-6s %12s %12s\n", "frames", "channels", "volume",
+			"copy+scale", "fused");
+
+	for (size_t v = 0; v < sizeof(volumes) / sizeof(volumes[0]); v++) {
+		for (size_t f = 0; f < sizeof(frame_counts) /
+				sizeof(frame_counts[0]); f++) {
+			for (size_t c = 0; c < sizeof(channel_counts) /
+					sizeof(channel_counts[0]); c++) {
+				size_t frames   = frame_counts[f];
+				size_t channels = channel_counts[c];
+				float  volume   = volumes[v];
+
+				printf("%-6d %-8d %-6.1f %12.0f %12.0f\n",
+						(int)frames, (int)channels,
+						volume,
+						run(place_copy_scale, channels,
+							frames, volume),
+						run(place_fused, channels,
+							frames, volume));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		bfree(source[i]);
+		da_free(volume_buffers[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Requests 10 saves of the same recording buffer at once and measures how
+ * long each takes to start writing and to finish, for the two ways the
+ * recording buffer can save:
+ *
+ * - one thread per save, each starting an ffmpeg-mux process and writing
+ *   the packets to its pipe (mux_in_process off)
+ * - a pool of two threads muxing in-process, every step writing at most one
+ *   segment of one save, so saves take turns (mux_in_process on)
+ *
+ * The packets are a synthetic H.264 stream muxed to MPEG-TS, which needs no
+ * codec headers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/pipe.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
+
+#include <libavformat/avformat.h>
+
+#define NUM_SAVES         10
+#define POOL_THREADS      2
+
+#define FPS               60
+#define BUFFER_SECONDS    30
+#define SEGMENT_FRAMES    FPS
+#define NUM_SEGMENTS      BUFFER_SECONDS
+#define KEYFRAME_INTERVAL (FPS * 2)
+
+/* 6 Mbps, with keyframes ten times the size of other frames */
+#define FRAME_SIZE        (6000000 / 8 / FPS)
+#define KEYFRAME_SIZE     (FRAME_SIZE * 10)
+
+struct save {
+	char              path[32];
+	uint64_t          request_ts;
+	uint64_t          start_ts;
+	uint64_t          end_ts;
+	bool              failed;
+
+	/* in-process */
+	struct ffmpeg_mux mux;
+	bool              opened;
+	size_t            next_segment;
+
+	/* process */
+	pthread_t         thread;
+};
+
+static struct save saves[NUM_SAVES];
+static uint8_t *frame_data;
+
+static inline void get_frame(size_t frame, struct ffm_packet_info *info)
+{
+	memset(info, 0, sizeof(*info));
+	info->pts      = (int64_t)frame;
+	info->dts      = (int64_t)frame;
+	info->keyframe = frame % KEYFRAME_INTERVAL == 0;
+	info->size     = info->keyframe ? KEYFRAME_SIZE : FRAME_SIZE;
+	info->type     = FFM_PACKET_VIDEO;
+}
+
+static void init_params(struct main_params *params, char *file)
+{
+	memset(params, 0, sizeof(*params));
+	params->file           = file;
+	params->has_video      = 1;
+	params->vcodec         = "h264";
+	params->vbitrate       = 6000;
+	params->width          = 1920;
+	params->height         = 1080;
+	params->fps_num        = FPS;
+	params->fps_den        = 1;
+	params->muxer_settings = "";
+}
+
+/* ------------------------------------------------------------------------- */
+/* one ffmpeg-mux process and thread per save                                */
+
+static void *process_save_thread(void *param)
+{
+	struct save *save = param;
+	struct ffm_packet_info header = {0};
+	os_process_pipe_t *pipe;
+	struct dstr cmd = {0};
+
+	dstr_printf(&cmd, "\"%s\" \"%s\" 1 0 h264 6000 1920 1080 %d 1 \"\"",
+			FFMPEG_MUX_PATH, save->path, FPS);
+	pipe = os_process_pipe_create(cmd.array, "w");
+	dstr_free(&cmd);
+
+	if (!pipe) {
+		save->failed = true;
+		return NULL;
+	}
+
+	/* the (empty) video header comes first */
+	header.type = FFM_PACKET_VIDEO;
+	save->failed = os_process_pipe_write(pipe, (const uint8_t*)&header,
+			sizeof(header)) != sizeof(header);
+
+	for (size_t frame = 0; !save->failed &&
+			frame < NUM_SEGMENTS * SEGMENT_FRAMES; frame++) {
+		struct ffm_packet_info info;
+		get_frame(frame, &info);
+
+		save->failed = os_process_pipe_write(pipe,
+				(const uint8_t*)&info, sizeof(info)) !=
+					sizeof(info) ||
+			os_process_pipe_write(pipe, frame_data, info.size) !=
+					info.size;
+
+		if (!save->start_ts)
+			save->start_ts = os_gettime_ns();
+	}
+
+	if (os_process_pipe_destroy(pipe) != 0)
+		save->failed = true;
+
+	save->end_ts = os_gettime_ns();
+	return NULL;
+}
+
+static void run_processes(void)
+{
+	for (size_t i = 0; i < NUM_SAVES; i++) {
+		saves[i].request_ts = os_gettime_ns();
+		pthread_create(&saves[i].thread, NULL, process_save_thread,
+				&saves[i]);
+	}
+
+	for (size_t i = 0; i < NUM_SAVES; i++)
+		pthread_join(saves[i].thread, NULL);
+}
+
+/* ------------------------------------------------------------------------- */
+/* in-process muxing on a shared pool, one segment per step                  */
+
+static pthread_mutex_t queue_mutex;
+static pthread_cond_t queue_update;
+static struct save *queue[NUM_SAVES];
+static size_t queue_start;
+static size_t queue_size;
+static size_t saves_left;
+
+/* ffmpeg_mux_init_context modifies the shared output format */
+static pthread_mutex_t init_mutex;
+
+static bool write_segment(struct save *save)
+{
+	size_t first = save->next_segment++ * SEGMENT_FRAMES;
+
+	for (size_t frame = first; frame < first + SEGMENT_FRAMES; frame++) {
+		struct ffm_packet_info info;
+		get_frame(frame, &info);
+
+		if (!ffmpeg_mux_packet(&save->mux, frame_data, &info))
+			return false;
+	}
+
+	return true;
+}
+
+/* returns true if the save has more to write */
+static bool step(struct save *save)
+{
+	int ret;
+
+	if (save->opened) {
+		if (!write_segment(save))
+			save->failed = true;
+		else if (save->next_segment < NUM_SEGMENTS)
+			return true;
+
+		ffmpeg_mux_free(&save->mux);
+		save->end_ts = os_gettime_ns();
+		return false;
+	}
+
+	init_params(&save->mux.params, save->path);
+
+	pthread_mutex_lock(&init_mutex);
+	ret = ffmpeg_mux_init_context(&save->mux);
+	pthread_mutex_unlock(&init_mutex);
+
+	if (ret != FFM_SUCCESS) {
+		save->failed = true;
+		save->end_ts = os_gettime_ns();
+		return false;
+	}
+
+	save->opened = true;
+	save->start_ts = os_gettime_ns();
+	return true;
+}
+
+static void *pool_thread(void *unused)
+{
+	pthread_mutex_lock(&queue_mutex);
+
+	while (saves_left) {
+		struct save *save;
+		bool more;
+
+		if (!queue_size) {
+			pthread_cond_wait(&queue_update, &queue_mutex);
+			continue;
+		}
+
+		save = queue[queue_start];
+		queue_start = (queue_start + 1) % NUM_SAVES;
+		queue_size--;
+		pthread_mutex_unlock(&queue_mutex);
+
+		more = step(save);
+
+		pthread_mutex_lock(&queue_mutex);
+		if (more) {
+			queue[(queue_start + queue_size) % NUM_SAVES] = save;
+			queue_size++;
+			pthread_cond_signal(&queue_update);
+		} else if (--saves_left == 0) {
+			pthread_cond_broadcast(&queue_update);
+		}
+	}
+
+	pthread_mutex_unlock(&queue_mutex);
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static void run_pool(void)
+{
+	pthread_t threads[POOL_THREADS];
+
+	pthread_mutex_init(&queue_mutex, NULL);
+	pthread_mutex_init(&init_mutex, NULL);
+	pthread_cond_init(&queue_update, NULL);
+
+	queue_start = 0;
+	queue_size  = 0;
+	saves_left  = NUM_SAVES;
+
+	for (size_t i = 0; i < POOL_THREADS; i++)
+		pthread_create(&threads[i], NULL, pool_thread, NULL);
+
+	for (size_t i = 0; i < NUM_SAVES; i++) {
+		pthread_mutex_lock(&queue_mutex);
+		saves[i].request_ts = os_gettime_ns();
+		queue[(queue_start + queue_size) % NUM_SAVES] = &saves[i];
+		queue_size++;
+		pthread_mutex_unlock(&queue_mutex);
+		pthread_cond_signal(&queue_update);
+	}
+
+	for (size_t i = 0; i < POOL_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_cond_destroy(&queue_update);
+	pthread_mutex_destroy(&init_mutex);
+	pthread_mutex_destroy(&queue_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void run(const char *name, void (*run_saves)(void))
+{
+	double start_sum = 0.0, start_max = 0.0;
+	double end_sum = 0.0, end_max = 0.0;
+	bool failed = false;
+
+	memset(saves, 0, sizeof(saves));
+	for (size_t i = 0; i < NUM_SAVES; i++)
+		snprintf(saves[i].path, sizeof(saves[i].path),
+				"bench-save-%d.ts", (int)i);
+
+	run_saves();
+
+	for (size_t i = 0; i < NUM_SAVES; i++) {
+		struct save *save = &saves[i];
+		double start = (save->start_ts - save->request_ts) / 1000000.0;
+		double end = (save->end_ts - save->request_ts) / 1000000.0;
+
+		start_sum += start;
+		end_sum   += end;
+		if (start > start_max) start_max = start;
+		if (end > end_max)     end_max   = end;
+
+		failed = failed || save->failed;
+		os_unlink(save->path);
+	}
+
+	printf("%-22s %10.1f %10.1f %10.1f %10.1f%s\n", name,
+			start_sum / NUM_SAVES, start_max,
+			end_sum / NUM_SAVES, end_max,
+			failed ? "  (failed)" : "");
+}
+
+int main(void)
+{
+	frame_data = bzalloc(KEYFRAME_SIZE);
+
+	/* annex b start code and an access unit delimiter */
+	frame_data[3] = 1;
+	frame_data[4] = 0x09;
+	frame_data[5] = 0xf0;
+
+	av_register_all();
+
+	printf("%d concurrent saves of a %d s, %d fps, 6 Mbps buffer\n",
+			NUM_SAVES, BUFFER_SECONDS, FPS);
+	printf("%-22s %10s %10s %10s %10s   (ms)\n", "", "start avg",
+			"start max", "done avg", "done max");
+
+	run("ffmpeg-mux processes", run_processes);
+	run("in-process, 2 threads", run_pool);
+
+	bfree(frame_data);
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Times the CPU conversion of a packed UYVX output frame to I420, NV12 and
+ * I444 at 720p, 1080p and 4K, on the graphics thread alone and split into
+ * slices on a worker pool the way output_video_data does it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/worker-pool.h>
+#include <media-io/format-conversion.h>
+
+#define MAX_CONVERT_THREADS   8
+#define MIN_CONVERT_SLICE_CY  64
+#define FRAMES                60
+
+struct resolution {
+	const char *name;
+	uint32_t   cx;
+	uint32_t   cy;
+};
+
+static const struct resolution resolutions[] = {
+	{"720p",  1280,  720},
+	{"1080p", 1920, 1080},
+	{"4K",    3840, 2160},
+};
+
+typedef void (*convert_func_t)(const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+struct conversion {
+	const char     *name;
+	convert_func_t convert;
+	bool           full_chroma;
+};
+
+static const struct conversion conversions[] = {
+	{"I420", compress_uyvx_to_i420, false},
+	{"NV12", compress_uyvx_to_nv12, false},
+	{"I444", convert_uyvx_to_i444,  true},
+};
+
+struct slice {
+	uint32_t start_y;
+	uint32_t end_y;
+};
+
+struct convert_job {
+	const struct conversion *conversion;
+	const uint8_t           *input;
+	uint32_t                in_linesize;
+	uint8_t                 *output[3];
+	uint32_t                out_linesize[3];
+	DARRAY(struct slice)    slices;
+};
+
+static void convert_slice(void *param, size_t idx)
+{
+	struct convert_job *job = param;
+	struct slice *slice = job->slices.array + idx;
+
+	job->conversion->convert(job->input, job->in_linesize,
+			slice->start_y, slice->end_y,
+			job->output, job->out_linesize);
+}
+
+/* same slicing as add_convert_slices in obs-video.c */
+static void make_slices(struct convert_job *job, uint32_t height,
+		size_t num_slices)
+{
+	uint32_t slice_cy = (uint32_t)((height + num_slices - 1) / num_slices);
+
+	if (slice_cy < MIN_CONVERT_SLICE_CY)
+		slice_cy = MIN_CONVERT_SLICE_CY;
+	slice_cy = (slice_cy + 1) & ~1;
+
+	da_resize(job->slices, 0);
+
+	for (uint32_t y = 0; y < height; y += slice_cy) {
+		struct slice *slice = da_push_back_new(job->slices);
+		slice->start_y = y;
+		slice->end_y   = (height - y > slice_cy) ?
+			y + slice_cy : height;
+	}
+}
+
+static double run(struct convert_job *job, worker_pool_t *pool,
+		uint32_t height)
+{
+	size_t threads = pool ? worker_pool_num_threads(pool) : 0;
+	uint64_t start;
+
+	make_slices(job, height, threads + 1);
+
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < FRAMES; i++)
+		worker_pool_run(pool, convert_slice, job, job->slices.num);
+
+	return (double)(os_gettime_ns() - start) / FRAMES / 1000000.0;
+}
+
+int main(void)
+{
+	int cores = os_get_logical_cores();
+	size_t max_threads = cores > 1 ? (size_t)(cores - 1) : 1;
+	worker_pool_t *pools[4] = {NULL};
+	size_t num_pools = 1;
+	struct convert_job job = {0};
+
+	if (max_threads > MAX_CONVERT_THREADS)
+		max_threads = MAX_CONVERT_THREADS;
+
+	/* no pool (the old single-threaded conversion), then 1, 3 and 7
+	 * worker threads, capped to what the machine would use */
+	for (size_t threads = 1; threads <= max_threads;
+	     threads = threads * 2 + 1)
+		pools[num_pools++] = worker_pool_create("bench: convert",
+				threads);
+
+	printf("%-6s %-5s", "res", "fmt");
+	for (size_t i = 0; i < num_pools; i++)
+		printf("   %d threads", (int)(pools[i] ?
+				worker_pool_num_threads(pools[i]) + 1 : 1));
+	printf("   (ms per frame)\n");
+
+	for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]);
+	     r++) {
+		const struct resolution *res = &resolutions[r];
+		uint8_t *input = bmalloc(res->cx * res->cy * 4);
+		uint8_t *output = bmalloc(res->cx * res->cy * 3);
+
+		for (size_t i = 0; i < res->cx * res->cy * 4; i++)
+			input[i] = (uint8_t)(i * 7);
+
+		job.input       = input;
+		job.in_linesize = res->cx * 4;
+
+		for (size_t c = 0; c < sizeof(conversions) /
+				sizeof(conversions[0]); c++) {
+			const struct conversion *conv = &conversions[c];
+			uint32_t chroma_cx = conv->full_chroma ?
+				res->cx : res->cx / 2;
+			uint32_t chroma_cy = conv->full_chroma ?
+				res->cy : res->cy / 2;
+			size_t luma_size = res->cx * res->cy;
+
+			job.conversion      = conv;
+			job.output[0]       = output;
+			job.output[1]       = output + luma_size;
+			job.output[2]       = job.output[1] +
+				chroma_cx * chroma_cy;
+			job.out_linesize[0] = res->cx;
+			job.out_linesize[1] = chroma_cx;
+			job.out_linesize[2] = chroma_cx;
+
+			/* NV12 interleaves both chroma planes in one */
+			if (conv->convert == compress_uyvx_to_nv12)
+				job.out_linesize[1] = res->cx;
+
+			printf("%-6s %-5s", res->name, conv->name);
+			for (size_t i = 0; i < num_pools; i++)
+				printf(" %11.2f", run(&job, pools[i], res->cy));
+			printf("\n");
+		}
+
+		bfree(input);
+		bfree(output);
+	}
+
+	for (size_t i = 0; i < num_pools; i++)
+		worker_pool_destroy(pools[i]);
+	da_free(job.slices);
+
+	return 0;
+}
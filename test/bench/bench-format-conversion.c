@@ -0,0 +1,203 @@
+/*
+ * Measures the throughput of the packed UYVX to I420/NV12/I444 conversions
+ * with each instruction set the dispatch in format-conversion.c can pick,
+ * plus a plain C version of the same conversion for reference.  The SIMD
+ * outputs are compared against the plain C output.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/cpu-features.h>
+#include <media-io/format-conversion.h>
+
+#define WIDTH           1920
+#define HEIGHT          1080
+#define FRAMES          100
+
+typedef void (*convert_func_t)(const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+enum chroma_layout {
+	CHROMA_420_PLANAR,
+	CHROMA_420_INTERLEAVED,
+	CHROMA_444_PLANAR,
+};
+
+static inline uint8_t avg4(const uint8_t *line1, const uint8_t *line2,
+		size_t offset)
+{
+	return (uint8_t)((line1[offset] + line1[offset + 4] +
+			line2[offset] + line2[offset + 4]) >> 2);
+}
+
+/* the same conversion as format-conversion.c, one pixel at a time: Y is
+ * byte 1 of each pixel, U byte 0 and V byte 2 */
+static void convert_scalar(enum chroma_layout layout, const uint8_t *input,
+		uint32_t in_linesize, uint8_t *output[],
+		const uint32_t out_linesize[])
+{
+	for (uint32_t y = 0; y < HEIGHT; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			lum0[x] = line1[x * 4 + 1];
+			lum1[x] = line2[x * 4 + 1];
+		}
+
+		if (layout == CHROMA_444_PLANAR) {
+			uint8_t *u0 = output[1] + y * out_linesize[1];
+			uint8_t *v0 = output[2] + y * out_linesize[2];
+
+			for (uint32_t x = 0; x < WIDTH; x++) {
+				u0[x] = line1[x * 4];
+				v0[x] = line1[x * 4 + 2];
+				u0[x + out_linesize[1]] = line2[x * 4];
+				v0[x + out_linesize[2]] = line2[x * 4 + 2];
+			}
+
+		} else if (layout == CHROMA_420_INTERLEAVED) {
+			uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+			for (uint32_t x = 0; x < WIDTH; x += 2) {
+				uv[x]     = avg4(line1, line2, x * 4);
+				uv[x + 1] = avg4(line1, line2, x * 4 + 2);
+			}
+
+		} else {
+			uint8_t *u = output[1] + (y / 2) * out_linesize[1];
+			uint8_t *v = output[2] + (y / 2) * out_linesize[2];
+
+			for (uint32_t x = 0; x < WIDTH; x += 2) {
+				u[x / 2] = avg4(line1, line2, x * 4);
+				v[x / 2] = avg4(line1, line2, x * 4 + 2);
+			}
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct conversion {
+	const char         *name;
+	convert_func_t     convert;
+	enum chroma_layout layout;
+};
+
+static const struct conversion conversions[] = {
+	{"I420", compress_uyvx_to_i420, CHROMA_420_PLANAR},
+	{"NV12", compress_uyvx_to_nv12, CHROMA_420_INTERLEAVED},
+	{"I444", convert_uyvx_to_i444,  CHROMA_444_PLANAR},
+};
+
+struct isa {
+	const char *name;
+	uint32_t   features;
+};
+
+/* the dispatch takes the best path the limited feature set allows */
+static const struct isa isas[] = {
+	{"sse2",  CPU_FEATURE_SSE2},
+	{"ssse3", CPU_FEATURE_SSE2 | CPU_FEATURE_SSSE3},
+	{"avx2",  CPU_FEATURE_SSE2 | CPU_FEATURE_SSSE3 | CPU_FEATURE_AVX |
+	          CPU_FEATURE_AVX2},
+};
+
+static uint8_t *planes[3];
+static uint32_t linesizes[3];
+
+static void set_planes(uint8_t *output, enum chroma_layout layout)
+{
+	size_t luma_size = WIDTH * HEIGHT;
+	bool full = layout == CHROMA_444_PLANAR;
+	uint32_t chroma_cx = full ? WIDTH : WIDTH / 2;
+	uint32_t chroma_cy = full ? HEIGHT : HEIGHT / 2;
+
+	planes[0]    = output;
+	planes[1]    = output + luma_size;
+	planes[2]    = planes[1] + chroma_cx * chroma_cy;
+	linesizes[0] = WIDTH;
+	linesizes[1] = layout == CHROMA_420_INTERLEAVED ? WIDTH : chroma_cx;
+	linesizes[2] = chroma_cx;
+}
+
+static double to_mb_per_sec(uint64_t ns)
+{
+	double bytes = (double)WIDTH * HEIGHT * 4 * FRAMES;
+	return bytes / ((double)ns / 1000000000.0) / (1024.0 * 1024.0);
+}
+
+int main(void)
+{
+	uint32_t supported = os_get_cpu_features();
+	size_t frame_size = WIDTH * HEIGHT * 4;
+	uint8_t *input = bmalloc(frame_size);
+	uint8_t *expected = bzalloc(WIDTH * HEIGHT * 3);
+	uint8_t *output = bzalloc(WIDTH * HEIGHT * 3);
+	uint32_t seed = 1;
+	int ret = 0;
+
+	for (size_t i = 0; i < frame_size; i++) {
+		seed = seed * 1103515245 + 12345;
+		input[i] = (uint8_t)(seed >> 16);
+	}
+
+	printf("%dx%d UYVX input, MB/s of input converted\n", WIDTH, HEIGHT);
+	printf("%-5s %9s", "fmt", "scalar");
+	for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+		printf(" %9s", isas[i].name);
+	printf("\n");
+
+	for (size_t c = 0; c < sizeof(conversions) / sizeof(conversions[0]);
+	     c++) {
+		const struct conversion *conv = &conversions[c];
+		uint64_t start;
+
+		printf("%-5s", conv->name);
+
+		set_planes(expected, conv->layout);
+		start = os_gettime_ns();
+		for (size_t i = 0; i < FRAMES; i++)
+			convert_scalar(conv->layout, input, WIDTH * 4, planes,
+					linesizes);
+		printf(" %9.0f", to_mb_per_sec(os_gettime_ns() - start));
+
+		for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+			const struct isa *isa = &isas[i];
+
+			if ((supported & isa->features) != isa->features) {
+				printf(" %9s", "n/a");
+				continue;
+			}
+
+			os_limit_cpu_features(isa->features);
+			set_planes(output, conv->layout);
+			memset(output, 0, WIDTH * HEIGHT * 3);
+
+			start = os_gettime_ns();
+			for (size_t j = 0; j < FRAMES; j++)
+				conv->convert(input, WIDTH * 4, 0, HEIGHT,
+						planes, linesizes);
+			printf(" %9.0f",
+					to_mb_per_sec(os_gettime_ns() - start));
+
+			if (memcmp(output, expected, WIDTH * HEIGHT * 3) != 0) {
+				printf(" (mismatch)");
+				ret = 1;
+			}
+		}
+
+		os_limit_cpu_features(0xFFFFFFFF);
+		printf("\n");
+	}
+
+	bfree(input);
+	bfree(expected);
+	bfree(output);
+	return ret;
+}
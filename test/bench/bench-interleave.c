@@ -0,0 +1,248 @@
+/*
+ * Feeds synthetic encoder packet streams through the output interleaving
+ * queue, for different numbers of audio tracks and video frame rates, and
+ * compares it with the single sorted array it replaced.
+ *
+ * "steady" sends one packet per received packet like interleave_packets
+ * does, "backlog" queues several seconds of packets first (i.e. a delayed
+ * start or reconnect) and then drains them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs-interleave.h>
+
+#define AUDIO_FRAME_USEC   (1024 * 1000000LL / 48000)
+#define AUDIO_LATENCY_USEC 20000
+#define VIDEO_LATENCY_USEC 150000
+
+#define STREAM_SECONDS     60
+#define BACKLOG_SECONDS    10
+
+struct stream_config {
+	int    fps;
+	size_t audio_tracks;
+};
+
+static const struct stream_config configs[] = {
+	{30,  1},
+	{60,  1},
+	{60,  2},
+	{30,  MAX_AUDIO_MIXES},
+	{60,  MAX_AUDIO_MIXES},
+	{120, MAX_AUDIO_MIXES},
+};
+
+struct arrival {
+	int64_t               time;
+	struct encoder_packet packet;
+};
+
+static int cmp_arrival(const void *a, const void *b)
+{
+	const struct arrival *arr_a = a;
+	const struct arrival *arr_b = b;
+	return arr_a->time < arr_b->time ? -1 : (arr_a->time > arr_b->time);
+}
+
+/* packets in the order the encoders deliver them: each track is in dts
+ * order, but video arrives later than audio because of encoder latency */
+static struct arrival *generate_stream(const struct stream_config *cfg,
+		int seconds, size_t *count)
+{
+	int64_t duration = seconds * 1000000LL;
+	int64_t frame_usec = 1000000LL / cfg->fps;
+	DARRAY(struct arrival) stream;
+
+	da_init(stream);
+
+	for (int64_t dts = 0; dts < duration; dts += frame_usec) {
+		struct arrival *arr = da_push_back_new(stream);
+		arr->packet.type     = OBS_ENCODER_VIDEO;
+		arr->packet.dts_usec = dts;
+		arr->time            = dts + VIDEO_LATENCY_USEC;
+	}
+
+	for (size_t track = 0; track < cfg->audio_tracks; track++) {
+		for (int64_t dts = 0; dts < duration;
+		     dts += AUDIO_FRAME_USEC) {
+			struct arrival *arr = da_push_back_new(stream);
+			arr->packet.type      = OBS_ENCODER_AUDIO;
+			arr->packet.track_idx = track;
+			arr->packet.dts_usec  = dts;
+			arr->time             = dts + AUDIO_LATENCY_USEC +
+				(int64_t)track;
+		}
+	}
+
+	qsort(stream.array, stream.num, sizeof(struct arrival), cmp_arrival);
+
+	*count = stream.num;
+	return stream.array;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct interleaver {
+	const char *name;
+	void (*insert)(const struct encoder_packet *packet);
+	bool (*send)(void);
+	void (*free)(void);
+};
+
+static int64_t highest_video_ts;
+static int64_t highest_audio_ts;
+
+static inline void set_higher_ts(const struct encoder_packet *packet)
+{
+	int64_t *highest = packet->type == OBS_ENCODER_VIDEO ?
+		&highest_video_ts : &highest_audio_ts;
+	if (*highest < packet->dts_usec)
+		*highest = packet->dts_usec;
+}
+
+static inline bool has_higher_opposing_ts(const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return highest_audio_ts > packet->dts_usec;
+	else
+		return highest_video_ts > packet->dts_usec;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct interleave_queue queue;
+
+static void queue_insert(const struct encoder_packet *packet)
+{
+	interleave_queue_insert(&queue, packet);
+}
+
+static bool queue_send(void)
+{
+	struct interleaved_packet *next;
+	size_t track_idx;
+
+	next = interleave_queue_peek(&queue, NULL, &track_idx);
+	if (!next || !has_higher_opposing_ts(&next->packet))
+		return false;
+
+	interleave_queue_pop(&queue, track_idx, NULL);
+	return true;
+}
+
+static void queue_free(void)
+{
+	interleave_queue_free(&queue);
+	queue.seq = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static DARRAY(struct encoder_packet) sorted;
+
+static void sorted_insert(const struct encoder_packet *packet)
+{
+	size_t idx;
+	for (idx = 0; idx < sorted.num; idx++) {
+		if (packet->dts_usec < sorted.array[idx].dts_usec)
+			break;
+	}
+
+	da_insert(sorted, idx, packet);
+}
+
+static bool sorted_send(void)
+{
+	if (!sorted.num || !has_higher_opposing_ts(sorted.array))
+		return false;
+
+	da_erase(sorted, 0);
+	return true;
+}
+
+static void sorted_free(void)
+{
+	da_free(sorted);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double run_steady(const struct interleaver *il,
+		const struct arrival *stream, size_t count)
+{
+	uint64_t start;
+
+	highest_video_ts = highest_audio_ts = 0;
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		il->insert(&stream[i].packet);
+		set_higher_ts(&stream[i].packet);
+		il->send();
+	}
+
+	while (il->send());
+
+	il->free();
+	return (double)(os_gettime_ns() - start) / (double)count;
+}
+
+static double run_backlog(const struct interleaver *il,
+		const struct arrival *stream, size_t count)
+{
+	uint64_t start;
+
+	highest_video_ts = highest_audio_ts = 0;
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		il->insert(&stream[i].packet);
+		set_higher_ts(&stream[i].packet);
+	}
+
+	while (il->send());
+
+	il->free();
+	return (double)(os_gettime_ns() - start) / (double)count;
+}
+
+int main(void)
+{
+	const struct interleaver interleavers[] = {
+		{"track queues", queue_insert, queue_send, queue_free},
+		{"sorted array", sorted_insert, sorted_send, sorted_free},
+	};
+
+	printf("%-14s %4s %6s %9s %14s %14s\n", "interleaver", "fps",
+			"tracks", "packets", "steady ns/pkt",
+			"backlog ns/pkt");
+
+	for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+		const struct stream_config *cfg = &configs[i];
+		struct arrival *stream, *backlog;
+		size_t count, backlog_count;
+
+		stream  = generate_stream(cfg, STREAM_SECONDS, &count);
+		backlog = generate_stream(cfg, BACKLOG_SECONDS,
+				&backlog_count);
+
+		for (size_t j = 0; j < 2; j++) {
+			const struct interleaver *il = &interleavers[j];
+
+			printf("%-14s %4d %6d %9d %14.1f %14.1f\n", il->name,
+					cfg->fps, (int)cfg->audio_tracks,
+					(int)count,
+					run_steady(il, stream, count),
+					run_backlog(il, backlog,
+						backlog_count));
+		}
+
+		bfree(stream);
+		bfree(backlog);
+	}
+
+	return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * Sends packets to a child process through the ffmpeg-mux shared memory
+ * ring and through its stdin, and compares the throughput.  The child is
+ * this program started with --shm=... or --pipe and reads packets the way
+ * ffmpeg-mux does: from the ring in place, or from stdin into a buffer.
+ *
+ * The largest packet size doesn't fit in the ring, so it measures the pipe
+ * fallback of the shared memory transport.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "obs-ffmpeg-mux-shm.h"
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TOTAL_BYTES (1024 * 1024 * 1024ULL)
+
+static const uint32_t packet_sizes[] = {
+	1024,
+	16 * 1024,
+	256 * 1024,
+	4 * 1024 * 1024,
+	20 * 1024 * 1024,
+};
+
+static inline uint8_t packet_byte(uint32_t idx)
+{
+	return (uint8_t)(idx * 31 + 7);
+}
+
+/* ------------------------------------------------------------------------- */
+/* reader process                                                            */
+
+static bool read_stdin(void *data, size_t size)
+{
+	return fread(data, 1, size, stdin) == size;
+}
+
+static bool check_packet(const struct ffm_packet_info *info,
+		const uint8_t *data, uint32_t idx)
+{
+	return info->index == idx &&
+		data[0] == packet_byte(idx) &&
+		data[info->size - 1] == packet_byte(idx);
+}
+
+static bool read_pipe_packet(struct ffm_packet_info *info, uint8_t **buf,
+		size_t *buf_size)
+{
+	if (!read_stdin(info, sizeof(*info)))
+		return false;
+
+	if (*buf_size < info->size) {
+		*buf = brealloc(*buf, info->size);
+		*buf_size = info->size;
+	}
+
+	return read_stdin(*buf, info->size);
+}
+
+static int run_pipe_reader(uint32_t count)
+{
+	struct ffm_packet_info info;
+	uint8_t *buf = NULL;
+	size_t buf_size = 0;
+	uint32_t idx = 0;
+
+	while (read_pipe_packet(&info, &buf, &buf_size)) {
+		if (!check_packet(&info, buf, idx++))
+			break;
+	}
+
+	bfree(buf);
+	return idx == count ? 0 : 1;
+}
+
+struct ring {
+	struct ffm_shm_header *header;
+	uint8_t               *data;
+	uint64_t              read_pos;
+	int                   data_event;
+	int                   space_event;
+};
+
+static void ring_advance(struct ring *ring, uint64_t size)
+{
+	ring->read_pos += size;
+	ffm_shm_store(&ring->header->read_pos, ring->read_pos);
+
+	if (ffm_shm_load_flag(&ring->header->writer_waiting))
+		ffm_shm_signal(ring->space_event);
+}
+
+/* same as shm_reader_read in ffmpeg-mux.c, minus the error checking */
+static bool ring_read(struct ring *ring, struct ffm_packet_info *info,
+		uint8_t **data)
+{
+	struct ffm_shm_header *header = ring->header;
+
+	for (;;) {
+		if (ffm_shm_load(&header->write_pos) != ring->read_pos) {
+			uint64_t offset = ring->read_pos &
+				(header->capacity - 1);
+			uint64_t tail = header->capacity - offset;
+
+			if (tail < sizeof(*info)) {
+				ring_advance(ring, tail);
+				continue;
+			}
+
+			memcpy(info, ring->data + offset, sizeof(*info));
+
+			if (info->size == FFM_SHM_PAD_SIZE) {
+				ring_advance(ring, tail);
+				continue;
+			}
+			if (info->size == FFM_SHM_PIPE_SIZE) {
+				ring_advance(ring, FFM_SHM_ALIGN(sizeof(*info)));
+				return true;
+			}
+
+			*data = ring->data + offset + sizeof(*info);
+			return true;
+		}
+
+		if (ffm_shm_load_flag(&header->writer_closed))
+			return false;
+
+		ffm_shm_store_flag(&header->reader_waiting, 1);
+
+		if (ffm_shm_load(&header->write_pos) == ring->read_pos &&
+		    !ffm_shm_load_flag(&header->writer_closed))
+			ffm_shm_wait(ring->data_event);
+
+		ffm_shm_store_flag(&header->reader_waiting, 0);
+	}
+}
+
+static int run_shm_reader(const char *arg, uint32_t count)
+{
+	struct ffm_packet_info info;
+	struct ring ring = {0};
+	uint8_t *buf = NULL;
+	size_t buf_size = 0;
+	uint32_t idx = 0;
+	struct stat st;
+	int mem_fd;
+
+	sscanf(arg + strlen(FFM_SHM_ARG), "%d,%d,%d", &mem_fd,
+			&ring.data_event, &ring.space_event);
+	fstat(mem_fd, &st);
+
+	ring.header = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, mem_fd, 0);
+	if (ring.header == MAP_FAILED)
+		return 1;
+
+	ring.data = (uint8_t*)ring.header + FFM_SHM_DATA_OFFSET;
+
+	for (;;) {
+		uint8_t *data;
+
+		if (!ring_read(&ring, &info, &data))
+			break;
+
+		if (info.size == FFM_SHM_PIPE_SIZE) {
+			if (!read_pipe_packet(&info, &buf, &buf_size))
+				break;
+			data = buf;
+		} else {
+			ring_advance(&ring, FFM_SHM_ALIGN(sizeof(info) +
+						info.size));
+		}
+
+		if (!check_packet(&info, data, idx++))
+			break;
+	}
+
+	ffm_shm_store_flag(&ring.header->reader_closed, 1);
+	ffm_shm_signal(ring.space_event);
+
+	bfree(buf);
+	return idx == count ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* writer                                                                    */
+
+static double run_writer(const char *self, uint32_t size, bool use_shm)
+{
+	uint32_t count = (uint32_t)(TOTAL_BYTES / size);
+	uint8_t *data = bmalloc(size);
+	struct ffmpeg_mux_shm *shm = NULL;
+	os_process_pipe_t *pipe;
+	struct dstr cmd = {0};
+	uint64_t start;
+	bool success = true;
+	int ret;
+
+	if (use_shm) {
+		shm = ffmpeg_mux_shm_create();
+		if (!shm) {
+			bfree(data);
+			return 0.0;
+		}
+	}
+
+	dstr_printf(&cmd, "\"%s\" ", self);
+	if (shm)
+		ffmpeg_mux_shm_add_arg(shm, &cmd);
+	else
+		dstr_cat(&cmd, "--pipe ");
+	dstr_catf(&cmd, "%u", count);
+
+	start = os_gettime_ns();
+
+	pipe = shm ?
+		ffmpeg_mux_shm_start_process(shm, cmd.array) :
+		os_process_pipe_create(cmd.array, "w");
+
+	for (uint32_t idx = 0; pipe && success && idx < count; idx++) {
+		struct ffm_packet_info info = {0};
+		info.size  = size;
+		info.index = idx;
+		info.type  = FFM_PACKET_VIDEO;
+
+		data[0] = data[size - 1] = packet_byte(idx);
+
+		if (shm) {
+			success = ffmpeg_mux_shm_write(shm, &info, data);
+		} else {
+			success = os_process_pipe_write(pipe,
+					(const uint8_t*)&info, sizeof(info)) ==
+					sizeof(info) &&
+				os_process_pipe_write(pipe, data, size) == size;
+		}
+	}
+
+	ffmpeg_mux_shm_destroy(shm);
+	ret = os_process_pipe_destroy(pipe);
+
+	start = os_gettime_ns() - start;
+
+	dstr_free(&cmd);
+	bfree(data);
+
+	if (!pipe || !success || ret != 0)
+		return -1.0;
+
+	return (double)count * size / ((double)start / 1000000000.0) /
+		(1024.0 * 1024.0);
+}
+
+static void print_result(double mb_per_sec)
+{
+	if (mb_per_sec > 0.0)
+		printf(" %10.0f", mb_per_sec);
+	else
+		printf(" %10s", mb_per_sec < 0.0 ? "failed" : "n/a");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && strcmp(argv[1], "--pipe") == 0)
+		return run_pipe_reader((uint32_t)strtoul(argv[2], NULL, 10));
+	if (argc == 3 && strncmp(argv[1], FFM_SHM_ARG,
+				strlen(FFM_SHM_ARG)) == 0)
+		return run_shm_reader(argv[1],
+				(uint32_t)strtoul(argv[2], NULL, 10));
+
+	printf("%llu MB per run, MB/s\n", TOTAL_BYTES / (1024 * 1024));
+	printf("%10s %10s %10s\n", "packet", "pipe", "shm");
+
+	for (size_t i = 0; i < sizeof(packet_sizes) / sizeof(packet_sizes[0]);
+	     i++) {
+		uint32_t size = packet_sizes[i];
+
+		printf("%9uK", size / 1024);
+		print_result(run_writer(argv[0], size, false));
+		print_result(run_writer(argv[0], size, true));
+		printf("\n");
+	}
+
+	return 0;
+}
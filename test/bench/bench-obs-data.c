@@ -0,0 +1,159 @@
+/*
+ * Loads a scene collection style JSON with 5000 sources through obs_data and
+ * times parsing and field access: the per-source fields read when sources
+ * are loaded, and lookups in one object with an item per source (the case
+ * the obs_data name index is for).
+ */
+
+#include <stdio.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <obs-data.h>
+
+#define NUM_SOURCES 5000
+#define RUNS        5
+
+static char *make_json(void)
+{
+	struct dstr json = {0};
+
+	dstr_cat(&json, "{\"current_scene\":\"Scene\",\"sources\":[");
+
+	for (int i = 0; i < NUM_SOURCES; i++) {
+		dstr_catf(&json, "%s{"
+				"\"enabled\":true,"
+				"\"flags\":0,"
+				"\"id\":\"image_source\","
+				"\"mixers\":15,"
+				"\"monitoring_type\":0,"
+				"\"muted\":false,"
+				"\"name\":\"Source %d\","
+				"\"settings\":{"
+					"\"file\":\"/images/%d.png\","
+					"\"unload\":false"
+				"},"
+				"\"sync\":0,"
+				"\"volume\":1.0"
+				"}", i ? "," : "", i, i);
+	}
+
+	/* an object with one item per source, like per-source hotkeys or
+	 * a scene's item list keyed by name */
+	dstr_cat(&json, "],\"hotkeys\":{");
+	for (int i = 0; i < NUM_SOURCES; i++)
+		dstr_catf(&json, "%s\"Source %d\":{\"key\":%d}",
+				i ? "," : "", i, i);
+	dstr_cat(&json, "}}");
+
+	return json.array;
+}
+
+static double elapsed_ms(uint64_t start)
+{
+	return (double)(os_gettime_ns() - start) / 1000000.0;
+}
+
+/* keys in the order they were generated, which doesn't match the sorted
+ * order obs_data keeps them in */
+static double time_unsorted_load(const char *json)
+{
+	double ms = 0.0;
+
+	for (int run = 0; run < RUNS; run++) {
+		uint64_t start = os_gettime_ns();
+		obs_data_release(obs_data_create_from_json(json));
+		ms += elapsed_ms(start);
+	}
+
+	return ms / RUNS;
+}
+
+int main(void)
+{
+	char *generated = make_json();
+	double unsorted_ms = time_unsorted_load(generated);
+	double parse_ms = 0.0, source_ms = 0.0, lookup_ms = 0.0;
+	long long check = 0;
+	obs_data_t *saved;
+	char *json;
+
+	/* the JSON as obs_data_save_json writes it, which is what scene
+	 * collections are loaded from */
+	saved = obs_data_create_from_json(generated);
+	json = bstrdup(obs_data_get_json(saved));
+	obs_data_release(saved);
+	bfree(generated);
+
+	printf("%d sources, %d bytes of JSON\n", NUM_SOURCES,
+			(int)strlen(json));
+
+	for (int run = 0; run < RUNS; run++) {
+		uint64_t start = os_gettime_ns();
+		obs_data_t *data = obs_data_create_from_json(json);
+		obs_data_array_t *sources;
+		obs_data_t *hotkeys;
+		size_t count;
+
+		parse_ms += elapsed_ms(start);
+
+		/* the fields obs_load_source reads for every source */
+		start = os_gettime_ns();
+		sources = obs_data_get_array(data, "sources");
+		count = obs_data_array_count(sources);
+
+		for (size_t i = 0; i < count; i++) {
+			obs_data_t *source = obs_data_array_item(sources, i);
+			obs_data_t *settings = obs_data_get_obj(source,
+					"settings");
+
+			check += (long long)strlen(
+					obs_data_get_string(source, "name"));
+			check += (long long)strlen(
+					obs_data_get_string(source, "id"));
+			check += obs_data_get_int(source, "mixers");
+			check += obs_data_get_int(source, "sync");
+			check += obs_data_get_bool(source, "muted");
+			check += (long long)obs_data_get_double(source,
+					"volume");
+			check += (long long)strlen(
+					obs_data_get_string(settings, "file"));
+
+			obs_data_release(settings);
+			obs_data_release(source);
+		}
+
+		obs_data_array_release(sources);
+		source_ms += elapsed_ms(start);
+
+		/* name lookups in a large object */
+		start = os_gettime_ns();
+		hotkeys = obs_data_get_obj(data, "hotkeys");
+
+		for (int i = 0; i < NUM_SOURCES; i++) {
+			char name[32];
+			obs_data_t *key;
+
+			snprintf(name, sizeof(name), "Source %d",
+					(i * 7919) % NUM_SOURCES);
+			key = obs_data_get_obj(hotkeys, name);
+			check += obs_data_get_int(key, "key");
+			obs_data_release(key);
+		}
+
+		obs_data_release(hotkeys);
+		lookup_ms += elapsed_ms(start);
+
+		obs_data_release(data);
+	}
+
+	printf("obs_data_create_from_json: %8.2f ms (%.2f ms with keys out "
+			"of order)\n", parse_ms / RUNS, unsorted_ms);
+	printf("source fields (%d x 7):  %8.2f ms\n", NUM_SOURCES,
+			source_ms / RUNS);
+	printf("lookups in %d items:    %8.2f ms\n", NUM_SOURCES,
+			lookup_ms / RUNS);
+	printf("(checksum %lld)\n", check);
+
+	bfree(json);
+	return 0;
+}
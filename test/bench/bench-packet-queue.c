@@ -0,0 +1,170 @@
+/*
+ * Measures enqueue and enqueue-to-dequeue latency of the rtmp-stream packet
+ * queue at a fixed packet rate, against the mutex protected circlebuf it
+ * replaced.  The consumer waits on a semaphore, the same way the send thread
+ * does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "packet-queue.h"
+
+#define PACKETS_PER_SEC 50000
+#define NUM_PACKETS     (PACKETS_PER_SEC * 4)
+
+struct queue_ops {
+	const char *name;
+	void (*push)(const struct encoder_packet *packet);
+	bool (*pop)(struct encoder_packet *packet);
+};
+
+static os_sem_t *send_sem;
+
+static uint64_t push_ns[NUM_PACKETS];
+static uint64_t latency_ns[NUM_PACKETS];
+
+/* ------------------------------------------------------------------------- */
+
+static struct packet_queue spsc_queue;
+
+static void spsc_push(const struct encoder_packet *packet)
+{
+	packet_queue_push(&spsc_queue, packet);
+}
+
+static bool spsc_pop(struct encoder_packet *packet)
+{
+	long seq;
+	return packet_queue_pop(&spsc_queue, packet, &seq);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static pthread_mutex_t packets_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct circlebuf packets;
+
+static void mutex_push(const struct encoder_packet *packet)
+{
+	pthread_mutex_lock(&packets_mutex);
+	circlebuf_push_back(&packets, packet, sizeof(*packet));
+	pthread_mutex_unlock(&packets_mutex);
+}
+
+static bool mutex_pop(struct encoder_packet *packet)
+{
+	bool available;
+
+	pthread_mutex_lock(&packets_mutex);
+	available = packets.size != 0;
+	if (available)
+		circlebuf_pop_front(&packets, packet, sizeof(*packet));
+	pthread_mutex_unlock(&packets_mutex);
+
+	return available;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void *consumer_thread(void *data)
+{
+	const struct queue_ops *ops = data;
+	size_t received = 0;
+
+	while (received < NUM_PACKETS) {
+		struct encoder_packet packet;
+
+		if (os_sem_wait(send_sem) != 0)
+			break;
+
+		while (ops->pop(&packet)) {
+			uint64_t now = os_gettime_ns();
+			latency_ns[packet.track_idx] = now - (uint64_t)packet.pts;
+			received++;
+		}
+	}
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return val_a < val_b ? -1 : (val_a > val_b ? 1 : 0);
+}
+
+static void print_stats(const char *name, uint64_t *times)
+{
+	uint64_t total = 0;
+
+	qsort(times, NUM_PACKETS, sizeof(uint64_t), cmp_u64);
+
+	for (size_t i = 0; i < NUM_PACKETS; i++)
+		total += times[i];
+
+	printf("  %-8s avg %8.0f ns, p50 %8llu ns, p99 %8llu ns, "
+			"max %8llu ns\n", name,
+			(double)total / NUM_PACKETS,
+			(unsigned long long)times[NUM_PACKETS / 2],
+			(unsigned long long)times[NUM_PACKETS * 99 / 100],
+			(unsigned long long)times[NUM_PACKETS - 1]);
+}
+
+static void run(const struct queue_ops *ops)
+{
+	uint64_t interval = 1000000000ULL / PACKETS_PER_SEC;
+	uint64_t start;
+	pthread_t thread;
+
+	os_sem_init(&send_sem, 0);
+	pthread_create(&thread, NULL, consumer_thread, (void*)ops);
+
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		struct encoder_packet packet = {0};
+		uint64_t push_start;
+
+		/* roughly one video packet per 15 audio packets */
+		packet.type      = (i % 16) == 0 ?
+			OBS_ENCODER_VIDEO : OBS_ENCODER_AUDIO;
+		packet.track_idx = i;
+
+		os_sleepto_ns(start + interval * i);
+
+		push_start = os_gettime_ns();
+		packet.pts = (int64_t)push_start;
+		ops->push(&packet);
+		push_ns[i] = os_gettime_ns() - push_start;
+
+		os_sem_post(send_sem);
+	}
+
+	pthread_join(thread, NULL);
+	os_sem_destroy(send_sem);
+
+	printf("%s (%d packets at %d packets/s):\n", ops->name, NUM_PACKETS,
+			PACKETS_PER_SEC);
+	print_stats("enqueue", push_ns);
+	print_stats("latency", latency_ns);
+}
+
+int main(void)
+{
+	const struct queue_ops spsc  = {"spsc queue", spsc_push, spsc_pop};
+	const struct queue_ops mutex = {"mutex + circlebuf", mutex_push,
+		mutex_pop};
+
+	packet_queue_init(&spsc_queue);
+	run(&spsc);
+	packet_queue_free(&spsc_queue);
+
+	run(&mutex);
+	circlebuf_free(&packets);
+
+	return 0;
+}
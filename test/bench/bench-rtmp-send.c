@@ -0,0 +1,284 @@
+/*
+ * Streams a synthetic 60 fps video and AAC audio stream through librtmp to a
+ * loopback TCP sink, the way send_packet did before (flv_packet_mux builds an
+ * FLV tag, RTMP_Write copies its body into an RTMPPacket) and the way it does
+ * now (RTMP_WriteMedia sends the packet data by reference), at a few
+ * bitrates.  Packets are sent as fast as the sink reads them.
+ *
+ * Reports the payload bytes copied in userspace per Mbit streamed (the FLV
+ * tag plus the RTMPPacket body, not counting reallocations while the tag
+ * grows) and the CPU time of the sending thread per Mbit.  The sink checks
+ * that both ways send the same bytes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "flv-mux.h"
+#include "librtmp/rtmp.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define STREAM_SECONDS      120
+#define FPS                 60
+#define KEYFRAME_INTERVAL   (FPS * 2)
+#define AUDIO_RATE          48000
+#define AUDIO_FRAME_SAMPLES 1024
+#define AUDIO_BITRATE       160000
+#define CHUNK_SIZE          4096
+
+static const int video_bitrates[] = {2500, 6000, 20000, 50000};
+
+struct send_result {
+	uint64_t bytes_sent;
+	uint64_t bytes_copied;
+	uint64_t cpu_ns;
+	uint64_t checksum;
+	bool     failed;
+};
+
+/* ------------------------------------------------------------------------- */
+/* sink                                                                      */
+
+struct sink {
+	int       fd;
+	pthread_t thread;
+	uint64_t  bytes;
+	uint64_t  checksum;
+};
+
+static void *sink_thread(void *param)
+{
+	struct sink *sink = param;
+	uint64_t hash = 14695981039346656037ULL;
+	uint8_t buf[65536];
+	ssize_t ret;
+
+	while ((ret = recv(sink->fd, buf, sizeof(buf), 0)) > 0) {
+		for (ssize_t i = 0; i < ret; i++)
+			hash = (hash ^ buf[i]) * 1099511628211ULL;
+		sink->bytes += (uint64_t)ret;
+	}
+
+	sink->checksum = hash;
+	return NULL;
+}
+
+/* returns the sending end of a loopback connection to a new sink */
+static int start_sink(struct sink *sink)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	int listen_fd, fd;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		return -1;
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	    listen(listen_fd, 1) != 0 ||
+	    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) != 0) {
+		close(listen_fd);
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		if (fd >= 0)
+			close(fd);
+		close(listen_fd);
+		return -1;
+	}
+
+	memset(sink, 0, sizeof(*sink));
+	sink->fd = accept(listen_fd, NULL, NULL);
+	close(listen_fd);
+
+	if (sink->fd < 0) {
+		close(fd);
+		return -1;
+	}
+
+	pthread_create(&sink->thread, NULL, sink_thread, sink);
+	return fd;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sender                                                                    */
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* the old send_packet */
+static bool send_flv_tag(RTMP *rtmp, struct encoder_packet *packet,
+		struct send_result *result)
+{
+	uint8_t *data;
+	size_t size;
+	int ret;
+
+	flv_packet_mux(packet, &data, &size, false);
+	ret = RTMP_Write(rtmp, (char*)data, (int)size, 0);
+	bfree(data);
+
+	result->bytes_copied += size + (size - FLV_TAG_OVERHEAD);
+	result->bytes_sent   += size;
+	return ret > 0;
+}
+
+/* the current send_packet */
+static bool send_media(RTMP *rtmp, struct encoder_packet *packet,
+		struct send_result *result)
+{
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
+	size_t prefix_size = flv_packet_prefix(packet, false, prefix);
+	int ret;
+
+	ret = RTMP_WriteMedia(rtmp,
+			packet->type == OBS_ENCODER_VIDEO ?
+				RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO,
+			get_ms_time(packet, packet->dts) & 0x7FFFFFFF,
+			(const char*)prefix, (int)prefix_size,
+			(const char*)packet->data, (int)packet->size, 0);
+
+	result->bytes_copied += prefix_size;
+	result->bytes_sent   += FLV_TAG_OVERHEAD + prefix_size + packet->size;
+	return ret > 0;
+}
+
+typedef bool (*send_func_t)(RTMP *rtmp, struct encoder_packet *packet,
+		struct send_result *result);
+
+static void run(send_func_t send_func, int video_kbps, uint8_t *payload,
+		struct send_result *result)
+{
+	size_t frame_size = (size_t)video_kbps * 1000 / 8 / FPS;
+	size_t audio_size = AUDIO_BITRATE / 8 * AUDIO_FRAME_SAMPLES / AUDIO_RATE;
+	int64_t video_frames = STREAM_SECONDS * FPS;
+	int64_t frame = 0, audio_frame = 0;
+	struct sink sink;
+	uint64_t start;
+	RTMP rtmp;
+	int fd;
+
+	memset(result, 0, sizeof(*result));
+
+	fd = start_sink(&sink);
+	if (fd < 0) {
+		result->failed = true;
+		return;
+	}
+
+	RTMP_Init(&rtmp);
+	rtmp.m_sb.sb_socket     = fd;
+	rtmp.m_outChunkSize     = CHUNK_SIZE;
+	rtmp.Link.streams[0].id = 1;
+
+	start = thread_cpu_ns();
+
+	/* interleaved by dts, every frame a B frame one frame behind */
+	while (!result->failed && frame < video_frames) {
+		struct encoder_packet packet = {0};
+		int64_t audio_ms = audio_frame * AUDIO_FRAME_SAMPLES * 1000 /
+			AUDIO_RATE;
+
+		packet.data = payload;
+
+		if (audio_ms < frame * 1000 / FPS) {
+			packet.type         = OBS_ENCODER_AUDIO;
+			packet.size         = audio_size;
+			packet.pts          = audio_frame * AUDIO_FRAME_SAMPLES;
+			packet.dts          = packet.pts;
+			packet.timebase_num = 1;
+			packet.timebase_den = AUDIO_RATE;
+			audio_frame++;
+		} else {
+			packet.type         = OBS_ENCODER_VIDEO;
+			packet.keyframe     = frame % KEYFRAME_INTERVAL == 0;
+			packet.size         = packet.keyframe ?
+				frame_size * 10 : frame_size;
+			packet.pts          = frame + 1;
+			packet.dts          = frame;
+			packet.timebase_num = 1;
+			packet.timebase_den = FPS;
+			frame++;
+		}
+
+		result->failed = !send_func(&rtmp, &packet, result);
+	}
+
+	result->cpu_ns = thread_cpu_ns() - start;
+
+	RTMP_Close(&rtmp);
+	pthread_join(sink.thread, NULL);
+	close(sink.fd);
+
+	result->checksum = sink.checksum;
+	if (sink.bytes == 0)
+		result->failed = true;
+}
+
+static void print_result(const struct send_result *result)
+{
+	double mbits = (double)result->bytes_sent * 8.0 / 1000000.0;
+
+	if (result->failed) {
+		printf(" %12s %12s", "failed", "failed");
+		return;
+	}
+
+	printf(" %12.0f %12.1f", (double)result->bytes_copied / mbits,
+			(double)result->cpu_ns / 1000.0 / mbits);
+}
+
+int main(void)
+{
+	/* keyframes are ten times the size of other frames */
+	size_t max_size = (size_t)video_bitrates[sizeof(video_bitrates) /
+		sizeof(video_bitrates[0]) - 1] * 1000 / 8 / FPS * 10;
+	uint8_t *payload = bmalloc(max_size);
+	int ret = 0;
+
+	for (size_t i = 0; i < max_size; i++)
+		payload[i] = (uint8_t)(i * 31 + 7);
+
+	printf("%d s of %d fps video + %d kbps audio over loopback, "
+			"per Mbit streamed\n", STREAM_SECONDS, FPS,
+			AUDIO_BITRATE / 1000);
+	printf("%-8s %12s %12s %12s %12s\n", "video", "FLV copied",
+			"FLV cpu us", "media copied", "media cpu us");
+
+	for (size_t i = 0; i < sizeof(video_bitrates) /
+			sizeof(video_bitrates[0]); i++) {
+		struct send_result flv, media;
+
+		run(send_flv_tag, video_bitrates[i], payload, &flv);
+		run(send_media, video_bitrates[i], payload, &media);
+
+		printf("%5dk  ", video_bitrates[i]);
+		print_result(&flv);
+		print_result(&media);
+
+		if (!flv.failed && !media.failed &&
+		    flv.checksum != media.checksum) {
+			printf("  (streams differ)");
+			ret = 1;
+		}
+		printf("\n");
+	}
+
+	bfree(payload);
+	return ret;
+}
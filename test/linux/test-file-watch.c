@@ -0,0 +1,188 @@
+/*
+ * Checks os_file_watch: callbacks for written files and for files replaced
+ * by a rename, removing the last watch from its own callback, and that the
+ * watch thread is stopped with its memory and descriptors freed once the
+ * last watch is gone or os_file_watch_shutdown was called.  Returns non-zero
+ * if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <dirent.h>
+
+#define TIMEOUT_MS 3000
+
+struct watcher {
+	os_file_watch_t *volatile watch;
+	volatile long   calls;
+	bool            remove_self;
+};
+
+static int failures;
+
+static void check(bool success, const char *what)
+{
+	printf("%-60s %s\n", what, success ? "ok" : "FAILED");
+	if (!success)
+		failures++;
+}
+
+static void file_changed(void *param, const char *path)
+{
+	struct watcher *watcher = param;
+
+	os_atomic_inc_long(&watcher->calls);
+
+	if (watcher->remove_self) {
+		os_file_watch_remove(os_atomic_load_ptr(
+					(void *volatile*)&watcher->watch));
+		os_atomic_set_ptr((void *volatile*)&watcher->watch, NULL);
+	}
+
+	UNUSED_PARAMETER(path);
+}
+
+static bool wait_for_calls(struct watcher *watcher, long calls)
+{
+	for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+		if (os_atomic_load_long(&watcher->calls) >= calls)
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+static size_t count_entries(const char *path)
+{
+	struct dirent *entry;
+	size_t count = 0;
+	DIR *dir = opendir(path);
+
+	if (!dir)
+		return 0;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] != '.')
+			count++;
+	}
+
+	closedir(dir);
+	return count;
+}
+
+/* the thread is joined before the last remove returns, so this only has
+ * to wait when it stopped itself */
+static bool wait_for_threads(size_t threads)
+{
+	for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+		if (count_entries("/proc/self/task") == threads)
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+static void write_file(const char *path, const char *text)
+{
+	FILE *file = fopen(path, "w");
+	if (file) {
+		fputs(text, file);
+		fclose(file);
+	}
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/obs-file-watch-XXXXXX";
+	struct watcher a = {0}, b = {0}, c = {0};
+	struct dstr path_a = {0}, path_b = {0}, path_c = {0}, tmp = {0};
+	size_t threads, fds;
+	long allocs;
+
+	if (!mkdtemp(dir)) {
+		printf("failed to create a temporary directory\n");
+		return 1;
+	}
+
+	dstr_printf(&path_a, "%s/a.txt", dir);
+	dstr_printf(&path_b, "%s/b.txt", dir);
+	dstr_printf(&path_c, "%s/c.txt", dir);
+	dstr_printf(&tmp, "%s/b.tmp", dir);
+
+	write_file(path_a.array, "a");
+	write_file(path_b.array, "b");
+	write_file(path_c.array, "c");
+
+	threads = count_entries("/proc/self/task");
+	fds     = count_entries("/proc/self/fd");
+	allocs  = bnum_allocs();
+
+	/* writes and renames */
+	a.watch = os_file_watch_add(path_a.array, file_changed, &a);
+	b.watch = os_file_watch_add(path_b.array, file_changed, &b);
+	check(a.watch && b.watch, "watches added");
+	check(count_entries("/proc/self/task") == threads + 1,
+			"one thread for all watches");
+
+	write_file(path_a.array, "a2");
+	check(wait_for_calls(&a, 1), "callback for a written file");
+	os_sleep_ms(100);
+	check(os_atomic_load_long(&b.calls) == 0,
+			"no callback for another file in the directory");
+
+	write_file(tmp.array, "b2");
+	rename(tmp.array, path_b.array);
+	check(wait_for_calls(&b, 1), "callback for a file replaced by rename");
+
+	/* removing the last watch stops the thread */
+	os_file_watch_remove(a.watch);
+	os_file_watch_remove(b.watch);
+	check(count_entries("/proc/self/task") == threads,
+			"thread joined when the last watch is removed");
+	check(count_entries("/proc/self/fd") == fds,
+			"descriptors closed when the last watch is removed");
+	check(bnum_allocs() == allocs,
+			"memory freed when the last watch is removed");
+
+	/* the thread stops itself if a callback removes the last watch */
+	c.remove_self = true;
+	os_atomic_set_ptr((void *volatile*)&c.watch,
+			os_file_watch_add(path_c.array, file_changed, &c));
+	write_file(path_c.array, "c2");
+	check(wait_for_calls(&c, 1) && wait_for_threads(threads),
+			"thread exits after a callback removed the last watch");
+
+	os_file_watch_shutdown();
+	check(count_entries("/proc/self/fd") == fds &&
+			bnum_allocs() == allocs,
+			"os_file_watch_shutdown frees everything");
+
+	/* and starts again afterwards */
+	a.calls = 0;
+	a.watch = os_file_watch_add(path_a.array, file_changed, &a);
+	write_file(path_a.array, "a3");
+	check(wait_for_calls(&a, 1), "watching again after shutdown");
+	os_file_watch_remove(a.watch);
+	check(count_entries("/proc/self/task") == threads &&
+			bnum_allocs() == allocs,
+			"thread stopped again");
+
+	os_unlink(path_a.array);
+	os_unlink(path_b.array);
+	os_unlink(path_c.array);
+	os_rmdir(dir);
+
+	dstr_free(&path_a);
+	dstr_free(&path_b);
+	dstr_free(&path_c);
+	dstr_free(&tmp);
+
+	return failures ? 1 : 0;
+}
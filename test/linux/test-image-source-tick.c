@@ -0,0 +1,166 @@
+/*
+ * Ticks image sources in parallel on a worker pool, the way tick_sources
+ * does for sources with OBS_SOURCE_PARALLEL_TICK, while their files keep
+ * changing so that images are reloaded from the ticks and from the file
+ * watch thread at the same time.  Checks that every source ends up with
+ * the cache entry of the latest version of its file swapped in.  Runs
+ * without a graphics context, so the images are never turned into
+ * textures.  obs_startup needs an X server (for hotkeys), headless:
+ *
+ *   xvfb-run ./test-image-source-tick
+ *
+ * Returns non-zero if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <utime.h>
+#include <util/dstr.h>
+#include <util/worker-pool.h>
+#include "obs-internal.h"
+
+/* for image_source_info and the source's state */
+#include "image-source.c"
+
+#define NUM_FILES    4
+#define NUM_SOURCES  32
+#define NUM_ROUNDS   200
+#define TICK_THREADS 4
+#define TIMEOUT_MS   5000
+
+static int failures;
+
+static void check(bool success, const char *what)
+{
+	printf("%-60s %s\n", what, success ? "ok" : "FAILED");
+	if (!success)
+		failures++;
+}
+
+static obs_source_t *sources[NUM_SOURCES];
+static struct dstr files[NUM_FILES];
+static time_t file_times[NUM_FILES];
+static struct image_cache_entry *latest[NUM_FILES];
+
+static inline struct image_source *get_context(size_t idx)
+{
+	return sources[idx]->context.data;
+}
+
+/* same as tick_callback_job in obs-video.c */
+static void tick_job(void *param, size_t idx)
+{
+	image_source_info.video_tick(get_context(idx), 1.0f / 60.0f);
+	UNUSED_PARAMETER(param);
+}
+
+/* the image source reloads a file when its modification time increases.
+ * the times are in the future, so they're newer than the file's creation */
+static void touch_file(size_t idx)
+{
+	struct utimbuf times;
+
+	file_times[idx]++;
+	times.actime  = file_times[idx];
+	times.modtime = file_times[idx];
+	utime(files[idx].array, &times);
+}
+
+static bool all_swapped_in(void)
+{
+	for (size_t i = 0; i < NUM_SOURCES; i++) {
+		struct image_source *context = get_context(i);
+		bool swapped;
+
+		pthread_mutex_lock(&context->mutex);
+		swapped = !context->pending &&
+			context->image == latest[i % NUM_FILES];
+		pthread_mutex_unlock(&context->mutex);
+
+		if (!swapped)
+			return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/test-image-source-tick-XXXXXX";
+	worker_pool_t *pool;
+	uint64_t start;
+
+	if (!mkdtemp(dir) || !obs_startup("en-US", NULL, NULL)) {
+		printf("failed to set up\n");
+		return 1;
+	}
+
+	obs_module_load();
+	pool = worker_pool_create("test: tick thread", TICK_THREADS);
+
+	for (size_t i = 0; i < NUM_FILES; i++) {
+		dstr_printf(&files[i], "%s/image%d.png", dir, (int)i);
+		os_quick_write_utf8_file(files[i].array, "x", 1, false);
+
+		file_times[i] = time(NULL) + 1000;
+		touch_file(i);
+	}
+
+	for (size_t i = 0; i < NUM_SOURCES; i++) {
+		obs_data_t *settings = obs_data_create();
+		struct dstr name = {0};
+
+		dstr_printf(&name, "image %d", (int)i);
+		obs_data_set_string(settings, "file",
+				files[i % NUM_FILES].array);
+		obs_data_set_bool(settings, "unload", false);
+
+		sources[i] = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"image_source", name.array, settings, NULL);
+
+		obs_data_release(settings);
+		dstr_free(&name);
+	}
+
+	check(image_source_info.output_flags & OBS_SOURCE_PARALLEL_TICK,
+			"image source ticks in parallel");
+
+	for (size_t round = 0; round < NUM_ROUNDS; round++) {
+		if (round % 20 == 0)
+			touch_file(round / 20 % NUM_FILES);
+
+		worker_pool_run(pool, tick_job, NULL, NUM_SOURCES);
+		os_sleep_ms(1);
+	}
+
+	/* the last reloads may still be on their way from the file watch, or
+	 * being decoded */
+	for (size_t i = 0; i < NUM_FILES; i++)
+		latest[i] = image_cache_acquire(files[i].array, file_times[i]);
+
+	start = os_gettime_ns();
+	while (!all_swapped_in() &&
+	       os_gettime_ns() - start < TIMEOUT_MS * 1000000ULL) {
+		worker_pool_run(pool, tick_job, NULL, NUM_SOURCES);
+		os_sleep_ms(10);
+	}
+
+	check(all_swapped_in(), "every source swapped in its latest image");
+
+	for (size_t i = 0; i < NUM_FILES; i++)
+		image_cache_release(latest[i]);
+	for (size_t i = 0; i < NUM_SOURCES; i++)
+		obs_source_release(sources[i]);
+
+	worker_pool_destroy(pool);
+	obs_module_unload();
+	obs_shutdown();
+
+	for (size_t i = 0; i < NUM_FILES; i++) {
+		os_unlink(files[i].array);
+		dstr_free(&files[i]);
+	}
+	os_rmdir(dir);
+
+	return failures ? 1 : 0;
+}
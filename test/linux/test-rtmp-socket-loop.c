@@ -0,0 +1,294 @@
+/*
+ * Streams patterned data through the rtmp-stream write buffer and the epoll
+ * socket loop (socket_thread_linux) to a local TCP sink standing in for an
+ * RTMP server, in normal and low-latency mode, and checks that the sink
+ * receives every byte in order.  In low-latency mode it also checks that no
+ * single send is larger than the latency packet size.
+ *
+ * The data is queued the way socket_queue_data does it: pushed into the byte
+ * ring under write_buf_mutex, waiting for buffer space when it's full.  The
+ * two rtmp-stream.c functions the loop calls are implemented here, and
+ * record what was sent.  Returns non-zero if a check fails.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "rtmp-stream.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WRITE_BUF_SIZE  (256 * 1024)
+#define MAX_CHUNK_SIZE  40000
+#define TIMEOUT_MS      30000
+
+/* the same values as in rtmp-linux.c */
+#define LATENCY_FACTOR  20
+
+static int failures;
+
+static void check(bool success, const char *what)
+{
+	printf("%-60s %s\n", what, success ? "ok" : "FAILED");
+	if (!success)
+		failures++;
+}
+
+static inline uint8_t pattern_byte(uint64_t offset)
+{
+	return (uint8_t)((offset ^ (offset >> 8) ^ (offset >> 16)) * 31 + 7);
+}
+
+/* ------------------------------------------------------------------------- */
+/* rtmp-stream.c hooks                                                       */
+
+static uint64_t bytes_sent;
+static size_t   max_send;
+
+void update_packets_sent(struct rtmp_stream *stream, int sent)
+{
+	/* called with write_buf_mutex locked */
+	bytes_sent += (uint64_t)sent;
+	if ((size_t)sent > max_send)
+		max_send = (size_t)sent;
+
+	UNUSED_PARAMETER(stream);
+}
+
+bool adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
+{
+	int cur_size = new_size;
+	socklen_t int_size = sizeof(int);
+
+	getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+			&cur_size, &int_size);
+
+	if (cur_size < new_size) {
+		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+				&new_size, int_size);
+		return true;
+	}
+
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sink                                                                      */
+
+struct sink {
+	int       fd;
+	pthread_t thread;
+	uint64_t  received;
+	uint64_t  mismatches;
+};
+
+static void *sink_thread(void *param)
+{
+	struct sink *sink = param;
+	uint8_t buf[4096];
+	ssize_t ret;
+
+	while ((ret = recv(sink->fd, buf, sizeof(buf), 0)) > 0) {
+		for (ssize_t i = 0; i < ret; i++) {
+			if (buf[i] != pattern_byte(sink->received + i))
+				sink->mismatches++;
+		}
+		sink->received += (uint64_t)ret;
+	}
+
+	return NULL;
+}
+
+/* returns the sending end of a loopback connection to a new sink */
+static int start_sink(struct sink *sink)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	int listen_fd, fd;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		return -1;
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	    listen(listen_fd, 1) != 0 ||
+	    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) != 0) {
+		close(listen_fd);
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		if (fd >= 0)
+			close(fd);
+		close(listen_fd);
+		return -1;
+	}
+
+	memset(sink, 0, sizeof(*sink));
+	sink->fd = accept(listen_fd, NULL, NULL);
+	close(listen_fd);
+
+	if (sink->fd < 0) {
+		close(fd);
+		return -1;
+	}
+
+	pthread_create(&sink->thread, NULL, sink_thread, sink);
+	return fd;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sender                                                                    */
+
+/* same as socket_queue_data in rtmp-stream.c */
+static bool queue_data(struct rtmp_stream *stream, const uint8_t *data,
+		size_t len)
+{
+	for (;;) {
+		pthread_mutex_lock(&stream->write_buf_mutex);
+
+		if (stream->rtmp.m_sb.sb_socket == -1) {
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+			return false;
+		}
+		if (stream->write_buf_len + len <= stream->write_buf_size)
+			break;
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		if (os_event_timedwait(stream->buffer_space_available_event,
+					TIMEOUT_MS) != 0)
+			return false;
+	}
+
+	write_buf_push(stream, data, len);
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	socket_thread_linux_wake(stream);
+	return true;
+}
+
+static bool init_stream(struct rtmp_stream *stream, int fd, bool low_latency)
+{
+	memset(stream, 0, sizeof(*stream));
+
+	stream->rtmp.m_sb.sb_socket = fd;
+	stream->low_latency_mode    = low_latency;
+	stream->new_socket_loop     = true;
+	stream->epoll_fd            = -1;
+	stream->socket_wake_fd      = -1;
+	stream->write_buf_size      = WRITE_BUF_SIZE;
+	stream->write_buf           = bmalloc(WRITE_BUF_SIZE);
+
+	pthread_mutex_init_value(&stream->write_buf_mutex);
+
+	return pthread_mutex_init(&stream->write_buf_mutex, NULL) == 0 &&
+		os_event_init(&stream->stop_event,
+				OS_EVENT_TYPE_MANUAL) == 0 &&
+		os_event_init(&stream->buffer_space_available_event,
+				OS_EVENT_TYPE_AUTO) == 0 &&
+		os_event_init(&stream->send_thread_signaled_exit,
+				OS_EVENT_TYPE_MANUAL) == 0 &&
+		socket_thread_linux_init(stream);
+}
+
+static void free_stream(struct rtmp_stream *stream)
+{
+	socket_thread_linux_free(stream);
+	os_event_destroy(stream->send_thread_signaled_exit);
+	os_event_destroy(stream->buffer_space_available_event);
+	os_event_destroy(stream->stop_event);
+	pthread_mutex_destroy(&stream->write_buf_mutex);
+	bfree(stream->write_buf);
+}
+
+static void run(const char *name, bool low_latency, uint64_t total)
+{
+	struct rtmp_stream stream;
+	struct sink sink;
+	uint8_t *chunk = bmalloc(MAX_CHUNK_SIZE);
+	uint64_t offset = 0;
+	uint64_t start;
+	uint32_t seed = 1;
+	bool queued = true;
+	int fd;
+
+	printf("%s:\n", name);
+
+	bytes_sent = 0;
+	max_send = 0;
+
+	fd = start_sink(&sink);
+	if (fd < 0 || !init_stream(&stream, fd, low_latency)) {
+		check(false, "loopback connection and socket loop set up");
+		bfree(chunk);
+		return;
+	}
+
+	start = os_gettime_ns();
+	pthread_create(&stream.socket_thread, NULL, socket_thread_linux,
+			&stream);
+
+	/* chunks of varying size, so the ring wraps at different offsets */
+	while (queued && offset < total) {
+		size_t size;
+
+		seed = seed * 1103515245 + 12345;
+		size = 1 + (seed >> 8) % MAX_CHUNK_SIZE;
+		if (size > total - offset)
+			size = (size_t)(total - offset);
+
+		for (size_t i = 0; i < size; i++)
+			chunk[i] = pattern_byte(offset + i);
+
+		queued = queue_data(&stream, chunk, size);
+		offset += size;
+	}
+
+	/* the loop exits once everything queued has been sent */
+	os_event_signal(stream.send_thread_signaled_exit);
+	socket_thread_linux_wake(&stream);
+	pthread_join(stream.socket_thread, NULL);
+
+	start = os_gettime_ns() - start;
+
+	if (stream.rtmp.m_sb.sb_socket != -1) {
+		shutdown(stream.rtmp.m_sb.sb_socket, SHUT_WR);
+		close(stream.rtmp.m_sb.sb_socket);
+	}
+	pthread_join(sink.thread, NULL);
+	close(sink.fd);
+
+	printf("  %.1f MB in %.2f s, largest send %d bytes\n",
+			(double)total / (1024.0 * 1024.0),
+			(double)start / 1000000000.0, (int)max_send);
+
+	check(queued, "all data queued");
+	check(bytes_sent == total, "all data sent");
+	check(sink.received == total && sink.mismatches == 0,
+			"all data received in order");
+	if (low_latency)
+		check(max_send <= WRITE_BUF_SIZE / (LATENCY_FACTOR - 2),
+				"sends limited to the latency packet size");
+
+	free_stream(&stream);
+	bfree(chunk);
+}
+
+int main(void)
+{
+	run("normal mode", false, 256 * 1024 * 1024ULL);
+
+	/* one latency packet per 50 ms, so ~280 KB/s */
+	run("low-latency mode", true, 1024 * 1024);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Checks signal_handler_disconnect when a callback disconnects itself while
+ * a second thread is running the same callback: the disconnect must return
+ * once the other call has returned (and not before), and the callback must
+ * not be called again afterwards.  Returns non-zero if a check fails, or if
+ * the disconnect doesn't return within a few seconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <callback/signal.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define TIMEOUT_MS 3000
+
+static signal_handler_t *handler;
+
+static volatile long entered;
+static volatile long calls;
+static volatile bool other_returned;
+static volatile bool returned_before_disconnect;
+
+static int failures;
+
+static void check(bool success, const char *what)
+{
+	printf("%-60s %s\n", what, success ? "ok" : "FAILED");
+	if (!success)
+		failures++;
+}
+
+static void test_callback(void *data, calldata_t *params)
+{
+	long idx = os_atomic_inc_long(&entered);
+
+	os_atomic_inc_long(&calls);
+
+	/* both emissions are inside the callback before either continues */
+	for (int ms = 0; ms < TIMEOUT_MS; ms += 1) {
+		if (os_atomic_load_long(&entered) >= 2)
+			break;
+		os_sleep_ms(1);
+	}
+
+	if (idx == 1) {
+		signal_handler_disconnect(handler, "test", test_callback,
+				data);
+		os_atomic_set_bool(&returned_before_disconnect,
+				os_atomic_load_bool(&other_returned));
+	} else {
+		os_sleep_ms(100);
+		os_atomic_set_bool(&other_returned, true);
+	}
+
+	UNUSED_PARAMETER(params);
+}
+
+static void *emit_thread(void *param)
+{
+	os_event_t *done = param;
+	calldata_t params;
+
+	calldata_init(&params);
+	signal_handler_signal(handler, "test", &params);
+	calldata_free(&params);
+
+	os_event_signal(done);
+	return NULL;
+}
+
+int main(void)
+{
+	os_event_t *done[2];
+	pthread_t threads[2];
+	bool finished = true;
+	calldata_t params;
+
+	handler = signal_handler_create();
+	signal_handler_add(handler, "void test()");
+	signal_handler_connect(handler, "test", test_callback, NULL);
+
+	for (size_t i = 0; i < 2; i++) {
+		os_event_init(&done[i], OS_EVENT_TYPE_MANUAL);
+		pthread_create(&threads[i], NULL, emit_thread, done[i]);
+	}
+
+	for (size_t i = 0; i < 2; i++) {
+		if (os_event_timedwait(done[i], TIMEOUT_MS) != 0)
+			finished = false;
+	}
+
+	check(finished, "self-disconnect returns while another thread emits");
+	if (!finished) {
+		/* the threads are stuck, they can't be joined */
+		printf("disconnect deadlocked\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+		os_event_destroy(done[i]);
+	}
+
+	check(os_atomic_load_bool(&returned_before_disconnect),
+			"disconnect waited for the other thread's call");
+
+	calldata_init(&params);
+	signal_handler_signal(handler, "test", &params);
+	calldata_free(&params);
+
+	check(os_atomic_load_long(&calls) == 2,
+			"no calls after disconnect returned");
+
+	signal_handler_destroy(handler);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Checks the damage tracking of the XSHM screen capture against an X server,
+ * headless with Xvfb:
+ *
+ *   xvfb-run -s "-screen 0 640x480x24" ./test-xshm-damage
+ *
+ * Draws rectangles on the root window and checks which rows of each capture
+ * buffer are out of date, that a fetch only writes those rows, and that
+ * nothing is fetched while the screen is unchanged.  Returns non-zero if a
+ * check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+#include "xshm-damage.h"
+
+#define RED        0xff0000
+#define GREEN      0x00ff00
+#define UNFETCHED  0x55
+
+static int failures;
+
+static void check(bool success, const char *what)
+{
+	printf("%-60s %s\n", what, success ? "ok" : "FAILED");
+	if (!success)
+		failures++;
+}
+
+/* the damage events are sent before the reply, so they have been received
+ * once this returns */
+static void sync_server(xcb_connection_t *xcb)
+{
+	free(xcb_get_input_focus_reply(xcb, xcb_get_input_focus(xcb), NULL));
+}
+
+static void fill_rect(xcb_connection_t *xcb, xcb_window_t root,
+		xcb_gcontext_t gc, uint32_t color, int16_t x, int16_t y,
+		uint16_t w, uint16_t h)
+{
+	xcb_rectangle_t rect = {x, y, w, h};
+
+	xcb_change_gc(xcb, gc, XCB_GC_FOREGROUND, &color);
+	xcb_poly_fill_rectangle(xcb, root, gc, 1, &rect);
+	sync_server(xcb);
+}
+
+static uint32_t get_pixel(xshm_damage_t *damage, xcb_shm_t *shm,
+		int_fast32_t x, int_fast32_t y)
+{
+	uint32_t *pixels = (uint32_t*)shm->data;
+	return pixels[y * damage->width + x] & 0xffffff;
+}
+
+static bool rows_equal(xshm_damage_t *damage, int buffer, int_fast32_t top,
+		int_fast32_t bottom)
+{
+	return damage->top[buffer] == top && damage->bottom[buffer] == bottom;
+}
+
+int main(void)
+{
+	xcb_connection_t *xcb;
+	xcb_screen_t *screen;
+	xcb_gcontext_t gc;
+	xcb_shm_t *shm[XSHM_BUFFERS] = {0};
+	xshm_damage_t damage;
+	int_fast32_t x, y, w, h;
+	bool unfetched_kept = true;
+
+	xcb = xcb_connect(NULL, NULL);
+	if (!xcb || xcb_connection_has_error(xcb)) {
+		printf("failed to connect to the X server, run with xvfb-run\n");
+		return 1;
+	}
+
+	screen = xcb_get_screen(xcb, 0);
+	if (!screen || screen->root_depth != 24 ||
+	    screen->width_in_pixels < 320 || screen->height_in_pixels < 240) {
+		printf("needs a screen of at least 320x240x24\n");
+		xcb_disconnect(xcb);
+		return 1;
+	}
+
+	/* the left half of the screen, starting a quarter of the way down */
+	x = 0;
+	y = screen->height_in_pixels / 4;
+	w = screen->width_in_pixels / 2;
+	h = screen->height_in_pixels - y;
+
+	for (size_t i = 0; i < XSHM_BUFFERS; i++) {
+		shm[i] = xshm_xcb_attach(xcb, w, h);
+		if (!shm[i]) {
+			printf("failed to attach shm\n");
+			return 1;
+		}
+	}
+
+	gc = xcb_generate_id(xcb);
+	xcb_create_gc(xcb, gc, screen->root, 0, NULL);
+	fill_rect(xcb, screen->root, gc, GREEN, 0, 0,
+			screen->width_in_pixels, screen->height_in_pixels);
+
+	check(xshm_damage_init(&damage, xcb, screen->root, x, y, w, h),
+			"damage extension available");
+
+	/* the first fetch of each buffer is in full */
+	xshm_damage_process(&damage);
+	check(damage.changed && rows_equal(&damage, 0, 0, h) &&
+			rows_equal(&damage, 1, 0, h),
+			"new buffers are out of date");
+	check(xshm_damage_fetch(&damage, shm[0], 0) &&
+			rows_equal(&damage, 0, 0, 0) &&
+			rows_equal(&damage, 1, 0, h),
+			"fetching one buffer leaves the other out of date");
+	check(get_pixel(&damage, shm[0], 0, 0) == GREEN &&
+			get_pixel(&damage, shm[0], w - 1, h - 1) == GREEN,
+			"fetched the captured area");
+
+	/* rows 100 to 120 of the captured area */
+	fill_rect(xcb, screen->root, gc, RED, 10, (int16_t)(y + 100), 100, 20);
+	xshm_damage_process(&damage);
+	check(damage.changed && rows_equal(&damage, 0, 100, 120) &&
+			rows_equal(&damage, 1, 0, h),
+			"drawn rows are out of date in every buffer");
+
+	check(xshm_damage_fetch(&damage, shm[1], 1) &&
+			get_pixel(&damage, shm[1], 50, 110) == RED &&
+			get_pixel(&damage, shm[1], 50, 90) == GREEN,
+			"out of date buffer fetched in full");
+
+	memset(shm[0]->data, UNFETCHED, (size_t)(w * h * 4));
+	check(xshm_damage_fetch(&damage, shm[0], 0) &&
+			get_pixel(&damage, shm[0], 50, 100) == RED &&
+			get_pixel(&damage, shm[0], 50, 119) == RED &&
+			get_pixel(&damage, shm[0], 5, 110) == GREEN,
+			"drawn rows fetched at their offset");
+
+	for (int_fast32_t row = 0; row < h; row++) {
+		if (row >= 100 && row < 120)
+			continue;
+		if (shm[0]->data[row * w * 4] != UNFETCHED)
+			unfetched_kept = false;
+	}
+	check(unfetched_kept, "other rows not fetched");
+
+	/* nothing to do while the screen doesn't change */
+	sync_server(xcb);
+	xshm_damage_process(&damage);
+	check(!damage.changed && rows_equal(&damage, 0, 0, 0) &&
+			rows_equal(&damage, 1, 0, 0),
+			"nothing out of date while the screen is unchanged");
+
+	fill_rect(xcb, screen->root, gc, RED, (int16_t)(w + 10),
+			(int16_t)(y + 10), 50, 50);
+	xshm_damage_process(&damage);
+	check(!damage.changed, "drawing outside the captured area is ignored");
+
+	/* clipped to the captured area */
+	fill_rect(xcb, screen->root, gc, RED, 10, (int16_t)(y - 10), 50, 20);
+	xshm_damage_process(&damage);
+	check(rows_equal(&damage, 0, 0, 10) && rows_equal(&damage, 1, 0, 10),
+			"damage is clipped to the captured area");
+
+	xshm_damage_free(&damage);
+	xcb_free_gc(xcb, gc);
+
+	for (size_t i = 0; i < XSHM_BUFFERS; i++)
+		xshm_xcb_detach(shm[i]);
+
+	xcb_disconnect(xcb);
+	return failures ? 1 : 0;
+}